@@ -36,4 +36,8 @@
                                 + 2 * hyperdex::entityid::SERIALIZEDSIZE \
                                 + sizeof(uint64_t))
 
+// How many objects (and bytes) a server may pack into each search response.
+#define HYPERCLIENT_SEARCH_BATCH_ITEMS 64
+#define HYPERCLIENT_SEARCH_BATCH_BYTES (64 * 1024)
+
 #endif // hyperclient_constants_h_
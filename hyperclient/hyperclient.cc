@@ -25,6 +25,8 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#define __STDC_LIMIT_MACROS
+
 // C++
 #include <iostream>
 
@@ -48,9 +50,13 @@
 #include "hyperclient/hyperclient.h"
 #include "hyperclient/hyperclient_completedop.h"
 #include "hyperclient/hyperclient_pending.h"
+#include "hyperclient/hyperclient_pending_aggregate.h"
 #include "hyperclient/hyperclient_pending_get.h"
+#include "hyperclient/hyperclient_pending_scan.h"
 #include "hyperclient/hyperclient_pending_search.h"
+#include "hyperclient/hyperclient_pending_sorted_search.h"
 #include "hyperclient/hyperclient_pending_statusonly.h"
+#include "hyperclient/hyperclient_pending_watch.h"
 #include "hyperclient/util.h"
 
 #define MICROOP_BASE_SIZE \
@@ -62,6 +68,8 @@ hyperclient :: hyperclient(const char* coordinator, in_port_t port)
     , m_busybee(new busybee_st())
     , m_incomplete()
     , m_complete()
+    , m_buffered()
+    , m_watches()
     , m_server_nonce(1)
     , m_client_id(1)
     , m_old_coord_fd(-1)
@@ -96,6 +104,72 @@ hyperclient :: get(const char* space, const char* key, size_t key_sz,
     return add_keyop(space, key, key_sz, msg, op);
 }
 
+int64_t
+hyperclient :: get_at(const char* space, const char* key, size_t key_sz,
+                      uint64_t version, hyperclient_returncode* status,
+                      struct hyperclient_attribute** attrs, size_t* attrs_sz,
+                      uint64_t* version_out)
+{
+    if (maintain_coord_connection(status) < 0)
+    {
+        return -1;
+    }
+
+    e::intrusive_ptr<pending> op;
+    op = new pending_get(status, attrs, attrs_sz, version_out);
+    size_t sz = HYPERCLIENT_HEADER_SIZE
+              + sizeof(uint32_t)
+              + key_sz
+              + sizeof(uint64_t);
+    std::auto_ptr<e::buffer> msg(e::buffer::create(sz));
+    e::buffer::packer p = msg->pack_at(HYPERCLIENT_HEADER_SIZE);
+    p = p << e::slice(key, key_sz) << version;
+    assert(!p.error());
+    return add_keyop(space, key, key_sz, msg, op);
+}
+
+int64_t
+hyperclient :: get_partial(const char* space, const char* key, size_t key_sz,
+                           const char** attrnames, size_t attrnames_sz,
+                           hyperclient_returncode* status,
+                           struct hyperclient_attribute** attrs, size_t* attrs_sz)
+{
+    if (maintain_coord_connection(status) < 0)
+    {
+        return -1;
+    }
+
+    hyperdex::spaceid si = m_config->space(space);
+
+    if (si == hyperdex::spaceid())
+    {
+        *status = HYPERCLIENT_UNKNOWNSPACE;
+        return -1;
+    }
+
+    std::vector<uint16_t> projection;
+    int64_t ret = project(m_config->dimension_names(si), attrnames, attrnames_sz,
+                          &projection, status);
+
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    e::intrusive_ptr<pending> op;
+    op = new pending_get(status, attrs, attrs_sz, projection);
+    size_t sz = HYPERCLIENT_HEADER_SIZE
+              + sizeof(uint32_t)
+              + key_sz
+              + sizeof(uint32_t)
+              + sizeof(uint16_t) * projection.size();
+    std::auto_ptr<e::buffer> msg(e::buffer::create(sz));
+    e::buffer::packer p = msg->pack_at(HYPERCLIENT_HEADER_SIZE);
+    p = p << e::slice(key, key_sz) << projection;
+    assert(!p.error());
+    return add_keyop(space, key, key_sz, msg, op);
+}
+
 int64_t
 hyperclient :: put(const char* space, const char* key, size_t key_sz,
                    const struct hyperclient_attribute* attrs, size_t attrs_sz,
@@ -389,6 +463,46 @@ hyperclient :: search(const char* space,
                       const struct hyperclient_range_query* rn, size_t rn_sz,
                       enum hyperclient_returncode* status,
                       struct hyperclient_attribute** attrs, size_t* attrs_sz)
+{
+    return search(space, eq, eq_sz, rn, rn_sz, NULL, 0, NULL, 0, status, attrs, attrs_sz);
+}
+
+int64_t
+hyperclient :: prefix_search(const char* space,
+                             const struct hyperclient_attribute* eq, size_t eq_sz,
+                             const struct hyperclient_range_query* rn, size_t rn_sz,
+                             const struct hyperclient_attribute* prefix, size_t prefix_sz,
+                             enum hyperclient_returncode* status,
+                             struct hyperclient_attribute** attrs, size_t* attrs_sz)
+{
+    return search(space, eq, eq_sz, rn, rn_sz, prefix, prefix_sz, NULL, 0, status, attrs, attrs_sz);
+}
+
+int64_t
+hyperclient :: search_partial(const char* space,
+                              const struct hyperclient_attribute* eq, size_t eq_sz,
+                              const struct hyperclient_range_query* rn, size_t rn_sz,
+                              const char** attrnames, size_t attrnames_sz,
+                              enum hyperclient_returncode* status,
+                              struct hyperclient_attribute** attrs, size_t* attrs_sz)
+{
+    // To search, a NULL attrnames means every attribute.
+    static const char* none = NULL;
+    return search(space, eq, eq_sz, rn, rn_sz, NULL, 0,
+                  attrnames ? attrnames : &none, attrnames_sz,
+                  status, attrs, attrs_sz);
+}
+
+// Search with the given terms.  If "attrnames" is not NULL, return just the
+// key and those attributes for each object.
+int64_t
+hyperclient :: search(const char* space,
+                      const struct hyperclient_attribute* eq, size_t eq_sz,
+                      const struct hyperclient_range_query* rn, size_t rn_sz,
+                      const struct hyperclient_attribute* prefix, size_t prefix_sz,
+                      const char** attrnames, size_t attrnames_sz,
+                      enum hyperclient_returncode* status,
+                      struct hyperclient_attribute** attrs, size_t* attrs_sz)
 {
     if (maintain_coord_connection(status) < 0)
     {
@@ -405,59 +519,259 @@ hyperclient :: search(const char* space,
 
     std::vector<hyperdex::attribute> dims = m_config->dimension_names(si);
     assert(dims.size() > 0);
-    e::bitfield dims_seen(dims.size());
 
     // Populate the search object.
     hyperspacehashing::search s(dims.size());
+    int64_t ret = build_search(dims, eq, eq_sz, rn, rn_sz, prefix, prefix_sz, &s, status);
 
-    // Check the equality conditions.
-    for (size_t i = 0; i < eq_sz; ++i)
+    if (ret < 0)
     {
-        hyperdatatype coerced = eq[i].datatype;
-        int idx = validate_attr(coerce_identity, dims, &dims_seen, eq[i].attr, &coerced, status);
+        return ret;
+    }
 
-        if (idx < 0)
+    // Check the projection.
+    std::tr1::shared_ptr<std::vector<uint16_t> > projection;
+
+    if (attrnames)
+    {
+        projection.reset(new std::vector<uint16_t>());
+        ret = project(dims, attrnames, attrnames_sz, projection.get(), status);
+
+        if (ret < 0)
         {
-            return -1 - i;
+            return ret - eq_sz - rn_sz - prefix_sz;
         }
+    }
 
-        assert(coerced == eq[i].datatype);
-        s.equality_set(idx, e::slice(eq[i].value, eq[i].value_sz));
+    // Get the hosts that match our search terms.
+    std::map<hyperdex::entityid, hyperdex::instance> search_entities;
+    search_entities = m_config->search_entities(si, s);
+
+    // Send a search query to each matching host.
+    int64_t searchid = m_client_id;
+    ++m_client_id;
+
+    // Pack the message to send
+    size_t sz = HYPERCLIENT_HEADER_SIZE + sizeof(uint64_t) + s.packed_size()
+              + sizeof(uint32_t) + sizeof(uint64_t)
+              + (projection ? sizeof(uint32_t) + sizeof(uint16_t) * projection->size() : 0);
+    std::auto_ptr<e::buffer> msg(e::buffer::create(sz));
+    e::buffer::packer p = msg->pack_at(HYPERCLIENT_HEADER_SIZE);
+    p = p << searchid << s
+          << static_cast<uint32_t>(HYPERCLIENT_SEARCH_BATCH_ITEMS)
+          << static_cast<uint64_t>(HYPERCLIENT_SEARCH_BATCH_BYTES);
+
+    if (projection)
+    {
+        p = p << *projection;
     }
 
-    // Check the range conditions.
-    for (size_t i = 0; i < rn_sz; ++i)
+    assert(!p.error());
+    std::tr1::shared_ptr<uint64_t> refcount(new uint64_t(0));
+
+    for (std::map<hyperdex::entityid, hyperdex::instance>::const_iterator ent_inst = search_entities.begin();
+            ent_inst != search_entities.end(); ++ent_inst)
     {
-        hyperdatatype coerced = HYPERDATATYPE_INT64;
-        int idx = validate_attr(coerce_identity, dims, &dims_seen, rn[i].attr, &coerced, status);
+        e::intrusive_ptr<pending> op   = new pending_search(searchid, refcount, status, attrs, attrs_sz, projection);
+        op->set_server_visible_nonce(m_server_nonce);
+        ++m_server_nonce;
+        op->set_entity(ent_inst->first);
+        op->set_instance(ent_inst->second);
+        m_incomplete.insert(std::make_pair(op->server_visible_nonce(), op));
+        std::auto_ptr<e::buffer> tosend(msg->copy());
 
-        if (idx < 0)
+        if (send(op, tosend) < 0)
         {
-            return -1 - eq_sz - i;
+            m_complete.push(completedop(op, HYPERCLIENT_RECONFIGURE, 0));
+            m_incomplete.erase(op->server_visible_nonce());
         }
+    }
 
-        assert(coerced == HYPERDATATYPE_INT64);
-        s.range_set(idx, rn[i].lower, rn[i].upper);
+    return searchid;
+}
+
+int64_t
+hyperclient :: aggregate(const char* space,
+                         const struct hyperclient_attribute* eq, size_t eq_sz,
+                         const struct hyperclient_range_query* rn, size_t rn_sz,
+                         enum hyperaggregate func, const char* attr, const char* group_by,
+                         enum hyperclient_returncode* status,
+                         struct hyperclient_aggregate_group** groups, size_t* groups_sz)
+{
+    if (maintain_coord_connection(status) < 0)
+    {
+        return -1;
+    }
+
+    hyperdex::spaceid si = m_config->space(space);
+
+    if (si == hyperdex::spaceid())
+    {
+        *status = HYPERCLIENT_UNKNOWNSPACE;
+        return -1;
+    }
+
+    std::vector<hyperdex::attribute> dims = m_config->dimension_names(si);
+    assert(dims.size() > 0);
+
+    // Populate the search object.
+    hyperspacehashing::search s(dims.size());
+    int64_t ret = build_search(dims, eq, eq_sz, rn, rn_sz, NULL, 0, &s, status);
+
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    // Check the aggregated attribute.  It stays 0 (the key) if named so.
+    std::vector<uint16_t> attrnum;
+
+    if (func != HYPERAGGREGATE_COUNT)
+    {
+        if (func != HYPERAGGREGATE_SUM &&
+            func != HYPERAGGREGATE_MIN &&
+            func != HYPERAGGREGATE_MAX)
+        {
+            *status = HYPERCLIENT_WRONGTYPE;
+            return -1 - eq_sz - rn_sz;
+        }
+
+        if (!attr || project(dims, &attr, 1, &attrnum, status) < 0)
+        {
+            *status = HYPERCLIENT_UNKNOWNATTR;
+            return -1 - eq_sz - rn_sz;
+        }
+
+        if (dims[attrnum.empty() ? 0 : attrnum[0]].type != HYPERDATATYPE_INT64)
+        {
+            *status = HYPERCLIENT_WRONGTYPE;
+            return -1 - eq_sz - rn_sz;
+        }
+    }
+
+    // Check the attribute to group by.
+    std::vector<uint16_t> groupnum;
+
+    if (group_by)
+    {
+        if (project(dims, &group_by, 1, &groupnum, status) < 0)
+        {
+            return -2 - eq_sz - rn_sz;
+        }
+
+        if (groupnum.empty())
+        {
+            *status = HYPERCLIENT_DONTUSEKEY;
+            return -2 - eq_sz - rn_sz;
+        }
     }
 
     // Get the hosts that match our search terms.
     std::map<hyperdex::entityid, hyperdex::instance> search_entities;
     search_entities = m_config->search_entities(si, s);
 
-    // Send a search query to each matching host.
+    // Send the aggregate to each matching host.
+    int64_t aggid = m_client_id;
+    ++m_client_id;
+
+    // Pack the message to send
+    std::auto_ptr<e::buffer> msg(e::buffer::create(HYPERCLIENT_HEADER_SIZE + s.packed_size()
+                                                   + 3 * sizeof(uint16_t)));
+    e::buffer::packer p = msg->pack_at(HYPERCLIENT_HEADER_SIZE);
+    p = p << s << static_cast<uint16_t>(func)
+          << static_cast<uint16_t>(attrnum.empty() ? 0 : attrnum[0])
+          << static_cast<uint16_t>(groupnum.empty() ? 0 : groupnum[0]);
+    assert(!p.error());
+    std::tr1::shared_ptr<pending_aggregate::results> results(
+            new pending_aggregate::results(func, group_by != NULL));
+
+    for (std::map<hyperdex::entityid, hyperdex::instance>::const_iterator ent_inst = search_entities.begin();
+            ent_inst != search_entities.end(); ++ent_inst)
+    {
+        e::intrusive_ptr<pending> op = new pending_aggregate(aggid, results, status, groups, groups_sz);
+        op->set_server_visible_nonce(m_server_nonce);
+        ++m_server_nonce;
+        op->set_entity(ent_inst->first);
+        op->set_instance(ent_inst->second);
+        m_incomplete.insert(std::make_pair(op->server_visible_nonce(), op));
+        std::auto_ptr<e::buffer> tosend(msg->copy());
+
+        if (send(op, tosend) < 0)
+        {
+            m_complete.push(completedop(op, HYPERCLIENT_RECONFIGURE, 0));
+            m_incomplete.erase(op->server_visible_nonce());
+        }
+    }
+
+    return aggid;
+}
+
+int64_t
+hyperclient :: sorted_search(const char* space,
+                             const struct hyperclient_attribute* eq, size_t eq_sz,
+                             const struct hyperclient_range_query* rn, size_t rn_sz,
+                             const char* sort_by, uint64_t limit, bool descending,
+                             enum hyperclient_returncode* status,
+                             struct hyperclient_attribute** attrs, size_t* attrs_sz)
+{
+    if (maintain_coord_connection(status) < 0)
+    {
+        return -1;
+    }
+
+    hyperdex::spaceid si = m_config->space(space);
+
+    if (si == hyperdex::spaceid())
+    {
+        *status = HYPERCLIENT_UNKNOWNSPACE;
+        return -1;
+    }
+
+    std::vector<hyperdex::attribute> dims = m_config->dimension_names(si);
+    assert(dims.size() > 0);
+
+    // Populate the search object.
+    hyperspacehashing::search s(dims.size());
+    int64_t ret = build_search(dims, eq, eq_sz, rn, rn_sz, NULL, 0, &s, status);
+
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    // Check the attribute to sort by.  It stays 0 (the key) if named so.
+    std::vector<uint16_t> sortnum;
+
+    if (!sort_by || project(dims, &sort_by, 1, &sortnum, status) < 0)
+    {
+        *status = HYPERCLIENT_UNKNOWNATTR;
+        return -1 - eq_sz - rn_sz;
+    }
+
+    uint16_t sort_dim = sortnum.empty() ? 0 : sortnum[0];
+
+    // Get the hosts that match our search terms.
+    std::map<hyperdex::entityid, hyperdex::instance> search_entities;
+    search_entities = m_config->search_entities(si, s);
+
+    // Send the search to each matching host.
     int64_t searchid = m_client_id;
     ++m_client_id;
 
     // Pack the message to send
-    std::auto_ptr<e::buffer> msg(e::buffer::create(HYPERCLIENT_HEADER_SIZE + sizeof(uint64_t) + s.packed_size()));
-    bool packed = !(msg->pack_at(HYPERCLIENT_HEADER_SIZE) << searchid << s).error();
-    assert(packed);
-    std::tr1::shared_ptr<uint64_t> refcount(new uint64_t(0));
+    std::auto_ptr<e::buffer> msg(e::buffer::create(HYPERCLIENT_HEADER_SIZE + s.packed_size()
+                                                   + sizeof(uint16_t) + sizeof(uint64_t)
+                                                   + sizeof(uint8_t)));
+    e::buffer::packer p = msg->pack_at(HYPERCLIENT_HEADER_SIZE);
+    p = p << s << sort_dim << limit << static_cast<uint8_t>(descending ? 1 : 0);
+    assert(!p.error());
+    std::tr1::shared_ptr<pending_sorted_search::results> results(
+            new pending_sorted_search::results(dims[sort_dim].type, sort_dim, limit, descending));
 
     for (std::map<hyperdex::entityid, hyperdex::instance>::const_iterator ent_inst = search_entities.begin();
             ent_inst != search_entities.end(); ++ent_inst)
     {
-        e::intrusive_ptr<pending> op   = new pending_search(searchid, refcount, status, attrs, attrs_sz);
+        e::intrusive_ptr<pending> op = new pending_sorted_search(searchid, results, status, attrs, attrs_sz);
         op->set_server_visible_nonce(m_server_nonce);
         ++m_server_nonce;
         op->set_entity(ent_inst->first);
@@ -475,11 +789,188 @@ hyperclient :: search(const char* space,
     return searchid;
 }
 
+static bool
+compare_region_order(const std::pair<hyperdex::entityid, hyperdex::instance>& lhs,
+                     const std::pair<hyperdex::entityid, hyperdex::instance>& rhs)
+{
+    return lhs.first.mask < rhs.first.mask;
+}
+
+int64_t
+hyperclient :: sorted_scan(const char* space,
+                           uint64_t lower, uint64_t upper, uint64_t limit,
+                           bool descending, enum hyperclient_returncode* status,
+                           struct hyperclient_attribute** attrs, size_t* attrs_sz)
+{
+    if (maintain_coord_connection(status) < 0)
+    {
+        return -1;
+    }
+
+    hyperdex::spaceid si = m_config->space(space);
+
+    if (si == hyperdex::spaceid())
+    {
+        *status = HYPERCLIENT_UNKNOWNSPACE;
+        return -1;
+    }
+
+    std::vector<hyperdex::attribute> dims = m_config->dimension_names(si);
+    assert(dims.size() > 0);
+
+    // Only int64 keys are hashed as RANGE, and thus placed in key order.
+    if (dims[0].type != HYPERDATATYPE_INT64)
+    {
+        *status = HYPERCLIENT_WRONGTYPE;
+        return -1;
+    }
+
+    hyperspacehashing::search s(dims.size());
+    s.range_set(0, lower, upper);
+
+    // The key subspace places each region over a contiguous range of keys, so
+    // visiting its regions in order yields the keys in order.
+    std::map<hyperdex::entityid, hyperdex::instance> search_entities;
+    search_entities = m_config->search_entities(hyperdex::subspaceid(si.space, 0), s);
+    pending_scan::targets_t targets(search_entities.begin(), search_entities.end());
+    std::sort(targets.begin(), targets.end(), compare_region_order);
+
+    if (descending)
+    {
+        std::reverse(targets.begin(), targets.end());
+    }
+
+    int64_t scanid = m_client_id;
+    ++m_client_id;
+    bool any_targets = !targets.empty();
+    pending_scan* scan = new pending_scan(scanid, s, &targets,
+                                          limit == 0 ? UINT64_MAX : limit,
+                                          descending, status, attrs, attrs_sz);
+    e::intrusive_ptr<pending> op(scan);
+
+    if (!any_targets)
+    {
+        m_complete.push(completedop(op, HYPERCLIENT_SEARCHDONE, 0));
+    }
+    else if (!scan->start_next(this))
+    {
+        m_complete.push(completedop(op, HYPERCLIENT_RECONFIGURE, 0));
+    }
+
+    return scanid;
+}
+
+int64_t
+hyperclient :: watch(const char* space,
+                     const struct hyperclient_attribute* eq, size_t eq_sz,
+                     const struct hyperclient_range_query* rn, size_t rn_sz,
+                     bool initial, enum hyperclient_returncode* status,
+                     struct hyperclient_attribute** attrs, size_t* attrs_sz)
+{
+    if (maintain_coord_connection(status) < 0)
+    {
+        return -1;
+    }
+
+    hyperdex::spaceid si = m_config->space(space);
+
+    if (si == hyperdex::spaceid())
+    {
+        *status = HYPERCLIENT_UNKNOWNSPACE;
+        return -1;
+    }
+
+    std::vector<hyperdex::attribute> dims = m_config->dimension_names(si);
+    assert(dims.size() > 0);
+
+    hyperspacehashing::search s(dims.size());
+    int64_t ret = build_search(dims, eq, eq_sz, rn, rn_sz, NULL, 0, &s, status);
+
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    // Every change commits at the point leader of its region, which heads the
+    // region's chain in the key subspace.
+    std::map<hyperdex::entityid, hyperdex::instance> search_entities;
+    search_entities = m_config->search_entities(hyperdex::subspaceid(si.space, 0), s);
+
+    int64_t watchid = m_client_id;
+    ++m_client_id;
+
+    size_t sz = HYPERCLIENT_HEADER_SIZE + sizeof(uint64_t) + s.packed_size()
+              + sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint64_t);
+    std::auto_ptr<e::buffer> msg(e::buffer::create(sz));
+    bool packed = !(msg->pack_at(HYPERCLIENT_HEADER_SIZE)
+                        << static_cast<uint64_t>(watchid) << s
+                        << static_cast<uint8_t>(initial ? 1 : 0)
+                        << static_cast<uint32_t>(HYPERCLIENT_SEARCH_BATCH_ITEMS)
+                        << static_cast<uint64_t>(HYPERCLIENT_SEARCH_BATCH_BYTES)).error();
+    assert(packed);
+    std::vector<e::intrusive_ptr<pending> >& ops(m_watches[watchid]);
+
+    for (std::map<hyperdex::entityid, hyperdex::instance>::const_iterator ent_inst = search_entities.begin();
+            ent_inst != search_entities.end(); ++ent_inst)
+    {
+        e::intrusive_ptr<pending> op = new pending_watch(watchid, status, attrs, attrs_sz);
+        op->set_server_visible_nonce(m_server_nonce);
+        ++m_server_nonce;
+        op->set_entity(ent_inst->first);
+        op->set_instance(ent_inst->second);
+        ops.push_back(op);
+        m_incomplete.insert(std::make_pair(op->server_visible_nonce(), op));
+        std::auto_ptr<e::buffer> tosend(msg->copy());
+
+        if (send(op, tosend) < 0)
+        {
+            m_complete.push(completedop(op, HYPERCLIENT_RECONFIGURE, 0));
+            m_incomplete.erase(op->server_visible_nonce());
+        }
+    }
+
+    return watchid;
+}
+
+int64_t
+hyperclient :: unwatch(int64_t watchid)
+{
+    watch_map_t::iterator it = m_watches.find(watchid);
+
+    if (it == m_watches.end())
+    {
+        return -1;
+    }
+
+    for (size_t i = 0; i < it->second.size(); ++i)
+    {
+        static_cast<pending_watch*>(it->second[i].get())->stop(this);
+    }
+
+    m_watches.erase(it);
+    return 0;
+}
+
 int64_t
 hyperclient :: loop(int timeout, hyperclient_returncode* status)
 {
-    while (!m_incomplete.empty() && m_complete.empty())
+    while ((!m_incomplete.empty() || !m_buffered.empty()) && m_complete.empty())
     {
+        // Hand out results we already hold before waiting on the network.
+        if (!m_buffered.empty())
+        {
+            e::intrusive_ptr<pending> op = m_buffered.front();
+            m_buffered.pop();
+            int64_t id = op->handle_buffered(this, status);
+
+            if (id != 0)
+            {
+                return id;
+            }
+
+            continue;
+        }
+
         if (maintain_coord_connection(status) < 0)
         {
             return -1;
@@ -579,7 +1070,7 @@ hyperclient :: loop(int timeout, hyperclient_returncode* status)
         }
     }
 
-    if (m_incomplete.empty() && m_complete.empty())
+    if (m_incomplete.empty() && m_buffered.empty() && m_complete.empty())
     {
         *status = HYPERCLIENT_NONEPENDING;
         return -1;
@@ -990,6 +1481,106 @@ hyperclient :: map_attributes_to_microops(hyperdatatype (*coerce_datatype)(hyper
     return add_keyop(space, key, key_sz, msg, op);
 }
 
+// Fill in "s" from the search terms.  Returns 0, or a negative value
+// identifying the bad term as described for hyperclient_prefix_search.
+int64_t
+hyperclient :: build_search(const std::vector<hyperdex::attribute>& dims,
+                            const struct hyperclient_attribute* eq, size_t eq_sz,
+                            const struct hyperclient_range_query* rn, size_t rn_sz,
+                            const struct hyperclient_attribute* prefix, size_t prefix_sz,
+                            hyperspacehashing::search* s,
+                            hyperclient_returncode* status)
+{
+    e::bitfield dims_seen(dims.size());
+
+    // Check the equality conditions.
+    for (size_t i = 0; i < eq_sz; ++i)
+    {
+        hyperdatatype coerced = eq[i].datatype;
+        int idx = validate_attr(coerce_identity, dims, &dims_seen, eq[i].attr, &coerced, status);
+
+        if (idx < 0)
+        {
+            return -1 - i;
+        }
+
+        assert(coerced == eq[i].datatype);
+        s->equality_set(idx, e::slice(eq[i].value, eq[i].value_sz));
+    }
+
+    // Check the range conditions.
+    for (size_t i = 0; i < rn_sz; ++i)
+    {
+        hyperdatatype coerced = HYPERDATATYPE_INT64;
+        int idx = validate_attr(coerce_identity, dims, &dims_seen, rn[i].attr, &coerced, status);
+
+        if (idx < 0)
+        {
+            return -1 - eq_sz - i;
+        }
+
+        assert(coerced == HYPERDATATYPE_INT64);
+        s->range_set(idx, rn[i].lower, rn[i].upper);
+    }
+
+    // Check the prefix conditions.
+    for (size_t i = 0; i < prefix_sz; ++i)
+    {
+        hyperdatatype coerced = HYPERDATATYPE_STRING;
+        int idx = validate_attr(coerce_identity, dims, &dims_seen, prefix[i].attr, &coerced, status);
+
+        if (idx < 0)
+        {
+            return -1 - eq_sz - rn_sz - i;
+        }
+
+        if (prefix[i].datatype != HYPERDATATYPE_STRING)
+        {
+            *status = HYPERCLIENT_WRONGTYPE;
+            return -1 - eq_sz - rn_sz - i;
+        }
+
+        assert(coerced == HYPERDATATYPE_STRING);
+        s->prefix_set(idx, e::slice(prefix[i].value, prefix[i].value_sz));
+    }
+
+    return 0;
+}
+
+// Map "attrnames" to the numbers of the dimensions they name.  The key is
+// always known to the caller, so naming it adds nothing to the projection.
+int64_t
+hyperclient :: project(const std::vector<hyperdex::attribute>& dimension_names,
+                       const char** attrnames, size_t attrnames_sz,
+                       std::vector<uint16_t>* projection,
+                       hyperclient_returncode* status)
+{
+    projection->clear();
+
+    for (size_t i = 0; i < attrnames_sz; ++i)
+    {
+        size_t dim = 0;
+
+        while (dim < dimension_names.size() && dimension_names[dim].name != attrnames[i])
+        {
+            ++dim;
+        }
+
+        if (dim == dimension_names.size())
+        {
+            *status = HYPERCLIENT_UNKNOWNATTR;
+            return -1 - i;
+        }
+
+        if (dim > 0)
+        {
+            projection->push_back(dim);
+        }
+    }
+
+    return 0;
+}
+
 int
 hyperclient :: validate_attr(hyperdatatype (*coerce_datatype)(hyperdatatype e, hyperdatatype p),
                              const std::vector<hyperdex::attribute>& dimension_names,
@@ -1056,6 +1647,7 @@ operator << (std::ostream& lhs, hyperclient_returncode rhs)
         stringify(HYPERCLIENT_SEARCHDONE);
         stringify(HYPERCLIENT_CMPFAIL);
         stringify(HYPERCLIENT_READONLY);
+        stringify(HYPERCLIENT_BACKOFF);
         stringify(HYPERCLIENT_UNKNOWNSPACE);
         stringify(HYPERCLIENT_COORDFAIL);
         stringify(HYPERCLIENT_SERVERERROR);
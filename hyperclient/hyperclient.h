@@ -71,6 +71,10 @@ class configuration;
 class coordinatorlink;
 class instance;
 } // namespace hyperdex
+namespace hyperspacehashing
+{
+class search;
+} // namespace hyperspacehashing
 
 extern "C"
 {
@@ -103,6 +107,14 @@ struct hyperclient_range_query
     uint64_t upper;
 };
 
+struct hyperclient_aggregate_group
+{
+    const char* value; /* NULL unless grouped */
+    size_t value_sz;
+    uint64_t count;
+    int64_t result;
+};
+
 /* HyperClient returncode occupies [8448, 8576) */
 enum hyperclient_returncode
 {
@@ -111,6 +123,7 @@ enum hyperclient_returncode
     HYPERCLIENT_SEARCHDONE   = 8450,
     HYPERCLIENT_CMPFAIL      = 8451,
     HYPERCLIENT_READONLY     = 8452,
+    HYPERCLIENT_BACKOFF      = 8453,
 
     /* Error conditions */
     HYPERCLIENT_UNKNOWNSPACE = 8512,
@@ -169,6 +182,53 @@ hyperclient_get(struct hyperclient* client, const char* space, const char* key,
                 size_t key_sz, enum hyperclient_returncode* status,
                 struct hyperclient_attribute** attrs, size_t* attrs_sz);
 
+/* Retrieve the secondary attributes corresponding to "key" in "space" as they
+ * were at "version":  the newest version of the object no greater than
+ * "version".  The version retrieved is stored in *version_out.  Passing
+ * UINT64_MAX retrieves the latest version, and passing one less than a
+ * retrieved version steps back through the object's history.
+ *
+ * Versions count each object's changes on its own, so this reads one object
+ * at a point in its own history; it gives no snapshot across objects.  Only as
+ * much history as the servers retain (HYPERDEX_OBJECT_HISTORY_VERSIONS) is
+ * available; older versions are reported as HYPERCLIENT_NOTFOUND.
+ *
+ * Allocated memory will be returned in *attrs.  This memory *MUST* be freed
+ * using hyperclient_attribute_free.
+ *
+ * - space, key must point to memory that exists for the duration of this call
+ * - client, status, attrs, attrs_sz, version_out must point to memory that
+ *   exists until the request is considered complete
+ */
+int64_t
+hyperclient_get_at(struct hyperclient* client, const char* space, const char* key,
+                   size_t key_sz, uint64_t version,
+                   enum hyperclient_returncode* status,
+                   struct hyperclient_attribute** attrs, size_t* attrs_sz,
+                   uint64_t* version_out);
+
+/* Retrieve only the secondary attributes named in "attrnames" for "key" in
+ * "space".  The server sends just these attributes, in the order given, so
+ * reading one small attribute of a large object moves little data.  Naming
+ * the key is allowed and has no effect.
+ *
+ * If this returns a value < 0 and *status == HYPERCLIENT_UNKNOWNATTR, then
+ * abs(returned value) - 1 == the attribute which caused the error.
+ *
+ * Allocated memory will be returned in *attrs.  This memory *MUST* be freed
+ * using hyperclient_attribute_free.
+ *
+ * - space, key, attrnames must point to memory that exists for the duration of
+ *   this call
+ * - client, status, attrs, attrs_sz must point to memory that exists until the
+ *   request is considered complete
+ */
+int64_t
+hyperclient_get_partial(struct hyperclient* client, const char* space, const char* key,
+                        size_t key_sz, const char** attrnames, size_t attrnames_sz,
+                        enum hyperclient_returncode* status,
+                        struct hyperclient_attribute** attrs, size_t* attrs_sz);
+
 /* Store the secondary attributes under "key" in "space".
  * If this returns a value < 0 and *status == HYPERCLIENT_UNKNOWNATTR, then
  * abs(returned value) - 1 == the attribute which caused the error.
@@ -605,6 +665,156 @@ hyperclient_search(struct hyperclient* client, const char* space,
                    enum hyperclient_returncode* status,
                    struct hyperclient_attribute** attrs, size_t* attrs_sz);
 
+/* Perform a search as hyperclient_search does, but additionally require that
+ * each string attribute named in "prefix" begin with the given value.
+ *
+ * Subspaces which hash an attribute with "prefix" place it by its leading
+ * bytes, so such a search contacts only the servers holding the prefix.
+ * Elsewhere a prefix term filters objects without narrowing the servers.
+ *
+ * Errors are reported as for hyperclient_search; an attr's index >= eq_sz +
+ * rn_sz is an index into prefix.
+ */
+int64_t
+hyperclient_prefix_search(struct hyperclient* client, const char* space,
+                          const struct hyperclient_attribute* eq, size_t eq_sz,
+                          const struct hyperclient_range_query* rn, size_t rn_sz,
+                          const struct hyperclient_attribute* prefix, size_t prefix_sz,
+                          enum hyperclient_returncode* status,
+                          struct hyperclient_attribute** attrs, size_t* attrs_sz);
+
+/* Perform a search as hyperclient_search does, but return only the key and the
+ * attributes named in "attrnames" for each object.
+ *
+ * Errors are reported as for hyperclient_search; an attr's index >= eq_sz +
+ * rn_sz is an index into attrnames.
+ */
+int64_t
+hyperclient_search_partial(struct hyperclient* client, const char* space,
+                           const struct hyperclient_attribute* eq, size_t eq_sz,
+                           const struct hyperclient_range_query* rn, size_t rn_sz,
+                           const char** attrnames, size_t attrnames_sz,
+                           enum hyperclient_returncode* status,
+                           struct hyperclient_attribute** attrs, size_t* attrs_sz);
+
+/* Compute "func" over the objects which match "eq" and "rn", without
+ * retrieving them.  Each server evaluates the aggregate over its own objects
+ * and returns a partial result, so the cost is one message per server no matter
+ * how many objects match.
+ *
+ * HYPERAGGREGATE_COUNT counts the objects and ignores "attr", which may be
+ * NULL.  HYPERAGGREGATE_SUM, _MIN, and _MAX apply to "attr", which must be an
+ * int64 attribute (or an int64 key).  Sums wrap on overflow.
+ *
+ * If "group_by" is NULL, *groups holds one group with the overall result.
+ * Otherwise there is one group for each distinct value of the "group_by"
+ * attribute among the matching objects.  Every group carries the number of
+ * objects it covers in "count", and the aggregate in "result" (equal to count
+ * for HYPERAGGREGATE_COUNT, and meaningless for MIN/MAX of zero objects).
+ *
+ * hyperclient_loop returns the identifier once, when every server has
+ * answered.  The memory in *groups *MUST* be freed using
+ * hyperclient_destroy_groups.
+ *
+ * Errors in "eq" and "rn" are reported as for hyperclient_search.  An index of
+ * eq_sz + rn_sz refers to "attr", and eq_sz + rn_sz + 1 to "group_by".
+ */
+int64_t
+hyperclient_aggregate(struct hyperclient* client, const char* space,
+                      const struct hyperclient_attribute* eq, size_t eq_sz,
+                      const struct hyperclient_range_query* rn, size_t rn_sz,
+                      enum hyperaggregate func, const char* attr, const char* group_by,
+                      enum hyperclient_returncode* status,
+                      struct hyperclient_aggregate_group** groups, size_t* groups_sz);
+
+/* Perform a search as hyperclient_search does, but return only the first
+ * "limit" matching objects when ordered by "sort_by" (ascending, or descending
+ * if "descending" is non-zero).  A limit of 0 returns every match in order.
+ * int64 attributes sort as signed numbers, and all others bytewise.  Objects
+ * which tie are returned in key order.
+ *
+ * Each server keeps only its own first "limit" matches and sends those, so the
+ * work, traffic, and client memory grow with the limit rather than with the
+ * number of matches.  Results are returned through hyperclient_loop exactly as
+ * for hyperclient_search, after every server has answered, ending with
+ * HYPERCLIENT_SEARCHDONE.  If a server fails, the objects from the others are
+ * still returned, and the search ends with that error in place of
+ * HYPERCLIENT_SEARCHDONE.  A server sends its matches in a single message of at
+ * most 64MB; one whose first "limit" matches are larger sends none, and the
+ * search ends with HYPERCLIENT_OVERFLOW.  Use a smaller limit (or a scan) for
+ * large results.
+ *
+ * Errors in "eq" and "rn" are reported as for hyperclient_search.  An index of
+ * eq_sz + rn_sz refers to "sort_by".
+ */
+int64_t
+hyperclient_sorted_search(struct hyperclient* client, const char* space,
+                          const struct hyperclient_attribute* eq, size_t eq_sz,
+                          const struct hyperclient_range_query* rn, size_t rn_sz,
+                          const char* sort_by, uint64_t limit, int descending,
+                          enum hyperclient_returncode* status,
+                          struct hyperclient_attribute** attrs, size_t* attrs_sz);
+
+/* Retrieve the objects in "space" whose keys lie in [lower, upper), in key
+ * order (or reverse key order if "descending" is non-zero).  At most "limit"
+ * objects are returned; 0 means no limit.  The key must be an int64, and keys
+ * are compared as unsigned integers (as a range query compares them), so
+ * negative keys sort after every non-negative key.
+ *
+ * To page through a range, start the next scan just past the last key
+ * returned, keeping the other end of the range.  The servers continue from
+ * where the previous page stopped, so later pages see the objects as they were
+ * when the first was taken.
+ *
+ * Results are returned through hyperclient_loop exactly as for
+ * hyperclient_search, ending with HYPERCLIENT_SEARCHDONE.  The scan visits one
+ * server at a time, so a small limit touches few servers.  If a server fails
+ * mid-scan, the scan ends with that error in place of HYPERCLIENT_SEARCHDONE.
+ *
+ * If an error is encountered before any hosts have been contacted, -1 will be
+ * returned, and *status will be set to the error.
+ */
+int64_t
+hyperclient_sorted_scan(struct hyperclient* client, const char* space,
+                        uint64_t lower, uint64_t upper, uint64_t limit,
+                        int descending, enum hyperclient_returncode* status,
+                        struct hyperclient_attribute** attrs, size_t* attrs_sz);
+
+/* Watch the objects in "space" which match "eq" and "rn" (as for
+ * hyperclient_search).  Each change committed to a matching object is returned
+ * through hyperclient_loop with the watch's identifier.  A put leaves
+ * HYPERCLIENT_SUCCESS in *status and the object in *attrs.  A delete, or a put
+ * after which the object no longer matches, leaves HYPERCLIENT_NOTFOUND and
+ * only the key in *attrs.  Both *MUST* be freed using
+ * hyperclient_destroy_attrs.  If "initial" is non-zero, the objects which
+ * match when the watch starts are returned first, as puts.
+ *
+ * Changes to one object are returned in the order they commit.  Each server
+ * holds the changes which commit while the application works on earlier ones,
+ * and sends them together.  A server whose changes are not taken quickly
+ * enough ends its part of the watch with HYPERCLIENT_OVERFLOW, and one which
+ * stops serving a region ends it with HYPERCLIENT_RECONFIGURE.  Changes may
+ * have been missed after either, so the application should unwatch, and watch
+ * again with "initial" set.
+ *
+ * A watch lasts until hyperclient_unwatch, which must be called to release it
+ * even after it ends.  Until then, hyperclient_loop will wait for changes.
+ *
+ * Errors in "eq" and "rn" are reported as for hyperclient_search.
+ */
+int64_t
+hyperclient_watch(struct hyperclient* client, const char* space,
+                  const struct hyperclient_attribute* eq, size_t eq_sz,
+                  const struct hyperclient_range_query* rn, size_t rn_sz,
+                  int initial, enum hyperclient_returncode* status,
+                  struct hyperclient_attribute** attrs, size_t* attrs_sz);
+
+/* Stop the watch with identifier "watchid".  Changes not yet returned are
+ * dropped.  Returns 0, or -1 if there is no such watch.
+ */
+int64_t
+hyperclient_unwatch(struct hyperclient* client, int64_t watchid);
+
 /* Handle I/O until at least one event is complete (either a key-op finishes, or
  * a search returns one item).
  *
@@ -627,6 +837,12 @@ hyperclient_loop(struct hyperclient* client, int timeout,
 void
 hyperclient_destroy_attrs(struct hyperclient_attribute* attrs, size_t attrs_sz);
 
+/* Free an array of hyperclient_aggregate_group objects returned by
+ * hyperclient_aggregate, under the same rules as hyperclient_destroy_attrs.
+ */
+void
+hyperclient_destroy_groups(struct hyperclient_aggregate_group* groups, size_t groups_sz);
+
 #ifdef __cplusplus
 }
 
@@ -646,6 +862,14 @@ class hyperclient
         int64_t get(const char* space, const char* key, size_t key_sz,
                     hyperclient_returncode* status,
                     struct hyperclient_attribute** attrs, size_t* attrs_sz);
+        int64_t get_at(const char* space, const char* key, size_t key_sz,
+                       uint64_t version, hyperclient_returncode* status,
+                       struct hyperclient_attribute** attrs, size_t* attrs_sz,
+                       uint64_t* version_out);
+        int64_t get_partial(const char* space, const char* key, size_t key_sz,
+                            const char** attrnames, size_t attrnames_sz,
+                            hyperclient_returncode* status,
+                            struct hyperclient_attribute** attrs, size_t* attrs_sz);
         int64_t put(const char* space, const char* key, size_t key_sz,
                     const struct hyperclient_attribute* attrs, size_t attrs_sz,
                     hyperclient_returncode* status);
@@ -744,18 +968,74 @@ class hyperclient
                        const struct hyperclient_range_query* rn, size_t rn_sz,
                        enum hyperclient_returncode* status,
                        struct hyperclient_attribute** attrs, size_t* attrs_sz);
+        int64_t prefix_search(const char* space,
+                              const struct hyperclient_attribute* eq, size_t eq_sz,
+                              const struct hyperclient_range_query* rn, size_t rn_sz,
+                              const struct hyperclient_attribute* prefix, size_t prefix_sz,
+                              enum hyperclient_returncode* status,
+                              struct hyperclient_attribute** attrs, size_t* attrs_sz);
+        int64_t search_partial(const char* space,
+                               const struct hyperclient_attribute* eq, size_t eq_sz,
+                               const struct hyperclient_range_query* rn, size_t rn_sz,
+                               const char** attrnames, size_t attrnames_sz,
+                               enum hyperclient_returncode* status,
+                               struct hyperclient_attribute** attrs, size_t* attrs_sz);
+        int64_t aggregate(const char* space,
+                          const struct hyperclient_attribute* eq, size_t eq_sz,
+                          const struct hyperclient_range_query* rn, size_t rn_sz,
+                          enum hyperaggregate func, const char* attr, const char* group_by,
+                          enum hyperclient_returncode* status,
+                          struct hyperclient_aggregate_group** groups, size_t* groups_sz);
+        int64_t sorted_search(const char* space,
+                              const struct hyperclient_attribute* eq, size_t eq_sz,
+                              const struct hyperclient_range_query* rn, size_t rn_sz,
+                              const char* sort_by, uint64_t limit, bool descending,
+                              enum hyperclient_returncode* status,
+                              struct hyperclient_attribute** attrs, size_t* attrs_sz);
+        int64_t sorted_scan(const char* space,
+                            uint64_t lower, uint64_t upper, uint64_t limit,
+                            bool descending, enum hyperclient_returncode* status,
+                            struct hyperclient_attribute** attrs, size_t* attrs_sz);
+        int64_t watch(const char* space,
+                      const struct hyperclient_attribute* eq, size_t eq_sz,
+                      const struct hyperclient_range_query* rn, size_t rn_sz,
+                      bool initial, enum hyperclient_returncode* status,
+                      struct hyperclient_attribute** attrs, size_t* attrs_sz);
+        int64_t unwatch(int64_t watchid);
         int64_t loop(int timeout, hyperclient_returncode* status);
 
     private:
         class completedop;
         class pending;
+        class pending_aggregate;
         class pending_get;
+        class pending_scan;
         class pending_search;
+        class pending_sorted_search;
         class pending_statusonly;
+        class pending_watch;
         typedef std::map<int64_t, e::intrusive_ptr<pending> > incomplete_map_t;
+        typedef std::map<int64_t, std::vector<e::intrusive_ptr<pending> > > watch_map_t;
 
     private:
         int64_t maintain_coord_connection(hyperclient_returncode* status);
+        int64_t search(const char* space,
+                       const struct hyperclient_attribute* eq, size_t eq_sz,
+                       const struct hyperclient_range_query* rn, size_t rn_sz,
+                       const struct hyperclient_attribute* prefix, size_t prefix_sz,
+                       const char** attrnames, size_t attrnames_sz,
+                       enum hyperclient_returncode* status,
+                       struct hyperclient_attribute** attrs, size_t* attrs_sz);
+        int64_t build_search(const std::vector<hyperdex::attribute>& dimensions,
+                             const struct hyperclient_attribute* eq, size_t eq_sz,
+                             const struct hyperclient_range_query* rn, size_t rn_sz,
+                             const struct hyperclient_attribute* prefix, size_t prefix_sz,
+                             hyperspacehashing::search* s,
+                             hyperclient_returncode* status);
+        int64_t project(const std::vector<hyperdex::attribute>& dimensions,
+                        const char** attrnames, size_t attrnames_sz,
+                        std::vector<uint16_t>* projection,
+                        hyperclient_returncode* status);
         int64_t add_keyop(const char* space,
                           const char* key,
                           size_t key_sz,
@@ -796,6 +1076,10 @@ class hyperclient
         const std::auto_ptr<busybee_st> m_busybee;
         incomplete_map_t m_incomplete;
         std::queue<completedop> m_complete;
+        std::queue<e::intrusive_ptr<pending> > m_buffered;
+        // The operations (one for each server) of every watch not yet
+        // stopped by unwatch.
+        watch_map_t m_watches;
         int64_t m_server_nonce;
         int64_t m_client_id;
         int m_old_coord_fd;
@@ -78,6 +78,53 @@ hyperclient_get(struct hyperclient* client, const char* space, const char* key,
     }
 }
 
+int64_t
+hyperclient_get_at(struct hyperclient* client, const char* space, const char* key,
+                   size_t key_sz, uint64_t version, hyperclient_returncode* status,
+                   struct hyperclient_attribute** attrs, size_t* attrs_sz,
+                   uint64_t* version_out)
+{
+    try
+    {
+        return client->get_at(space, key, key_sz, version, status, attrs, attrs_sz, version_out);
+    }
+    catch (po6::error& e)
+    {
+        errno = e;
+        *status = HYPERCLIENT_EXCEPTION;
+        return -1;
+    }
+    catch (...)
+    {
+        *status = HYPERCLIENT_EXCEPTION;
+        return -1;
+    }
+}
+
+int64_t
+hyperclient_get_partial(struct hyperclient* client, const char* space, const char* key,
+                        size_t key_sz, const char** attrnames, size_t attrnames_sz,
+                        hyperclient_returncode* status,
+                        struct hyperclient_attribute** attrs, size_t* attrs_sz)
+{
+    try
+    {
+        return client->get_partial(space, key, key_sz, attrnames, attrnames_sz,
+                                   status, attrs, attrs_sz);
+    }
+    catch (po6::error& e)
+    {
+        errno = e;
+        *status = HYPERCLIENT_EXCEPTION;
+        return -1;
+    }
+    catch (...)
+    {
+        *status = HYPERCLIENT_EXCEPTION;
+        return -1;
+    }
+}
+
 int64_t
 hyperclient_put(struct hyperclient* client, const char* space, const char* key,
                 size_t key_sz, const struct hyperclient_attribute* attrs,
@@ -225,6 +272,177 @@ hyperclient_search(struct hyperclient* client, const char* space,
     }
 }
 
+int64_t
+hyperclient_prefix_search(struct hyperclient* client, const char* space,
+                          const struct hyperclient_attribute* eq, size_t eq_sz,
+                          const struct hyperclient_range_query* rn, size_t rn_sz,
+                          const struct hyperclient_attribute* prefix, size_t prefix_sz,
+                          enum hyperclient_returncode* status,
+                          struct hyperclient_attribute** attrs, size_t* attrs_sz)
+{
+    try
+    {
+        return client->prefix_search(space, eq, eq_sz, rn, rn_sz, prefix, prefix_sz,
+                                     status, attrs, attrs_sz);
+    }
+    catch (po6::error& e)
+    {
+        errno = e;
+        *status = HYPERCLIENT_EXCEPTION;
+        return -1;
+    }
+    catch (...)
+    {
+        *status = HYPERCLIENT_EXCEPTION;
+        return -1;
+    }
+}
+
+int64_t
+hyperclient_search_partial(struct hyperclient* client, const char* space,
+                           const struct hyperclient_attribute* eq, size_t eq_sz,
+                           const struct hyperclient_range_query* rn, size_t rn_sz,
+                           const char** attrnames, size_t attrnames_sz,
+                           enum hyperclient_returncode* status,
+                           struct hyperclient_attribute** attrs, size_t* attrs_sz)
+{
+    try
+    {
+        return client->search_partial(space, eq, eq_sz, rn, rn_sz, attrnames, attrnames_sz,
+                                      status, attrs, attrs_sz);
+    }
+    catch (po6::error& e)
+    {
+        errno = e;
+        *status = HYPERCLIENT_EXCEPTION;
+        return -1;
+    }
+    catch (...)
+    {
+        *status = HYPERCLIENT_EXCEPTION;
+        return -1;
+    }
+}
+
+int64_t
+hyperclient_aggregate(struct hyperclient* client, const char* space,
+                      const struct hyperclient_attribute* eq, size_t eq_sz,
+                      const struct hyperclient_range_query* rn, size_t rn_sz,
+                      enum hyperaggregate func, const char* attr, const char* group_by,
+                      enum hyperclient_returncode* status,
+                      struct hyperclient_aggregate_group** groups, size_t* groups_sz)
+{
+    try
+    {
+        return client->aggregate(space, eq, eq_sz, rn, rn_sz, func, attr, group_by,
+                                 status, groups, groups_sz);
+    }
+    catch (po6::error& e)
+    {
+        errno = e;
+        *status = HYPERCLIENT_EXCEPTION;
+        return -1;
+    }
+    catch (...)
+    {
+        *status = HYPERCLIENT_EXCEPTION;
+        return -1;
+    }
+}
+
+int64_t
+hyperclient_sorted_search(struct hyperclient* client, const char* space,
+                          const struct hyperclient_attribute* eq, size_t eq_sz,
+                          const struct hyperclient_range_query* rn, size_t rn_sz,
+                          const char* sort_by, uint64_t limit, int descending,
+                          enum hyperclient_returncode* status,
+                          struct hyperclient_attribute** attrs, size_t* attrs_sz)
+{
+    try
+    {
+        return client->sorted_search(space, eq, eq_sz, rn, rn_sz, sort_by, limit,
+                                     descending != 0, status, attrs, attrs_sz);
+    }
+    catch (po6::error& e)
+    {
+        errno = e;
+        *status = HYPERCLIENT_EXCEPTION;
+        return -1;
+    }
+    catch (...)
+    {
+        *status = HYPERCLIENT_EXCEPTION;
+        return -1;
+    }
+}
+
+int64_t
+hyperclient_sorted_scan(struct hyperclient* client, const char* space,
+                        uint64_t lower, uint64_t upper, uint64_t limit,
+                        int descending, enum hyperclient_returncode* status,
+                        struct hyperclient_attribute** attrs, size_t* attrs_sz)
+{
+    try
+    {
+        return client->sorted_scan(space, lower, upper, limit, descending != 0,
+                                   status, attrs, attrs_sz);
+    }
+    catch (po6::error& e)
+    {
+        errno = e;
+        *status = HYPERCLIENT_EXCEPTION;
+        return -1;
+    }
+    catch (...)
+    {
+        *status = HYPERCLIENT_EXCEPTION;
+        return -1;
+    }
+}
+
+int64_t
+hyperclient_watch(struct hyperclient* client, const char* space,
+                  const struct hyperclient_attribute* eq, size_t eq_sz,
+                  const struct hyperclient_range_query* rn, size_t rn_sz,
+                  int initial, enum hyperclient_returncode* status,
+                  struct hyperclient_attribute** attrs, size_t* attrs_sz)
+{
+    try
+    {
+        return client->watch(space, eq, eq_sz, rn, rn_sz, initial != 0,
+                             status, attrs, attrs_sz);
+    }
+    catch (po6::error& e)
+    {
+        errno = e;
+        *status = HYPERCLIENT_EXCEPTION;
+        return -1;
+    }
+    catch (...)
+    {
+        *status = HYPERCLIENT_EXCEPTION;
+        return -1;
+    }
+}
+
+int64_t
+hyperclient_unwatch(struct hyperclient* client, int64_t watchid)
+{
+    try
+    {
+        return client->unwatch(watchid);
+    }
+    catch (po6::error& e)
+    {
+        errno = e;
+        return -1;
+    }
+    catch (...)
+    {
+        return -1;
+    }
+}
+
 int64_t
 hyperclient_loop(struct hyperclient* client, int timeout, hyperclient_returncode* status)
 {
@@ -251,4 +469,10 @@ hyperclient_destroy_attrs(struct hyperclient_attribute* attrs, size_t /*attrs_sz
     free(attrs);
 }
 
+void
+hyperclient_destroy_groups(struct hyperclient_aggregate_group* groups, size_t /*groups_sz*/)
+{
+    free(groups);
+}
+
 } // extern "C"
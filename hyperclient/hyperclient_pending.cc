@@ -25,6 +25,9 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+// C
+#include <cstdlib>
+
 // HyperClient
 #include "hyperclient/hyperclient_pending.h"
 
@@ -41,3 +44,11 @@ hyperclient :: pending :: pending(hyperclient_returncode* status)
 hyperclient :: pending :: ~pending() throw ()
 {
 }
+
+int64_t
+hyperclient :: pending :: handle_buffered(hyperclient*,
+                                          hyperclient_returncode*)
+{
+    // Only ops which put themselves on m_buffered should ever get here.
+    abort();
+}
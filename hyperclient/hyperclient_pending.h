@@ -62,6 +62,11 @@ class hyperclient::pending
                                         std::auto_ptr<e::buffer> msg,
                                         hyperdex::network_msgtype type,
                                         hyperclient_returncode* status) = 0;
+        // Called from loop for ops on m_buffered, which hold results that were
+        // received earlier but not yet handed to the application.  Returns as
+        // handle_response does.
+        virtual int64_t handle_buffered(hyperclient* cl,
+                                        hyperclient_returncode* status);
 
     private:
         friend class e::intrusive_ptr<pending>;
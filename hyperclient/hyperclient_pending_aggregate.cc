@@ -0,0 +1,237 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// C
+#include <cstdlib>
+#include <cstring>
+
+// STL
+#include <algorithm>
+
+// HyperClient
+#include "hyperclient/constants.h"
+#include "hyperclient/hyperclient_pending_aggregate.h"
+
+hyperclient :: pending_aggregate :: pending_aggregate(int64_t aggid,
+                                                      std::tr1::shared_ptr<results> res,
+                                                      hyperclient_returncode* status,
+                                                      hyperclient_aggregate_group** groups,
+                                                      size_t* groups_sz)
+    : pending(status)
+    , m_results(res)
+    , m_groups(groups)
+    , m_groups_sz(groups_sz)
+{
+    ++m_results->outstanding;
+    this->set_client_visible_id(aggid);
+}
+
+hyperclient :: pending_aggregate :: ~pending_aggregate() throw ()
+{
+}
+
+hyperdex::network_msgtype
+hyperclient :: pending_aggregate :: request_type()
+{
+    return hyperdex::REQ_AGGREGATE;
+}
+
+int64_t
+hyperclient :: pending_aggregate :: handle_response(hyperclient* cl,
+                                                    const po6::net::location& sender,
+                                                    std::auto_ptr<e::buffer> msg,
+                                                    hyperdex::network_msgtype type,
+                                                    hyperclient_returncode* status)
+{
+    assert(m_results->outstanding > 0);
+    *status = HYPERCLIENT_SUCCESS;
+
+    if (type != hyperdex::RESP_AGGREGATE)
+    {
+        cl->killall(sender, HYPERCLIENT_SERVERERROR);
+        return 0;
+    }
+
+    e::buffer::unpacker up = msg->unpack_from(HYPERCLIENT_HEADER_SIZE);
+    uint16_t response;
+    uint32_t num_groups;
+    up = up >> response >> num_groups;
+
+    if (up.error())
+    {
+        cl->killall(sender, HYPERCLIENT_SERVERERROR);
+        m_results->error = HYPERCLIENT_SERVERERROR;
+        return finish();
+    }
+
+    switch (static_cast<hyperdex::network_returncode>(response))
+    {
+        case hyperdex::NET_SUCCESS:
+            break;
+        case hyperdex::NET_NOTUS:
+            m_results->error = HYPERCLIENT_RECONFIGURE;
+            return finish();
+        case hyperdex::NET_BADDIMSPEC:
+        case hyperdex::NET_NOTFOUND:
+        case hyperdex::NET_READONLY:
+        case hyperdex::NET_SERVERERROR:
+        case hyperdex::NET_CMPFAIL:
+        case hyperdex::NET_BADMICROS:
+        case hyperdex::NET_OVERFLOW:
+        case hyperdex::NET_BACKOFF:
+        default:
+            m_results->error = HYPERCLIENT_SERVERERROR;
+            return finish();
+    }
+
+    for (uint32_t i = 0; i < num_groups; ++i)
+    {
+        e::slice group;
+        uint64_t count;
+        int64_t result;
+        up = up >> group >> count >> result;
+
+        if (up.error())
+        {
+            cl->killall(sender, HYPERCLIENT_SERVERERROR);
+            m_results->error = HYPERCLIENT_SERVERERROR;
+            return finish();
+        }
+
+        m_results->merge(std::string(reinterpret_cast<const char*>(group.data()), group.size()),
+                         count, result);
+    }
+
+    return finish();
+}
+
+int64_t
+hyperclient :: pending_aggregate :: finish()
+{
+    if (--m_results->outstanding > 0)
+    {
+        // Silently remove this operation
+        return 0;
+    }
+
+    if (m_results->error != HYPERCLIENT_SUCCESS)
+    {
+        set_status(m_results->error);
+        return client_visible_id();
+    }
+
+    typedef std::map<std::string, std::pair<uint64_t, int64_t> > group_map_t;
+    const group_map_t& groups(m_results->groups);
+    size_t sz = sizeof(hyperclient_aggregate_group) * groups.size();
+
+    for (group_map_t::const_iterator g = groups.begin(); g != groups.end(); ++g)
+    {
+        sz += g->first.size();
+    }
+
+    char* ret = static_cast<char*>(malloc(std::max(sz, static_cast<size_t>(1))));
+
+    if (!ret)
+    {
+        set_status(HYPERCLIENT_NOMEM);
+        return client_visible_id();
+    }
+
+    hyperclient_aggregate_group* out = reinterpret_cast<hyperclient_aggregate_group*>(ret);
+    char* data = ret + sizeof(hyperclient_aggregate_group) * groups.size();
+
+    for (group_map_t::const_iterator g = groups.begin(); g != groups.end(); ++g, ++out)
+    {
+        out->value = m_results->grouped ? data : NULL;
+        out->value_sz = g->first.size();
+        out->count = g->second.first;
+        out->result = g->second.second;
+        memmove(data, g->first.data(), g->first.size());
+        data += g->first.size();
+    }
+
+    *m_groups = reinterpret_cast<hyperclient_aggregate_group*>(ret);
+    *m_groups_sz = groups.size();
+    set_status(HYPERCLIENT_SUCCESS);
+    return client_visible_id();
+}
+
+hyperclient :: pending_aggregate :: results :: results(hyperaggregate f, bool g)
+    : func(f)
+    , grouped(g)
+    , outstanding(0)
+    , error(HYPERCLIENT_SUCCESS)
+    , groups()
+{
+}
+
+hyperclient :: pending_aggregate :: results :: ~results() throw ()
+{
+}
+
+void
+hyperclient :: pending_aggregate :: results :: merge(const std::string& group,
+                                                     uint64_t count,
+                                                     int64_t result)
+{
+    std::map<std::string, std::pair<uint64_t, int64_t> >::iterator it = groups.find(group);
+
+    if (it == groups.end())
+    {
+        groups.insert(std::make_pair(group, std::make_pair(count, result)));
+        return;
+    }
+
+    std::pair<uint64_t, int64_t>& agg(it->second);
+
+    // MIN and MAX of no objects carry no value.
+    if (agg.first == 0)
+    {
+        agg.second = result;
+    }
+    else if (count > 0)
+    {
+        switch (func)
+        {
+            case HYPERAGGREGATE_COUNT:
+            case HYPERAGGREGATE_SUM:
+                agg.second = static_cast<uint64_t>(agg.second) + static_cast<uint64_t>(result);
+                break;
+            case HYPERAGGREGATE_MIN:
+                agg.second = std::min(agg.second, result);
+                break;
+            case HYPERAGGREGATE_MAX:
+                agg.second = std::max(agg.second, result);
+                break;
+            default:
+                abort();
+        }
+    }
+
+    agg.first += count;
+}
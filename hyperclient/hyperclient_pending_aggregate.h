@@ -0,0 +1,105 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef hyperclient_pending_aggregate_h_
+#define hyperclient_pending_aggregate_h_
+
+// STL
+#include <map>
+#include <string>
+#include <tr1/memory>
+
+// HyperClient
+#include "hyperclient/hyperclient_pending.h"
+
+// One of these is sent to each server an aggregate touches.  They share a
+// results object, and the last to hear back hands the merged result to the
+// application.
+class hyperclient::pending_aggregate : public hyperclient::pending
+{
+    public:
+        class results;
+
+    public:
+        pending_aggregate(int64_t aggid,
+                          std::tr1::shared_ptr<results> res,
+                          hyperclient_returncode* status,
+                          hyperclient_aggregate_group** groups,
+                          size_t* groups_sz);
+        virtual ~pending_aggregate() throw ();
+
+    public:
+        virtual hyperdex::network_msgtype request_type();
+        virtual int64_t handle_response(hyperclient* cl,
+                                        const po6::net::location& sender,
+                                        std::auto_ptr<e::buffer> msg,
+                                        hyperdex::network_msgtype type,
+                                        hyperclient_returncode* status);
+
+    private:
+        pending_aggregate(const pending_aggregate& other);
+
+    private:
+        pending_aggregate& operator = (const pending_aggregate& rhs);
+
+    private:
+        int64_t finish();
+
+    private:
+        std::tr1::shared_ptr<results> m_results;
+        hyperclient_aggregate_group** m_groups;
+        size_t* m_groups_sz;
+};
+
+class hyperclient::pending_aggregate::results
+{
+    public:
+        results(hyperaggregate func, bool grouped);
+        ~results() throw ();
+
+    public:
+        // Fold one server's partial result for "group" into the total.
+        void merge(const std::string& group, uint64_t count, int64_t result);
+
+    public:
+        const hyperaggregate func;
+        const bool grouped;
+        // Servers which have yet to answer.
+        uint64_t outstanding;
+        // The first error any server reported.
+        hyperclient_returncode error;
+        std::map<std::string, std::pair<uint64_t, int64_t> > groups;
+
+    private:
+        results(const results&);
+
+    private:
+        results& operator = (const results&);
+};
+
+#endif // hyperclient_pending_aggregate_h_
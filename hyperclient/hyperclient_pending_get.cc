@@ -34,8 +34,37 @@ hyperclient :: pending_get :: pending_get(hyperclient_returncode* status,
                                           struct hyperclient_attribute** attrs,
                                           size_t* attrs_sz)
     : pending(status)
+    , m_req_type(hyperdex::REQ_GET)
     , m_attrs(attrs)
     , m_attrs_sz(attrs_sz)
+    , m_version(NULL)
+    , m_projection()
+{
+}
+
+hyperclient :: pending_get :: pending_get(hyperclient_returncode* status,
+                                          struct hyperclient_attribute** attrs,
+                                          size_t* attrs_sz,
+                                          uint64_t* version)
+    : pending(status)
+    , m_req_type(hyperdex::REQ_GET_AT)
+    , m_attrs(attrs)
+    , m_attrs_sz(attrs_sz)
+    , m_version(version)
+    , m_projection()
+{
+}
+
+hyperclient :: pending_get :: pending_get(hyperclient_returncode* status,
+                                          struct hyperclient_attribute** attrs,
+                                          size_t* attrs_sz,
+                                          const std::vector<uint16_t>& projection)
+    : pending(status)
+    , m_req_type(hyperdex::REQ_GET_PARTIAL)
+    , m_attrs(attrs)
+    , m_attrs_sz(attrs_sz)
+    , m_version(NULL)
+    , m_projection(projection)
 {
 }
 
@@ -46,7 +75,7 @@ hyperclient :: pending_get :: ~pending_get() throw ()
 hyperdex::network_msgtype
 hyperclient :: pending_get :: request_type()
 {
-    return hyperdex::REQ_GET;
+    return m_req_type;
 }
 
 int64_t
@@ -94,14 +123,21 @@ hyperclient :: pending_get :: handle_response(hyperclient* cl,
         case hyperdex::NET_CMPFAIL:
         case hyperdex::NET_BADMICROS:
         case hyperdex::NET_OVERFLOW:
+        case hyperdex::NET_BACKOFF:
         default:
             cl->killall(sender, HYPERCLIENT_SERVERERROR);
             return 0;
     }
 
     std::vector<e::slice> value;
+    uint64_t version = 0;
     up = up >> value;
 
+    if (m_req_type == hyperdex::REQ_GET_AT)
+    {
+        up = up >> version;
+    }
+
     if (up.error())
     {
         cl->killall(sender, HYPERCLIENT_SERVERERROR);
@@ -111,12 +147,18 @@ hyperclient :: pending_get :: handle_response(hyperclient* cl,
     hyperclient_returncode op_status;
 
     if (!value_to_attributes(*cl->m_config, this->entity(), NULL, 0,
-                             value, status, &op_status, m_attrs, m_attrs_sz))
+                             value, status, &op_status, m_attrs, m_attrs_sz,
+                             m_req_type == hyperdex::REQ_GET_PARTIAL ? &m_projection : NULL))
     {
         set_status(op_status);
         return client_visible_id();
     }
 
+    if (m_version)
+    {
+        *m_version = version;
+    }
+
     set_status(HYPERCLIENT_SUCCESS);
     return client_visible_id();
 }
@@ -28,6 +28,9 @@
 #ifndef hyperclient_pending_get_h_
 #define hyperclient_pending_get_h_
 
+// STL
+#include <vector>
+
 // HyperClient
 #include "hyperclient/hyperclient_pending.h"
 
@@ -37,6 +40,17 @@ class hyperclient::pending_get : public hyperclient::pending
         pending_get(hyperclient_returncode* status,
                     struct hyperclient_attribute** attrs,
                     size_t* attrs_sz);
+        // A REQ_GET_AT, which also returns the version retrieved.
+        pending_get(hyperclient_returncode* status,
+                    struct hyperclient_attribute** attrs,
+                    size_t* attrs_sz,
+                    uint64_t* version);
+        // A REQ_GET_PARTIAL, which returns only the attributes numbered in
+        // "projection".
+        pending_get(hyperclient_returncode* status,
+                    struct hyperclient_attribute** attrs,
+                    size_t* attrs_sz,
+                    const std::vector<uint16_t>& projection);
         virtual ~pending_get() throw ();
 
     public:
@@ -54,8 +68,11 @@ class hyperclient::pending_get : public hyperclient::pending
         pending_get& operator = (const pending_get& rhs);
 
     private:
+        hyperdex::network_msgtype m_req_type;
         hyperclient_attribute** m_attrs;
         size_t* m_attrs_sz;
+        uint64_t* m_version;
+        std::vector<uint16_t> m_projection;
 };
 
 #endif // hyperclient_pending_get_h_
@@ -0,0 +1,194 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// HyperClient
+#include "hyperclient/constants.h"
+#include "hyperclient/hyperclient_completedop.h"
+#include "hyperclient/hyperclient_pending_scan.h"
+#include "hyperclient/util.h"
+
+hyperclient :: pending_scan :: pending_scan(int64_t scanid,
+                                            const hyperspacehashing::search& terms,
+                                            targets_t* targets,
+                                            uint64_t limit,
+                                            bool descending,
+                                            hyperclient_returncode* status,
+                                            hyperclient_attribute** attrs,
+                                            size_t* attrs_sz)
+    : pending(status)
+    , m_scanid(scanid)
+    , m_reqtype(hyperdex::REQ_SCAN_START)
+    , m_terms(terms)
+    , m_targets()
+    , m_next(0)
+    , m_remaining(limit)
+    , m_descending(descending)
+    , m_attrs(attrs)
+    , m_attrs_sz(attrs_sz)
+{
+    m_targets.swap(*targets);
+    this->set_client_visible_id(scanid);
+}
+
+hyperclient :: pending_scan :: ~pending_scan() throw ()
+{
+}
+
+hyperdex::network_msgtype
+hyperclient :: pending_scan :: request_type()
+{
+    return m_reqtype;
+}
+
+int64_t
+hyperclient :: pending_scan :: handle_response(hyperclient* cl,
+                                               const po6::net::location& sender,
+                                               std::auto_ptr<e::buffer> msg,
+                                               hyperdex::network_msgtype type,
+                                               hyperclient_returncode* status)
+{
+    *status = HYPERCLIENT_SUCCESS;
+
+    if (type != hyperdex::RESP_SEARCH_ITEM && type != hyperdex::RESP_SEARCH_DONE)
+    {
+        cl->killall(sender, HYPERCLIENT_SERVERERROR);
+        cl->m_complete.push(completedop(this, HYPERCLIENT_SERVERERROR, 0));
+        return 0;
+    }
+
+    // This region is finished.  Move on to the next unless we have all we
+    // asked for.
+    if (type == hyperdex::RESP_SEARCH_DONE)
+    {
+        // A daemon which no longer had the scan (it was evicted or expired)
+        // says so.
+        uint16_t result;
+
+        if (!(msg->unpack_from(HYPERCLIENT_HEADER_SIZE) >> result).error() &&
+            result != static_cast<uint16_t>(hyperdex::NET_SUCCESS))
+        {
+            cl->m_complete.push(completedop(this, HYPERCLIENT_SERVERERROR, 0));
+            return 0;
+        }
+
+        if (m_remaining > 0 && m_next < m_targets.size())
+        {
+            if (start_next(cl))
+            {
+                return 0;
+            }
+
+            cl->m_complete.push(completedop(this, HYPERCLIENT_RECONFIGURE, 0));
+            return 0;
+        }
+
+        set_status(HYPERCLIENT_SEARCHDONE);
+        return client_visible_id();
+    }
+
+    // Otherwise it is a SEARCH_ITEM message.
+    e::slice key;
+    std::vector<e::slice> value;
+
+    if ((msg->unpack_from(HYPERCLIENT_HEADER_SIZE) >> key >> value).error())
+    {
+        cl->killall(sender, HYPERCLIENT_SERVERERROR);
+        cl->m_complete.push(completedop(this, HYPERCLIENT_SERVERERROR, 0));
+        return 0;
+    }
+
+    hyperclient_returncode op_status;
+
+    if (!value_to_attributes(*cl->m_config, this->entity(), key.data(), key.size(),
+                             value, status, &op_status, m_attrs, m_attrs_sz))
+    {
+        set_status(op_status);
+        return client_visible_id();
+    }
+
+    if (m_remaining > 0)
+    {
+        --m_remaining;
+    }
+
+    e::guard g = e::makeguard(hyperclient_destroy_attrs, *m_attrs, *m_attrs_sz);
+    std::auto_ptr<e::buffer> smsg(e::buffer::create(HYPERCLIENT_HEADER_SIZE + sizeof(uint64_t)));
+    bool packed = !(smsg->pack_at(HYPERCLIENT_HEADER_SIZE) << static_cast<uint64_t>(m_scanid)).error();
+    assert(packed);
+
+    set_server_visible_nonce(cl->m_server_nonce);
+    ++cl->m_server_nonce;
+    m_reqtype = hyperdex::REQ_SEARCH_NEXT;
+
+    if (cl->send(this, smsg) < 0)
+    {
+        cl->m_complete.push(completedop(this, HYPERCLIENT_RECONFIGURE, 0));
+        return 0;
+    }
+
+    cl->m_incomplete.insert(std::make_pair(server_visible_nonce(), this));
+    set_status(HYPERCLIENT_SUCCESS);
+    g.dismiss();
+    return client_visible_id();
+}
+
+bool
+hyperclient :: pending_scan :: start_next(hyperclient* cl)
+{
+    if (m_next >= m_targets.size())
+    {
+        return false;
+    }
+
+    set_entity(m_targets[m_next].first);
+    set_instance(m_targets[m_next].second);
+    set_server_visible_nonce(cl->m_server_nonce);
+    ++cl->m_server_nonce;
+    ++m_next;
+    m_reqtype = hyperdex::REQ_SCAN_START;
+    size_t sz = HYPERCLIENT_HEADER_SIZE
+              + sizeof(uint64_t)
+              + m_terms.packed_size()
+              + sizeof(uint64_t)
+              + sizeof(uint8_t);
+    std::auto_ptr<e::buffer> msg(e::buffer::create(sz));
+    bool packed = !(msg->pack_at(HYPERCLIENT_HEADER_SIZE)
+                        << static_cast<uint64_t>(m_scanid)
+                        << m_terms
+                        << m_remaining
+                        << static_cast<uint8_t>(m_descending ? 1 : 0)).error();
+    assert(packed);
+
+    if (cl->send(this, msg) < 0)
+    {
+        return false;
+    }
+
+    cl->m_incomplete.insert(std::make_pair(server_visible_nonce(), this));
+    return true;
+}
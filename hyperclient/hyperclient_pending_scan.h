@@ -0,0 +1,92 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef hyperclient_pending_scan_h_
+#define hyperclient_pending_scan_h_
+
+// STL
+#include <utility>
+#include <vector>
+
+// HyperspaceHashing
+#include "hyperspacehashing/hyperspacehashing/search.h"
+
+// HyperClient
+#include "hyperclient/hyperclient_pending.h"
+
+// An ordered scan visits the regions of the key subspace one at a time, in key
+// order.  Each region returns its objects in key order, and the regions hold
+// disjoint ranges of keys, so the results need no merging at the client.
+class hyperclient::pending_scan : public hyperclient::pending
+{
+    public:
+        typedef std::vector<std::pair<hyperdex::entityid, hyperdex::instance> > targets_t;
+
+    public:
+        pending_scan(int64_t scanid,
+                     const hyperspacehashing::search& terms,
+                     targets_t* targets,
+                     uint64_t limit,
+                     bool descending,
+                     hyperclient_returncode* status,
+                     hyperclient_attribute** attrs,
+                     size_t* attrs_sz);
+        virtual ~pending_scan() throw ();
+
+    public:
+        virtual hyperdex::network_msgtype request_type();
+        virtual int64_t handle_response(hyperclient* cl,
+                                        const po6::net::location& sender,
+                                        std::auto_ptr<e::buffer> msg,
+                                        hyperdex::network_msgtype type,
+                                        hyperclient_returncode* status);
+
+    public:
+        // Send the scan to the next region.  Returns false if there are no
+        // more regions or the scan could not be sent.
+        bool start_next(hyperclient* cl);
+
+    private:
+        pending_scan(const pending_scan& other);
+
+    private:
+        pending_scan& operator = (const pending_scan& rhs);
+
+    private:
+        int64_t m_scanid;
+        hyperdex::network_msgtype m_reqtype;
+        hyperspacehashing::search m_terms;
+        targets_t m_targets;
+        size_t m_next;
+        uint64_t m_remaining;
+        bool m_descending;
+        hyperclient_attribute** m_attrs;
+        size_t* m_attrs_sz;
+};
+
+#endif // hyperclient_pending_scan_h_
@@ -25,6 +25,9 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+// po6
+#include <po6/net/location.h>
+
 // HyperClient
 #include "hyperclient/constants.h"
 #include "hyperclient/hyperclient_completedop.h"
@@ -35,13 +38,19 @@ hyperclient :: pending_search :: pending_search(int64_t searchid,
                                                 std::tr1::shared_ptr<uint64_t> refcount,
                                                 hyperclient_returncode* status,
                                                 hyperclient_attribute** attrs,
-                                                size_t* attrs_sz)
+                                                size_t* attrs_sz,
+                                                std::tr1::shared_ptr<std::vector<uint16_t> > projection)
     : pending(status)
     , m_searchid(searchid)
     , m_reqtype(hyperdex::REQ_SEARCH_START)
     , m_refcount(refcount)
     , m_attrs(attrs)
     , m_attrs_sz(attrs_sz)
+    , m_projection(projection)
+    , m_batch()
+    , m_batch_off(0)
+    , m_batch_left(0)
+    , m_batch_last(false)
 {
     ++*m_refcount;
     this->set_client_visible_id(searchid);
@@ -67,7 +76,9 @@ hyperclient :: pending_search :: handle_response(hyperclient* cl,
     assert(*m_refcount > 0);
     *status = HYPERCLIENT_SUCCESS;
 
-    if (type != hyperdex::RESP_SEARCH_ITEM && type != hyperdex::RESP_SEARCH_DONE)
+    if (type != hyperdex::RESP_SEARCH_ITEM &&
+        type != hyperdex::RESP_SEARCH_BATCH &&
+        type != hyperdex::RESP_SEARCH_DONE)
     {
         cl->killall(sender, HYPERCLIENT_SERVERERROR);
         return 0;
@@ -76,6 +87,81 @@ hyperclient :: pending_search :: handle_response(hyperclient* cl,
     // If it is a SEARCH_DONE message.
     if (type == hyperdex::RESP_SEARCH_DONE)
     {
+        // A daemon which no longer had the search (it was evicted or expired)
+        // says so, and the results from its region are incomplete.
+        uint16_t result;
+
+        if (!(msg->unpack_from(HYPERCLIENT_HEADER_SIZE) >> result).error() &&
+            result != static_cast<uint16_t>(hyperdex::NET_SUCCESS))
+        {
+            set_status(HYPERCLIENT_SERVERERROR);
+
+            if (--*m_refcount == 0)
+            {
+                cl->m_complete.push(completedop(this, HYPERCLIENT_SEARCHDONE, 0));
+            }
+
+            return client_visible_id();
+        }
+
+        if (--*m_refcount == 0)
+        {
+            set_status(HYPERCLIENT_SEARCHDONE);
+            return client_visible_id();
+        }
+
+        // Silently remove this operation
+        return 0;
+    }
+
+    // A SEARCH_ITEM message is a batch of one which does not end the search.
+    m_batch_off = HYPERCLIENT_HEADER_SIZE;
+    m_batch_left = 1;
+    m_batch_last = false;
+
+    if (type == hyperdex::RESP_SEARCH_BATCH)
+    {
+        uint8_t flags;
+        e::buffer::unpacker up = msg->unpack_from(HYPERCLIENT_HEADER_SIZE);
+        up = up >> flags >> m_batch_left;
+
+        if (up.error())
+        {
+            cl->killall(sender, HYPERCLIENT_SERVERERROR);
+
+            if (--*m_refcount == 0)
+            {
+                cl->m_complete.push(completedop(this, HYPERCLIENT_SEARCHDONE, 0));
+            }
+
+            return 0;
+        }
+
+        m_batch_off = msg->size() - up.remain();
+        m_batch_last = flags & 1;
+    }
+
+    m_batch = msg;
+    return handle_buffered(cl, status);
+}
+
+int64_t
+hyperclient :: pending_search :: handle_buffered(hyperclient* cl,
+                                                 hyperclient_returncode* status)
+{
+    assert(*m_refcount > 0);
+    *status = HYPERCLIENT_SUCCESS;
+
+    if (m_batch_left == 0)
+    {
+        m_batch.reset();
+
+        if (!m_batch_last)
+        {
+            send_next(cl);
+            return 0;
+        }
+
         if (--*m_refcount == 0)
         {
             set_status(HYPERCLIENT_SEARCHDONE);
@@ -86,13 +172,17 @@ hyperclient :: pending_search :: handle_response(hyperclient* cl,
         return 0;
     }
 
-    // Otheriwise it is a SEARCH_ITEM message.
     e::slice key;
     std::vector<e::slice> value;
+    e::buffer::unpacker up = m_batch->unpack_from(m_batch_off);
+    up = up >> key >> value;
 
-    if ((msg->unpack_from(HYPERCLIENT_HEADER_SIZE) >> key >> value).error())
+    if (up.error())
     {
-        cl->killall(sender, HYPERCLIENT_SERVERERROR);
+        m_batch.reset();
+        m_batch_left = 0;
+        cl->killall(po6::net::location(instance().address, instance().inbound_port),
+                    HYPERCLIENT_SERVERERROR);
 
         if (--*m_refcount == 0)
         {
@@ -102,11 +192,16 @@ hyperclient :: pending_search :: handle_response(hyperclient* cl,
         return 0;
     }
 
+    m_batch_off = m_batch->size() - up.remain();
+    --m_batch_left;
     hyperclient_returncode op_status;
 
     if (!value_to_attributes(*cl->m_config, this->entity(), key.data(), key.size(),
-                             value, status, &op_status, m_attrs, m_attrs_sz))
+                             value, status, &op_status, m_attrs, m_attrs_sz,
+                             m_projection.get()))
     {
+        m_batch.reset();
+        m_batch_left = 0;
         set_status(op_status);
 
         if (--*m_refcount == 0)
@@ -118,6 +213,32 @@ hyperclient :: pending_search :: handle_response(hyperclient* cl,
     }
 
     e::guard g = e::makeguard(hyperclient_destroy_attrs, *m_attrs, *m_attrs_sz);
+
+    // Hand out the rest of the batch (or the end of the search) on later calls
+    // to loop.  Otherwise, ask for the next batch while the application works
+    // on this object.
+    if (m_batch_left > 0 || m_batch_last)
+    {
+        cl->m_buffered.push(this);
+    }
+    else
+    {
+        m_batch.reset();
+
+        if (!send_next(cl))
+        {
+            return 0;
+        }
+    }
+
+    set_status(HYPERCLIENT_SUCCESS);
+    g.dismiss();
+    return client_visible_id();
+}
+
+bool
+hyperclient :: pending_search :: send_next(hyperclient* cl)
+{
     std::auto_ptr<e::buffer> smsg(e::buffer::create(HYPERCLIENT_HEADER_SIZE + sizeof(uint64_t)));
     bool packed = !(smsg->pack_at(HYPERCLIENT_HEADER_SIZE) << static_cast<uint64_t>(m_searchid)).error();
     assert(packed);
@@ -128,18 +249,17 @@ hyperclient :: pending_search :: handle_response(hyperclient* cl,
 
     if (cl->send(this, smsg) < 0)
     {
-        cl->killall(sender, HYPERCLIENT_RECONFIGURE);
+        cl->killall(po6::net::location(instance().address, instance().inbound_port),
+                    HYPERCLIENT_RECONFIGURE);
 
         if (--*m_refcount == 0)
         {
             cl->m_complete.push(completedop(this, HYPERCLIENT_SEARCHDONE, 0));
         }
 
-        return 0;
+        return false;
     }
 
     cl->m_incomplete.insert(std::make_pair(server_visible_nonce(), this));
-    set_status(HYPERCLIENT_SUCCESS);
-    g.dismiss();
-    return client_visible_id();
+    return true;
 }
@@ -29,7 +29,9 @@
 #define hyperclient_pending_search_h_
 
 // STL
+#include <memory>
 #include <tr1/memory>
+#include <vector>
 
 // HyperClient
 #include "hyperclient/hyperclient_pending.h"
@@ -41,7 +43,8 @@ class hyperclient::pending_search : public hyperclient::pending
                        std::tr1::shared_ptr<uint64_t> refcount,
                        hyperclient_returncode* status,
                        hyperclient_attribute** attrs,
-                       size_t* attrs_sz);
+                       size_t* attrs_sz,
+                       std::tr1::shared_ptr<std::vector<uint16_t> > projection);
         virtual ~pending_search() throw ();
 
     public:
@@ -51,6 +54,8 @@ class hyperclient::pending_search : public hyperclient::pending
                                         std::auto_ptr<e::buffer> msg,
                                         hyperdex::network_msgtype type,
                                         hyperclient_returncode* status);
+        virtual int64_t handle_buffered(hyperclient* cl,
+                                        hyperclient_returncode* status);
 
     private:
         pending_search(const pending_search& other);
@@ -58,12 +63,22 @@ class hyperclient::pending_search : public hyperclient::pending
     private:
         pending_search& operator = (const pending_search& rhs);
 
+    private:
+        bool send_next(hyperclient* cl);
+
     private:
         int64_t m_searchid;
         hyperdex::network_msgtype m_reqtype;
         std::tr1::shared_ptr<uint64_t> m_refcount;
         hyperclient_attribute** m_attrs;
         size_t* m_attrs_sz;
+        // The attributes asked for, or NULL for all of them.
+        std::tr1::shared_ptr<std::vector<uint16_t> > m_projection;
+        // The most recent response, and the objects in it not yet returned.
+        std::auto_ptr<e::buffer> m_batch;
+        size_t m_batch_off;
+        uint32_t m_batch_left;
+        bool m_batch_last;
 };
 
 #endif // hyperclient_pending_search_h_
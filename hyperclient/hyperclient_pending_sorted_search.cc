@@ -0,0 +1,219 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// STL
+#include <algorithm>
+
+// HyperDex
+#include "hyperdex/hyperdex/ordering.h"
+
+// HyperClient
+#include "hyperclient/constants.h"
+#include "hyperclient/hyperclient_pending_sorted_search.h"
+#include "hyperclient/util.h"
+
+hyperclient :: pending_sorted_search :: pending_sorted_search(int64_t searchid,
+                                                              std::tr1::shared_ptr<results> res,
+                                                              hyperclient_returncode* status,
+                                                              hyperclient_attribute** attrs,
+                                                              size_t* attrs_sz)
+    : pending(status)
+    , m_results(res)
+    , m_attrs(attrs)
+    , m_attrs_sz(attrs_sz)
+{
+    ++m_results->outstanding;
+    this->set_client_visible_id(searchid);
+}
+
+hyperclient :: pending_sorted_search :: ~pending_sorted_search() throw ()
+{
+}
+
+hyperdex::network_msgtype
+hyperclient :: pending_sorted_search :: request_type()
+{
+    return hyperdex::REQ_SORTED_SEARCH;
+}
+
+int64_t
+hyperclient :: pending_sorted_search :: handle_response(hyperclient* cl,
+                                                        const po6::net::location& sender,
+                                                        std::auto_ptr<e::buffer> msg,
+                                                        hyperdex::network_msgtype type,
+                                                        hyperclient_returncode* status)
+{
+    assert(m_results->outstanding > 0);
+    *status = HYPERCLIENT_SUCCESS;
+
+    if (type != hyperdex::RESP_SORTED_SEARCH)
+    {
+        cl->killall(sender, HYPERCLIENT_SERVERERROR);
+        return 0;
+    }
+
+    e::buffer::unpacker up = msg->unpack_from(HYPERCLIENT_HEADER_SIZE);
+    uint16_t response;
+    uint32_t num_items;
+    up = up >> response >> num_items;
+
+    if (up.error())
+    {
+        cl->killall(sender, HYPERCLIENT_SERVERERROR);
+        m_results->error = HYPERCLIENT_SERVERERROR;
+        return finish(cl, status);
+    }
+
+    switch (static_cast<hyperdex::network_returncode>(response))
+    {
+        case hyperdex::NET_SUCCESS:
+            break;
+        case hyperdex::NET_NOTUS:
+            m_results->error = HYPERCLIENT_RECONFIGURE;
+            return finish(cl, status);
+        case hyperdex::NET_OVERFLOW:
+            m_results->error = HYPERCLIENT_OVERFLOW;
+            return finish(cl, status);
+        case hyperdex::NET_BADDIMSPEC:
+        case hyperdex::NET_NOTFOUND:
+        case hyperdex::NET_READONLY:
+        case hyperdex::NET_SERVERERROR:
+        case hyperdex::NET_CMPFAIL:
+        case hyperdex::NET_BADMICROS:
+        case hyperdex::NET_BACKOFF:
+        default:
+            m_results->error = HYPERCLIENT_SERVERERROR;
+            return finish(cl, status);
+    }
+
+    std::tr1::shared_ptr<e::buffer> backing(msg.release());
+    m_results->backings.push_back(backing);
+
+    for (uint32_t i = 0; i < num_items; ++i)
+    {
+        results::item it;
+        up = up >> it.key >> it.value;
+
+        if (up.error() || (m_results->sort_by > 0 && it.value.size() < m_results->sort_by))
+        {
+            cl->killall(sender, HYPERCLIENT_SERVERERROR);
+            m_results->error = HYPERCLIENT_SERVERERROR;
+            return finish(cl, status);
+        }
+
+        it.sort = m_results->sort_by == 0 ? it.key : it.value[m_results->sort_by - 1];
+        m_results->items.push_back(it);
+    }
+
+    return finish(cl, status);
+}
+
+int64_t
+hyperclient :: pending_sorted_search :: handle_buffered(hyperclient* cl,
+                                                        hyperclient_returncode* status)
+{
+    *status = HYPERCLIENT_SUCCESS;
+
+    if (m_results->next >= m_results->items.size())
+    {
+        set_status(m_results->error != HYPERCLIENT_SUCCESS ? m_results->error
+                                                           : HYPERCLIENT_SEARCHDONE);
+        return client_visible_id();
+    }
+
+    const results::item& it(m_results->items[m_results->next]);
+    ++m_results->next;
+    cl->m_buffered.push(this);
+    hyperclient_returncode op_status;
+
+    if (!value_to_attributes(*cl->m_config, this->entity(), it.key.data(), it.key.size(),
+                             it.value, status, &op_status, m_attrs, m_attrs_sz))
+    {
+        set_status(op_status);
+        return client_visible_id();
+    }
+
+    set_status(HYPERCLIENT_SUCCESS);
+    return client_visible_id();
+}
+
+// Once every server has answered, put the first "limit" objects in order and
+// start handing them out.
+int64_t
+hyperclient :: pending_sorted_search :: finish(hyperclient* cl,
+                                               hyperclient_returncode* status)
+{
+    if (--m_results->outstanding > 0)
+    {
+        // Silently remove this operation
+        return 0;
+    }
+
+    std::vector<results::item>& items(m_results->items);
+    results::before order(m_results->type, m_results->descending);
+
+    if (m_results->limit > 0 && m_results->limit < items.size())
+    {
+        std::partial_sort(items.begin(), items.begin() + m_results->limit,
+                          items.end(), order);
+        items.resize(m_results->limit);
+    }
+    else
+    {
+        std::sort(items.begin(), items.end(), order);
+    }
+
+    return handle_buffered(cl, status);
+}
+
+hyperclient :: pending_sorted_search :: results :: results(hyperdatatype t,
+                                                           uint16_t s,
+                                                           uint64_t l,
+                                                           bool d)
+    : type(t)
+    , sort_by(s)
+    , limit(l)
+    , descending(d)
+    , outstanding(0)
+    , error(HYPERCLIENT_SUCCESS)
+    , backings()
+    , items()
+    , next(0)
+{
+}
+
+hyperclient :: pending_sorted_search :: results :: ~results() throw ()
+{
+}
+
+bool
+hyperclient :: pending_sorted_search :: results :: before :: operator () (const item& lhs,
+                                                                          const item& rhs) const
+{
+    return hyperdex::sorts_before(m_type, m_descending, lhs.sort, lhs.key, rhs.sort, rhs.key);
+}
@@ -0,0 +1,137 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef hyperclient_pending_sorted_search_h_
+#define hyperclient_pending_sorted_search_h_
+
+// STL
+#include <tr1/memory>
+#include <vector>
+
+// HyperClient
+#include "hyperclient/hyperclient_pending.h"
+
+// One of these is sent to each server a sorted search touches.  Each server
+// answers with its own first objects; the last op to hear back merges them all
+// and hands them to the application one at a time.
+class hyperclient::pending_sorted_search : public hyperclient::pending
+{
+    public:
+        class results;
+
+    public:
+        pending_sorted_search(int64_t searchid,
+                              std::tr1::shared_ptr<results> res,
+                              hyperclient_returncode* status,
+                              hyperclient_attribute** attrs,
+                              size_t* attrs_sz);
+        virtual ~pending_sorted_search() throw ();
+
+    public:
+        virtual hyperdex::network_msgtype request_type();
+        virtual int64_t handle_response(hyperclient* cl,
+                                        const po6::net::location& sender,
+                                        std::auto_ptr<e::buffer> msg,
+                                        hyperdex::network_msgtype type,
+                                        hyperclient_returncode* status);
+        virtual int64_t handle_buffered(hyperclient* cl,
+                                        hyperclient_returncode* status);
+
+    private:
+        pending_sorted_search(const pending_sorted_search& other);
+
+    private:
+        pending_sorted_search& operator = (const pending_sorted_search& rhs);
+
+    private:
+        int64_t finish(hyperclient* cl, hyperclient_returncode* status);
+
+    private:
+        std::tr1::shared_ptr<results> m_results;
+        hyperclient_attribute** m_attrs;
+        size_t* m_attrs_sz;
+};
+
+class hyperclient::pending_sorted_search::results
+{
+    public:
+        class item;
+        class before;
+
+    public:
+        results(hyperdatatype type, uint16_t sort_by, uint64_t limit, bool descending);
+        ~results() throw ();
+
+    public:
+        const hyperdatatype type;
+        const uint16_t sort_by;
+        const uint64_t limit;
+        const bool descending;
+        // Servers which have yet to answer.
+        uint64_t outstanding;
+        // The first error any server reported.
+        hyperclient_returncode error;
+        // The responses which the items point into.
+        std::vector<std::tr1::shared_ptr<e::buffer> > backings;
+        std::vector<item> items;
+        // The next item to hand out, once every server has answered.
+        size_t next;
+
+    private:
+        results(const results&);
+
+    private:
+        results& operator = (const results&);
+};
+
+class hyperclient::pending_sorted_search::results::item
+{
+    public:
+        item() : key(), value(), sort() {}
+
+    public:
+        e::slice key;
+        std::vector<e::slice> value;
+        e::slice sort;
+};
+
+class hyperclient::pending_sorted_search::results::before
+{
+    public:
+        before(hyperdatatype type, bool descending)
+            : m_type(type), m_descending(descending) {}
+
+    public:
+        bool operator () (const item& lhs, const item& rhs) const;
+
+    private:
+        hyperdatatype m_type;
+        bool m_descending;
+};
+
+#endif // hyperclient_pending_sorted_search_h_
@@ -98,6 +98,9 @@ hyperclient :: pending_statusonly :: handle_response(hyperclient* cl,
         case hyperdex::NET_READONLY:
             set_status(HYPERCLIENT_READONLY);
             break;
+        case hyperdex::NET_BACKOFF:
+            set_status(HYPERCLIENT_BACKOFF);
+            break;
         case hyperdex::NET_SERVERERROR:
         default:
             cl->killall(sender, HYPERCLIENT_SERVERERROR);
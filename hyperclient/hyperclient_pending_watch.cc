@@ -0,0 +1,242 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// po6
+#include <po6/net/location.h>
+
+// HyperClient
+#include "hyperclient/constants.h"
+#include "hyperclient/hyperclient_completedop.h"
+#include "hyperclient/hyperclient_pending_watch.h"
+#include "hyperclient/util.h"
+
+hyperclient :: pending_watch :: pending_watch(int64_t watchid,
+                                              hyperclient_returncode* status,
+                                              hyperclient_attribute** attrs,
+                                              size_t* attrs_sz)
+    : pending(status)
+    , m_watchid(watchid)
+    , m_reqtype(hyperdex::REQ_WATCH_START)
+    , m_attrs(attrs)
+    , m_attrs_sz(attrs_sz)
+    , m_batch()
+    , m_batch_off(0)
+    , m_batch_left(0)
+    , m_batch_flags(0)
+    , m_done(false)
+{
+    this->set_client_visible_id(watchid);
+}
+
+hyperclient :: pending_watch :: ~pending_watch() throw ()
+{
+}
+
+hyperdex::network_msgtype
+hyperclient :: pending_watch :: request_type()
+{
+    return m_reqtype;
+}
+
+int64_t
+hyperclient :: pending_watch :: handle_response(hyperclient* cl,
+                                                const po6::net::location& sender,
+                                                std::auto_ptr<e::buffer> msg,
+                                                hyperdex::network_msgtype type,
+                                                hyperclient_returncode* status)
+{
+    *status = HYPERCLIENT_SUCCESS;
+
+    // The answer to the request which was open when the watch was stopped.
+    if (m_done)
+    {
+        return 0;
+    }
+
+    if (type != hyperdex::RESP_WATCH_BATCH)
+    {
+        cl->killall(sender, HYPERCLIENT_SERVERERROR);
+        fail(cl, HYPERCLIENT_SERVERERROR);
+        return 0;
+    }
+
+    e::buffer::unpacker up = msg->unpack_from(HYPERCLIENT_HEADER_SIZE);
+    up = up >> m_batch_flags >> m_batch_left;
+
+    if (up.error())
+    {
+        cl->killall(sender, HYPERCLIENT_SERVERERROR);
+        fail(cl, HYPERCLIENT_SERVERERROR);
+        return 0;
+    }
+
+    m_batch_off = msg->size() - up.remain();
+    m_batch = msg;
+    return handle_buffered(cl, status);
+}
+
+int64_t
+hyperclient :: pending_watch :: handle_buffered(hyperclient* cl,
+                                                hyperclient_returncode* status)
+{
+    *status = HYPERCLIENT_SUCCESS;
+
+    if (m_done)
+    {
+        m_batch.reset();
+        return 0;
+    }
+
+    if (m_batch_left == 0)
+    {
+        m_batch.reset();
+
+        if (!(m_batch_flags & 1))
+        {
+            send_next(cl);
+            return 0;
+        }
+
+        // The server ended the watch.
+        m_done = true;
+        set_status(m_batch_flags & 2 ? HYPERCLIENT_OVERFLOW : HYPERCLIENT_RECONFIGURE);
+        return client_visible_id();
+    }
+
+    uint8_t kind;
+    e::slice key;
+    uint64_t version;
+    std::vector<e::slice> value;
+    e::buffer::unpacker up = m_batch->unpack_from(m_batch_off);
+    up = up >> kind >> key >> version;
+
+    if (!up.error() && kind != 0)
+    {
+        up = up >> value;
+    }
+
+    if (up.error())
+    {
+        m_batch.reset();
+        m_batch_left = 0;
+        cl->killall(po6::net::location(instance().address, instance().inbound_port),
+                    HYPERCLIENT_SERVERERROR);
+        fail(cl, HYPERCLIENT_SERVERERROR);
+        return 0;
+    }
+
+    m_batch_off = m_batch->size() - up.remain();
+    --m_batch_left;
+    hyperclient_returncode op_status;
+    // A removed object is returned as just its key.
+    std::vector<uint16_t> key_only;
+
+    if (!value_to_attributes(*cl->m_config, this->entity(), key.data(), key.size(),
+                             value, status, &op_status, m_attrs, m_attrs_sz,
+                             kind != 0 ? NULL : &key_only))
+    {
+        m_batch.reset();
+        m_batch_left = 0;
+        m_done = true;
+        set_status(op_status);
+        return client_visible_id();
+    }
+
+    e::guard g = e::makeguard(hyperclient_destroy_attrs, *m_attrs, *m_attrs_sz);
+
+    // Hand out the rest of the batch (or the end of the watch) on later calls
+    // to loop.  Otherwise, ask for more changes while the application works
+    // on this one.
+    if (m_batch_left > 0 || (m_batch_flags & 1))
+    {
+        cl->m_buffered.push(this);
+    }
+    else
+    {
+        m_batch.reset();
+
+        if (!send_next(cl))
+        {
+            return 0;
+        }
+    }
+
+    set_status(kind != 0 ? HYPERCLIENT_SUCCESS : HYPERCLIENT_NOTFOUND);
+    g.dismiss();
+    return client_visible_id();
+}
+
+void
+hyperclient :: pending_watch :: stop(hyperclient* cl)
+{
+    if (m_done)
+    {
+        return;
+    }
+
+    m_done = true;
+    m_batch.reset();
+    m_batch_left = 0;
+    // The header reuses the current nonce so that the answer to an open
+    // request still finds this operation.
+    std::auto_ptr<e::buffer> smsg(e::buffer::create(HYPERCLIENT_HEADER_SIZE + sizeof(uint64_t)));
+    bool packed = !(smsg->pack_at(HYPERCLIENT_HEADER_SIZE) << static_cast<uint64_t>(m_watchid)).error();
+    assert(packed);
+    m_reqtype = hyperdex::REQ_WATCH_STOP;
+    cl->send(this, smsg);
+}
+
+bool
+hyperclient :: pending_watch :: send_next(hyperclient* cl)
+{
+    std::auto_ptr<e::buffer> smsg(e::buffer::create(HYPERCLIENT_HEADER_SIZE + sizeof(uint64_t)));
+    bool packed = !(smsg->pack_at(HYPERCLIENT_HEADER_SIZE) << static_cast<uint64_t>(m_watchid)).error();
+    assert(packed);
+
+    set_server_visible_nonce(cl->m_server_nonce);
+    ++cl->m_server_nonce;
+    m_reqtype = hyperdex::REQ_WATCH_NEXT;
+
+    if (cl->send(this, smsg) < 0)
+    {
+        cl->killall(po6::net::location(instance().address, instance().inbound_port),
+                    HYPERCLIENT_RECONFIGURE);
+        fail(cl, HYPERCLIENT_RECONFIGURE);
+        return false;
+    }
+
+    cl->m_incomplete.insert(std::make_pair(server_visible_nonce(), this));
+    return true;
+}
+
+void
+hyperclient :: pending_watch :: fail(hyperclient* cl, hyperclient_returncode status)
+{
+    m_done = true;
+    cl->m_complete.push(completedop(this, status, 0));
+}
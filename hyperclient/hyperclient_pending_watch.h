@@ -0,0 +1,83 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef hyperclient_pending_watch_h_
+#define hyperclient_pending_watch_h_
+
+// STL
+#include <memory>
+
+// HyperClient
+#include "hyperclient/hyperclient_pending.h"
+
+class hyperclient::pending_watch : public hyperclient::pending
+{
+    public:
+        pending_watch(int64_t watchid,
+                      hyperclient_returncode* status,
+                      hyperclient_attribute** attrs,
+                      size_t* attrs_sz);
+        virtual ~pending_watch() throw ();
+
+    public:
+        virtual hyperdex::network_msgtype request_type();
+        virtual int64_t handle_response(hyperclient* cl,
+                                        const po6::net::location& sender,
+                                        std::auto_ptr<e::buffer> msg,
+                                        hyperdex::network_msgtype type,
+                                        hyperclient_returncode* status);
+        virtual int64_t handle_buffered(hyperclient* cl,
+                                        hyperclient_returncode* status);
+        // Tell the server to drop the watch, and return nothing more from it.
+        void stop(hyperclient* cl);
+
+    private:
+        pending_watch(const pending_watch& other);
+
+    private:
+        pending_watch& operator = (const pending_watch& rhs);
+
+    private:
+        bool send_next(hyperclient* cl);
+        void fail(hyperclient* cl, hyperclient_returncode status);
+
+    private:
+        int64_t m_watchid;
+        hyperdex::network_msgtype m_reqtype;
+        hyperclient_attribute** m_attrs;
+        size_t* m_attrs_sz;
+        // The most recent batch, and the changes in it not yet returned.
+        std::auto_ptr<e::buffer> m_batch;
+        size_t m_batch_off;
+        uint32_t m_batch_left;
+        uint8_t m_batch_flags;
+        // Set once the watch has ended or been stopped.
+        bool m_done;
+};
+
+#endif // hyperclient_pending_watch_h_
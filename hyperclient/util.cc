@@ -40,27 +40,48 @@ value_to_attributes(const hyperdex::configuration& config,
                     hyperclient_returncode* loop_status,
                     hyperclient_returncode* op_status,
                     hyperclient_attribute** attrs,
-                    size_t* attrs_sz)
+                    size_t* attrs_sz,
+                    const std::vector<uint16_t>* projection)
 {
     *loop_status = HYPERCLIENT_SUCCESS;
     std::vector<hyperdex::attribute> dimension_names = config.dimension_names(entity.get_space());
+    // dims[i] is the dimension held in value[i].
+    std::vector<uint16_t> dims;
 
-    if (value.size() + 1 != dimension_names.size())
+    if (projection)
+    {
+        dims = *projection;
+    }
+    else
+    {
+        for (size_t i = 1; i < dimension_names.size(); ++i)
+        {
+            dims.push_back(i);
+        }
+    }
+
+    if (value.size() != dims.size())
     {
         *op_status = HYPERCLIENT_SERVERERROR;
         return false;
     }
 
-    size_t sz = sizeof(hyperclient_attribute) * dimension_names.size() + key_sz
+    size_t sz = sizeof(hyperclient_attribute) * (value.size() + 1) + key_sz
               + dimension_names[0].name.size() + 1;
 
     for (size_t i = 0; i < value.size(); ++i)
     {
-        sz += dimension_names[i + 1].name.size() + 1 + value[i].size();
+        if (dims[i] < 1 || dims[i] >= dimension_names.size())
+        {
+            *op_status = HYPERCLIENT_SERVERERROR;
+            return false;
+        }
+
+        sz += dimension_names[dims[i]].name.size() + 1 + value[i].size();
     }
 
     std::vector<hyperclient_attribute> ha;
-    ha.reserve(dimension_names.size());
+    ha.reserve(value.size() + 1);
     char* ret = static_cast<char*>(malloc(sz));
 
     if (!ret)
@@ -90,18 +111,22 @@ value_to_attributes(const hyperdex::configuration& config,
     for (size_t i = 0; i < value.size(); ++i)
     {
         ha.push_back(hyperclient_attribute());
-        size_t attr_sz = dimension_names[i + 1].name.size() + 1;
+        size_t attr_sz = dimension_names[dims[i]].name.size() + 1;
         ha.back().attr = data;
-        memmove(data, dimension_names[i + 1].name.c_str(), attr_sz);
+        memmove(data, dimension_names[dims[i]].name.c_str(), attr_sz);
         data += attr_sz;
         ha.back().value = data;
         memmove(data, value[i].data(), value[i].size());
         data += value[i].size();
         ha.back().value_sz = value[i].size();
-        ha.back().datatype = dimension_names[i + 1].type;
+        ha.back().datatype = dimension_names[dims[i]].type;
+    }
+
+    if (!ha.empty())
+    {
+        memmove(ret, &ha.front(), sizeof(hyperclient_attribute) * ha.size());
     }
 
-    memmove(ret, &ha.front(), sizeof(hyperclient_attribute) * ha.size());
     *op_status = HYPERCLIENT_SUCCESS;
     *attrs = reinterpret_cast<hyperclient_attribute*>(ret);
     *attrs_sz = ha.size();
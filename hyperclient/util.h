@@ -37,7 +37,8 @@
 #include "hyperclient/hyperclient.h"
 
 // Convert the key and value vector returned by entity to an array of
-// hyperclient_attribute using the given configuration.
+// hyperclient_attribute using the given configuration.  If "attrs" is given,
+// the value holds only those attributes, in that order.
 bool
 value_to_attributes(const hyperdex::configuration& config,
                     const hyperdex::entityid& entity,
@@ -47,7 +48,8 @@ value_to_attributes(const hyperdex::configuration& config,
                     hyperclient_returncode* loop_status,
                     hyperclient_returncode* op_status,
                     hyperclient_attribute** attrs,
-                    size_t* attrs_sz);
+                    size_t* attrs_sz,
+                    const std::vector<uint16_t>* projection = NULL);
 
 bool
 compare_for_microop_sort(const hyperdex::microop& lhs,
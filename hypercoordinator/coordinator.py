@@ -53,6 +53,7 @@ RESTRICTED_SPACES = set([0, 2**32 - 1, 2**32 - 2, 2**32 - 3, 2**32 - 4])
 # Format strings for configuration lines
 SPACE_LINE = 'space {name} {id} {dims}\n'
 SUBSPACE_LINE = 'subspace {space} {subspace} {hashes}\n'
+DISTRIBUTION_LINE = 'distribution {space} {attr} {bounds}\n'
 REGION_LINE = 'region {space} {subspace} {prefix} {mask} {hosts}\n'
 TRANSFER_LINE = 'transfer {xferid} {space} {subspace} {prefix} {mask} {instid}\n'
 HOST_LINE = 'host {id} {ip} {inport} {inver} {outport} {outver}'
@@ -396,17 +397,26 @@ class Coordinator(object):
             spacedims = ' '.join([d.name + ' ' + d.datatype for d in space.dimensions])
             config += SPACE_LINE \
                       .format(name=space.name, id=spaceid, dims=spacedims)
+            for attr, dim in enumerate(space.dimensions):
+                if dim.name in space.distributions:
+                    bounds = ' '.join([str(b) for b in space.distributions[dim.name]])
+                    config += DISTRIBUTION_LINE \
+                              .format(space=spaceid, attr=attr, bounds=bounds)
             for subspaceid, subspace in enumerate(space.subspaces):
                 hashes = []
                 for dim in space.dimensions:
+                    hashed = 'prefix' if dim.name in subspace.prefix else 'true'
                     if dim.name in subspace.dimensions:
-                        hashes.append('true')
+                        hashes.append(hashed)
                     else:
                         hashes.append('false')
                     if dim.name not in subspace.nosearch:
-                        hashes.append('true')
+                        hashes.append(hashed)
                     else:
                         hashes.append('false')
+                # CityHash is the default and is left implicit.
+                if subspace.hash != 'cityhash':
+                    hashes.append(subspace.hash)
                 config += SUBSPACE_LINE \
                           .format(space=spaceid, subspace=subspaceid,
                                   hashes=' '.join(hashes))
@@ -48,10 +48,12 @@ class Dimension(object):
 
 class Space(object):
 
-    def __init__(self, name, dimensions, subspaces):
+    def __init__(self, name, dimensions, subspaces, distributions=None):
         self._name = name
         self._dimensions = tuple(dimensions)
         self._subspaces = tuple(subspaces)
+        # Quantile bounds for skewed int64 dimensions, by dimension name.
+        self._distributions = dict(distributions or {})
 
     @property
     def name(self):
@@ -65,15 +67,22 @@ class Space(object):
     def subspaces(self):
         return self._subspaces
 
+    @property
+    def distributions(self):
+        return self._distributions
+
     def __repr__(self):
         return hdjson.Encoder().encode(self)
 
 class Subspace(object):
 
-    def __init__(self, dimensions, nosearch, regions):
+    def __init__(self, dimensions, nosearch, regions, prefix=(), hash='cityhash'):
         self._dimensions = tuple(dimensions)
         self._nosearch = tuple(nosearch)
         self._regions = tuple(regions)
+        self._prefix = tuple(prefix)
+        # The function equality-hashed dimensions are hashed with.
+        self._hash = hash
 
     @property
     def dimensions(self):
@@ -87,6 +96,14 @@ class Subspace(object):
     def regions(self):
         return self._regions
 
+    @property
+    def prefix(self):
+        return self._prefix
+
+    @property
+    def hash(self):
+        return self._hash
+
     def __repr__(self):
         return hdjson.Encoder().encode(self)
 
@@ -38,6 +38,8 @@ from hypercoordinator import hdtypes
 
 KEY_TYPES = ('string', 'int64')
 SEARCHABLE_TYPES = ('string', 'int64')
+# The most segments a distribution's transform will split a dimension into.
+DISTRIBUTION_SEGMENTS = 64
 
 
 def _encompases(outter, inner):
@@ -125,10 +127,28 @@ def parse_regions(regions):
     return regions
 
 
+def quantile_bounds(samples, segments=DISTRIBUTION_SEGMENTS):
+    '''Pick bounds splitting the sampled values into equally full segments.
+
+    Values are taken as the unsigned 64-bit integers range hashing reads, so
+    negative samples sort above positive ones.
+    '''
+    values = sorted([v & ((1 << 64) - 1) for v in samples])
+    segments = min(segments, len(values))
+    bounds = []
+    for i in range(1, segments):
+        bound = values[i * len(values) // segments]
+        if bound > 0 and (not bounds or bound > bounds[-1]):
+            bounds.append(bound)
+    return bounds
+
+
 def parse_subspace(subspace):
     return hdtypes.Subspace(dimensions=list(subspace[0]),
                     nosearch=list(subspace[1]),
-                    regions=list(subspace[2]))
+                    prefix=list(subspace[2]),
+                    hash=subspace[3],
+                    regions=list(subspace[4]))
 
 
 def parse_space(space):
@@ -143,16 +163,37 @@ def parse_space(space):
                 raise ValueError("Subspace dimension {0} must be one of its dimensions.".format(repr(dim)))
             if dims[dim] not in ('string', 'int64'):
                 raise ValueError("Subspace dimension {0} is not a searchable type.".format(repr(dim)))
+        for dim in set(subspace.prefix):
+            if dim not in subspace.dimensions:
+                raise ValueError("Prefix dimension {0} must be one of the subspace's dimensions.".format(repr(dim)))
+            if dim == space.key:
+                raise ValueError("The key may not be prefix hashed.")
+            if dims[dim] != 'string':
+                raise ValueError("Prefix dimension {0} is not a string.".format(repr(dim)))
         subspace._nosearch += nosearch
     if dims[space.key] not in KEY_TYPES:
         raise ValueError("Key must be a primitive datatype")
-    keysubspace = hdtypes.Subspace(dimensions=[space.key], nosearch=list(nosearch), regions=list(space.keyregions))
+    keysubspace = hdtypes.Subspace(dimensions=[space.key], nosearch=list(nosearch),
+                                   hash=space.keyhash, regions=list(space.keyregions))
     subspaces = [keysubspace] + list(space.subspaces)
-    return hdtypes.Space(space.name, space.dimensions, subspaces)
+    distributions = {}
+    for dist in space.distributions:
+        dim, samples = dist[0], list(dist[1])
+        if dim not in dims:
+            raise ValueError("Distribution dimension {0} must be one of its dimensions.".format(repr(dim)))
+        if dim == space.key or dims[dim] != 'int64':
+            raise ValueError("Distribution dimension {0} must be an int64 other than the key.".format(repr(dim)))
+        if dim in distributions:
+            raise ValueError("Distribution dimension {0} given twice.".format(repr(dim)))
+        bounds = quantile_bounds(samples)
+        if bounds:
+            distributions[dim] = bounds
+    return hdtypes.Space(space.name, space.dimensions, subspaces, distributions)
 
 
 identifier = Word(string.ascii_letters + string.digits + '_')
 integer = Word(string.digits).setParseAction(lambda t: int(t[0]))
+signed = Combine(Optional(Literal("-")) + Word(string.digits)).setParseAction(lambda t: int(t[0]))
 hexnum  = Combine(Literal("0x") + Word(string.hexdigits)).setParseAction(lambda t: int(t[0][2:], 16))
 LSTR = Literal("string")
 LINT = Literal("int64")
@@ -176,17 +217,26 @@ autoregion = Literal("auto") + integer + integer
 staticregion = Literal("region") + integer + hexnum + integer
 region = ZeroOrMore(Group(staticregion)) + Optional(Group(autoregion))
 region.setParseAction(parse_regions)
+hashfunc = Optional(Suppress(Literal("hash")) +
+                   (Literal("cityhash") | Literal("shorthash")), default="cityhash")
 subspace = Literal("subspace").suppress() + \
            Group(delimitedList(identifier)) + \
            Optional(Suppress(Literal("nosearch")) +
                    Group(delimitedList(identifier)), default=[]) + \
+           Optional(Suppress(Literal("prefix")) +
+                   Group(delimitedList(identifier)), default=[]) + \
+           hashfunc + \
            Group(region)
 subspace.setParseAction(parse_subspace)
+distribution = Literal("distribution").suppress() + identifier + \
+               Group(delimitedList(signed))
 space = Literal("space").suppress() + identifier.setResultsName("name") + \
         Literal("dimensions").suppress() + Group(delimitedList(dimension)).setResultsName("dimensions") + \
         Literal("key").suppress() + identifier.setResultsName("key") + \
+        hashfunc.setResultsName("keyhash") + \
         Group(region).setResultsName("keyregions") + \
-        ZeroOrMore(subspace).setResultsName("subspaces")
+        ZeroOrMore(subspace).setResultsName("subspaces") + \
+        Group(ZeroOrMore(Group(distribution))).setResultsName("distributions")
 space.setParseAction(parse_space)
 
 
@@ -326,7 +376,27 @@ class TestRegionParsing(unittest.TestCase):
         self.assertEqual(expected, returned)
 
 
+class TestQuantileBounds(unittest.TestCase):
+
+    def test_even(self):
+        self.assertEqual([25, 50, 75], quantile_bounds(range(100), 4))
+
+    def test_skewed(self):
+        samples = [1] * 50 + range(1000, 1050)
+        self.assertEqual([1, 1000, 1025], quantile_bounds(samples, 4))
+
+    def test_negative(self):
+        expected = [3, (1 << 64) - 2]
+        self.assertEqual(expected, quantile_bounds([-1, -2, -3, 1, 2, 3], 3))
+
+    def test_few_samples(self):
+        self.assertEqual([], quantile_bounds([], 4))
+        self.assertEqual([], quantile_bounds([7], 4))
+        self.assertEqual([9], quantile_bounds([7, 9], 4))
+
+
 if __name__ == '__main__':
     suite = unittest.TestLoader().loadTestsFromTestCase(TestFillToRegion)
     suite.addTest(unittest.TestLoader().loadTestsFromTestCase(TestRegionParsing))
+    suite.addTest(unittest.TestLoader().loadTestsFromTestCase(TestQuantileBounds))
     unittest.TextTestRunner(verbosity=2).run(suite)
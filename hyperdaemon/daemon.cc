@@ -55,6 +55,7 @@
 #include "hyperdaemon/ongoing_state_transfers.h"
 #include "hyperdaemon/replication_manager.h"
 #include "hyperdaemon/searches.h"
+#include "hyperdaemon/watches.h"
 
 // util
 #include <util/atomicfile.h>
@@ -187,15 +188,17 @@ hyperdaemon :: daemon(const char* progname,
     cl.set_announce(announce.str());
     // Setup the search component.
     searches ssss(&cl, &data, &comm);
+    // Setup the watch component.
+    watches wtch(&data, &comm);
     // Setup the recovery component.
     ongoing_state_transfers ost(&data, &comm, &cl);
     // Setup the replication component.
-    replication_manager repl(&cl, &data, &comm, &ost);
+    replication_manager repl(&cl, &data, &comm, &ost, &wtch);
     // Give the ongoing_state_transfers a view into the replication component
     ost.set_replication_manager(&repl);
     // Start the network workers.
     LOG(INFO) << "Starting network workers.";
-    network_worker nw(&data, &comm, &ssss, &ost, &repl);
+    network_worker nw(&data, &comm, &ssss, &ost, &repl, &wtch);
     std::tr1::function<void (network_worker*)> fnw(&network_worker::run);
     std::vector<thread_ptr> threads;
 
@@ -256,6 +259,7 @@ hyperdaemon :: daemon(const char* progname,
             repl.prepare(cl.config(), newinst);
             ost.prepare(cl.config(), newinst);
             ssss.prepare(cl.config(), newinst);
+            wtch.prepare(cl.config(), newinst);
 
             // Protect ourself against exceptions.
             e::guard g1 = e::makeobjguard(comm, &logical::unpause);
@@ -273,6 +277,7 @@ hyperdaemon :: daemon(const char* progname,
             repl.reconfigure(cl.config(), comm.inst());
             ost.reconfigure(cl.config(), comm.inst());
             ssss.reconfigure(cl.config(), comm.inst());
+            wtch.reconfigure(cl.config(), comm.inst());
             comm.unpause();
             g1.dismiss();
             g2.dismiss();
@@ -282,6 +287,7 @@ hyperdaemon :: daemon(const char* progname,
             // These operations should assume that there will be network
             // activity, and that the network threads will be in full force..
             ssss.prepare(cl.config(), comm.inst());
+            wtch.cleanup(cl.config(), comm.inst());
             ost.cleanup(cl.config(), comm.inst());
             repl.cleanup(cl.config(), comm.inst());
             data.cleanup(cl.config(), comm.inst());
@@ -294,6 +300,8 @@ hyperdaemon :: daemon(const char* progname,
 
     // Stop replication.
     repl.shutdown();
+    // Stop expiring searches.
+    ssss.shutdown();
     // Turn off the network.
     comm.shutdown();
     // Cleanup the network_worker threads.
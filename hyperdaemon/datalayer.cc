@@ -58,6 +58,10 @@
 // util
 #include <util/atomicfile.h>
 
+// HyperDisk
+#include "hyperdisk/hyperdisk/disk.h"
+#include "hyperdisk/hyperdisk/memory.h"
+
 // HyperDex
 #include "hyperdex/hyperdex/configuration.h"
 #include "hyperdex/hyperdex/coordinatorlink.h"
@@ -74,8 +78,7 @@ using hyperdex::configuration;
 using hyperdex::coordinatorlink;
 using hyperdex::configuration_parser;
 
-typedef e::intrusive_ptr<hyperdisk::disk> disk_ptr;
-typedef std::map<hyperdex::regionid, disk_ptr> disk_map_t;
+typedef e::intrusive_ptr<hyperdisk::engine> disk_ptr;
 
 const char* hyperdaemon :: datalayer :: STATE_FILE_NAME = "datalayer_state.hd";
 const int hyperdaemon :: datalayer :: STATE_FILE_VER = 1;
@@ -92,6 +95,15 @@ hyperdaemon :: datalayer :: datalayer(coordinatorlink* cl, const po6::pathname&
     , m_optimistic_rr()
     , m_last_dose_of_optimism(0)
     , m_flushed_recently(false)
+    , m_wal_bytes(0)
+    , m_dirty()
+    , m_flush_lock()
+    , m_flush_cond(&m_flush_lock)
+    , m_flushing()
+    , m_parked()
+    , m_optimism_rounds(0)
+    , m_flush_lag()
+    , m_last_flush_lag_report(0)
     , m_quiesce(false)
     , m_quiesce_state_id("")
 {
@@ -354,14 +366,16 @@ hyperdaemon :: datalayer :: cleanup(const configuration& newconfig, const instan
 void
 hyperdaemon :: datalayer :: shutdown()
 {
+    po6::threads::mutex::hold hold(&m_flush_lock);
     m_shutdown = true;
+    m_flush_cond.broadcast();
 }
 
 e::intrusive_ptr<hyperdisk::snapshot>
 hyperdaemon :: datalayer :: make_snapshot(const regionid& ri,
                                           const hyperspacehashing::search& terms)
 {
-    e::intrusive_ptr<hyperdisk::disk> r;
+    disk_ptr r;
 
     if (!m_disks.lookup(ri, &r))
     {
@@ -371,10 +385,41 @@ hyperdaemon :: datalayer :: make_snapshot(const regionid& ri,
     return r->make_snapshot(terms);
 }
 
+e::intrusive_ptr<hyperdisk::snapshot>
+hyperdaemon :: datalayer :: make_ordered_snapshot(const regionid& ri,
+                                                  const hyperspacehashing::search& terms,
+                                                  bool descending)
+{
+    disk_ptr r;
+
+    if (!m_disks.lookup(ri, &r))
+    {
+        return e::intrusive_ptr<hyperdisk::snapshot>();
+    }
+
+    return r->make_ordered_snapshot(terms, descending);
+}
+
+bool
+hyperdaemon :: datalayer :: make_partitioned_snapshot(const regionid& ri,
+                                                      const hyperspacehashing::search& terms,
+                                                      std::vector<e::intrusive_ptr<hyperdisk::snapshot> >* parts)
+{
+    disk_ptr r;
+
+    if (!m_disks.lookup(ri, &r))
+    {
+        return false;
+    }
+
+    r->make_partitioned_snapshot(terms, parts);
+    return true;
+}
+
 e::intrusive_ptr<hyperdisk::rolling_snapshot>
 hyperdaemon :: datalayer :: make_rolling_snapshot(const regionid& ri)
 {
-    e::intrusive_ptr<hyperdisk::disk> r;
+    disk_ptr r;
 
     if (!m_disks.lookup(ri, &r))
     {
@@ -391,7 +436,7 @@ hyperdaemon :: datalayer :: get(const regionid& ri,
                                 uint64_t* version,
                                 hyperdisk::reference* ref)
 {
-    e::intrusive_ptr<hyperdisk::disk> r;
+    disk_ptr r;
 
     if (!m_disks.lookup(ri, &r))
     {
@@ -401,6 +446,24 @@ hyperdaemon :: datalayer :: get(const regionid& ri,
     return r->get(key, value, version, ref);
 }
 
+hyperdisk::returncode
+hyperdaemon :: datalayer :: get_at(const regionid& ri,
+                                   const e::slice& key,
+                                   uint64_t at,
+                                   std::vector<e::slice>* value,
+                                   uint64_t* version,
+                                   hyperdisk::reference* ref)
+{
+    disk_ptr r;
+
+    if (!m_disks.lookup(ri, &r))
+    {
+        return hyperdisk::MISSINGDISK;
+    }
+
+    return r->get_at(key, at, value, version, ref);
+}
+
 hyperdisk::returncode
 hyperdaemon :: datalayer :: put(const regionid& ri,
                                 std::tr1::shared_ptr<e::buffer> backing,
@@ -408,29 +471,44 @@ hyperdaemon :: datalayer :: put(const regionid& ri,
                                 const std::vector<e::slice>& value,
                                 uint64_t version)
 {
-    e::intrusive_ptr<hyperdisk::disk> r;
+    disk_ptr r;
 
     if (!m_disks.lookup(ri, &r))
     {
         return hyperdisk::MISSINGDISK;
     }
 
-    return r->put(backing, key, value, version);
+    hyperdisk::returncode ret = r->put(backing, key, value, version);
+
+    if (ret == hyperdisk::SUCCESS)
+    {
+        mark_dirty(ri);
+    }
+
+    return ret;
 }
 
 hyperdisk::returncode
 hyperdaemon :: datalayer :: del(const regionid& ri,
                                 std::tr1::shared_ptr<e::buffer> backing,
-                                const e::slice& key)
+                                const e::slice& key,
+                                uint64_t version)
 {
-    e::intrusive_ptr<hyperdisk::disk> r;
+    disk_ptr r;
 
     if (!m_disks.lookup(ri, &r))
     {
         return hyperdisk::MISSINGDISK;
     }
 
-    return r->del(backing, key);
+    hyperdisk::returncode ret = r->del(backing, key, version);
+
+    if (ret == hyperdisk::SUCCESS)
+    {
+        mark_dirty(ri);
+    }
+
+    return ret;
 }
 
 hyperdisk::returncode
@@ -438,7 +516,7 @@ hyperdaemon :: datalayer :: flush(const regionid& ri,
                                   size_t n,
                                   bool nonblocking)
 {
-    e::intrusive_ptr<hyperdisk::disk> r;
+    disk_ptr r;
 
     if (!m_disks.lookup(ri, &r))
     {
@@ -451,7 +529,7 @@ hyperdaemon :: datalayer :: flush(const regionid& ri,
 hyperdisk::returncode
 hyperdaemon :: datalayer :: do_mandatory_io(const regionid& ri)
 {
-    e::intrusive_ptr<hyperdisk::disk> r;
+    disk_ptr r;
 
     if (!m_disks.lookup(ri, &r))
     {
@@ -461,8 +539,40 @@ hyperdaemon :: datalayer :: do_mandatory_io(const regionid& ri)
     return r->do_mandatory_io();
 }
 
-typedef std::map<hyperdex::regionid, e::intrusive_ptr<hyperdisk::disk> > disk_map_t;
-typedef std::queue<hyperdex::regionid> disk_queue_t;
+hyperdisk::returncode
+hyperdaemon :: datalayer :: admit_write(const regionid& ri)
+{
+    disk_ptr r;
+
+    if (!m_disks.lookup(ri, &r))
+    {
+        return hyperdisk::MISSINGDISK;
+    }
+
+    uint64_t region_bytes = r->wal_bytes();
+    uint64_t daemon_bytes = m_wal_bytes;
+
+    if (region_bytes >= WAL_HARD_LIMIT || daemon_bytes >= DAEMON_WAL_HARD_LIMIT)
+    {
+        return hyperdisk::WALFULL;
+    }
+
+    // A region claimed by a flush thread is already being drained.
+    if ((region_bytes >= WAL_SOFT_LIMIT || daemon_bytes >= DAEMON_WAL_SOFT_LIMIT) &&
+        claim_region(ri))
+    {
+        hyperdisk::returncode ret = r->flush(1000, true);
+
+        if (ret == hyperdisk::DATAFULL || ret == hyperdisk::SEARCHFULL)
+        {
+            r->do_mandatory_io();
+        }
+
+        release_region(ri);
+    }
+
+    return hyperdisk::SUCCESS;
+}
 
 void
 hyperdaemon :: datalayer :: optimistic_io_thread()
@@ -496,7 +606,7 @@ hyperdaemon :: datalayer :: optimistic_io_thread()
         {
             for (size_t i = 0; i < m_preallocate_rr.size(); ++i)
             {
-                e::intrusive_ptr<hyperdisk::disk> d;
+                disk_ptr d;
 
                 if (m_disks.lookup(m_preallocate_rr.front(), &d))
                 {
@@ -522,24 +632,27 @@ hyperdaemon :: datalayer :: optimistic_io_thread()
             m_last_preallocation = e::time();
         }
 
-        // We rate-limit the number of optimistic splits we do each second.
+        // Each burst lets every disk sample how quickly its shards are filling
+        // and split those that will soon be full.
         uint64_t nanos_since_last_optimism = e::time() - m_last_dose_of_optimism;
         uint64_t optimism_interval = 1000000000. / OPTIMISM_BURSTS_PER_SECOND;
 
         if (nanos_since_last_optimism / optimism_interval >= 1)
         {
-            for (size_t i = 0; i < m_optimistic_rr.size(); ++i)
+            size_t regions = m_optimistic_rr.size();
+
+            for (size_t i = 0; i < regions; ++i)
             {
-                e::intrusive_ptr<hyperdisk::disk> d;
+                disk_ptr d;
 
                 if (m_disks.lookup(m_optimistic_rr.front(), &d))
                 {
                     m_optimistic_rr.push_back(m_optimistic_rr.front());
                     hyperdisk::returncode ret = d->do_optimistic_io();
+                    unpark_region(m_optimistic_rr.front());
 
                     if (ret == hyperdisk::SUCCESS)
                     {
-                        break;
                     }
                     else if (ret == hyperdisk::DIDNOTHING)
                     {
@@ -556,11 +669,18 @@ hyperdaemon :: datalayer :: optimistic_io_thread()
             m_last_dose_of_optimism = e::time();
         }
 
+        if (e::time() - m_last_flush_lag_report >= FLUSH_LAG_REPORT_INTERVAL * 1000000000ULL)
+        {
+            report_flush_lag();
+            m_last_flush_lag_report = e::time();
+        }
+
         (void) __sync_and_and_fetch(&m_flushed_recently, false);
 
         do
         {
             e::sleep_ms(0, 10);
+            refresh_wal_bytes();
         } while (!m_shutdown && !__sync_and_and_fetch(&m_flushed_recently, true));
     }
 }
@@ -570,46 +690,261 @@ hyperdaemon :: datalayer :: flush_thread()
 {
     LOG(WARNING) << "Started data-flush thread.";
 
-    while (!m_shutdown)
+    while (true)
     {
-        bool sleep = true;
+        regionid ri;
+        uint64_t since = 0;
 
-        for (disk_map_t::iterator d = m_disks.begin();
-                d != m_disks.end(); d.next())
         {
-            hyperdisk::returncode ret = d.value()->flush(10000, true);
+            po6::threads::mutex::hold hold(&m_flush_lock);
 
-            if (ret == hyperdisk::SUCCESS)
+            while (!m_shutdown && !claim_dirty(&ri, &since))
             {
-                sleep = false;
+                m_flush_cond.wait();
             }
-            else if (ret == hyperdisk::DIDNOTHING)
+
+            if (m_shutdown)
             {
+                break;
             }
-            else if (ret == hyperdisk::DATAFULL || ret == hyperdisk::SEARCHFULL)
-            {
-                hyperdisk::returncode ioret;
-                ioret = d.value()->do_mandatory_io();
+        }
 
-                if (ioret != hyperdisk::SUCCESS && ioret != hyperdisk::DIDNOTHING)
-                {
-                    PLOG(ERROR) << "Disk I/O returned " << ioret;
-                }
-            }
-            else
+        flush_region(ri, since);
+        release_region(ri);
+    }
+}
+
+void
+hyperdaemon :: datalayer :: refresh_wal_bytes()
+{
+    uint64_t wal_bytes = 0;
+
+    for (disk_map_t::iterator d = m_disks.begin();
+            d != m_disks.end(); d.next())
+    {
+        wal_bytes += d.value()->wal_bytes();
+    }
+
+    m_wal_bytes = wal_bytes;
+}
+
+void
+hyperdaemon :: datalayer :: report_flush_lag()
+{
+    if (m_flush_lag.count() > 0)
+    {
+        LOG(INFO) << "Flush lag over " << m_flush_lag.count() << " flushes (us):"
+                  << " p50=" << m_flush_lag.percentile(0.50)
+                  << " p90=" << m_flush_lag.percentile(0.90)
+                  << " p99=" << m_flush_lag.percentile(0.99)
+                  << " p999=" << m_flush_lag.percentile(0.999);
+    }
+
+    m_flush_lag.reset();
+}
+
+void
+hyperdaemon :: datalayer :: mark_dirty(const regionid& ri, uint64_t since)
+{
+    // The common case is a write to a region that is already dirty, which
+    // costs a single lookup.  Only the clean-to-dirty transition pays for the
+    // lock and the wakeup.
+    if (m_dirty.contains(ri))
+    {
+        return;
+    }
+
+    if (m_dirty.insert(ri, since == 0 ? e::time() : since))
+    {
+        po6::threads::mutex::hold hold(&m_flush_lock);
+        m_flush_cond.signal();
+    }
+}
+
+bool
+hyperdaemon :: datalayer :: claim_dirty(regionid* ri, uint64_t* since)
+{
+    uint64_t now = e::time();
+    uint64_t max_delay = FLUSH_MAX_DELAY * 1000ULL;
+    bool found = false;
+    bool overdue = false;
+    uint64_t best_since = 0;
+    uint64_t best_bytes = 0;
+
+    // Regions that have waited longer than the maximum delay go first, oldest
+    // first, so that a busy region cannot starve the others.  Otherwise the
+    // region with the deepest log goes first, as it pins the most memory.
+    for (dirty_map_t::iterator d = m_dirty.begin(); d != m_dirty.end(); d.next())
+    {
+        disk_ptr disk;
+
+        if (m_flushing.find(d.key()) != m_flushing.end() ||
+            !m_disks.lookup(d.key(), &disk))
+        {
+            continue;
+        }
+
+        bool this_overdue = now - d.value() >= max_delay;
+        uint64_t this_bytes = disk->wal_bytes();
+
+        if (!found ||
+            (this_overdue && !overdue) ||
+            (this_overdue && overdue && d.value() < best_since) ||
+            (!this_overdue && !overdue && this_bytes > best_bytes))
+        {
+            found = true;
+            overdue = this_overdue;
+            best_since = d.value();
+            best_bytes = this_bytes;
+            *ri = d.key();
+        }
+    }
+
+    if (!found)
+    {
+        // Forget regions whose disks have gone away.
+        for (dirty_map_t::iterator d = m_dirty.begin(); d != m_dirty.end(); d.next())
+        {
+            if (!m_disks.contains(d.key()))
             {
-                PLOG(ERROR) << "Disk flush returned " << ret;
+                m_dirty.remove(d.key());
             }
         }
 
-        if (sleep)
+        return false;
+    }
+
+    *since = best_since;
+
+    if (!m_dirty.remove(*ri))
+    {
+        return false;
+    }
+
+    m_flushing.insert(*ri);
+    return true;
+}
+
+bool
+hyperdaemon :: datalayer :: claim_region(const regionid& ri)
+{
+    po6::threads::mutex::hold hold(&m_flush_lock);
+    return m_flushing.insert(ri).second;
+}
+
+void
+hyperdaemon :: datalayer :: park_region(const regionid& ri, uint64_t since, uint64_t round)
+{
+    {
+        po6::threads::mutex::hold hold(&m_flush_lock);
+
+        // Otherwise the pass which installs the split has yet to finish, and
+        // will unpark the region when it does.
+        if (round == m_optimism_rounds)
         {
-            e::sleep_ms(0, 10);
+            m_parked.insert(std::make_pair(ri, since));
+            return;
         }
-        else
+    }
+
+    mark_dirty(ri, since);
+}
+
+void
+hyperdaemon :: datalayer :: unpark_region(const regionid& ri)
+{
+    uint64_t since = 0;
+
+    {
+        po6::threads::mutex::hold hold(&m_flush_lock);
+        ++m_optimism_rounds;
+        std::map<regionid, uint64_t>::iterator p = m_parked.find(ri);
+
+        if (p == m_parked.end())
+        {
+            return;
+        }
+
+        since = p->second;
+        m_parked.erase(p);
+    }
+
+    mark_dirty(ri, since);
+}
+
+void
+hyperdaemon :: datalayer :: release_region(const regionid& ri)
+{
+    po6::threads::mutex::hold hold(&m_flush_lock);
+    m_flushing.erase(ri);
+
+    if (m_dirty.contains(ri))
+    {
+        m_flush_cond.signal();
+    }
+}
+
+void
+hyperdaemon :: datalayer :: flush_region(const regionid& ri, uint64_t since)
+{
+    disk_ptr d;
+
+    if (!m_disks.lookup(ri, &d))
+    {
+        return;
+    }
+
+    uint64_t round;
+
+    {
+        po6::threads::mutex::hold hold(&m_flush_lock);
+        round = m_optimism_rounds;
+    }
+
+    m_flush_lag.add((e::time() - since) / 1000);
+    // No other flush thread, nor admit_write, flushes a region while this
+    // thread holds its claim, so blocking here stalls only this region.  The
+    // disk serializes the flush with the optimistic-I/O thread, which holds
+    // the disk's mutate lock only to clean a shard or install a split.
+    hyperdisk::returncode ret = d->flush(10000, false);
+
+    if (ret == hyperdisk::SUCCESS)
+    {
+        (void) __sync_or_and_fetch(&m_flushed_recently, true);
+    }
+    else if (ret == hyperdisk::DIDNOTHING)
+    {
+    }
+    else if (ret == hyperdisk::SPLITTING)
+    {
+        park_region(ri, since, round);
+        return;
+    }
+    else if (ret == hyperdisk::DATAFULL || ret == hyperdisk::SEARCHFULL)
+    {
+        hyperdisk::returncode ioret;
+        ioret = d->do_mandatory_io();
+
+        if (ioret == hyperdisk::SPLITTING)
         {
-            (void) __sync_or_and_fetch(&m_flushed_recently, true);
+            park_region(ri, since, round);
+            return;
         }
+        else if (ioret != hyperdisk::SUCCESS && ioret != hyperdisk::DIDNOTHING)
+        {
+            PLOG(ERROR) << "Disk I/O returned " << ioret;
+        }
+    }
+    else
+    {
+        PLOG(ERROR) << "Disk flush returned " << ret;
+    }
+
+    // Anything left in the log keeps the region dirty.  It keeps its original
+    // age so that it is not pushed behind regions that became dirty later.
+    if (d->wal_bytes() > 0)
+    {
+        mark_dirty(ri, since);
     }
 }
 
@@ -625,7 +960,14 @@ hyperdaemon :: datalayer :: create_disk(const regionid& ri,
 
     try
     {
-        d = hyperdisk::disk::create(path, hasher, num_columns);
+        if (MEMORY_ENGINE)
+        {
+            d = hyperdisk::memory::create(hasher, num_columns).get();
+        }
+        else
+        {
+            d = hyperdisk::disk::create(path, hasher, num_columns).get();
+        }
     }
     catch (po6::error& e)
     {
@@ -634,6 +976,8 @@ hyperdaemon :: datalayer :: create_disk(const regionid& ri,
         return;
     }
 
+    d->retain_history(OBJECT_HISTORY_VERSIONS);
+
     if (m_disks.insert(ri, d))
     {
         LOG(INFO) << "Created disk " << ri << " with " << num_columns << " columns";
@@ -655,9 +999,17 @@ hyperdaemon :: datalayer :: open_disk(const regionid& ri,
     po6::pathname path(ostr.str());
     disk_ptr d;
 
+    if (MEMORY_ENGINE)
+    {
+        LOG(WARNING) << "The in-memory engine cannot reopen quiesced disk " << ri
+                     << "; starting it empty";
+        create_disk(ri, hasher, num_columns);
+        return;
+    }
+
     try
     {
-        d = hyperdisk::disk::open(path, hasher, num_columns, quiesce_state_id);
+        d = hyperdisk::disk::open(path, hasher, num_columns, quiesce_state_id).get();
         if (!d)
         {
             // XXX fail this region.
@@ -672,6 +1024,8 @@ hyperdaemon :: datalayer :: open_disk(const regionid& ri,
         return;
     }
 
+    d->retain_history(OBJECT_HISTORY_VERSIONS);
+
     if (m_disks.insert(ri, d))
     {
         LOG(INFO) << "Opened disk " << ri << " with " << num_columns << " columns";
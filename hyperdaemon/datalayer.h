@@ -36,6 +36,9 @@
 #include <vector>
 
 // po6
+#include <po6/pathname.h>
+#include <po6/threads/cond.h>
+#include <po6/threads/mutex.h>
 #include <po6/threads/rwlock.h>
 #include <po6/threads/thread.h>
 
@@ -44,12 +47,15 @@
 #include <e/lockfree_hash_map.h>
 
 // HyperDisk
-#include "hyperdisk/hyperdisk/disk.h"
+#include "hyperdisk/hyperdisk/engine.h"
 #include "hyperdisk/hyperdisk/returncode.h"
 
 // HyperDex
 #include "hyperdex/hyperdex/ids.h"
 
+// HyperDaemon
+#include "hyperdaemon/histogram.h"
+
 // Forward Declarations
 namespace hyperdex
 {
@@ -75,6 +81,13 @@ class datalayer
         void shutdown();
         e::intrusive_ptr<hyperdisk::snapshot> make_snapshot(const hyperdex::regionid& ri,
                                                             const hyperspacehashing::search& terms);
+        e::intrusive_ptr<hyperdisk::snapshot> make_ordered_snapshot(const hyperdex::regionid& ri,
+                                                                    const hyperspacehashing::search& terms,
+                                                                    bool descending);
+        // Returns false if the region does not exist.
+        bool make_partitioned_snapshot(const hyperdex::regionid& ri,
+                                       const hyperspacehashing::search& terms,
+                                       std::vector<e::intrusive_ptr<hyperdisk::snapshot> >* parts);
         e::intrusive_ptr<hyperdisk::rolling_snapshot> make_rolling_snapshot(const hyperdex::regionid& ri);
 
     // Key-Value store operations.
@@ -83,6 +96,11 @@ class datalayer
         hyperdisk::returncode get(const hyperdex::regionid& ri, const e::slice& key,
                                   std::vector<e::slice>* value, uint64_t* version,
                                   hyperdisk::reference* ref);
+        // Get the object as of version "at".  See hyperdisk::engine::get_at.
+        // May return SUCCESS, NOTFOUND or MISSINGDISK.
+        hyperdisk::returncode get_at(const hyperdex::regionid& ri, const e::slice& key,
+                                     uint64_t at, std::vector<e::slice>* value,
+                                     uint64_t* version, hyperdisk::reference* ref);
         // May return SUCCESS, WRONGARITY or MISSINGDISK.
         hyperdisk::returncode put(const hyperdex::regionid& ri,
                                   std::tr1::shared_ptr<e::buffer> backing,
@@ -92,15 +110,39 @@ class datalayer
         // May return SUCCESS or MISSINGDISK.
         hyperdisk::returncode del(const hyperdex::regionid& ri,
                                   std::tr1::shared_ptr<e::buffer> backing,
-                                  const e::slice& key);
+                                  const e::slice& key,
+                                  uint64_t version);
         // May return SUCCESS or DIDNOTHING.
         hyperdisk::returncode flush(const hyperdex::regionid& ri, size_t n, bool nonblocking);
         hyperdisk::returncode do_mandatory_io(const hyperdex::regionid& ri);
 
+    // Write-ahead log backpressure.
+    public:
+        // Decide whether a new client write to ri may proceed.  Above the soft
+        // limits the caller flushes part of the region's log itself, which
+        // slows it down in proportion to the backlog.  Above the hard limits
+        // the write must be rejected.
+        // May return SUCCESS, WALFULL or MISSINGDISK.
+        hyperdisk::returncode admit_write(const hyperdex::regionid& ri);
+        // Bytes pinned by un-flushed writes across all regions.  This is
+        // recomputed periodically, so it may lag slightly.
+        uint64_t wal_bytes() const { return m_wal_bytes; }
+
+    // Flush scheduling.
+    public:
+        // The delay (in microseconds) between a region becoming dirty and a
+        // flush thread picking it up, at percentile p (in [0, 1]) of the
+        // flushes since the last report.
+        uint64_t flush_lag(double p) const { return m_flush_lag.percentile(p); }
+
     private:
         static uint64_t regionid_hash(const hyperdex::regionid& r) { return r.hash(); }
-        typedef e::lockfree_hash_map<hyperdex::regionid, e::intrusive_ptr<hyperdisk::disk>, regionid_hash>
+        typedef e::lockfree_hash_map<hyperdex::regionid, e::intrusive_ptr<hyperdisk::engine>, regionid_hash>
                 disk_map_t;
+        // Regions with un-flushed writes, mapped to the time (from e::time())
+        // at which they became dirty.
+        typedef e::lockfree_hash_map<hyperdex::regionid, uint64_t, regionid_hash>
+                dirty_map_t;
 
     private:
         datalayer(const datalayer&);
@@ -108,6 +150,26 @@ class datalayer
     private:
         void optimistic_io_thread();
         void flush_thread();
+        void refresh_wal_bytes();
+        void report_flush_lag();
+        // Record that ri has un-flushed writes, and wake a flush thread if it
+        // was previously clean.  A "since" of 0 means now.
+        void mark_dirty(const hyperdex::regionid& ri, uint64_t since = 0);
+        // Pick the dirty region that most needs flushing, remove it from the
+        // dirty set, and claim it.  Regions claimed by another thread are
+        // skipped.  Must be called with m_flush_lock held.
+        bool claim_dirty(hyperdex::regionid* ri, uint64_t* since);
+        // Claim ri for flushing outside the flush threads, failing if another
+        // thread holds the claim.
+        bool claim_region(const hyperdex::regionid& ri);
+        // Drop the claim on ri and wake a flush thread if it is dirty again.
+        void release_region(const hyperdex::regionid& ri);
+        // Hold back a region whose log waits for a split until
+        // unpark_region, unless the split finished since "round".
+        void park_region(const hyperdex::regionid& ri, uint64_t since, uint64_t round);
+        // Called after ri's optimistic I/O, which installs its splits.
+        void unpark_region(const hyperdex::regionid& ri);
+        void flush_region(const hyperdex::regionid& ri, uint64_t since);
         // Create a blank disk.
         void create_disk(const hyperdex::regionid& ri,
                          const hyperspacehashing::mask::hasher& hasher,
@@ -134,6 +196,19 @@ class datalayer
         std::list<hyperdex::regionid> m_optimistic_rr;
         uint64_t m_last_dose_of_optimism;
         volatile bool m_flushed_recently;
+        volatile uint64_t m_wal_bytes;
+        dirty_map_t m_dirty;
+        po6::threads::mutex m_flush_lock;
+        // Regions being flushed.  Protected by m_flush_lock.
+        std::set<hyperdex::regionid> m_flushing;
+        // Regions whose logs wait for a split, with the time they became
+        // dirty, and the number of optimistic-I/O passes completed.
+        // Protected by m_flush_lock.
+        std::map<hyperdex::regionid, uint64_t> m_parked;
+        uint64_t m_optimism_rounds;
+        po6::threads::cond m_flush_cond;
+        histogram m_flush_lag;
+        uint64_t m_last_flush_lag_report;
 
     private:
         // Shutdown and restart.
@@ -0,0 +1,94 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#define __STDC_LIMIT_MACROS
+
+// HyperDaemon
+#include "hyperdaemon/histogram.h"
+
+hyperdaemon :: histogram :: histogram()
+{
+    reset();
+}
+
+hyperdaemon :: histogram :: ~histogram() throw ()
+{
+}
+
+void
+hyperdaemon :: histogram :: add(uint64_t value)
+{
+    unsigned bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+    __sync_add_and_fetch(&m_buckets[bucket], 1);
+}
+
+uint64_t
+hyperdaemon :: histogram :: count() const
+{
+    uint64_t total = 0;
+
+    for (unsigned i = 0; i < BUCKETS; ++i)
+    {
+        total += m_buckets[i];
+    }
+
+    return total;
+}
+
+uint64_t
+hyperdaemon :: histogram :: percentile(double p) const
+{
+    uint64_t total = count();
+    uint64_t seen = 0;
+
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    for (unsigned i = 0; i < BUCKETS; ++i)
+    {
+        seen += m_buckets[i];
+
+        if (seen >= p * total)
+        {
+            return i == 0 ? 0 : (i == 64 ? UINT64_MAX : (1ULL << i) - 1);
+        }
+    }
+
+    return UINT64_MAX;
+}
+
+void
+hyperdaemon :: histogram :: reset()
+{
+    for (unsigned i = 0; i < BUCKETS; ++i)
+    {
+        m_buckets[i] = 0;
+    }
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef hyperdaemon_histogram_h_
+#define hyperdaemon_histogram_h_
+
+// C
+#include <stdint.h>
+
+namespace hyperdaemon
+{
+
+// A lock-free histogram with power-of-two buckets.  It is meant for latencies,
+// where knowing the order of magnitude of a percentile is enough.  Bucket i
+// holds the samples whose highest set bit is bit i - 1, so percentiles are
+// reported as the upper bound of a bucket.
+
+class histogram
+{
+    public:
+        histogram();
+        ~histogram() throw ();
+
+    public:
+        // Record one sample.  Safe to call from any number of threads.
+        void add(uint64_t value);
+        // The number of samples recorded since the last reset.
+        uint64_t count() const;
+        // An upper bound on the value below which a fraction p (in [0, 1]) of
+        // the samples fall.  Concurrent add()s may or may not be reflected.
+        uint64_t percentile(double p) const;
+        void reset();
+
+    private:
+        static const unsigned BUCKETS = 65;
+
+    private:
+        histogram(const histogram&);
+
+    private:
+        histogram& operator = (const histogram&);
+
+    private:
+        uint64_t m_buckets[BUCKETS];
+};
+
+} // namespace hyperdaemon
+
+#endif // hyperdaemon_histogram_h_
@@ -51,6 +51,7 @@
 #include "hyperdaemon/ongoing_state_transfers.h"
 #include "hyperdaemon/replication_manager.h"
 #include "hyperdaemon/searches.h"
+#include "hyperdaemon/watches.h"
 
 using hyperdex::entityid;
 using hyperdex::network_msgtype;
@@ -60,13 +61,15 @@ hyperdaemon :: network_worker :: network_worker(datalayer* data,
                                                 logical* comm,
                                                 searches* ssss,
                                                 ongoing_state_transfers* ost,
-                                                replication_manager* repl)
+                                                replication_manager* repl,
+                                                watches* wtch)
     : m_continue(true)
     , m_data(data)
     , m_comm(comm)
     , m_ssss(ssss)
     , m_ost(ost)
     , m_repl(repl)
+    , m_watches(wtch)
 {
 }
 
@@ -107,13 +110,27 @@ hyperdaemon :: network_worker :: run()
         e::buffer::unpacker up = msg->unpack_from(m_comm->header_size());
         uint64_t nonce;
 
-        if (type == hyperdex::REQ_GET)
+        if (type == hyperdex::REQ_GET || type == hyperdex::REQ_GET_AT ||
+            type == hyperdex::REQ_GET_PARTIAL)
         {
             e::slice key;
+            uint64_t at = 0;
+            std::vector<uint16_t> attrs;
+            up = up >> nonce >> key;
 
-            if ((up >> nonce >> key).error())
+            if (type == hyperdex::REQ_GET_AT)
             {
-                LOG(WARNING) << "unpack of REQ_GET failed; here's some hex:  " << msg->hex();
+                up = up >> at;
+            }
+
+            if (type == hyperdex::REQ_GET_PARTIAL)
+            {
+                up = up >> attrs;
+            }
+
+            if (up.error())
+            {
+                LOG(WARNING) << "unpack of " << type << " failed; here's some hex:  " << msg->hex();
                 continue;
             }
 
@@ -121,8 +138,18 @@ hyperdaemon :: network_worker :: run()
             uint64_t version;
             hyperdisk::reference ref;
             network_returncode result;
+            hyperdisk::returncode rc;
+
+            if (type != hyperdex::REQ_GET_AT)
+            {
+                rc = m_data->get(to.get_region(), key, &value, &version, &ref);
+            }
+            else
+            {
+                rc = m_data->get_at(to.get_region(), key, at, &value, &version, &ref);
+            }
 
-            switch (m_data->get(to.get_region(), key, &value, &version, &ref))
+            switch (rc)
             {
                 case hyperdisk::SUCCESS:
                     result = hyperdex::NET_SUCCESS;
@@ -143,17 +170,43 @@ hyperdaemon :: network_worker :: run()
                 case hyperdisk::DROPFAILED:
                 case hyperdisk::SPLITFAILED:
                 case hyperdisk::DIDNOTHING:
+                case hyperdisk::WALFULL:
+                case hyperdisk::SPLITTING:
                 default:
                     LOG(ERROR) << "GET returned unacceptable error code.";
                     result = hyperdex::NET_SERVERERROR;
                     break;
             }
 
+            // A REQ_GET_PARTIAL ships only the attributes it names.
+            if (type == hyperdex::REQ_GET_PARTIAL && result == hyperdex::NET_SUCCESS)
+            {
+                std::vector<e::slice> projected;
+
+                if (hyperdex::project(value, attrs, &projected))
+                {
+                    value.swap(projected);
+                }
+                else
+                {
+                    result = hyperdex::NET_BADDIMSPEC;
+                }
+            }
+
+            // A REQ_GET_AT is also told which version it got, so that the
+            // client may walk back through the object's history.
             size_t sz = m_comm->header_size() + sizeof(uint64_t)
-                      + sizeof(uint16_t) + hyperdex::packspace(value);
+                      + sizeof(uint16_t) + hyperdex::packspace(value)
+                      + (type == hyperdex::REQ_GET_AT ? sizeof(uint64_t) : 0);
             msg.reset(e::buffer::create(sz));
             e::buffer::packer pa = msg->pack_at(m_comm->header_size());
             pa = pa << nonce << static_cast<uint16_t>(result) << value;
+
+            if (type == hyperdex::REQ_GET_AT)
+            {
+                pa = pa << (result == hyperdex::NET_SUCCESS ? version : 0);
+            }
+
             assert(!pa.error());
             m_comm->send(to, from, hyperdex::RESP_GET, msg);
         }
@@ -255,8 +308,26 @@ hyperdaemon :: network_worker :: run()
         {
             uint64_t searchid;
             hyperspacehashing::search s(0);
+            e::buffer::unpacker sup = up >> nonce >> searchid >> s;
+            // Clients that predate batching stop after the search.
+            uint32_t batch_items = 0;
+            uint64_t batch_bytes = 0;
+            // The batch limits may be followed by the attributes to return.
+            bool partial = false;
+            std::vector<uint16_t> attrs;
+
+            if (!sup.error() && sup.remain() > 0)
+            {
+                sup = sup >> batch_items >> batch_bytes;
+            }
+
+            if (!sup.error() && sup.remain() > 0)
+            {
+                sup = sup >> attrs;
+                partial = true;
+            }
 
-            if ((up >> nonce >> searchid >> s).error())
+            if (sup.error())
             {
                 LOG(WARNING) << "unpack of REQ_SEARCH_START failed; here's some hex:  " << msg->hex();
                 continue;
@@ -264,13 +335,36 @@ hyperdaemon :: network_worker :: run()
 
             if (s.sanity_check())
             {
-                m_ssss->start(to, from, searchid, nonce, msg, s);
+                m_ssss->start(to, from, searchid, nonce, msg, s, batch_items, batch_bytes,
+                              partial ? &attrs : NULL);
             }
             else
             {
                 LOG(INFO) << "Dropping search which fails sanity_check.";
             }
         }
+        else if (type == hyperdex::REQ_SCAN_START)
+        {
+            uint64_t searchid;
+            hyperspacehashing::search s(0);
+            uint64_t limit;
+            uint8_t descending;
+
+            if ((up >> nonce >> searchid >> s >> limit >> descending).error())
+            {
+                LOG(WARNING) << "unpack of REQ_SCAN_START failed; here's some hex:  " << msg->hex();
+                continue;
+            }
+
+            if (s.sanity_check())
+            {
+                m_ssss->scan(to, from, searchid, nonce, msg, s, limit, descending != 0);
+            }
+            else
+            {
+                LOG(INFO) << "Dropping scan which fails sanity_check.";
+            }
+        }
         else if (type == hyperdex::REQ_SEARCH_NEXT)
         {
             uint64_t searchid;
@@ -283,73 +377,120 @@ hyperdaemon :: network_worker :: run()
 
             m_ssss->next(to, from, searchid, nonce);
         }
-        else if (type == hyperdex::REQ_SEARCH_STOP)
+        else if (type == hyperdex::REQ_AGGREGATE)
         {
-            uint64_t searchid;
+            hyperspacehashing::search s(0);
+            uint16_t func;
+            uint16_t attr;
+            uint16_t group_by;
 
-            if ((up >> nonce >> searchid).error())
+            if ((up >> nonce >> s >> func >> attr >> group_by).error())
             {
-                LOG(WARNING) << "unpack of REQ_SEARCH_STOP failed; here's some hex:  " << msg->hex();
+                LOG(WARNING) << "unpack of REQ_AGGREGATE failed; here's some hex:  " << msg->hex();
                 continue;
             }
 
-            m_ssss->stop(to, from, searchid);
+            if (s.sanity_check())
+            {
+                m_ssss->aggregate(to, from, nonce, s, static_cast<hyperaggregate>(func), attr, group_by);
+            }
+            else
+            {
+                LOG(INFO) << "Dropping aggregate which fails sanity_check.";
+            }
         }
-        else if (type == hyperdex::CHAIN_PUT)
+        else if (type == hyperdex::REQ_SORTED_SEARCH)
         {
-            uint64_t version;
-            uint8_t fresh;
-            e::slice key;
-            std::vector<e::slice> value;
+            hyperspacehashing::search s(0);
+            uint16_t sort_by;
+            uint64_t limit;
+            uint8_t descending;
 
-            if ((up >> version >> fresh >> key >> value).error())
+            if ((up >> nonce >> s >> sort_by >> limit >> descending).error())
             {
-                LOG(WARNING) << "unpack of CHAIN_PUT failed; here's some hex:  " << msg->hex();
+                LOG(WARNING) << "unpack of REQ_SORTED_SEARCH failed; here's some hex:  " << msg->hex();
                 continue;
             }
 
-            m_repl->chain_put(from, to, version, fresh == 1, msg, key, value);
+            if (s.sanity_check())
+            {
+                m_ssss->sorted_search(to, from, nonce, s, sort_by, limit, descending != 0);
+            }
+            else
+            {
+                LOG(INFO) << "Dropping sorted search which fails sanity_check.";
+            }
         }
-        else if (type == hyperdex::CHAIN_DEL)
+        else if (type == hyperdex::REQ_SEARCH_STOP)
         {
-            uint64_t version;
-            e::slice key;
+            uint64_t searchid;
 
-            if ((up >> version >> key).error())
+            if ((up >> nonce >> searchid).error())
             {
-                LOG(WARNING) << "unpack of CHAIN_DEL failed; here's some hex:  " << msg->hex();
+                LOG(WARNING) << "unpack of REQ_SEARCH_STOP failed; here's some hex:  " << msg->hex();
                 continue;
             }
 
-            m_repl->chain_del(from, to, version, msg, key);
+            m_ssss->stop(to, from, searchid);
         }
-        else if (type == hyperdex::CHAIN_SUBSPACE)
+        else if (type == hyperdex::REQ_WATCH_START)
         {
-            uint64_t version;
-            e::slice key;
-            std::vector<e::slice> value;
-            uint64_t nextpoint;
+            uint64_t watchid;
+            hyperspacehashing::search s(0);
+            uint8_t initial;
+            uint32_t batch_items;
+            uint64_t batch_bytes;
 
-            if ((up >> version >> key >> value >> nextpoint).error())
+            if ((up >> nonce >> watchid >> s >> initial >> batch_items >> batch_bytes).error())
             {
-                LOG(WARNING) << "unpack of CHAIN_SUBSPACE failed; here's some hex:  " << msg->hex();
+                LOG(WARNING) << "unpack of REQ_WATCH_START failed; here's some hex:  " << msg->hex();
                 continue;
             }
 
-            m_repl->chain_subspace(from, to, version, msg, key, value, nextpoint);
+            if (s.sanity_check())
+            {
+                m_watches->start(to, from, watchid, nonce, msg, s, initial != 0, batch_items, batch_bytes);
+            }
+            else
+            {
+                LOG(INFO) << "Dropping watch which fails sanity_check.";
+            }
         }
-        else if (type == hyperdex::CHAIN_ACK)
+        else if (type == hyperdex::REQ_WATCH_NEXT)
         {
-            uint64_t version;
-            e::slice key;
+            uint64_t watchid;
 
-            if ((up >> version >> key).error())
+            if ((up >> nonce >> watchid).error())
             {
-                LOG(WARNING) << "unpack of CHAIN_ACK failed; here's some hex:  " << msg->hex();
+                LOG(WARNING) << "unpack of REQ_WATCH_NEXT failed; here's some hex:  " << msg->hex();
                 continue;
             }
 
-            m_repl->chain_ack(from, to, version, msg, key);
+            m_watches->next(to, from, watchid, nonce);
+        }
+        else if (type == hyperdex::REQ_WATCH_STOP)
+        {
+            uint64_t watchid;
+
+            if ((up >> nonce >> watchid).error())
+            {
+                LOG(WARNING) << "unpack of REQ_WATCH_STOP failed; here's some hex:  " << msg->hex();
+                continue;
+            }
+
+            m_watches->stop(to, from, watchid);
+        }
+        else if (type == hyperdex::CHAIN_PUT ||
+                 type == hyperdex::CHAIN_DEL ||
+                 type == hyperdex::CHAIN_SUBSPACE ||
+                 type == hyperdex::CHAIN_ACK)
+        {
+            std::tr1::shared_ptr<e::buffer> backing(msg.release());
+            chain_message(from, to, type, backing, m_comm->header_size());
+        }
+        else if (type == hyperdex::CHAIN_BATCH)
+        {
+            chain_batch(from, to, msg);
         }
         else if (type == hyperdex::XFER_MORE)
         {
@@ -397,6 +538,104 @@ hyperdaemon :: network_worker :: run()
     }
 }
 
+void
+hyperdaemon :: network_worker :: chain_message(const entityid& from,
+                                               const entityid& to,
+                                               network_msgtype type,
+                                               std::tr1::shared_ptr<e::buffer> msg,
+                                               size_t off)
+{
+    e::buffer::unpacker up = msg->unpack_from(off);
+
+    if (type == hyperdex::CHAIN_PUT)
+    {
+        uint64_t version;
+        uint8_t fresh;
+        e::slice key;
+        std::vector<e::slice> value;
+
+        if ((up >> version >> fresh >> key >> value).error())
+        {
+            LOG(WARNING) << "unpack of CHAIN_PUT failed; here's some hex:  " << msg->hex();
+            return;
+        }
+
+        m_repl->chain_put(from, to, version, fresh == 1, msg, key, value);
+    }
+    else if (type == hyperdex::CHAIN_DEL)
+    {
+        uint64_t version;
+        e::slice key;
+
+        if ((up >> version >> key).error())
+        {
+            LOG(WARNING) << "unpack of CHAIN_DEL failed; here's some hex:  " << msg->hex();
+            return;
+        }
+
+        m_repl->chain_del(from, to, version, msg, key);
+    }
+    else if (type == hyperdex::CHAIN_SUBSPACE)
+    {
+        uint64_t version;
+        e::slice key;
+        std::vector<e::slice> value;
+        uint64_t nextpoint;
+
+        if ((up >> version >> key >> value >> nextpoint).error())
+        {
+            LOG(WARNING) << "unpack of CHAIN_SUBSPACE failed; here's some hex:  " << msg->hex();
+            return;
+        }
+
+        m_repl->chain_subspace(from, to, version, msg, key, value, nextpoint);
+    }
+    else if (type == hyperdex::CHAIN_ACK)
+    {
+        uint64_t version;
+        e::slice key;
+
+        if ((up >> version >> key).error())
+        {
+            LOG(WARNING) << "unpack of CHAIN_ACK failed; here's some hex:  " << msg->hex();
+            return;
+        }
+
+        m_repl->chain_ack(from, to, version, msg, key);
+    }
+    else
+    {
+        LOG(WARNING) << "dropping " << type << " which is not a chain message";
+    }
+}
+
+void
+hyperdaemon :: network_worker :: chain_batch(const entityid& from,
+                                             const entityid& to,
+                                             std::auto_ptr<e::buffer> msg)
+{
+    // Every message's key and value point into the batch, which lives as long
+    // as the replication manager needs any of them.
+    std::tr1::shared_ptr<e::buffer> backing(msg.release());
+    e::buffer::unpacker up = backing->unpack_from(m_comm->header_size());
+
+    while (up.remain() > 0)
+    {
+        uint8_t type;
+        e::slice body;
+        up = up >> type >> body;
+
+        if (up.error())
+        {
+            LOG(WARNING) << "unpack of CHAIN_BATCH failed; here's some hex:  " << backing->hex();
+            return;
+        }
+
+        chain_message(from, to, static_cast<network_msgtype>(type), backing,
+                      body.data() - backing->data());
+    }
+}
+
 void
 hyperdaemon :: network_worker :: shutdown()
 {
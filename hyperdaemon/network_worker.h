@@ -28,6 +28,17 @@
 #ifndef hyperdaemon_network_worker_h_
 #define hyperdaemon_network_worker_h_
 
+// STL
+#include <memory>
+#include <tr1/memory>
+
+// e
+#include <e/buffer.h>
+
+// HyperDex
+#include "hyperdex/hyperdex/ids.h"
+#include "hyperdex/hyperdex/network_constants.h"
+
 // Forward Declarations
 namespace hyperdaemon
 {
@@ -36,6 +47,7 @@ class logical;
 class ongoing_state_transfers;
 class replication_manager;
 class searches;
+class watches;
 }
 
 namespace hyperdaemon
@@ -49,7 +61,8 @@ class network_worker
                        logical* comm,
                        searches* ssss,
                        ongoing_state_transfers* ost,
-                       replication_manager* repl);
+                       replication_manager* repl,
+                       watches* wtch);
         ~network_worker() throw ();
 
     public:
@@ -62,6 +75,20 @@ class network_worker
     private:
         network_worker& operator = (const network_worker&);
 
+    private:
+        // Handle one CHAIN_PUT, CHAIN_DEL, CHAIN_SUBSPACE or CHAIN_ACK, whose
+        // body starts at "off" in "msg".
+        void chain_message(const hyperdex::entityid& from,
+                           const hyperdex::entityid& to,
+                           hyperdex::network_msgtype type,
+                           std::tr1::shared_ptr<e::buffer> msg,
+                           size_t off);
+        // Handle each message of a CHAIN_BATCH in turn, as if it had arrived
+        // alone.
+        void chain_batch(const hyperdex::entityid& from,
+                         const hyperdex::entityid& to,
+                         std::auto_ptr<e::buffer> msg);
+
     private:
         bool m_continue;
         datalayer* m_data;
@@ -69,6 +96,7 @@ class network_worker
         searches* m_ssss;
         ongoing_state_transfers* m_ost;
         replication_manager* m_repl;
+        watches* m_watches;
 };
 
 } // namespace hyperdaemon
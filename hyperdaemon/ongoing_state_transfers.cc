@@ -458,7 +458,7 @@ hyperdaemon :: ongoing_state_transfers :: region_transfer_recv(const hyperdex::e
             }
             else
             {
-                res = m_data->del(t->replicate_from.get_region(), oneop.backing, oneop.key);
+                res = m_data->del(t->replicate_from.get_region(), oneop.backing, oneop.key, oneop.version);
             }
 
             if (res != hyperdisk::SUCCESS)
@@ -31,6 +31,9 @@
 // STL
 #include <memory>
 
+// po6
+#include <po6/threads/mutex.h>
+
 // e
 #include <e/buffer.h>
 #include <e/intrusive_ptr.h>
@@ -64,10 +64,12 @@
 #include "hyperdaemon/logical.h"
 #include "hyperdaemon/ongoing_state_transfers.h"
 #include "hyperdaemon/replication_manager.h"
+#include "hyperdaemon/replication_manager_batch.h"
 #include "hyperdaemon/replication_manager_deferred.h"
 #include "hyperdaemon/replication_manager_keyholder.h"
 #include "hyperdaemon/replication_manager_pending.h"
 #include "hyperdaemon/runtimeconfig.h"
+#include "hyperdaemon/watches.h"
 #include "hyperspacehashing/hashes_internal.h"
 
 using hyperspacehashing::prefix::coordinate;
@@ -93,11 +95,13 @@ using hyperdaemon::replication::keypair;
 hyperdaemon :: replication_manager :: replication_manager(coordinatorlink* cl,
                                                           datalayer* data,
                                                           logical* comm,
-                                                          ongoing_state_transfers* ost)
+                                                          ongoing_state_transfers* ost,
+                                                          watches* wtch)
     : m_cl(cl)
     , m_data(data)
     , m_comm(comm)
     , m_ost(ost)
+    , m_watches(wtch)
     , m_config()
     , m_locks(LOCK_STRIPING)
     , m_keyholders_lock()
@@ -108,8 +112,16 @@ hyperdaemon :: replication_manager :: replication_manager(coordinatorlink* cl,
     , m_quiesce_state_id("")
     , m_shutdown(false)
     , m_periodic_thread(std::tr1::bind(&replication_manager::periodic, this))
+    , m_batches_lock()
+    , m_batches_cond(&m_batches_lock)
+    , m_batches()
+    , m_batches_opened(false)
+    , m_batch_thread(std::tr1::bind(&replication_manager::batch_thread, this))
+    , m_lost_lock()
+    , m_lost()
 {
     m_periodic_thread.start();
+    m_batch_thread.start();
 }
 
 hyperdaemon :: replication_manager :: ~replication_manager() throw ()
@@ -120,12 +132,14 @@ hyperdaemon :: replication_manager :: ~replication_manager() throw ()
     }
 
     m_periodic_thread.join();
+    m_batch_thread.join();
 }
 
 void
 hyperdaemon :: replication_manager :: prepare(const configuration&, const instance&)
 {
-    // Do nothing.
+    // Messages batched under the old configuration go out under it.
+    flush_batches(true);
 }
 
 void
@@ -160,15 +174,17 @@ hyperdaemon :: replication_manager :: reconfigure(const configuration& newconfig
 }
 
 void
-hyperdaemon :: replication_manager :: cleanup(const configuration&, const instance&)
+hyperdaemon :: replication_manager :: cleanup(const configuration& newconfig, const instance& us)
 {
-    // Do nothing.
+    prune_batches(newconfig, us);
 }
 
 void
 hyperdaemon :: replication_manager :: shutdown()
 {
+    po6::threads::mutex::hold hold(&m_batches_lock);
     m_shutdown = true;
+    m_batches_cond.broadcast();
 }
 
 static bool
@@ -355,6 +371,13 @@ hyperdaemon :: replication_manager :: client_atomic(const hyperdex::entityid& fr
         return;
     }
 
+    // Push back on the client if too many writes are waiting to reach disk.
+    if (m_data->admit_write(to.get_region()) == hyperdisk::WALFULL)
+    {
+        respond_to_client(to, from, nonce, hyperdex::RESP_ATOMIC, hyperdex::NET_BACKOFF);
+        return;
+    }
+
     // Automatically respond with "SERVERERROR" whenever we return without g.dismiss()
     e::guard g = e::makeobjguard(*this, &replication_manager::respond_to_client, to, from, nonce, hyperdex::RESP_ATOMIC, hyperdex::NET_SERVERERROR);
 
@@ -544,6 +567,11 @@ hyperdaemon :: replication_manager :: client_atomic(const hyperdex::entityid& fr
     new_pend->retcode = hyperdex::RESP_ATOMIC;
     new_pend->ref = ref;
     new_pend->key = new_key;
+    new_pend->has_old_value = has_old_value;
+    new_pend->old_value = old_value;
+    new_pend->old_op = kh->has_blocked_ops() ? kh->most_recent_blocked_op()
+                     : kh->has_committable_ops() ? kh->most_recent_committable_op()
+                     : e::intrusive_ptr<pending>();
 
     if (!prev_and_next(to.get_region(), new_pend->key, true, new_pend->value, has_old_value, old_value, new_pend))
     {
@@ -563,7 +591,7 @@ hyperdaemon :: replication_manager :: chain_put(const entityid& from,
                                                 const entityid& to,
                                                 uint64_t newversion,
                                                 bool fresh,
-                                                std::auto_ptr<e::buffer> backing,
+                                                std::tr1::shared_ptr<e::buffer> backing,
                                                 const e::slice& key,
                                                 const std::vector<e::slice>& newvalue)
 {
@@ -574,7 +602,7 @@ void
 hyperdaemon :: replication_manager :: chain_del(const entityid& from,
                                                 const entityid& to,
                                                 uint64_t newversion,
-                                                std::auto_ptr<e::buffer> backing,
+                                                std::tr1::shared_ptr<e::buffer> backing,
                                                 const e::slice& key)
 {
     chain_common(false, from, to, newversion, false, backing, key, std::vector<e::slice>());
@@ -584,7 +612,7 @@ void
 hyperdaemon :: replication_manager :: chain_subspace(const entityid& from,
                                                      const entityid& to,
                                                      uint64_t version,
-                                                     std::auto_ptr<e::buffer> backing,
+                                                     std::tr1::shared_ptr<e::buffer> backing,
                                                      const e::slice& key,
                                                      const std::vector<e::slice>& value,
                                                      uint64_t nextpoint)
@@ -635,8 +663,7 @@ hyperdaemon :: replication_manager :: chain_subspace(const entityid& from,
 
     // Create a new pending object to set as pending.
     e::intrusive_ptr<pending> newpend;
-    std::tr1::shared_ptr<e::buffer> sharedbacking(backing.release());
-    newpend = new pending(true, sharedbacking, key, value);
+    newpend = new pending(true, backing, key, value);
     newpend->recv_e = from;
     newpend->recv_i = m_config.instancefor(from);
     newpend->subspace_prev = to.subspace;
@@ -671,7 +698,7 @@ void
 hyperdaemon :: replication_manager :: chain_ack(const entityid& from,
                                                 const entityid& to,
                                                 uint64_t version,
-                                                std::auto_ptr<e::buffer> backing,
+                                                std::tr1::shared_ptr<e::buffer> backing,
                                                 const e::slice& key)
 {
     // Grab the lock that protects this key.
@@ -699,8 +726,7 @@ hyperdaemon :: replication_manager :: chain_ack(const entityid& from,
         return;
     }
 
-    std::tr1::shared_ptr<e::buffer> shared_backing(backing.release());
-    m_ost->add_trigger(to.get_region(), shared_backing, key, version);
+    m_ost->add_trigger(to.get_region(), backing, key, version);
     pend->acked = true;
     put_to_disk(to.get_region(), kh, version);
 
@@ -714,6 +740,14 @@ hyperdaemon :: replication_manager :: chain_ack(const entityid& from,
 
     if (m_config.is_point_leader(to))
     {
+        m_watches->notify(to.get_region(), pend->key, version,
+                          pend->has_value, pend->value,
+                          pend->has_old_value, pend->old_value);
+        // Let go of the value this update replaced.
+        pend->has_old_value = false;
+        pend->old_value.clear();
+        pend->old_op = NULL;
+
         if (pend->co.from.space == UINT32_MAX)
         {
             respond_to_client(to, pend->co.from, pend->co.nonce,
@@ -762,6 +796,13 @@ hyperdaemon :: replication_manager :: client_common(const hyperdex::network_msgt
         return;
     }
 
+    // Push back on the client if too many writes are waiting to reach disk.
+    if (m_data->admit_write(to.get_region()) == hyperdisk::WALFULL)
+    {
+        respond_to_client(to, from, nonce, retcode, hyperdex::NET_BACKOFF);
+        return;
+    }
+
     // Automatically respond with "SERVERERROR" whenever we return without g.dismiss()
     e::guard g = e::makeobjguard(*this, &replication_manager::respond_to_client, to, from, nonce, retcode, hyperdex::NET_SERVERERROR);
 
@@ -798,6 +839,11 @@ hyperdaemon :: replication_manager :: client_common(const hyperdex::network_msgt
     new_pend = new pending(has_value, sharedbacking, key, value, co);
     new_pend->retcode = retcode;
     new_pend->ref = ref;
+    new_pend->has_old_value = has_old_value;
+    new_pend->old_value = old_value;
+    new_pend->old_op = kh->has_blocked_ops() ? kh->most_recent_blocked_op()
+                     : kh->has_committable_ops() ? kh->most_recent_committable_op()
+                     : e::intrusive_ptr<pending>();
 
     if (!has_value && !has_old_value)
     {
@@ -901,10 +947,17 @@ hyperdaemon :: replication_manager :: chain_common(bool has_value,
                                                    const entityid& to,
                                                    uint64_t version,
                                                    bool fresh,
-                                                   std::auto_ptr<e::buffer> backing,
+                                                   std::tr1::shared_ptr<e::buffer> backing,
                                                    const e::slice& key,
                                                    const std::vector<e::slice>& value)
 {
+    // Push back on the upstream daemon too.  The message is not acked, so it
+    // is retransmitted once the log has drained.
+    if (m_data->admit_write(to.get_region()) == hyperdisk::WALFULL)
+    {
+        return;
+    }
+
     // Grab the lock that protects this key.
     HOLD_LOCK_FOR_KEY(to, key);
     // Get the keyholder for this key.
@@ -973,8 +1026,7 @@ hyperdaemon :: replication_manager :: chain_common(bool has_value,
 
     // Create a new pending object to set as pending.
     e::intrusive_ptr<pending> newpend;
-    std::tr1::shared_ptr<e::buffer> sharedbacking(backing.release());
-    newpend = new pending(has_value, sharedbacking, key, value);
+    newpend = new pending(has_value, backing, key, value);
     newpend->fresh = fresh;
     newpend->ref = ref;
     newpend->recv_e = from;
@@ -1064,6 +1116,8 @@ hyperdaemon :: replication_manager :: from_disk(const regionid& r,
         case hyperdisk::DROPFAILED:
         case hyperdisk::SPLITFAILED:
         case hyperdisk::DIDNOTHING:
+        case hyperdisk::WALFULL:
+        case hyperdisk::SPLITTING:
         default:
             LOG(WARNING) << "Data layer returned unexpected result when reading old value.";
             return false;
@@ -1088,7 +1142,7 @@ hyperdaemon :: replication_manager :: put_to_disk(const regionid& pending_in,
     if (!op->has_value
             || (pending_in.subspace == op->subspace_next && pending_in.subspace != 0))
     {
-        switch (m_data->del(pending_in, op->backing, op->key))
+        switch (m_data->del(pending_in, op->backing, op->key, version))
         {
             case hyperdisk::SUCCESS:
                 success = true;
@@ -1102,6 +1156,8 @@ hyperdaemon :: replication_manager :: put_to_disk(const regionid& pending_in,
             case hyperdisk::DROPFAILED:
             case hyperdisk::SPLITFAILED:
             case hyperdisk::DIDNOTHING:
+            case hyperdisk::WALFULL:
+            case hyperdisk::SPLITTING:
                 LOG(ERROR) << "commit caused error " << rc;
                 success = false;
                 break;
@@ -1127,6 +1183,8 @@ hyperdaemon :: replication_manager :: put_to_disk(const regionid& pending_in,
             case hyperdisk::DROPFAILED:
             case hyperdisk::SPLITFAILED:
             case hyperdisk::DIDNOTHING:
+            case hyperdisk::WALFULL:
+            case hyperdisk::SPLITTING:
                 LOG(ERROR) << "commit caused error " << rc;
                 success = false;
                 break;
@@ -1420,7 +1478,7 @@ hyperdaemon :: replication_manager :: send_message(const entityid& us,
             bool packed = !(revkey->pack_at(m_comm->header_size()) << version << key).error();
             assert(packed);
 
-            if (m_comm->send(us, us, hyperdex::CHAIN_ACK, revkey))
+            if (send_chain(us, us, hyperdex::CHAIN_ACK, revkey, NULL, 0))
             {
                 op->sent_e = us;
                 op->sent_i = m_us;
@@ -1437,7 +1495,7 @@ hyperdaemon :: replication_manager :: send_message(const entityid& us,
             dst = entityid(us.space, us.subspace, 64, op->point_next, 0);
             dst = m_config.sloppy_lookup(dst);
 
-            if (m_comm->send(us, dst, hyperdex::CHAIN_SUBSPACE, msg))
+            if (send_chain(us, dst, hyperdex::CHAIN_SUBSPACE, msg, &key, version))
             {
                 op->sent_e = dst;
                 op->sent_i = m_config.instancefor(dst);
@@ -1467,7 +1525,7 @@ hyperdaemon :: replication_manager :: send_message(const entityid& us,
             assert(packed);
             dst = m_config.chain_next(us);
 
-            if (m_comm->send(us, dst, hyperdex::CHAIN_SUBSPACE, msg))
+            if (send_chain(us, dst, hyperdex::CHAIN_SUBSPACE, msg, &key, version))
             {
                 op->sent_e = dst;
                 op->sent_i = m_config.instancefor(dst);
@@ -1499,7 +1557,7 @@ hyperdaemon :: replication_manager :: send_message(const entityid& us,
         type = hyperdex::CHAIN_DEL;
     }
 
-    if (m_comm->send(us, dst, type, msg))
+    if (send_chain(us, dst, type, msg, &key, version))
     {
         op->sent_e = dst;
         op->sent_i = m_config.instancefor(dst);
@@ -1519,7 +1577,279 @@ hyperdaemon :: replication_manager :: send_ack(const entityid& from,
     std::auto_ptr<e::buffer> msg(e::buffer::create(sz));
     bool packed = !(msg->pack_at(m_comm->header_size()) << version << key).error();
     assert(packed);
-    return m_comm->send(from, to, hyperdex::CHAIN_ACK, msg);
+    return send_chain(from, to, hyperdex::CHAIN_ACK, msg, &key, version);
+}
+
+bool
+hyperdaemon :: replication_manager :: send_chain(const entityid& from,
+                                                 const entityid& to,
+                                                 network_msgtype type,
+                                                 std::auto_ptr<e::buffer> msg,
+                                                 const e::slice* key,
+                                                 uint64_t version)
+{
+    // Messages to ourself never touch the network, so there is nothing to
+    // save by batching them.
+    if (CHAIN_BATCH_DELAY == 0 || m_config.instancefor(to) == m_us)
+    {
+        return m_comm->send(from, to, type, msg);
+    }
+
+    // Fail now, as the send would, rather than claim a message was sent.
+    if (m_config.instancefor(to) == instance())
+    {
+        return false;
+    }
+
+    while (true)
+    {
+        e::intrusive_ptr<batch> b = get_batch(from, to);
+        po6::threads::mutex::hold hold(&b->lock);
+
+        // Otherwise the batch was pruned after we found it.
+        if (!b->dead)
+        {
+            return queue_chain(b, type, msg, key, version);
+        }
+    }
+}
+
+bool
+hyperdaemon :: replication_manager :: queue_chain(e::intrusive_ptr<batch> b,
+                                                  network_msgtype type,
+                                                  std::auto_ptr<e::buffer> msg,
+                                                  const e::slice* key,
+                                                  uint64_t version)
+{
+    uint64_t now = e::time();
+
+    // Nothing else is going to this entity, so waiting for company would only
+    // add latency.
+    if (b->count == 0 && now - b->last_sent >= CHAIN_BATCH_DELAY * 1000)
+    {
+        b->last_sent = now;
+        return m_comm->send(b->from, b->to, type, msg);
+    }
+
+    size_t body = msg->size() - m_comm->header_size();
+    size_t sz = sizeof(uint8_t) + sizeof(uint32_t) + body;
+
+    if (b->count > 0 && b->bytes + sz > CHAIN_BATCH_BYTES)
+    {
+        send_batch(b);
+    }
+
+    if (key)
+    {
+        b->updates.push_back(batched_update(b->from, b->to, *key, version,
+                                            type == hyperdex::CHAIN_ACK));
+    }
+
+    if (b->count == 0)
+    {
+        b->first = msg;
+        b->first_type = type;
+        b->count = 1;
+        b->bytes = m_comm->header_size() + sz;
+        b->deadline = now + CHAIN_BATCH_DELAY * 1000;
+        po6::threads::mutex::hold hold_batches(&m_batches_lock);
+        m_batches_opened = true;
+        m_batches_cond.signal();
+        return true;
+    }
+
+    // The buffer grows with the batch, at least doubling each time so that
+    // the messages are copied a bounded number of times.
+    size_t capacity = b->packed.get() ? b->packed->capacity() : 0;
+
+    if (b->bytes + sz > capacity)
+    {
+        capacity = std::max(b->bytes + sz, std::min<size_t>(capacity * 2, CHAIN_BATCH_BYTES));
+        std::auto_ptr<e::buffer> grown(e::buffer::create(capacity));
+
+        if (b->count == 1)
+        {
+            e::slice first_body(b->first->data() + m_comm->header_size(),
+                                b->first->size() - m_comm->header_size());
+            bool packed = !(grown->pack_at(m_comm->header_size())
+                                << static_cast<uint8_t>(b->first_type) << first_body).error();
+            assert(packed);
+            b->first.reset();
+        }
+        else
+        {
+            bool copied = !grown->pack_at(0).copy(b->packed->as_slice()).error();
+            assert(copied);
+        }
+
+        b->packed = grown;
+    }
+
+    e::slice msg_body(msg->data() + m_comm->header_size(), body);
+    bool packed = !(b->packed->pack_at(b->bytes) << static_cast<uint8_t>(type) << msg_body).error();
+    assert(packed);
+    ++b->count;
+    b->bytes += sz;
+    return true;
+}
+
+e::intrusive_ptr<hyperdaemon::replication_manager::batch>
+hyperdaemon :: replication_manager :: get_batch(const entityid& from,
+                                                const entityid& to)
+{
+    po6::threads::mutex::hold hold(&m_batches_lock);
+    e::intrusive_ptr<batch>& b(m_batches[std::make_pair(from, to)]);
+
+    if (!b)
+    {
+        b = new batch(from, to);
+    }
+
+    return b;
+}
+
+void
+hyperdaemon :: replication_manager :: send_batch(e::intrusive_ptr<batch> b)
+{
+    bool sent = true;
+
+    if (b->count == 1)
+    {
+        sent = m_comm->send(b->from, b->to, b->first_type, b->first);
+    }
+    else if (b->count > 1)
+    {
+        sent = m_comm->send(b->from, b->to, hyperdex::CHAIN_BATCH, b->packed);
+    }
+
+    if (!sent)
+    {
+        LOG(INFO) << "could not send " << b->count << " chain messages to " << b->to;
+        po6::threads::mutex::hold hold(&m_lost_lock);
+        m_lost.insert(m_lost.end(), b->updates.begin(), b->updates.end());
+    }
+
+    b->first.reset();
+    b->packed.reset();
+    b->count = 0;
+    b->bytes = 0;
+    b->updates.clear();
+    b->last_sent = e::time();
+}
+
+uint64_t
+hyperdaemon :: replication_manager :: flush_batches(bool all)
+{
+    std::vector<e::intrusive_ptr<batch> > batches;
+
+    {
+        po6::threads::mutex::hold hold(&m_batches_lock);
+
+        for (batch_map_t::iterator it = m_batches.begin(); it != m_batches.end(); ++it)
+        {
+            batches.push_back(it->second);
+        }
+    }
+
+    uint64_t now = e::time();
+    uint64_t next = 0;
+
+    for (size_t i = 0; i < batches.size(); ++i)
+    {
+        po6::threads::mutex::hold hold(&batches[i]->lock);
+
+        if (batches[i]->count == 0)
+        {
+            continue;
+        }
+
+        if (all || batches[i]->deadline <= now)
+        {
+            send_batch(batches[i]);
+        }
+        else if (next == 0 || batches[i]->deadline < next)
+        {
+            next = batches[i]->deadline;
+        }
+    }
+
+    return next;
+}
+
+void
+hyperdaemon :: replication_manager :: prune_batches(const configuration& newconfig,
+                                                    const instance& us)
+{
+    std::vector<e::intrusive_ptr<batch> > pruned;
+
+    {
+        po6::threads::mutex::hold hold(&m_batches_lock);
+        batch_map_t::iterator it = m_batches.begin();
+
+        while (it != m_batches.end())
+        {
+            batch_map_t::iterator cur = it;
+            ++it;
+
+            if (newconfig.instancefor(cur->first.first) != us ||
+                newconfig.instancefor(cur->first.second) == instance())
+            {
+                pruned.push_back(cur->second);
+                m_batches.erase(cur);
+            }
+        }
+    }
+
+    // A sender may have queued messages since prepare flushed them.
+    for (size_t i = 0; i < pruned.size(); ++i)
+    {
+        po6::threads::mutex::hold hold(&pruned[i]->lock);
+        send_batch(pruned[i]);
+        pruned[i]->dead = true;
+    }
+}
+
+void
+hyperdaemon :: replication_manager :: batch_thread()
+{
+    while (true)
+    {
+        {
+            po6::threads::mutex::hold hold(&m_batches_lock);
+
+            while (!m_batches_opened && !m_shutdown)
+            {
+                m_batches_cond.wait();
+            }
+
+            if (m_shutdown)
+            {
+                break;
+            }
+
+            m_batches_opened = false;
+        }
+
+        uint64_t next = flush_batches(false);
+
+        // Some batches are not yet due; sleep until the first of them is.
+        if (next != 0)
+        {
+            {
+                po6::threads::mutex::hold hold(&m_batches_lock);
+                m_batches_opened = true;
+            }
+
+            uint64_t now = e::time();
+
+            if (next > now)
+            {
+                e::sleep_ns(0, next - now);
+            }
+        }
+    }
+
+    flush_batches(true);
 }
 
 void
@@ -1574,10 +1904,53 @@ hyperdaemon :: replication_manager :: periodic()
     }
 }
 
+void
+hyperdaemon :: replication_manager :: resend_lost_updates()
+{
+    std::vector<batched_update> lost;
+
+    {
+        po6::threads::mutex::hold hold(&m_lost_lock);
+        lost.swap(m_lost);
+    }
+
+    for (size_t i = 0; i < lost.size(); ++i)
+    {
+        e::slice key(lost[i].key.data(), lost[i].key.size());
+
+        // The sender keeps the update until it is acked, so the ack is all
+        // there is to send.
+        if (lost[i].ack)
+        {
+            send_ack(lost[i].from, lost[i].to, lost[i].version, key);
+            continue;
+        }
+
+        HOLD_LOCK_FOR_KEY(lost[i].from, key);
+        e::intrusive_ptr<keyholder> kh;
+
+        if (!m_keyholders.lookup(keypair(lost[i].from.get_region(), key), &kh))
+        {
+            continue;
+        }
+
+        e::intrusive_ptr<pending> pend = kh->get_by_version(lost[i].version);
+
+        // Leave the update as a failed send would have, unless it has been
+        // sent elsewhere since.
+        if (pend && pend->sent_e == lost[i].to)
+        {
+            pend->sent_e = entityid();
+            pend->sent_i = instance();
+        }
+    }
+}
+
 int
 hyperdaemon :: replication_manager :: retransmit()
 {
     int processed = 0;
+    resend_lost_updates();
     
     for (keyholder_map_t::iterator khiter = m_keyholders.begin();
             khiter != m_keyholders.end(); khiter.next())
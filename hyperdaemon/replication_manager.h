@@ -30,11 +30,18 @@
 
 // STL
 #include <limits>
+#include <map>
 #include <tr1/functional>
+#include <tr1/memory>
 #include <tr1/unordered_map>
+#include <utility>
+#include <vector>
 
 // po6
+#include <po6/threads/cond.h>
+#include <po6/threads/mutex.h>
 #include <po6/threads/rwlock.h>
+#include <po6/threads/thread.h>
 
 // e
 #include <e/bitfield.h>
@@ -62,6 +69,7 @@ namespace hyperdaemon
 class datalayer;
 class logical;
 class ongoing_state_transfers;
+class watches;
 }
 
 namespace hyperdaemon
@@ -74,7 +82,8 @@ class replication_manager
         replication_manager(hyperdex::coordinatorlink* cl,
                             datalayer* dl,
                             logical* comm,
-                            ongoing_state_transfers* ost);
+                            ongoing_state_transfers* ost,
+                            watches* wtch);
         ~replication_manager() throw ();
 
     // Reconfigure this layer.
@@ -112,38 +121,43 @@ class replication_manager
                            std::auto_ptr<e::buffer> backing,
                            const e::slice& key,
                            std::vector<hyperdex::microop>* ops);
-        // These are called in response to messages from other hosts.
+        // These are called in response to messages from other hosts.  The
+        // message may be one of many sharing "backing".
         void chain_put(const hyperdex::entityid& from,
                        const hyperdex::entityid& to,
                        uint64_t rev,
                        bool fresh,
-                       std::auto_ptr<e::buffer> backing,
+                       std::tr1::shared_ptr<e::buffer> backing,
                        const e::slice& key,
                        const std::vector<e::slice>& value);
         void chain_del(const hyperdex::entityid& from,
                        const hyperdex::entityid& to,
                        uint64_t rev,
-                       std::auto_ptr<e::buffer> backing,
+                       std::tr1::shared_ptr<e::buffer> backing,
                        const e::slice& key);
         void chain_subspace(const hyperdex::entityid& from,
                             const hyperdex::entityid& to,
                             uint64_t rev,
-                            std::auto_ptr<e::buffer> backing,
+                            std::tr1::shared_ptr<e::buffer> backing,
                             const e::slice& key,
                             const std::vector<e::slice>& value,
                             uint64_t nextpoint);
         void chain_ack(const hyperdex::entityid& from,
                        const hyperdex::entityid& to,
                        uint64_t rev,
-                       std::auto_ptr<e::buffer> backing,
+                       std::tr1::shared_ptr<e::buffer> backing,
                        const e::slice& key);
 
     private:
+        class batch;
+        class batched_update;
         class deferred;
         class pending;
         class keyholder;
         typedef e::lockfree_hash_map<replication::keypair, e::intrusive_ptr<keyholder>, replication::keypair::hash>
                 keyholder_map_t;
+        typedef std::map<std::pair<hyperdex::entityid, hyperdex::entityid>, e::intrusive_ptr<batch> >
+                batch_map_t;
         friend class ongoing_state_transfers;
 
     private:
@@ -169,7 +183,7 @@ class replication_manager
                           const hyperdex::entityid& to,
                           uint64_t newversion,
                           bool fresh,
-                          std::auto_ptr<e::buffer> backing,
+                          std::tr1::shared_ptr<e::buffer> backing,
                           const e::slice& key,
                           const std::vector<e::slice>& newvalue);
         uint64_t get_lock_num(const hyperdex::regionid& reg, const e::slice& key);
@@ -208,6 +222,41 @@ class replication_manager
                           uint64_t version,
                           const e::slice& key,
                           e::intrusive_ptr<pending> op);
+        // Send a chain message, coalescing it with others to the same entity
+        // when they come fast enough.  Messages between two entities are
+        // always delivered in the order given.  A message which waits for
+        // company counts as sent.  If it carries the update of "key" at
+        // "version", or its ack (key is non-NULL), and its batch fails to
+        // send, the update is marked unsent for retransmit to send again, or
+        // the ack is sent again.
+        bool send_chain(const hyperdex::entityid& from,
+                        const hyperdex::entityid& to,
+                        hyperdex::network_msgtype type,
+                        std::auto_ptr<e::buffer> msg,
+                        const e::slice* key,
+                        uint64_t version);
+        e::intrusive_ptr<batch> get_batch(const hyperdex::entityid& from,
+                                          const hyperdex::entityid& to);
+        // Add a message to "b", or send it at once if nothing else is going
+        // the same way.  Must be called with b->lock held.
+        bool queue_chain(e::intrusive_ptr<batch> b,
+                         hyperdex::network_msgtype type,
+                         std::auto_ptr<e::buffer> msg,
+                         const e::slice* key,
+                         uint64_t version);
+        // Send what "b" holds.  Must be called with b->lock held.
+        void send_batch(e::intrusive_ptr<batch> b);
+        // Send every batch, or only those past their deadline.  Returns the
+        // earliest deadline of those left, or 0 if none are.
+        uint64_t flush_batches(bool all);
+        // Drop the batches between entities which are no longer ours or no
+        // longer exist.
+        void prune_batches(const hyperdex::configuration& newconfig,
+                           const hyperdex::instance& us);
+        void batch_thread();
+        // Mark unsent the updates lost by batches which failed to send, and
+        // send their acks again.
+        void resend_lost_updates();
         bool send_ack(const hyperdex::entityid& us,
                       const hyperdex::entityid& to,
                       uint64_t version,
@@ -227,6 +276,7 @@ class replication_manager
         datalayer* m_data;
         logical* m_comm;
         ongoing_state_transfers* m_ost;
+        watches* m_watches;
         hyperdex::configuration m_config;
         e::striped_lock<po6::threads::mutex> m_locks;
         po6::threads::mutex m_keyholders_lock;
@@ -237,6 +287,16 @@ class replication_manager
         std::string m_quiesce_state_id;
         volatile bool m_shutdown; // acessed from multiple threads
         po6::threads::thread m_periodic_thread;
+        po6::threads::mutex m_batches_lock;
+        po6::threads::cond m_batches_cond;
+        batch_map_t m_batches;
+        // Set when a batch opens, so that the batch thread looks for it.
+        bool m_batches_opened;
+        po6::threads::thread m_batch_thread;
+        // The updates carried by batches which failed to send.  Marking them
+        // unsent takes their keys' locks, which the sender may not take.
+        po6::threads::mutex m_lost_lock;
+        std::vector<batched_update> m_lost;
 };
 
 } // namespace hyperdaemon
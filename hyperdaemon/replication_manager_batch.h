@@ -0,0 +1,151 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef hyperdaemon_replication_manager_batch
+#define hyperdaemon_replication_manager_batch
+
+// STL
+#include <memory>
+#include <string>
+#include <vector>
+
+// po6
+#include <po6/threads/mutex.h>
+
+// e
+#include <e/buffer.h>
+#include <e/slice.h>
+
+// HyperDex
+#include "hyperdex/hyperdex/ids.h"
+#include "hyperdex/hyperdex/network_constants.h"
+
+// An update, or the ack of one, sent from one entity to another in a batch.
+class hyperdaemon::replication_manager::batched_update
+{
+    public:
+        batched_update(const hyperdex::entityid& from,
+                       const hyperdex::entityid& to,
+                       const e::slice& key,
+                       uint64_t version,
+                       bool ack);
+        ~batched_update() throw ();
+
+    public:
+        hyperdex::entityid from;
+        hyperdex::entityid to;
+        std::string key;
+        uint64_t version;
+        bool ack;
+};
+
+// The chain messages waiting to go from one entity to another.  A batch of
+// one message is sent as is; otherwise each message is packed into a single
+// CHAIN_BATCH as its type and its body (everything after the header).
+class hyperdaemon::replication_manager::batch
+{
+    public:
+        batch(const hyperdex::entityid& from, const hyperdex::entityid& to);
+        ~batch() throw ();
+
+    public:
+        po6::threads::mutex lock;
+        const hyperdex::entityid from;
+        const hyperdex::entityid to;
+        // The first message, until a second arrives.
+        std::auto_ptr<e::buffer> first;
+        hyperdex::network_msgtype first_type;
+        // Every message, once there are two.  It grows as messages arrive.
+        std::auto_ptr<e::buffer> packed;
+        size_t count;
+        // The size of the CHAIN_BATCH which holds every message.
+        size_t bytes;
+        // The updates and acks carried by the messages.  If the batch fails
+        // to send, the updates are marked unsent and the acks sent again.
+        std::vector<batched_update> updates;
+        // Set once the batch leaves the batch map.  A sender which finds it
+        // set must look up the batch again.
+        bool dead;
+        // When the batch must go out, and when the last one did, from
+        // e::time().
+        uint64_t deadline;
+        uint64_t last_sent;
+
+    private:
+        friend class e::intrusive_ptr<batch>;
+
+    private:
+        void inc() { __sync_add_and_fetch(&m_ref, 1); }
+        void dec() { if (__sync_sub_and_fetch(&m_ref, 1) == 0) delete this; }
+
+    private:
+        size_t m_ref;
+};
+
+hyperdaemon :: replication_manager :: batch :: batch(const hyperdex::entityid& f,
+                                                     const hyperdex::entityid& t)
+    : lock()
+    , from(f)
+    , to(t)
+    , first()
+    , first_type()
+    , packed()
+    , count(0)
+    , bytes(0)
+    , updates()
+    , dead(false)
+    , deadline(0)
+    , last_sent(0)
+    , m_ref(0)
+{
+}
+
+hyperdaemon :: replication_manager :: batch :: ~batch()
+                                               throw ()
+{
+}
+
+hyperdaemon :: replication_manager :: batched_update :: batched_update(const hyperdex::entityid& f,
+                                                                       const hyperdex::entityid& t,
+                                                                       const e::slice& k,
+                                                                       uint64_t v,
+                                                                       bool a)
+    : from(f)
+    , to(t)
+    , key(reinterpret_cast<const char*>(k.data()), k.size())
+    , version(v)
+    , ack(a)
+{
+}
+
+hyperdaemon :: replication_manager :: batched_update :: ~batched_update()
+                                                        throw ()
+{
+}
+
+#endif // hyperdaemon_replication_manager_batch
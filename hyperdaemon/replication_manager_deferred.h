@@ -32,7 +32,7 @@ class hyperdaemon::replication_manager::deferred
 {
     public:
         deferred(const bool has_value,
-                 std::auto_ptr<e::buffer> backing,
+                 std::tr1::shared_ptr<e::buffer> backing,
                  const e::slice& key,
                  const std::vector<e::slice>& value,
                  const hyperdex::entityid& from_ent,
@@ -61,13 +61,13 @@ class hyperdaemon::replication_manager::deferred
 };
 
 hyperdaemon :: replication_manager :: deferred :: deferred(const bool hv,
-                                                           std::auto_ptr<e::buffer> b,
+                                                           std::tr1::shared_ptr<e::buffer> b,
                                                            const e::slice& k,
                                                            const std::vector<e::slice>& val,
                                                            const hyperdex::entityid& e,
                                                            const hyperdex::instance& i,
                                                            const hyperdisk::reference& r)
-    : backing(b.release())
+    : backing(b)
     , has_value(hv)
     , key(k)
     , value(val)
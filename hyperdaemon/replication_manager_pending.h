@@ -52,6 +52,12 @@ class hyperdaemon::replication_manager::pending
         hyperdex::network_msgtype retcode;
         e::intrusive_ptr<pending> backing2;
         hyperdisk::reference ref;
+        // At the point leader, the value this update replaces, which is kept
+        // (in "old_op" or "ref") until the update commits so that watches
+        // see objects which stop matching.
+        bool has_old_value;
+        std::vector<e::slice> old_value;
+        e::intrusive_ptr<pending> old_op;
 
         hyperdex::entityid recv_e; // We recv from here
         hyperdex::instance recv_i; // We recv from here
@@ -90,6 +96,9 @@ hyperdaemon :: replication_manager :: pending :: pending(bool hv,
     , retcode()
     , backing2()
     , ref()
+    , has_old_value(false)
+    , old_value()
+    , old_op()
     , recv_e()
     , recv_i()
     , sent_e()
@@ -35,3 +35,22 @@ e::envconfig<size_t> hyperdaemon::LOCK_STRIPING("HYPERDEX_LOCK_STRIPING", 1024);
 e::envconfig<size_t> hyperdaemon::TRANSFERS_IN_FLIGHT("HYPERDEX_TRANSFERS_IN_FLIGHT", 8);
 e::envconfig<uint16_t> hyperdaemon::REPLICATION_HASHTABLE_SIZE("HYPERDEX_REPLICATION_HASHTABLE_SIZE", 10);
 e::envconfig<uint16_t> hyperdaemon::STATE_TRANSFER_HASHTABLE_SIZE("HYPERDEX_STATE_TRANSFER_HASHTABLE_SIZE", 10);
+e::envconfig<unsigned int> hyperdaemon::MEMORY_ENGINE("HYPERDEX_MEMORY_ENGINE", 0);
+e::envconfig<uint64_t> hyperdaemon::WAL_SOFT_LIMIT("HYPERDEX_WAL_SOFT_LIMIT", 64ULL << 20);
+e::envconfig<uint64_t> hyperdaemon::WAL_HARD_LIMIT("HYPERDEX_WAL_HARD_LIMIT", 256ULL << 20);
+e::envconfig<uint64_t> hyperdaemon::DAEMON_WAL_SOFT_LIMIT("HYPERDEX_DAEMON_WAL_SOFT_LIMIT", 512ULL << 20);
+e::envconfig<uint64_t> hyperdaemon::DAEMON_WAL_HARD_LIMIT("HYPERDEX_DAEMON_WAL_HARD_LIMIT", 2048ULL << 20);
+e::envconfig<uint64_t> hyperdaemon::FLUSH_MAX_DELAY("HYPERDEX_FLUSH_MAX_DELAY", 10000);
+e::envconfig<unsigned int> hyperdaemon::FLUSH_LAG_REPORT_INTERVAL("HYPERDEX_FLUSH_LAG_REPORT_INTERVAL", 60);
+e::envconfig<uint64_t> hyperdaemon::OBJECT_HISTORY_VERSIONS("HYPERDEX_OBJECT_HISTORY_VERSIONS", 0);
+e::envconfig<size_t> hyperdaemon::SEARCHES_PER_CLIENT("HYPERDEX_SEARCHES_PER_CLIENT", 16);
+e::envconfig<size_t> hyperdaemon::SEARCHES_MAX("HYPERDEX_SEARCHES_MAX", 4096);
+e::envconfig<unsigned int> hyperdaemon::SEARCH_IDLE_TIMEOUT("HYPERDEX_SEARCH_IDLE_TIMEOUT", 300);
+e::envconfig<unsigned int> hyperdaemon::SEARCH_REPORT_INTERVAL("HYPERDEX_SEARCH_REPORT_INTERVAL", 60);
+e::envconfig<unsigned int> hyperdaemon::SEARCH_THREADS("HYPERDEX_SEARCH_THREADS", 4);
+e::envconfig<uint64_t> hyperdaemon::WATCH_QUEUE_BYTES("HYPERDEX_WATCH_QUEUE_BYTES", 16ULL << 20);
+e::envconfig<size_t> hyperdaemon::WATCHES_PER_CLIENT("HYPERDEX_WATCHES_PER_CLIENT", 16);
+e::envconfig<size_t> hyperdaemon::WATCHES_MAX("HYPERDEX_WATCHES_MAX", 4096);
+e::envconfig<unsigned int> hyperdaemon::WATCH_IDLE_TIMEOUT("HYPERDEX_WATCH_IDLE_TIMEOUT", 300);
+e::envconfig<uint64_t> hyperdaemon::CHAIN_BATCH_DELAY("HYPERDEX_CHAIN_BATCH_DELAY", 50);
+e::envconfig<uint64_t> hyperdaemon::CHAIN_BATCH_BYTES("HYPERDEX_CHAIN_BATCH_BYTES", 64ULL << 10);
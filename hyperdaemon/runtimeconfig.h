@@ -46,6 +46,56 @@ extern e::envconfig<size_t> LOCK_STRIPING;
 extern e::envconfig<size_t> TRANSFERS_IN_FLIGHT;
 extern e::envconfig<uint16_t> REPLICATION_HASHTABLE_SIZE;
 extern e::envconfig<uint16_t> STATE_TRANSFER_HASHTABLE_SIZE;
+// Non-zero selects the in-memory reference engine instead of hyperdisk for
+// every region this daemon stores.
+extern e::envconfig<unsigned int> MEMORY_ENGINE;
+// Limits, in bytes, on memory pinned by un-flushed write-ahead log entries,
+// both for a single region and for the daemon as a whole.  Above the soft
+// limit writes must help flush before being admitted; above the hard limit
+// client writes are rejected with NET_BACKOFF, and chain writes are dropped
+// for the upstream daemon to retransmit.
+extern e::envconfig<uint64_t> WAL_SOFT_LIMIT;
+extern e::envconfig<uint64_t> WAL_HARD_LIMIT;
+extern e::envconfig<uint64_t> DAEMON_WAL_SOFT_LIMIT;
+extern e::envconfig<uint64_t> DAEMON_WAL_HARD_LIMIT;
+// Microseconds a dirty region may wait before the flush threads prefer it
+// over regions with deeper logs.
+extern e::envconfig<uint64_t> FLUSH_MAX_DELAY;
+// Seconds between reports of flush-lag percentiles in the log.
+extern e::envconfig<unsigned int> FLUSH_LAG_REPORT_INTERVAL;
+// How many superseded versions of each object are kept for GET at a version.
+// Versions count each object's changes on its own, so this bounds the history
+// of single objects; it is not a window of time in which reads of many
+// objects see one snapshot.  Older versions are dropped when their shards are
+// cleaned or split.
+extern e::envconfig<uint64_t> OBJECT_HISTORY_VERSIONS;
+// Limits on open searches, for each client and for the daemon as a whole.  A
+// new search evicts the least recently used search once a limit is reached; 0
+// disables the limit.  Searches with no request for SEARCH_IDLE_TIMEOUT
+// seconds are dropped, and the search counters are logged every
+// SEARCH_REPORT_INTERVAL seconds.
+extern e::envconfig<size_t> SEARCHES_PER_CLIENT;
+extern e::envconfig<size_t> SEARCHES_MAX;
+extern e::envconfig<unsigned int> SEARCH_IDLE_TIMEOUT;
+extern e::envconfig<unsigned int> SEARCH_REPORT_INTERVAL;
+// Threads which scan the shards of a search in parallel.  With 0, each search
+// is scanned serially by the network thread which serves it.
+extern e::envconfig<unsigned int> SEARCH_THREADS;
+// Bytes of changes a watch may queue for a client which is slow to ask for
+// them.  A watch which exceeds this is ended with an overflow.
+extern e::envconfig<uint64_t> WATCH_QUEUE_BYTES;
+// Limits on watches, as for searches.  A watch whose client has asked for
+// nothing in WATCH_IDLE_TIMEOUT seconds is ended, along with its request if
+// one waits, so a client which waits longer on a quiet watch must watch again.
+extern e::envconfig<size_t> WATCHES_PER_CLIENT;
+extern e::envconfig<size_t> WATCHES_MAX;
+extern e::envconfig<unsigned int> WATCH_IDLE_TIMEOUT;
+// Chain messages to another daemon are coalesced into CHAIN_BATCH messages of
+// up to CHAIN_BATCH_BYTES, each held at most CHAIN_BATCH_DELAY microseconds.
+// A message to a daemon which has had nothing for that long goes out at once.
+// A delay of 0 disables batching.
+extern e::envconfig<uint64_t> CHAIN_BATCH_DELAY;
+extern e::envconfig<uint64_t> CHAIN_BATCH_BYTES;
 
 } // namespace hyperdaemon
 
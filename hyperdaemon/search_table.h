@@ -0,0 +1,316 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef hyperdaemon_search_table_h_
+#define hyperdaemon_search_table_h_
+
+// C
+#include <assert.h>
+#include <stdint.h>
+
+// STL
+#include <list>
+#include <map>
+#include <vector>
+
+namespace hyperdaemon
+{
+
+// The searches open at a daemon, in order of last use.  K names the part of a
+// search one region serves, and has a "client" member of type C naming the
+// client which opened it and a "search_number" member naming the search.  A
+// client's search reaches many regions under one search number, so the
+// per-client limit counts search numbers:  a client with "per_client"
+// searches open has every part of its least recently used search evicted to
+// make room for another.  The table evicts its least recently used parts once
+// it holds "max" of them.  A limit of 0 disables it.  The table does no
+// locking of its own.
+
+template <typename K, typename C, typename V>
+class search_table
+{
+    public:
+        search_table(size_t per_client, size_t max);
+        ~search_table() throw ();
+
+    public:
+        size_t size() const { return m_table.size(); }
+        size_t clients() const { return m_per_client.size(); }
+        // Insert "v" as the most recently used search, appending the
+        // searches evicted to make room to "evicted".  Parts of the search
+        // "k" belongs to are never evicted for it.  Fails if "k" is already
+        // in the table.
+        bool insert(const K& k, const V& v, uint64_t now, std::vector<V>* evicted);
+        // Find "k", and mark it used at "now".
+        bool lookup(const K& k, uint64_t now, V* v);
+        bool remove(const K& k, V* v);
+        // Remove the searches unused for "timeout" as of "now".
+        void expire(uint64_t now, uint64_t timeout, std::vector<V>* expired);
+        // Remove the searches whose names satisfy "pred".
+        template <typename P>
+        void remove_if(const P& pred, std::vector<V>* removed);
+        // Append the searches from "first" onward whose names satisfy "pred",
+        // stopping at the first name which does not.
+        template <typename P>
+        void scan(const K& first, const P& pred, std::vector<V>* vs) const;
+        void values(std::vector<V>* vs) const;
+
+    private:
+        typedef std::list<K> lru_t;
+
+        class entry
+        {
+            public:
+                entry() : value(), last_used(), lru() {}
+                entry(const V& v, uint64_t lu, typename lru_t::iterator l)
+                    : value(v), last_used(lu), lru(l) {}
+
+            public:
+                V value;
+                uint64_t last_used;
+                // The search's position in m_lru.
+                typename lru_t::iterator lru;
+        };
+
+        typedef std::map<K, entry> table_t;
+        // For each client, the number of parts of each of its searches.
+        typedef std::map<C, std::map<uint64_t, size_t> > per_client_t;
+
+    private:
+        void erase(typename table_t::iterator it, std::vector<V>* vs);
+
+    private:
+        search_table(const search_table&);
+
+    private:
+        search_table& operator = (const search_table&);
+
+    private:
+        const size_t m_max_per_client;
+        const size_t m_max;
+        table_t m_table;
+        // Every search in m_table, most recently used first.
+        lru_t m_lru;
+        per_client_t m_per_client;
+};
+
+template <typename K, typename C, typename V>
+search_table<K, C, V> :: search_table(size_t per_client, size_t max)
+    : m_max_per_client(per_client)
+    , m_max(max)
+    , m_table()
+    , m_lru()
+    , m_per_client()
+{
+}
+
+template <typename K, typename C, typename V>
+search_table<K, C, V> :: ~search_table() throw ()
+{
+}
+
+template <typename K, typename C, typename V>
+bool
+search_table<K, C, V> :: insert(const K& k, const V& v, uint64_t now, std::vector<V>* evicted)
+{
+    if (m_table.find(k) != m_table.end())
+    {
+        return false;
+    }
+
+    // Evict this client's least recently used searches first, as a client
+    // which opens many searches is most likely to have abandoned some.
+    typename per_client_t::iterator pc = m_per_client.find(k.client);
+
+    while (m_max_per_client > 0 && pc != m_per_client.end() &&
+           pc->second.size() >= m_max_per_client &&
+           pc->second.find(k.search_number) == pc->second.end())
+    {
+        typename lru_t::reverse_iterator l = m_lru.rbegin();
+
+        while (!(l->client == k.client))
+        {
+            ++l;
+            assert(l != m_lru.rend());
+        }
+
+        uint64_t victim = l->search_number;
+        std::vector<K> parts;
+
+        for (l = m_lru.rbegin(); l != m_lru.rend(); ++l)
+        {
+            if (l->client == k.client && l->search_number == victim)
+            {
+                parts.push_back(*l);
+            }
+        }
+
+        for (size_t i = 0; i < parts.size(); ++i)
+        {
+            erase(m_table.find(parts[i]), evicted);
+        }
+
+        pc = m_per_client.find(k.client);
+    }
+
+    while (m_max > 0 && m_table.size() >= m_max && !m_lru.empty())
+    {
+        erase(m_table.find(m_lru.back()), evicted);
+    }
+
+    m_lru.push_front(k);
+    m_table.insert(std::make_pair(k, entry(v, now, m_lru.begin())));
+    ++m_per_client[k.client][k.search_number];
+    return true;
+}
+
+template <typename K, typename C, typename V>
+bool
+search_table<K, C, V> :: lookup(const K& k, uint64_t now, V* v)
+{
+    typename table_t::iterator it = m_table.find(k);
+
+    if (it == m_table.end())
+    {
+        return false;
+    }
+
+    *v = it->second.value;
+    it->second.last_used = now;
+    m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+    return true;
+}
+
+template <typename K, typename C, typename V>
+bool
+search_table<K, C, V> :: remove(const K& k, V* v)
+{
+    typename table_t::iterator it = m_table.find(k);
+
+    if (it == m_table.end())
+    {
+        return false;
+    }
+
+    *v = it->second.value;
+    erase(it, NULL);
+    return true;
+}
+
+template <typename K, typename C, typename V>
+void
+search_table<K, C, V> :: expire(uint64_t now, uint64_t timeout, std::vector<V>* expired)
+{
+    // m_lru is ordered by last use, so the idle searches are at the back.
+    while (!m_lru.empty())
+    {
+        typename table_t::iterator it = m_table.find(m_lru.back());
+        assert(it != m_table.end());
+
+        if (it->second.last_used + timeout > now)
+        {
+            break;
+        }
+
+        erase(it, expired);
+    }
+}
+
+template <typename K, typename C, typename V>
+template <typename P>
+void
+search_table<K, C, V> :: remove_if(const P& pred, std::vector<V>* removed)
+{
+    typename table_t::iterator it = m_table.begin();
+
+    while (it != m_table.end())
+    {
+        typename table_t::iterator cur = it;
+        ++it;
+
+        if (pred(cur->first))
+        {
+            erase(cur, removed);
+        }
+    }
+}
+
+template <typename K, typename C, typename V>
+template <typename P>
+void
+search_table<K, C, V> :: scan(const K& first, const P& pred, std::vector<V>* vs) const
+{
+    for (typename table_t::const_iterator it = m_table.lower_bound(first);
+            it != m_table.end() && pred(it->first); ++it)
+    {
+        vs->push_back(it->second.value);
+    }
+}
+
+template <typename K, typename C, typename V>
+void
+search_table<K, C, V> :: values(std::vector<V>* vs) const
+{
+    for (typename table_t::const_iterator it = m_table.begin(); it != m_table.end(); ++it)
+    {
+        vs->push_back(it->second.value);
+    }
+}
+
+template <typename K, typename C, typename V>
+void
+search_table<K, C, V> :: erase(typename table_t::iterator it, std::vector<V>* vs)
+{
+    assert(it != m_table.end());
+    typename per_client_t::iterator pc = m_per_client.find(it->first.client);
+    assert(pc != m_per_client.end());
+    std::map<uint64_t, size_t>::iterator parts = pc->second.find(it->first.search_number);
+    assert(parts != pc->second.end() && parts->second > 0);
+
+    if (--parts->second == 0)
+    {
+        pc->second.erase(parts);
+    }
+
+    if (pc->second.empty())
+    {
+        m_per_client.erase(pc);
+    }
+
+    if (vs)
+    {
+        vs->push_back(it->second.value);
+    }
+
+    m_lru.erase(it->second.lru);
+    m_table.erase(it);
+}
+
+} // namespace hyperdaemon
+
+#endif // hyperdaemon_search_table_h_
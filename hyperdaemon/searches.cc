@@ -25,19 +25,40 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#define __STDC_LIMIT_MACROS
+
+// C
+#include <cstdlib>
+
+// STL
+#include <algorithm>
+#include <map>
+#include <string>
+#include <tr1/functional>
+#include <tr1/memory>
+
 // Google Log
 #include <glog/logging.h>
 
+// e
+#include <e/timer.h>
+
 // HyperDisk
 #include "hyperdisk/hyperdisk/disk.h"
 #include "hyperdisk/hyperdisk/returncode.h"
 
 // HyperDex
+#include "hyperdex/hyperdex/network_constants.h"
+#include "hyperdex/hyperdex/ordering.h"
 #include "hyperdex/hyperdex/packing.h"
 
+// HyperspaceHashing
+#include "hyperspacehashing/hashes_internal.h"
+
 // HyperDaemon
 #include "hyperdaemon/datalayer.h"
 #include "hyperdaemon/logical.h"
+#include "hyperdaemon/runtimeconfig.h"
 #include "hyperdaemon/searches.h"
 
 using hyperdex::coordinatorlink;
@@ -46,6 +67,118 @@ using hyperdex::regionid;
 using hyperspacehashing::search;
 using hyperspacehashing::mask::coordinate;
 
+// A candidate for a sorted search, packed as it will be sent.  "sort" and
+// "key" point into "backing".
+class sorted_item
+{
+    public:
+        sorted_item() : backing(), sort(), key() {}
+
+    public:
+        std::tr1::shared_ptr<e::buffer> backing;
+        e::slice sort;
+        e::slice key;
+};
+
+class sorted_before
+{
+    public:
+        sorted_before(hyperdatatype type, bool descending)
+            : m_type(type), m_descending(descending) {}
+
+    public:
+        bool operator () (const e::slice& lhs_sort, const e::slice& lhs_key,
+                          const e::slice& rhs_sort, const e::slice& rhs_key) const
+        { return hyperdex::sorts_before(m_type, m_descending, lhs_sort, lhs_key, rhs_sort, rhs_key); }
+        bool operator () (const sorted_item& lhs, const sorted_item& rhs) const
+        { return (*this)(lhs.sort, lhs.key, rhs.sort, rhs.key); }
+
+    private:
+        hyperdatatype m_type;
+        bool m_descending;
+};
+
+// The (count, result) pair an aggregate sends for one group.  "count" is the
+// number of matching objects; "result" is the aggregate, which for COUNT is
+// tallied on its own.
+class aggregate_group
+{
+    public:
+        aggregate_group() : count(0), result(0) {}
+
+    public:
+        void add(hyperaggregate func, int64_t num)
+        {
+            switch (func)
+            {
+                case HYPERAGGREGATE_COUNT:
+                    ++result;
+                    break;
+                case HYPERAGGREGATE_SUM:
+                    // Wraps rather than failing on overflow.
+                    result = static_cast<uint64_t>(result) + static_cast<uint64_t>(num);
+                    break;
+                case HYPERAGGREGATE_MIN:
+                    result = count == 0 ? num : std::min(result, num);
+                    break;
+                case HYPERAGGREGATE_MAX:
+                    result = count == 0 ? num : std::max(result, num);
+                    break;
+                default:
+                    abort();
+            }
+
+            ++count;
+        }
+
+    public:
+        uint64_t count;
+        int64_t result;
+};
+
+class hyperdaemon::searches::not_in_region
+{
+    public:
+        not_in_region(const hyperdex::configuration& config, const hyperdex::instance& us)
+            : m_config(config), m_us(us) {}
+
+    public:
+        bool operator () (const search_id& id) const
+        { return !m_config.in_region(m_us, id.region); }
+
+    private:
+        const hyperdex::configuration& m_config;
+        const hyperdex::instance& m_us;
+};
+
+class hyperdaemon::searches::same_client
+{
+    public:
+        same_client(const hyperdex::regionid& region, const hyperdex::entityid& client)
+            : m_region(region), m_client(client) {}
+
+    public:
+        bool operator () (const search_id& id) const
+        { return id.region == m_region && id.client == m_client; }
+
+    private:
+        const hyperdex::regionid m_region;
+        const hyperdex::entityid m_client;
+};
+
+// Clients pick their batch size, but no single batch may exceed this many bytes
+// (unless one object alone is larger).
+static const uint64_t MAX_BATCH_BYTES = 1 << 20;
+// A sorted search's results go back in a single message, which may not exceed
+// this many bytes.  A search whose first "limit" matches are larger fails with
+// NET_OVERFLOW.
+static const uint64_t MAX_SORTED_BYTES = 64 << 20;
+// A scan thread visits at most this many objects of a part before giving
+// other searches a turn.  A part stops scanning while its search has this many
+// matches queued, and resumes once the queue is half empty.
+static const size_t SCAN_CHUNK = 1024;
+static const size_t MAX_FOUND = 4096;
+
 hyperdaemon :: searches :: searches(coordinatorlink* cl,
                                     datalayer* data,
                                     logical* comm)
@@ -53,12 +186,43 @@ hyperdaemon :: searches :: searches(coordinatorlink* cl,
     , m_data(data)
     , m_comm(comm)
     , m_config()
-    , m_searches(16)
+    , m_searches_lock()
+    , m_searches(SEARCHES_PER_CLIENT, SEARCHES_MAX)
+    , m_searches_started(0)
+    , m_searches_finished(0)
+    , m_searches_expired(0)
+    , m_searches_evicted(0)
+    , m_shutdown(false)
+    , m_periodic_thread(std::tr1::bind(&searches::periodic, this))
+    , m_scan_lock()
+    , m_scan_cond(&m_scan_lock)
+    , m_scan_queue()
+    , m_scan_threads()
 {
+    m_periodic_thread.start();
+
+    for (size_t i = 0; i < SEARCH_THREADS; ++i)
+    {
+        std::tr1::shared_ptr<po6::threads::thread>
+            t(new po6::threads::thread(std::tr1::bind(&searches::scan_thread, this)));
+        t->start();
+        m_scan_threads.push_back(t);
+    }
 }
 
 hyperdaemon :: searches :: ~searches() throw ()
 {
+    if (!m_shutdown)
+    {
+        shutdown();
+    }
+
+    m_periodic_thread.join();
+
+    for (size_t i = 0; i < m_scan_threads.size(); ++i)
+    {
+        m_scan_threads[i]->join();
+    }
 }
 
 void
@@ -69,9 +233,21 @@ hyperdaemon :: searches :: prepare(const hyperdex::configuration&,
 
 void
 hyperdaemon :: searches :: reconfigure(const hyperdex::configuration& newconfig,
-                                       const hyperdex::instance&)
+                                       const hyperdex::instance& us)
 {
     m_config = newconfig;
+    // Searches of regions we no longer hold would pin their shards forever.
+    std::vector<e::intrusive_ptr<search_state> > dropped;
+
+    {
+        po6::threads::mutex::hold hold(&m_searches_lock);
+        m_searches.remove_if(not_in_region(newconfig, us), &dropped);
+    }
+
+    for (size_t i = 0; i < dropped.size(); ++i)
+    {
+        cancel_search(dropped[i]);
+    }
 }
 
 void
@@ -80,63 +256,154 @@ hyperdaemon :: searches :: cleanup(const hyperdex::configuration&,
 {
 }
 
+void
+hyperdaemon :: searches :: shutdown()
+{
+    // Cancel every search so that no network thread waits on a scan thread
+    // which is about to exit.
+    std::vector<e::intrusive_ptr<search_state> > open;
+
+    {
+        po6::threads::mutex::hold hold(&m_searches_lock);
+        m_searches.values(&open);
+    }
+
+    for (size_t i = 0; i < open.size(); ++i)
+    {
+        cancel_search(open[i]);
+    }
+
+    po6::threads::mutex::hold hold(&m_scan_lock);
+    m_shutdown = true;
+    m_scan_cond.broadcast();
+}
+
 void
 hyperdaemon :: searches :: start(const hyperdex::entityid& us,
                                  const hyperdex::entityid& client,
                                  uint64_t search_num,
                                  uint64_t nonce,
                                  std::auto_ptr<e::buffer> msg,
-                                 const hyperspacehashing::search& terms)
+                                 const hyperspacehashing::search& terms,
+                                 uint32_t batch_items,
+                                 uint64_t batch_bytes,
+                                 const std::vector<uint16_t>* attrs)
 {
-    search_id key(us.get_region(), client, search_num);
+    start(us, client, search_num, nonce, msg, terms, false, false, UINT64_MAX,
+          batch_items, batch_bytes, attrs);
+}
 
-    if (m_searches.contains(key))
+void
+hyperdaemon :: searches :: scan(const hyperdex::entityid& us,
+                                const hyperdex::entityid& client,
+                                uint64_t search_num,
+                                uint64_t nonce,
+                                std::auto_ptr<e::buffer> msg,
+                                const hyperspacehashing::search& terms,
+                                uint64_t limit,
+                                bool descending)
+{
+    if (resume_scan(us, client, search_num, nonce, terms, limit, descending))
     {
-        LOG(INFO) << "DROPPED";
         return;
     }
 
+    start(us, client, search_num, nonce, msg, terms, true, descending, limit, 0, 0, NULL);
+}
+
+void
+hyperdaemon :: searches :: start(const hyperdex::entityid& us,
+                                 const hyperdex::entityid& client,
+                                 uint64_t search_num,
+                                 uint64_t nonce,
+                                 std::auto_ptr<e::buffer> msg,
+                                 const hyperspacehashing::search& terms,
+                                 bool ordered,
+                                 bool descending,
+                                 uint64_t limit,
+                                 uint32_t batch_items,
+                                 uint64_t batch_bytes,
+                                 const std::vector<uint16_t>* attrs)
+{
+    search_id key(us.get_region(), client, search_num);
+
     if (m_config.dimensions(us.get_space()) != terms.size())
     {
         LOG(INFO) << "DROPPED";
         return;
     }
 
-    bool done = false;
-
-    while(!done)
+    for (size_t i = 0; attrs && i < attrs->size(); ++i)
     {
-        hyperdisk::returncode ret = m_data->flush(us.get_region(), -1, false);
-
-        if (ret == hyperdisk::SUCCESS)
+        if ((*attrs)[i] < 1 || (*attrs)[i] >= terms.size())
         {
-            done = true;
+            LOG(INFO) << "DROPPED";
+            return;
         }
-        else if (ret == hyperdisk::DIDNOTHING)
+    }
+
+    hyperspacehashing::mask::hasher hasher(m_config.disk_hasher(us.get_subspace()));
+    hyperspacehashing::mask::coordinate coord(hasher.hash(terms));
+    e::intrusive_ptr<hyperdisk::snapshot> snap;
+    std::vector<e::intrusive_ptr<hyperdisk::snapshot> > parts;
+
+    if (ordered)
+    {
+        snap = m_data->make_ordered_snapshot(us.get_region(), terms, descending);
+    }
+    else if (batch_items > 0 && !m_scan_threads.empty())
+    {
+        if (!m_data->make_partitioned_snapshot(us.get_region(), terms, &parts))
         {
-            done = true;
+            send_ended(us, client, nonce, hyperdex::NET_SERVERERROR);
+            return;
         }
-        else if (ret == hyperdisk::DATAFULL || ret == hyperdisk::SEARCHFULL)
+
+        // Nothing to gain from the scan threads with a single part.
+        if (parts.size() == 1)
         {
-            hyperdisk::returncode ioret;
-            ioret = m_data->do_mandatory_io(us.get_region());
+            snap = parts[0];
+            parts.clear();
+        }
+    }
+    else
+    {
+        snap = m_data->make_snapshot(us.get_region(), terms);
+    }
+
+    e::intrusive_ptr<search_state> state = new search_state(us.get_region(), coord, msg, terms, snap, limit,
+                                                          batch_items, batch_bytes, attrs);
+    state->parts.swap(parts);
+    state->scanning = state->parts.size();
+    state->search_number = search_num;
 
-            if (ioret != hyperdisk::SUCCESS && ioret != hyperdisk::DIDNOTHING)
+    // Only a scan of a range of keys, and nothing else, can be continued.
+    if (ordered && terms.is_range(0))
+    {
+        state->resumable = true;
+        state->descending = descending;
+        terms.range_value(0, &state->resume_lower, &state->resume_upper);
+
+        for (size_t i = 1; i < terms.size(); ++i)
+        {
+            if (terms.is_equality(i) || terms.is_range(i) || terms.is_prefix(i))
             {
-                PLOG(ERROR) << "Disk I/O returned " << ioret;
+                state->resumable = false;
             }
         }
-        else
-        {
-            PLOG(ERROR) << "Disk flush returned " << ret;
-        }
     }
 
-    hyperspacehashing::mask::hasher hasher(m_config.disk_hasher(us.get_subspace()));
-    hyperspacehashing::mask::coordinate coord(hasher.hash(terms));
-    e::intrusive_ptr<hyperdisk::snapshot> snap = m_data->make_snapshot(us.get_region(), terms);
-    e::intrusive_ptr<search_state> state = new search_state(us.get_region(), coord, msg, terms, snap);
-    m_searches.insert(key, state);
+    if (!insert_search(key, state))
+    {
+        LOG(INFO) << "DROPPED";
+        return;
+    }
+
+    for (size_t i = 0; i < state->parts.size(); ++i)
+    {
+        submit_scan(state, i);
+    }
+
     next(us, client, search_num, nonce);
 }
 
@@ -149,31 +416,67 @@ hyperdaemon :: searches :: next(const hyperdex::entityid& us,
     search_id key(us.get_region(), client, search_num);
     e::intrusive_ptr<search_state> state;
 
-    if (!m_searches.lookup(key, &state))
+    if (!lookup_search(key, &state))
     {
-        LOG(INFO) << "DROPPED";
+        // The search was evicted or expired, so the client must not wait for
+        // the rest of it.
+        send_ended(us, client, nonce, hyperdex::NET_NOTFOUND);
         return;
     }
 
+    // Other requests for the search need not wait behind the scan threads.
+    if (!state->parts.empty())
+    {
+        wait_for_matches(state);
+    }
+
     po6::threads::mutex::hold hold(&state->lock);
 
-    while (state->snap->valid())
+    if (state->batch_items > 0)
+    {
+        next_batch(us, client, search_num, nonce, state);
+        return;
+    }
+
+    while (state->remaining > 0 && state->snap->valid())
     {
         if (state->search_coord.intersects(state->snap->coordinate()))
         {
-            if (state->terms.matches(state->snap->key(), state->snap->value()))
+            if (state->predicate.matches(state->snap->key(), state->snap->value()))
             {
                 size_t sz = m_comm->header_size() + sizeof(uint64_t)
                           + sizeof(uint32_t) + state->snap->key().size()
-                          + hyperdex::packspace(state->snap->value());
+                          + hyperdex::packspace(state->value());
                 std::auto_ptr<e::buffer> msg(e::buffer::create(sz));
                 bool fits = !(msg->pack_at(m_comm->header_size())
                                 << nonce
                                 << state->snap->key()
-                                << state->snap->value()).error();
+                                << state->value()).error();
                 assert(fits);
                 m_comm->send(us, client, hyperdex::RESP_SEARCH_ITEM, msg);
+
+                if (state->resumable)
+                {
+                    // Keys are ordered by the unsigned value of their first
+                    // eight bytes (see hyperdisk/key_order.h).
+                    uint64_t order = hyperspacehashing::lendian(state->snap->key());
+
+                    if (state->descending)
+                    {
+                        state->resume_upper = order;
+                    }
+                    else if (order < UINT64_MAX)
+                    {
+                        state->resume_lower = order + 1;
+                    }
+                    else
+                    {
+                        state->resumable = false;
+                    }
+                }
+
                 state->snap->next();
+                --state->remaining;
                 return;
             }
         }
@@ -185,21 +488,655 @@ hyperdaemon :: searches :: next(const hyperdex::entityid& us,
     bool fits = !(msg->pack_at(m_comm->header_size()) << nonce).error();
     assert(fits);
     m_comm->send(us, client, hyperdex::RESP_SEARCH_DONE, msg);
+
+    // Keep a scan with objects left for the client's next page.
+    if (state->resumable && state->remaining == 0 && state->snap->valid())
+    {
+        state->stopped = true;
+        return;
+    }
+
     stop(us, client, search_num);
 }
 
+// Must be called with state->lock held.
+void
+hyperdaemon :: searches :: next_batch(const hyperdex::entityid& us,
+                                      const hyperdex::entityid& client,
+                                      uint64_t search_num,
+                                      uint64_t nonce,
+                                      e::intrusive_ptr<search_state> state)
+{
+    size_t used = m_comm->header_size() + sizeof(uint64_t)
+                + sizeof(uint8_t) + sizeof(uint32_t);
+    std::auto_ptr<e::buffer> msg(e::buffer::create(used + state->batch_bytes));
+    uint32_t count = 0;
+    const e::slice* key;
+    const std::vector<e::slice>* value;
+
+    while (count < state->batch_items && state->remaining > 0 &&
+           peek_match(state, &key, &value))
+    {
+        size_t sz = sizeof(uint32_t) + key->size()
+                  + hyperdex::packspace(*value);
+
+        if (used + sz > msg->capacity())
+        {
+            // Leave this object for the next batch.
+            if (count > 0)
+            {
+                break;
+            }
+
+            // It does not fit in an empty batch, so send it alone.
+            msg.reset(e::buffer::create(used + sz));
+        }
+
+        bool fits = !(msg->pack_at(used) << *key << *value).error();
+        assert(fits);
+        used += sz;
+        ++count;
+        --state->remaining;
+        pop_match(state);
+    }
+
+    // The search left the table while this request waited for the scan
+    // threads.
+    if (count == 0 && state->cancelled)
+    {
+        send_ended(us, client, nonce, hyperdex::NET_NOTFOUND);
+        return;
+    }
+
+    // Tell the client when this is the last batch so that it need not ask for
+    // an empty one.
+    bool done = state->remaining == 0 || !more_matches(state);
+    uint8_t flags = done ? 1 : 0;
+    bool fits = !(msg->pack_at(m_comm->header_size()) << nonce << flags << count).error();
+    assert(fits);
+    m_comm->send(us, client, hyperdex::RESP_SEARCH_BATCH, msg);
+
+    if (done)
+    {
+        stop(us, client, search_num);
+    }
+}
+
 void
 hyperdaemon :: searches :: stop(const hyperdex::entityid& us,
                                 const hyperdex::entityid& client,
                                 uint64_t search_num)
 {
-    m_searches.remove(search_id(us.get_region(), client, search_num));
+    remove_search(search_id(us.get_region(), client, search_num));
+}
+
+void
+hyperdaemon :: searches :: aggregate(const hyperdex::entityid& us,
+                                     const hyperdex::entityid& client,
+                                     uint64_t nonce,
+                                     const hyperspacehashing::search& terms,
+                                     hyperaggregate func,
+                                     uint16_t attr,
+                                     uint16_t group_by)
+{
+    std::vector<hyperdex::attribute> dims = m_config.dimension_names(us.get_space());
+    // Without a group_by attribute, everything lands in the group named by
+    // the empty string, which is sent even when nothing matches so that
+    // counts of zero come back.
+    std::map<std::string, aggregate_group> groups;
+    hyperdex::network_returncode result = hyperdex::NET_SUCCESS;
+
+    if (dims.size() != terms.size() || attr >= dims.size() || group_by >= dims.size() ||
+        (func != HYPERAGGREGATE_COUNT && dims[attr].type != HYPERDATATYPE_INT64))
+    {
+        result = hyperdex::NET_BADDIMSPEC;
+    }
+    else
+    {
+        if (group_by == 0)
+        {
+            groups[std::string()] = aggregate_group();
+        }
+
+        hyperspacehashing::mask::hasher hasher(m_config.disk_hasher(us.get_subspace()));
+        hyperspacehashing::mask::coordinate coord(hasher.hash(terms));
+        hyperspacehashing::compiled_search predicate(terms);
+        e::intrusive_ptr<hyperdisk::snapshot> snap = m_data->make_snapshot(us.get_region(), terms);
+
+        for (; snap->valid(); snap->next())
+        {
+            if (!coord.intersects(snap->coordinate()) ||
+                !predicate.matches(snap->key(), snap->value()))
+            {
+                continue;
+            }
+
+            const e::slice& g(group_by == 0 ? e::slice() : snap->value()[group_by - 1]);
+            aggregate_group& agg(groups[std::string(reinterpret_cast<const char*>(g.data()), g.size())]);
+            int64_t num = 0;
+
+            if (func != HYPERAGGREGATE_COUNT)
+            {
+                num = hyperdex::int64_value(attr == 0 ? snap->key() : snap->value()[attr - 1]);
+            }
+
+            agg.add(func, num);
+        }
+    }
+
+    size_t sz = m_comm->header_size() + sizeof(uint64_t)
+              + sizeof(uint16_t) + sizeof(uint32_t);
+
+    for (std::map<std::string, aggregate_group>::iterator g = groups.begin();
+            g != groups.end(); ++g)
+    {
+        sz += sizeof(uint32_t) + g->first.size() + sizeof(uint64_t) + sizeof(int64_t);
+    }
+
+    std::auto_ptr<e::buffer> msg(e::buffer::create(sz));
+    e::buffer::packer pa = msg->pack_at(m_comm->header_size());
+    pa = pa << nonce << static_cast<uint16_t>(result) << static_cast<uint32_t>(groups.size());
+
+    for (std::map<std::string, aggregate_group>::iterator g = groups.begin();
+            g != groups.end(); ++g)
+    {
+        pa = pa << e::slice(g->first.data(), g->first.size())
+                << g->second.count << g->second.result;
+    }
+
+    assert(!pa.error());
+    m_comm->send(us, client, hyperdex::RESP_AGGREGATE, msg);
+}
+
+void
+hyperdaemon :: searches :: sorted_search(const hyperdex::entityid& us,
+                                         const hyperdex::entityid& client,
+                                         uint64_t nonce,
+                                         const hyperspacehashing::search& terms,
+                                         uint16_t sort_by,
+                                         uint64_t limit,
+                                         bool descending)
+{
+    std::vector<hyperdex::attribute> dims = m_config.dimension_names(us.get_space());
+    // A heap holding the best "limit" objects seen so far, with the one which
+    // would be sent last on top.
+    std::vector<sorted_item> heap;
+    uint64_t heap_bytes = 0;
+    hyperdex::network_returncode result = hyperdex::NET_SUCCESS;
+
+    if (dims.size() != terms.size() || sort_by >= dims.size())
+    {
+        result = hyperdex::NET_BADDIMSPEC;
+    }
+    else
+    {
+        uint64_t k = limit == 0 ? UINT64_MAX : limit;
+        sorted_before before(dims[sort_by].type, descending);
+        hyperspacehashing::mask::hasher hasher(m_config.disk_hasher(us.get_subspace()));
+        hyperspacehashing::mask::coordinate coord(hasher.hash(terms));
+        hyperspacehashing::compiled_search predicate(terms);
+        e::intrusive_ptr<hyperdisk::snapshot> snap = m_data->make_snapshot(us.get_region(), terms);
+
+        for (; snap->valid(); snap->next())
+        {
+            if (!coord.intersects(snap->coordinate()) ||
+                !predicate.matches(snap->key(), snap->value()))
+            {
+                continue;
+            }
+
+            const e::slice& key(snap->key());
+            const std::vector<e::slice>& value(snap->value());
+
+            // Only copy objects which make the cut.
+            if (heap.size() >= k &&
+                !before(sort_by == 0 ? key : value[sort_by - 1], key,
+                        heap.front().sort, heap.front().key))
+            {
+                continue;
+            }
+
+            sorted_item item;
+            item.backing.reset(e::buffer::create(sizeof(uint32_t) + key.size()
+                                                 + hyperdex::packspace(value)));
+            bool fits = !(item.backing->pack() << key << value).error();
+            assert(fits);
+            std::vector<e::slice> packed_value;
+            bool unpacked = !(item.backing->unpack() >> item.key >> packed_value).error();
+            assert(unpacked);
+            item.sort = sort_by == 0 ? item.key : packed_value[sort_by - 1];
+
+            if (heap.size() >= k)
+            {
+                std::pop_heap(heap.begin(), heap.end(), before);
+                heap_bytes -= heap.back().backing->size();
+                heap.pop_back();
+            }
+
+            heap_bytes += item.backing->size();
+            heap.push_back(item);
+            std::push_heap(heap.begin(), heap.end(), before);
+
+            if (heap_bytes > MAX_SORTED_BYTES)
+            {
+                result = hyperdex::NET_OVERFLOW;
+                heap.clear();
+                break;
+            }
+        }
+
+        std::sort_heap(heap.begin(), heap.end(), before);
+    }
+
+    size_t sz = m_comm->header_size() + sizeof(uint64_t)
+              + sizeof(uint16_t) + sizeof(uint32_t);
+
+    for (size_t i = 0; i < heap.size(); ++i)
+    {
+        sz += heap[i].backing->size();
+    }
+
+    std::auto_ptr<e::buffer> msg(e::buffer::create(sz));
+    e::buffer::packer pa = msg->pack_at(m_comm->header_size());
+    pa = pa << nonce << static_cast<uint16_t>(result) << static_cast<uint32_t>(heap.size());
+
+    for (size_t i = 0; i < heap.size(); ++i)
+    {
+        pa = pa.copy(heap[i].backing->as_slice());
+    }
+
+    assert(!pa.error());
+    m_comm->send(us, client, hyperdex::RESP_SORTED_SEARCH, msg);
+}
+
+bool
+hyperdaemon :: searches :: insert_search(const search_id& id,
+                                         e::intrusive_ptr<search_state> state)
+{
+    std::vector<e::intrusive_ptr<search_state> > evicted;
+
+    {
+        po6::threads::mutex::hold hold(&m_searches_lock);
+
+        if (!m_searches.insert(id, state, e::time(), &evicted))
+        {
+            return false;
+        }
+
+        m_searches_evicted += evicted.size();
+        ++m_searches_started;
+    }
+
+    // Any next() already holding an evicted state finishes with it; dropping
+    // the table's reference releases the snapshot after that.  The scan
+    // threads drop their references as soon as they see it is cancelled.
+    for (size_t i = 0; i < evicted.size(); ++i)
+    {
+        cancel_search(evicted[i]);
+    }
+
+    return true;
+}
+
+bool
+hyperdaemon :: searches :: lookup_search(const search_id& id,
+                                         e::intrusive_ptr<search_state>* state)
+{
+    po6::threads::mutex::hold hold(&m_searches_lock);
+    return m_searches.lookup(id, e::time(), state);
+}
+
+void
+hyperdaemon :: searches :: remove_search(const search_id& id)
+{
+    e::intrusive_ptr<search_state> state;
+
+    {
+        po6::threads::mutex::hold hold(&m_searches_lock);
+
+        if (!m_searches.remove(id, &state))
+        {
+            return;
+        }
+
+        ++m_searches_finished;
+    }
+
+    cancel_search(state);
+}
+
+bool
+hyperdaemon :: searches :: resume_scan(const hyperdex::entityid& us,
+                                       const hyperdex::entityid& client,
+                                       uint64_t search_num,
+                                       uint64_t nonce,
+                                       const hyperspacehashing::search& terms,
+                                       uint64_t limit,
+                                       bool descending)
+{
+    if (!terms.is_range(0))
+    {
+        return false;
+    }
+
+    uint64_t lower;
+    uint64_t upper;
+    terms.range_value(0, &lower, &upper);
+    std::vector<e::intrusive_ptr<search_state> > states;
+    bool resumed = false;
+
+    {
+        po6::threads::mutex::hold hold(&m_searches_lock);
+        m_searches.scan(search_id(us.get_region(), client, 0),
+                        same_client(us.get_region(), client), &states);
+    }
+
+    for (size_t i = 0; i < states.size(); ++i)
+    {
+        e::intrusive_ptr<search_state> state = states[i];
+        po6::threads::mutex::hold hold(&state->lock);
+
+        if (!state->stopped || state->descending != descending ||
+            state->resume_lower != lower || state->resume_upper != upper)
+        {
+            continue;
+        }
+
+        e::intrusive_ptr<search_state> removed;
+
+        {
+            po6::threads::mutex::hold hold_table(&m_searches_lock);
+
+            // Lost to eviction or expiry since the table was scanned.
+            if (!m_searches.remove(search_id(us.get_region(), client, state->search_number), &removed))
+            {
+                continue;
+            }
+
+            ++m_searches_finished;
+        }
+
+        state->stopped = false;
+        state->remaining = limit;
+        state->search_number = search_num;
+
+        if (!insert_search(search_id(us.get_region(), client, search_num), state))
+        {
+            LOG(INFO) << "DROPPED";
+            cancel_search(state);
+            return true;
+        }
+
+        resumed = true;
+        break;
+    }
+
+    if (resumed)
+    {
+        next(us, client, search_num, nonce);
+    }
+
+    return resumed;
+}
+
+void
+hyperdaemon :: searches :: cancel_search(e::intrusive_ptr<search_state> state)
+{
+    po6::threads::mutex::hold hold(&state->found_lock);
+    state->cancelled = true;
+    // Parked parts will never be resumed.  The others stop the next time a
+    // scan thread picks them up.
+    state->scanning -= state->parked.size();
+    state->parked.clear();
+    state->found_cond.broadcast();
+}
+
+void
+hyperdaemon :: searches :: expire_searches()
+{
+    std::vector<e::intrusive_ptr<search_state> > expired;
+
+    {
+        po6::threads::mutex::hold hold(&m_searches_lock);
+        m_searches.expire(e::time(), SEARCH_IDLE_TIMEOUT * 1000000000ULL, &expired);
+        m_searches_expired += expired.size();
+    }
+
+    for (size_t i = 0; i < expired.size(); ++i)
+    {
+        cancel_search(expired[i]);
+    }
+}
+
+void
+hyperdaemon :: searches :: report_searches()
+{
+    po6::threads::mutex::hold hold(&m_searches_lock);
+    LOG(INFO) << "Searches: open=" << m_searches.size()
+              << " clients=" << m_searches.clients()
+              << " started=" << m_searches_started
+              << " finished=" << m_searches_finished
+              << " expired=" << m_searches_expired
+              << " evicted=" << m_searches_evicted;
+}
+
+void
+hyperdaemon :: searches :: send_ended(const hyperdex::entityid& us,
+                                      const hyperdex::entityid& client,
+                                      uint64_t nonce,
+                                      hyperdex::network_returncode result)
+{
+    // The return code tells the client that the search ended early.
+    size_t sz = m_comm->header_size() + sizeof(uint64_t) + sizeof(uint16_t);
+    std::auto_ptr<e::buffer> msg(e::buffer::create(sz));
+    bool fits = !(msg->pack_at(m_comm->header_size())
+                    << nonce << static_cast<uint16_t>(result)).error();
+    assert(fits);
+    m_comm->send(us, client, hyperdex::RESP_SEARCH_DONE, msg);
+}
+
+void
+hyperdaemon :: searches :: periodic()
+{
+    LOG(WARNING) << "Search expiry thread started.";
+    uint64_t last_report = e::time();
+
+    while (!m_shutdown)
+    {
+        expire_searches();
+
+        if (e::time() - last_report >= SEARCH_REPORT_INTERVAL * 1000000000ULL)
+        {
+            report_searches();
+            last_report = e::time();
+        }
+
+        e::sleep_ms(250);
+    }
+}
+
+void
+hyperdaemon :: searches :: submit_scan(e::intrusive_ptr<search_state> state, size_t part)
+{
+    po6::threads::mutex::hold hold(&m_scan_lock);
+    m_scan_queue.push_back(std::make_pair(state, part));
+    m_scan_cond.signal();
 }
 
-uint64_t
-hyperdaemon :: searches :: hash(const search_id& si)
+void
+hyperdaemon :: searches :: scan_part(e::intrusive_ptr<search_state> state, size_t part)
 {
-    return si.region.hash() + si.client.hash() + si.search_number;
+    std::vector<std::pair<e::slice, std::vector<e::slice> > > matches;
+    hyperdisk::snapshot* snap = state->parts[part].get();
+
+    for (size_t i = 0; !state->cancelled && i < SCAN_CHUNK && snap->valid(); ++i, snap->next())
+    {
+        if (!state->search_coord.intersects(snap->coordinate()) ||
+            !state->predicate.matches(snap->key(), snap->value()))
+        {
+            continue;
+        }
+
+        // The slices point into the part's shard or log entries, which the
+        // search state keeps alive.
+        matches.push_back(std::make_pair(snap->key(), std::vector<e::slice>()));
+
+        if (state->partial)
+        {
+            bool projected = hyperdex::project(snap->value(), state->attrs, &matches.back().second);
+            assert(projected);
+        }
+        else
+        {
+            matches.back().second = snap->value();
+        }
+    }
+
+    bool resubmit = false;
+
+    {
+        po6::threads::mutex::hold hold(&state->found_lock);
+        state->found.insert(state->found.end(), matches.begin(), matches.end());
+
+        if (state->cancelled || !snap->valid())
+        {
+            --state->scanning;
+        }
+        else if (state->found.size() >= MAX_FOUND)
+        {
+            state->parked.push_back(part);
+        }
+        else
+        {
+            resubmit = true;
+        }
+
+        state->found_cond.broadcast();
+    }
+
+    // Go to the back of the queue so that other searches get a turn.
+    if (resubmit)
+    {
+        submit_scan(state, part);
+    }
+}
+
+void
+hyperdaemon :: searches :: scan_thread()
+{
+    LOG(WARNING) << "Started search-scan thread.";
+
+    while (true)
+    {
+        std::pair<e::intrusive_ptr<search_state>, size_t> task;
+
+        {
+            po6::threads::mutex::hold hold(&m_scan_lock);
+
+            while (!m_shutdown && m_scan_queue.empty())
+            {
+                m_scan_cond.wait();
+            }
+
+            // Every search is cancelled by now, so the remaining tasks only
+            // need to account for their parts.
+            if (m_shutdown && m_scan_queue.empty())
+            {
+                break;
+            }
+
+            task = m_scan_queue.front();
+            m_scan_queue.pop_front();
+        }
+
+        scan_part(task.first, task.second);
+    }
+}
+
+bool
+hyperdaemon :: searches :: peek_match(e::intrusive_ptr<search_state> state,
+                                      const e::slice** key,
+                                      const std::vector<e::slice>** value)
+{
+    if (state->parts.empty())
+    {
+        for (; state->snap->valid(); state->snap->next())
+        {
+            if (state->search_coord.intersects(state->snap->coordinate()) &&
+                state->predicate.matches(state->snap->key(), state->snap->value()))
+            {
+                *key = &state->snap->key();
+                *value = &state->value();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // The batch goes out with what the scan threads have found so far.
+    po6::threads::mutex::hold hold(&state->found_lock);
+
+    if (state->found.empty())
+    {
+        return false;
+    }
+
+    // Only this thread removes from "found", and adding to the back of a deque
+    // does not move its elements, so these stay valid until pop_match.
+    *key = &state->found.front().first;
+    *value = &state->found.front().second;
+    return true;
+}
+
+void
+hyperdaemon :: searches :: wait_for_matches(e::intrusive_ptr<search_state> state)
+{
+    po6::threads::mutex::hold hold(&state->found_lock);
+
+    while (state->found.empty() && state->scanning > 0 && !state->cancelled)
+    {
+        state->found_cond.wait();
+    }
+}
+
+void
+hyperdaemon :: searches :: pop_match(e::intrusive_ptr<search_state> state)
+{
+    if (state->parts.empty())
+    {
+        state->snap->next();
+        return;
+    }
+
+    std::vector<size_t> resume;
+
+    {
+        po6::threads::mutex::hold hold(&state->found_lock);
+        state->found.pop_front();
+
+        if (state->found.size() <= MAX_FOUND / 2)
+        {
+            resume.swap(state->parked);
+        }
+    }
+
+    for (size_t i = 0; i < resume.size(); ++i)
+    {
+        submit_scan(state, resume[i]);
+    }
+}
+
+bool
+hyperdaemon :: searches :: more_matches(e::intrusive_ptr<search_state> state)
+{
+    if (state->parts.empty())
+    {
+        return state->snap->valid();
+    }
+
+    po6::threads::mutex::hold hold(&state->found_lock);
+    return !state->found.empty() || state->scanning > 0;
 }
 
 
@@ -207,17 +1144,55 @@ hyperdaemon :: searches :: search_state :: search_state(const regionid& r,
                                                         const coordinate& sc,
                                                         std::auto_ptr<e::buffer> msg,
                                                         const hyperspacehashing::search& t,
-                                                        e::intrusive_ptr<hyperdisk::snapshot> s)
+                                                        e::intrusive_ptr<hyperdisk::snapshot> s,
+                                                        uint64_t l,
+                                                        uint32_t bi,
+                                                        uint64_t bb,
+                                                        const std::vector<uint16_t>* a)
     : lock()
     , region(r)
     , search_coord(sc)
     , backing(msg)
     , terms(t)
+    , predicate(terms)
     , snap(s)
+    , remaining(l)
+    , batch_items(bi)
+    , batch_bytes(std::min(bb, MAX_BATCH_BYTES))
+    , partial(a != NULL)
+    , attrs(a ? *a : std::vector<uint16_t>())
+    , parts()
+    , found_lock()
+    , found_cond(&found_lock)
+    , found()
+    , scanning(0)
+    , parked()
+    , cancelled(false)
+    , resumable(false)
+    , descending(false)
+    , resume_lower(0)
+    , resume_upper(0)
+    , stopped(false)
+    , search_number(0)
     , m_ref(0)
+    , m_projected()
 {
 }
 
 hyperdaemon :: searches :: search_state :: ~search_state() throw ()
 {
 }
+
+const std::vector<e::slice>&
+hyperdaemon :: searches :: search_state :: value()
+{
+    if (!partial)
+    {
+        return snap->value();
+    }
+
+    // start checked attrs against the space, so this cannot fail.
+    bool projected = hyperdex::project(snap->value(), attrs, &m_projected);
+    assert(projected);
+    return m_projected;
+}
@@ -28,19 +28,31 @@
 #ifndef hyperdaemon_searches_h_
 #define hyperdaemon_searches_h_
 
+// STL
+#include <deque>
+#include <map>
+#include <tr1/memory>
+#include <vector>
+
 // po6
+#include <po6/threads/cond.h>
 #include <po6/threads/mutex.h>
+#include <po6/threads/thread.h>
 
 // e
 #include <e/intrusive_ptr.h>
-#include <e/lockfree_hash_map.h>
 #include <e/tuple_compare.h>
 
 // HyperspaceHashing
 #include "hyperspacehashing/hyperspacehashing/search.h"
 
 // HyperDex
+#include "hyperdex.h"
 #include "hyperdex/hyperdex/ids.h"
+#include "hyperdex/hyperdex/network_constants.h"
+
+// HyperDaemon
+#include "hyperdaemon/search_table.h"
 
 // Forward Declarations
 namespace hyperdex
@@ -66,6 +78,7 @@ class searches
         void prepare(const hyperdex::configuration& newconfig, const hyperdex::instance& us);
         void reconfigure(const hyperdex::configuration& newconfig, const hyperdex::instance& us);
         void cleanup(const hyperdex::configuration& newconfig, const hyperdex::instance& us);
+        void shutdown();
 
     public:
         void start(const hyperdex::entityid& us,
@@ -73,7 +86,24 @@ class searches
                    uint64_t searchid,
                    uint64_t nonce,
                    std::auto_ptr<e::buffer> msg,
-                   const hyperspacehashing::search& wc);
+                   const hyperspacehashing::search& wc,
+                   uint32_t batch_items,
+                   uint64_t batch_bytes,
+                   const std::vector<uint16_t>* attrs);
+        // As start, but return at most "limit" objects, in key order (or
+        // reverse key order if "descending").  A scan which stops at its
+        // limit stays open, so that the same client's scan of the rest of its
+        // range (starting just past the last key returned) continues from
+        // where it stopped, without sorting the region again.  The continued
+        // scan sees the objects as they were when the first one started.
+        void scan(const hyperdex::entityid& us,
+                  const hyperdex::entityid& client,
+                  uint64_t searchid,
+                  uint64_t nonce,
+                  std::auto_ptr<e::buffer> msg,
+                  const hyperspacehashing::search& wc,
+                  uint64_t limit,
+                  bool descending);
         void next(const hyperdex::entityid& us,
                   const hyperdex::entityid& client,
                   uint64_t searchid,
@@ -81,13 +111,103 @@ class searches
         void stop(const hyperdex::entityid& us,
                   const hyperdex::entityid& client,
                   uint64_t searchid);
+        // Apply "func" to "attr" of every object matching "wc", and send back
+        // the partial result for this region in a single RESP_AGGREGATE.  If
+        // "group_by" is non-zero, there is one result for each value of that
+        // attribute.
+        void aggregate(const hyperdex::entityid& us,
+                       const hyperdex::entityid& client,
+                       uint64_t nonce,
+                       const hyperspacehashing::search& wc,
+                       hyperaggregate func,
+                       uint16_t attr,
+                       uint16_t group_by);
+        // Send back, in a single RESP_SORTED_SEARCH, the first "limit" objects
+        // matching "wc" when ordered by attribute "sort_by" (all of them if
+        // "limit" is 0).  If those do not fit in MAX_SORTED_BYTES, send none,
+        // with NET_OVERFLOW.
+        void sorted_search(const hyperdex::entityid& us,
+                           const hyperdex::entityid& client,
+                           uint64_t nonce,
+                           const hyperspacehashing::search& wc,
+                           uint16_t sort_by,
+                           uint64_t limit,
+                           bool descending);
 
     private:
         class search_state;
         class search_id;
+        class not_in_region;
+        class same_client;
+        typedef search_table<search_id, hyperdex::entityid, e::intrusive_ptr<search_state> > table_t;
 
     private:
-        static uint64_t hash(const search_id&);
+        // The search table.  Each of these takes m_searches_lock.  A search
+        // is evicted to make room when its client already has
+        // SEARCHES_PER_CLIENT searches open (however many of this daemon's
+        // regions each reaches), or when the daemon has SEARCHES_MAX region
+        // searches, and expires after SEARCH_IDLE_TIMEOUT seconds without
+        // a request.  The client learns that its search is gone when it next
+        // asks for it.  Insert fails if the search already exists.
+        bool insert_search(const search_id& id, e::intrusive_ptr<search_state> state);
+        bool lookup_search(const search_id& id, e::intrusive_ptr<search_state>* state);
+        void remove_search(const search_id& id);
+        void cancel_search(e::intrusive_ptr<search_state> state);
+        // Move a scan of "client" which stopped at its limit, and whose
+        // range continues at "terms", to "searchid" and answer "nonce" with
+        // up to "limit" more objects.  Returns false if there is no such
+        // scan.
+        bool resume_scan(const hyperdex::entityid& us,
+                         const hyperdex::entityid& client,
+                         uint64_t searchid,
+                         uint64_t nonce,
+                         const hyperspacehashing::search& terms,
+                         uint64_t limit,
+                         bool descending);
+        // Answer a request for a search which ended early, such as one which
+        // is no longer in the table, with "result".
+        void send_ended(const hyperdex::entityid& us,
+                        const hyperdex::entityid& client,
+                        uint64_t nonce,
+                        hyperdex::network_returncode result);
+        void expire_searches();
+        void report_searches();
+        void periodic();
+        // Parallel scans.  Each part of a parallel search's snapshot is
+        // scanned a chunk at a time by the scan threads, which queue the
+        // matches in the search state for next_batch to send.
+        void submit_scan(e::intrusive_ptr<search_state> state, size_t part);
+        void scan_part(e::intrusive_ptr<search_state> state, size_t part);
+        void scan_thread();
+        // Block until a parallel search has a match queued or nothing left to
+        // scan.  This must be called without state->lock held.
+        void wait_for_matches(e::intrusive_ptr<search_state> state);
+        // The next match of the search, which stays current until pop_match.
+        // A parallel search has no next match while the scan threads have
+        // found nothing new, so a batch never waits once it holds a match.
+        // These must be called with state->lock held.
+        bool peek_match(e::intrusive_ptr<search_state> state,
+                        const e::slice** key,
+                        const std::vector<e::slice>** value);
+        void pop_match(e::intrusive_ptr<search_state> state);
+        bool more_matches(e::intrusive_ptr<search_state> state);
+        void start(const hyperdex::entityid& us,
+                   const hyperdex::entityid& client,
+                   uint64_t searchid,
+                   uint64_t nonce,
+                   std::auto_ptr<e::buffer> msg,
+                   const hyperspacehashing::search& wc,
+                   bool ordered,
+                   bool descending,
+                   uint64_t limit,
+                   uint32_t batch_items,
+                   uint64_t batch_bytes,
+                   const std::vector<uint16_t>* attrs);
+        void next_batch(const hyperdex::entityid& us,
+                        const hyperdex::entityid& client,
+                        uint64_t searchid,
+                        uint64_t nonce,
+                        e::intrusive_ptr<search_state> state);
 
     private:
         searches(const searches&);
@@ -100,7 +220,18 @@ class searches
         datalayer* m_data;
         logical* m_comm;
         hyperdex::configuration m_config;
-        e::lockfree_hash_map<search_id, e::intrusive_ptr<search_state>, hash> m_searches;
+        po6::threads::mutex m_searches_lock;
+        table_t m_searches;
+        uint64_t m_searches_started;
+        uint64_t m_searches_finished;
+        uint64_t m_searches_expired;
+        uint64_t m_searches_evicted;
+        volatile bool m_shutdown; // acessed from multiple threads
+        po6::threads::thread m_periodic_thread;
+        po6::threads::mutex m_scan_lock;
+        po6::threads::cond m_scan_cond;
+        std::deque<std::pair<e::intrusive_ptr<search_state>, size_t> > m_scan_queue;
+        std::vector<std::tr1::shared_ptr<po6::threads::thread> > m_scan_threads;
 };
 
 class searches::search_state
@@ -110,16 +241,57 @@ class searches::search_state
                      const hyperspacehashing::mask::coordinate& search_coord,
                      std::auto_ptr<e::buffer> msg,
                      const hyperspacehashing::search& terms,
-                     e::intrusive_ptr<hyperdisk::snapshot> snap);
+                     e::intrusive_ptr<hyperdisk::snapshot> snap,
+                     uint64_t limit,
+                     uint32_t batch_items,
+                     uint64_t batch_bytes,
+                     const std::vector<uint16_t>* attrs);
         ~search_state() throw ();
 
+    public:
+        // The value of the snapshot's current object, holding just "attrs"
+        // if the client asked for only some attributes.
+        const std::vector<e::slice>& value();
+
     public:
         po6::threads::mutex lock;
         const hyperdex::regionid region;
         const hyperspacehashing::mask::coordinate search_coord;
         const std::auto_ptr<e::buffer> backing;
         hyperspacehashing::search terms;
+        const hyperspacehashing::compiled_search predicate;
         e::intrusive_ptr<hyperdisk::snapshot> snap;
+        // How many more objects may be returned.
+        uint64_t remaining;
+        // Most objects/bytes packed into a single RESP_SEARCH_BATCH.  When
+        // batch_items is 0, objects go out one per RESP_SEARCH_ITEM.
+        const uint32_t batch_items;
+        const uint64_t batch_bytes;
+        const bool partial;
+        const std::vector<uint16_t> attrs;
+        // Set for a parallel search, in which case "snap" is unused.  Matches
+        // are queued in "found" (guarded by found_lock) by the scan threads.
+        // "scanning" counts the parts not yet exhausted, and "parked" holds
+        // the parts which stopped because "found" was full.
+        std::vector<e::intrusive_ptr<hyperdisk::snapshot> > parts;
+        po6::threads::mutex found_lock;
+        po6::threads::cond found_cond;
+        std::deque<std::pair<e::slice, std::vector<e::slice> > > found;
+        size_t scanning;
+        std::vector<size_t> parked;
+        // Set once the search leaves the search table.
+        volatile bool cancelled;
+        // Set for a scan which may be resumed (see scan).  The range of keys
+        // a scan continuing this one would ask for, which narrows past each
+        // object returned.  The scan is "stopped" once it has returned as
+        // many objects as it may, and is left in the table under
+        // "search_number".
+        bool resumable;
+        bool descending;
+        uint64_t resume_lower;
+        uint64_t resume_upper;
+        bool stopped;
+        uint64_t search_number;
 
     private:
         friend class e::intrusive_ptr<search_state>;
@@ -130,6 +302,7 @@ class searches::search_state
 
     private:
         size_t m_ref;
+        std::vector<e::slice> m_projected;
 };
 
 class searches::search_id
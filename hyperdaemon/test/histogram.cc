@@ -0,0 +1,146 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#define __STDC_LIMIT_MACROS
+
+// C
+#include <stdint.h>
+
+// STL
+#include <tr1/functional>
+#include <tr1/memory>
+#include <vector>
+
+// po6
+#include <po6/threads/thread.h>
+
+// Google Test
+#include <gtest/gtest.h>
+
+// HyperDaemon
+#include "hyperdaemon/histogram.h"
+
+#pragma GCC diagnostic ignored "-Wswitch-default"
+
+namespace
+{
+
+void
+add_many(hyperdaemon::histogram* h, uint64_t value, size_t times)
+{
+    for (size_t i = 0; i < times; ++i)
+    {
+        h->add(value);
+    }
+}
+
+TEST(HistogramTest, Empty)
+{
+    hyperdaemon::histogram h;
+    ASSERT_EQ(0U, h.count());
+    ASSERT_EQ(0U, h.percentile(0.5));
+}
+
+TEST(HistogramTest, BucketBoundaries)
+{
+    // Each sample reports the upper bound of its power-of-two bucket.
+    hyperdaemon::histogram h;
+    h.add(0);
+    ASSERT_EQ(0U, h.percentile(1.0));
+    h.reset();
+    h.add(1);
+    ASSERT_EQ(1U, h.percentile(1.0));
+    h.reset();
+    h.add(2);
+    ASSERT_EQ(3U, h.percentile(1.0));
+    h.reset();
+    h.add(3);
+    ASSERT_EQ(3U, h.percentile(1.0));
+    h.reset();
+    h.add(4);
+    ASSERT_EQ(7U, h.percentile(1.0));
+    h.reset();
+    h.add(1023);
+    ASSERT_EQ(1023U, h.percentile(1.0));
+    h.reset();
+    h.add(1024);
+    ASSERT_EQ(2047U, h.percentile(1.0));
+    h.reset();
+    h.add(UINT64_MAX);
+    ASSERT_EQ(UINT64_MAX, h.percentile(1.0));
+    h.reset();
+    h.add(1ULL << 63);
+    ASSERT_EQ(UINT64_MAX, h.percentile(1.0));
+    ASSERT_EQ(1U, h.count());
+}
+
+TEST(HistogramTest, Percentiles)
+{
+    hyperdaemon::histogram h;
+    add_many(&h, 1, 90);
+    add_many(&h, 100, 9);
+    add_many(&h, 10000, 1);
+    ASSERT_EQ(100U, h.count());
+    ASSERT_EQ(1U, h.percentile(0.5));
+    ASSERT_EQ(1U, h.percentile(0.9));
+    ASSERT_EQ(127U, h.percentile(0.95));
+    ASSERT_EQ(127U, h.percentile(0.99));
+    ASSERT_EQ(16383U, h.percentile(0.999));
+    h.reset();
+    ASSERT_EQ(0U, h.count());
+}
+
+TEST(HistogramTest, ConcurrentAdds)
+{
+    const size_t threads = 8;
+    const size_t adds = 100000;
+    hyperdaemon::histogram h;
+    std::vector<std::tr1::shared_ptr<po6::threads::thread> > ts;
+
+    for (size_t i = 0; i < threads; ++i)
+    {
+        std::tr1::shared_ptr<po6::threads::thread>
+            t(new po6::threads::thread(std::tr1::bind(add_many, &h, i, adds)));
+        t->start();
+        ts.push_back(t);
+    }
+
+    for (size_t i = 0; i < ts.size(); ++i)
+    {
+        ts[i]->join();
+    }
+
+    // No add is lost, and each lands in its value's bucket.
+    ASSERT_EQ(threads * adds, h.count());
+    ASSERT_EQ(0U, h.percentile(1. / threads));
+    ASSERT_EQ(1U, h.percentile(2. / threads));
+    ASSERT_EQ(3U, h.percentile(4. / threads));
+    ASSERT_EQ(7U, h.percentile(1.0));
+}
+
+} // namespace
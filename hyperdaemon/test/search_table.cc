@@ -0,0 +1,210 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// C
+#include <stdint.h>
+
+// STL
+#include <vector>
+
+// Google Test
+#include <gtest/gtest.h>
+
+// HyperDaemon
+#include "hyperdaemon/search_table.h"
+
+#pragma GCC diagnostic ignored "-Wswitch-default"
+
+namespace
+{
+
+class id
+{
+    public:
+        id(int c, int n, int r = 0) : client(c), search_number(n), region(r) {}
+
+    public:
+        bool operator < (const id& rhs) const
+        {
+            if (client != rhs.client) return client < rhs.client;
+            if (search_number != rhs.search_number) return search_number < rhs.search_number;
+            return region < rhs.region;
+        }
+
+    public:
+        int client;
+        uint64_t search_number;
+        int region;
+};
+
+typedef hyperdaemon::search_table<id, int, int> table;
+
+TEST(SearchTableTest, InsertLookupRemove)
+{
+    table t(0, 0);
+    std::vector<int> evicted;
+    int v = 0;
+
+    ASSERT_TRUE(t.insert(id(1, 1), 11, 0, &evicted));
+    ASSERT_FALSE(t.insert(id(1, 1), 12, 0, &evicted));
+    ASSERT_TRUE(t.insert(id(2, 1), 21, 0, &evicted));
+    ASSERT_TRUE(evicted.empty());
+    ASSERT_EQ(2U, t.size());
+    ASSERT_EQ(2U, t.clients());
+    ASSERT_TRUE(t.lookup(id(1, 1), 1, &v));
+    ASSERT_EQ(11, v);
+    ASSERT_FALSE(t.lookup(id(1, 2), 1, &v));
+    ASSERT_TRUE(t.remove(id(1, 1), &v));
+    ASSERT_EQ(11, v);
+    ASSERT_FALSE(t.remove(id(1, 1), &v));
+    ASSERT_EQ(1U, t.size());
+    ASSERT_EQ(1U, t.clients());
+}
+
+TEST(SearchTableTest, EvictPerClient)
+{
+    table t(2, 0);
+    std::vector<int> evicted;
+    int v = 0;
+
+    ASSERT_TRUE(t.insert(id(1, 1), 11, 0, &evicted));
+    ASSERT_TRUE(t.insert(id(1, 2), 12, 0, &evicted));
+    ASSERT_TRUE(t.insert(id(2, 1), 21, 0, &evicted));
+    // Using 1.1 leaves 1.2 as the client's least recently used search.
+    ASSERT_TRUE(t.lookup(id(1, 1), 1, &v));
+    ASSERT_TRUE(t.insert(id(1, 3), 13, 2, &evicted));
+    ASSERT_EQ(1U, evicted.size());
+    ASSERT_EQ(12, evicted[0]);
+    ASSERT_FALSE(t.lookup(id(1, 2), 3, &v));
+    // Other clients' searches are left alone.
+    ASSERT_TRUE(t.lookup(id(2, 1), 3, &v));
+    ASSERT_TRUE(t.lookup(id(1, 1), 3, &v));
+    ASSERT_TRUE(t.lookup(id(1, 3), 3, &v));
+    ASSERT_EQ(3U, t.size());
+}
+
+TEST(SearchTableTest, SearchSpansRegions)
+{
+    table t(2, 0);
+    std::vector<int> evicted;
+    int v = 0;
+
+    // One search reaching more regions than the per-client limit keeps them
+    // all.
+    for (int r = 0; r < 5; ++r)
+    {
+        ASSERT_TRUE(t.insert(id(1, 1, r), 110 + r, r, &evicted));
+    }
+
+    ASSERT_TRUE(evicted.empty());
+    ASSERT_TRUE(t.insert(id(1, 2, 0), 120, 5, &evicted));
+    ASSERT_TRUE(t.insert(id(1, 2, 1), 121, 6, &evicted));
+    ASSERT_TRUE(evicted.empty());
+    ASSERT_EQ(7U, t.size());
+    // A third search evicts every region of the least recently used one.
+    ASSERT_TRUE(t.insert(id(1, 3, 0), 130, 7, &evicted));
+    ASSERT_EQ(5U, evicted.size());
+
+    for (int r = 0; r < 5; ++r)
+    {
+        ASSERT_FALSE(t.lookup(id(1, 1, r), 8, &v));
+    }
+
+    ASSERT_TRUE(t.lookup(id(1, 2, 0), 8, &v));
+    ASSERT_TRUE(t.lookup(id(1, 2, 1), 8, &v));
+    ASSERT_TRUE(t.lookup(id(1, 3, 0), 8, &v));
+    ASSERT_EQ(3U, t.size());
+    ASSERT_EQ(1U, t.clients());
+}
+
+TEST(SearchTableTest, EvictGlobal)
+{
+    table t(0, 3);
+    std::vector<int> evicted;
+    int v = 0;
+
+    ASSERT_TRUE(t.insert(id(1, 1), 11, 0, &evicted));
+    ASSERT_TRUE(t.insert(id(2, 1), 21, 1, &evicted));
+    ASSERT_TRUE(t.insert(id(3, 1), 31, 2, &evicted));
+    ASSERT_TRUE(t.lookup(id(1, 1), 3, &v));
+    ASSERT_TRUE(t.insert(id(4, 1), 41, 4, &evicted));
+    ASSERT_EQ(1U, evicted.size());
+    ASSERT_EQ(21, evicted[0]);
+    ASSERT_TRUE(t.insert(id(5, 1), 51, 5, &evicted));
+    ASSERT_EQ(2U, evicted.size());
+    ASSERT_EQ(31, evicted[1]);
+    ASSERT_EQ(3U, t.size());
+    ASSERT_EQ(3U, t.clients());
+}
+
+TEST(SearchTableTest, Expire)
+{
+    table t(0, 0);
+    std::vector<int> expired;
+    int v = 0;
+
+    ASSERT_TRUE(t.insert(id(1, 1), 11, 0, &expired));
+    ASSERT_TRUE(t.insert(id(1, 2), 12, 5, &expired));
+    ASSERT_TRUE(t.insert(id(2, 1), 21, 10, &expired));
+    // Using a search keeps it from expiring.
+    ASSERT_TRUE(t.lookup(id(1, 1), 12, &v));
+    t.expire(15, 10, &expired);
+    ASSERT_EQ(1U, expired.size());
+    ASSERT_EQ(12, expired[0]);
+    t.expire(22, 10, &expired);
+    ASSERT_EQ(3U, expired.size());
+    ASSERT_EQ(0U, t.size());
+    ASSERT_EQ(0U, t.clients());
+}
+
+struct same_client
+{
+    same_client(int c) : client(c) {}
+    bool operator () (const id& i) const { return i.client == client; }
+    int client;
+};
+
+TEST(SearchTableTest, Scan)
+{
+    table t(0, 0);
+    std::vector<int> found;
+
+    ASSERT_TRUE(t.insert(id(1, 1), 11, 0, &found));
+    ASSERT_TRUE(t.insert(id(2, 1), 21, 0, &found));
+    ASSERT_TRUE(t.insert(id(2, 2), 22, 0, &found));
+    ASSERT_TRUE(t.insert(id(3, 1), 31, 0, &found));
+    t.scan(id(2, 0), same_client(2), &found);
+    ASSERT_EQ(2U, found.size());
+    ASSERT_EQ(21, found[0]);
+    ASSERT_EQ(22, found[1]);
+    found.clear();
+    t.scan(id(4, 0), same_client(4), &found);
+    ASSERT_TRUE(found.empty());
+}
+
+} // namespace
@@ -0,0 +1,596 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// STL
+#include <algorithm>
+#include <tr1/functional>
+
+// Google Log
+#include <glog/logging.h>
+
+// e
+#include <e/timer.h>
+
+// HyperDex
+#include "hyperdex/hyperdex/network_constants.h"
+#include "hyperdex/hyperdex/packing.h"
+
+// HyperDaemon
+#include "hyperdaemon/datalayer.h"
+#include "hyperdaemon/logical.h"
+#include "hyperdaemon/runtimeconfig.h"
+#include "hyperdaemon/watches.h"
+
+using hyperdex::entityid;
+using hyperdex::regionid;
+
+// The kinds of change carried by RESP_WATCH_BATCH.
+static const uint8_t WATCH_DEL = 0;
+static const uint8_t WATCH_PUT = 1;
+// Clients pick their batch size, but no single batch may exceed this many bytes
+// (unless one change alone is larger).
+static const uint64_t MAX_BATCH_BYTES = 1 << 20;
+
+// Pack one change as it will be sent.
+static e::buffer*
+pack_change(uint8_t kind,
+            const e::slice& key,
+            uint64_t version,
+            const std::vector<e::slice>& value)
+{
+    size_t sz = sizeof(uint8_t) + sizeof(uint32_t) + key.size() + sizeof(uint64_t)
+              + (kind == WATCH_PUT ? hyperdex::packspace(value) : 0);
+    std::auto_ptr<e::buffer> change(e::buffer::create(sz));
+    e::buffer::packer pa = change->pack_at(0) << kind << key << version;
+
+    if (kind == WATCH_PUT)
+    {
+        pa = pa << value;
+    }
+
+    assert(!pa.error());
+    return change.release();
+}
+
+hyperdaemon :: watches :: watches(datalayer* data,
+                                  logical* comm)
+    : m_data(data)
+    , m_comm(comm)
+    , m_config()
+    , m_watches_lock()
+    , m_watches(WATCHES_PER_CLIENT, WATCHES_MAX)
+    , m_region_watches()
+    , m_watched()
+    , m_shutdown(false)
+    , m_periodic_thread(std::tr1::bind(&watches::periodic, this))
+{
+    m_periodic_thread.start();
+}
+
+hyperdaemon :: watches :: ~watches() throw ()
+{
+    m_shutdown = true;
+    m_periodic_thread.join();
+}
+
+void
+hyperdaemon :: watches :: prepare(const hyperdex::configuration&,
+                                  const hyperdex::instance&)
+{
+}
+
+void
+hyperdaemon :: watches :: reconfigure(const hyperdex::configuration& newconfig,
+                                      const hyperdex::instance&)
+{
+    m_config = newconfig;
+}
+
+void
+hyperdaemon :: watches :: cleanup(const hyperdex::configuration& newconfig,
+                                  const hyperdex::instance& us)
+{
+    // A watch only sees changes while we are the point leader of its region.
+    // End the others so that their clients can watch the new point leader.
+    std::vector<e::intrusive_ptr<watch_state> > open;
+    std::vector<e::intrusive_ptr<watch_state> > ended;
+
+    {
+        po6::threads::mutex::hold hold(&m_watches_lock);
+        m_watches.values(&open);
+
+        for (size_t i = 0; i < open.size(); ++i)
+        {
+            e::intrusive_ptr<watch_state> state;
+
+            if ((!newconfig.is_point_leader(open[i]->us) ||
+                 newconfig.instancefor(open[i]->us) != us) &&
+                m_watches.remove(watch_id(open[i]->us.get_region(),
+                                          open[i]->client,
+                                          open[i]->watch_number), &state))
+            {
+                ended.push_back(state);
+            }
+        }
+
+        forget_watches(ended);
+    }
+
+    end_watches(ended);
+}
+
+void
+hyperdaemon :: watches :: start(const hyperdex::entityid& us,
+                                const hyperdex::entityid& client,
+                                uint64_t watchid,
+                                uint64_t nonce,
+                                std::auto_ptr<e::buffer> msg,
+                                const hyperspacehashing::search& terms,
+                                bool initial,
+                                uint32_t batch_items,
+                                uint64_t batch_bytes)
+{
+    if (m_config.dimensions(us.get_space()) != terms.size() || batch_items == 0)
+    {
+        LOG(INFO) << "DROPPED";
+        return;
+    }
+
+    if (!m_config.is_point_leader(us))
+    {
+        send_end(us, client, nonce, false);
+        return;
+    }
+
+    watch_id id(us.get_region(), client, watchid);
+    e::intrusive_ptr<watch_state> state = new watch_state(us, client, watchid, msg, terms, batch_items, batch_bytes);
+    state->waiting = true;
+    state->nonce = nonce;
+    // Changes which commit once the watch is in the table wait for the
+    // snapshot, so that the objects which matched at the start go first.
+    state->snapshotting = initial;
+    std::vector<e::intrusive_ptr<watch_state> > evicted;
+
+    {
+        po6::threads::mutex::hold hold_watches(&m_watches_lock);
+
+        if (!m_watches.insert(id, state, e::time(), &evicted))
+        {
+            LOG(INFO) << "DROPPED";
+            return;
+        }
+
+        if (++m_region_watches[id.region] == 1)
+        {
+            m_watched.insert(id.region, 1);
+        }
+
+        forget_watches(evicted);
+    }
+
+    end_watches(evicted);
+
+    if (!initial)
+    {
+        return;
+    }
+
+    // The snapshot merges the log, so it holds every change committed before
+    // the watch was in the table.  It is taken without the watch's lock,
+    // which commits to the region take in notify.
+    e::intrusive_ptr<hyperdisk::snapshot> snap;
+    snap = m_data->make_snapshot(us.get_region(), state->terms);
+    po6::threads::mutex::hold hold(&state->lock);
+    state->snapshotting = false;
+
+    // The watch overflowed, or was stopped or ended, while the snapshot was
+    // taken.  Its request has been answered.
+    if (!state->waiting)
+    {
+        return;
+    }
+
+    if (!snap)
+    {
+        state->waiting = false;
+        remove_watch(id);
+        send_end(us, client, nonce, false);
+        return;
+    }
+
+    state->snap = snap;
+    send_batch(state);
+}
+
+void
+hyperdaemon :: watches :: next(const hyperdex::entityid& us,
+                               const hyperdex::entityid& client,
+                               uint64_t watchid,
+                               uint64_t nonce)
+{
+    watch_id id(us.get_region(), client, watchid);
+    e::intrusive_ptr<watch_state> state;
+
+    if (!lookup_watch(id, &state))
+    {
+        // The watch ended (or never started) here, so the client must watch
+        // again.
+        send_end(us, client, nonce, false);
+        return;
+    }
+
+    po6::threads::mutex::hold hold(&state->lock);
+
+    if (state->ended)
+    {
+        send_end(us, client, nonce, false);
+        return;
+    }
+
+    if (state->overflowed)
+    {
+        state->waiting = false;
+        remove_watch(id);
+        send_end(us, client, nonce, true);
+        return;
+    }
+
+    state->waiting = true;
+    state->nonce = nonce;
+
+    if (!state->snapshotting && (state->snap || !state->changes.empty()))
+    {
+        send_batch(state);
+    }
+}
+
+void
+hyperdaemon :: watches :: stop(const hyperdex::entityid& us,
+                               const hyperdex::entityid& client,
+                               uint64_t watchid)
+{
+    watch_id id(us.get_region(), client, watchid);
+    e::intrusive_ptr<watch_state> state;
+
+    if (!lookup_watch(id, &state))
+    {
+        return;
+    }
+
+    // Answer the waiting request, if any, so that the client need not keep
+    // it open.
+    po6::threads::mutex::hold hold(&state->lock);
+    remove_watch(id);
+
+    if (state->waiting)
+    {
+        state->waiting = false;
+        send_end(us, client, state->nonce, false);
+    }
+}
+
+void
+hyperdaemon :: watches :: notify(const hyperdex::regionid& region,
+                                 const e::slice& key,
+                                 uint64_t version,
+                                 bool has_value,
+                                 const std::vector<e::slice>& value,
+                                 bool has_old_value,
+                                 const std::vector<e::slice>& old_value)
+{
+    if (!m_watched.contains(region))
+    {
+        return;
+    }
+
+    std::vector<e::intrusive_ptr<watch_state> > watching;
+
+    {
+        po6::threads::mutex::hold hold(&m_watches_lock);
+        m_watches.scan(watch_id(region, entityid(), 0), same_region(region), &watching);
+    }
+
+    // Each kind of change is packed at most once and shared by the watches.
+    std::tr1::shared_ptr<e::buffer> put;
+    std::tr1::shared_ptr<e::buffer> del;
+
+    for (size_t i = 0; i < watching.size(); ++i)
+    {
+        e::intrusive_ptr<watch_state> state = watching[i];
+        std::tr1::shared_ptr<e::buffer> change;
+
+        // A put of an object which no longer matches is, to the watch, the
+        // removal of an object which did.
+        if (has_value && state->predicate.matches(key, value))
+        {
+            if (!put)
+            {
+                put.reset(pack_change(WATCH_PUT, key, version, value));
+            }
+
+            change = put;
+        }
+        else if (has_old_value && state->predicate.matches(key, old_value))
+        {
+            if (!del)
+            {
+                del.reset(pack_change(WATCH_DEL, key, version, std::vector<e::slice>()));
+            }
+
+            change = del;
+        }
+        else
+        {
+            continue;
+        }
+
+        po6::threads::mutex::hold hold(&state->lock);
+
+        if (state->overflowed || state->ended)
+        {
+            continue;
+        }
+
+        if (state->changes_bytes + change->size() > WATCH_QUEUE_BYTES)
+        {
+            state->overflowed = true;
+            state->snap = NULL;
+            state->changes.clear();
+            state->changes_bytes = 0;
+
+            if (state->waiting)
+            {
+                state->waiting = false;
+                remove_watch(watch_id(region, state->client, state->watch_number));
+                send_end(state->us, state->client, state->nonce, true);
+            }
+
+            continue;
+        }
+
+        state->changes.push_back(change);
+        state->changes_bytes += change->size();
+
+        if (state->waiting && !state->snap && !state->snapshotting)
+        {
+            send_batch(state);
+        }
+    }
+}
+
+bool
+hyperdaemon :: watches :: lookup_watch(const watch_id& id,
+                                       e::intrusive_ptr<watch_state>* state)
+{
+    po6::threads::mutex::hold hold(&m_watches_lock);
+    return m_watches.lookup(id, e::time(), state);
+}
+
+void
+hyperdaemon :: watches :: remove_watch(const watch_id& id)
+{
+    po6::threads::mutex::hold hold(&m_watches_lock);
+    std::vector<e::intrusive_ptr<watch_state> > removed(1);
+
+    if (m_watches.remove(id, &removed[0]))
+    {
+        forget_watches(removed);
+    }
+}
+
+void
+hyperdaemon :: watches :: forget_watches(const std::vector<e::intrusive_ptr<watch_state> >& removed)
+{
+    for (size_t i = 0; i < removed.size(); ++i)
+    {
+        regionid region = removed[i]->us.get_region();
+        std::map<regionid, size_t>::iterator it = m_region_watches.find(region);
+        assert(it != m_region_watches.end() && it->second > 0);
+
+        if (--it->second == 0)
+        {
+            m_region_watches.erase(it);
+            m_watched.remove(region);
+        }
+    }
+}
+
+void
+hyperdaemon :: watches :: end_watches(const std::vector<e::intrusive_ptr<watch_state> >& ended)
+{
+    for (size_t i = 0; i < ended.size(); ++i)
+    {
+        po6::threads::mutex::hold hold(&ended[i]->lock);
+        ended[i]->ended = true;
+        ended[i]->snap = NULL;
+        ended[i]->changes.clear();
+        ended[i]->changes_bytes = 0;
+
+        if (ended[i]->waiting)
+        {
+            ended[i]->waiting = false;
+            send_end(ended[i]->us, ended[i]->client, ended[i]->nonce, false);
+        }
+    }
+}
+
+void
+hyperdaemon :: watches :: expire_watches()
+{
+    std::vector<e::intrusive_ptr<watch_state> > expired;
+
+    {
+        po6::threads::mutex::hold hold(&m_watches_lock);
+        m_watches.expire(e::time(), WATCH_IDLE_TIMEOUT * 1000000000ULL, &expired);
+        forget_watches(expired);
+    }
+
+    end_watches(expired);
+}
+
+void
+hyperdaemon :: watches :: periodic()
+{
+    LOG(WARNING) << "Watch expiry thread started.";
+
+    while (!m_shutdown)
+    {
+        expire_watches();
+        e::sleep_ms(250);
+    }
+}
+
+void
+hyperdaemon :: watches :: send_batch(e::intrusive_ptr<watch_state> state)
+{
+    assert(state->waiting);
+    size_t used = m_comm->header_size() + sizeof(uint64_t)
+                + sizeof(uint8_t) + sizeof(uint32_t);
+    std::auto_ptr<e::buffer> msg(e::buffer::create(used + state->batch_bytes));
+    uint32_t count = 0;
+
+    // The objects which matched at the start go out before any change.
+    while (state->snap && count < state->batch_items)
+    {
+        if (!state->snap->valid())
+        {
+            state->snap = NULL;
+            break;
+        }
+
+        if (!state->predicate.matches(state->snap->key(), state->snap->value()))
+        {
+            state->snap->next();
+            continue;
+        }
+
+        size_t sz = sizeof(uint8_t) + sizeof(uint32_t) + state->snap->key().size()
+                  + sizeof(uint64_t) + hyperdex::packspace(state->snap->value());
+
+        if (used + sz > msg->capacity())
+        {
+            // Leave this object for the next batch.
+            if (count > 0)
+            {
+                break;
+            }
+
+            // It does not fit in an empty batch, so send it alone.
+            msg.reset(e::buffer::create(used + sz));
+        }
+
+        bool fits = !(msg->pack_at(used) << WATCH_PUT << state->snap->key()
+                                         << state->snap->version()
+                                         << state->snap->value()).error();
+        assert(fits);
+        used += sz;
+        ++count;
+        state->snap->next();
+    }
+
+    while (!state->snap && !state->changes.empty() && count < state->batch_items)
+    {
+        std::tr1::shared_ptr<e::buffer> change = state->changes.front();
+
+        if (used + change->size() > msg->capacity())
+        {
+            if (count > 0)
+            {
+                break;
+            }
+
+            msg.reset(e::buffer::create(used + change->size()));
+        }
+
+        bool fits = !msg->pack_at(used).copy(change->as_slice()).error();
+        assert(fits);
+        used += change->size();
+        ++count;
+        state->changes.pop_front();
+        state->changes_bytes -= change->size();
+    }
+
+    if (count == 0)
+    {
+        // Nothing matched the rest of the snapshot; wait for a change.
+        return;
+    }
+
+    uint8_t flags = 0;
+    bool fits = !(msg->pack_at(m_comm->header_size()) << state->nonce << flags << count).error();
+    assert(fits);
+    state->waiting = false;
+    m_comm->send(state->us, state->client, hyperdex::RESP_WATCH_BATCH, msg);
+}
+
+void
+hyperdaemon :: watches :: send_end(const entityid& us,
+                                   const entityid& client,
+                                   uint64_t nonce,
+                                   bool overflowed)
+{
+    size_t sz = m_comm->header_size() + sizeof(uint64_t)
+              + sizeof(uint8_t) + sizeof(uint32_t);
+    std::auto_ptr<e::buffer> msg(e::buffer::create(sz));
+    uint8_t flags = overflowed ? 3 : 1;
+    bool fits = !(msg->pack_at(m_comm->header_size()) << nonce << flags << static_cast<uint32_t>(0)).error();
+    assert(fits);
+    m_comm->send(us, client, hyperdex::RESP_WATCH_BATCH, msg);
+}
+
+hyperdaemon :: watches :: watch_state :: watch_state(const entityid& u,
+                                                     const entityid& c,
+                                                     uint64_t wn,
+                                                     std::auto_ptr<e::buffer> m,
+                                                     const hyperspacehashing::search& t,
+                                                     uint32_t bi,
+                                                     uint64_t bb)
+    : lock()
+    , us(u)
+    , client(c)
+    , watch_number(wn)
+    , backing(m)
+    , terms(t)
+    , predicate(t)
+    , batch_items(bi)
+    , batch_bytes(std::min(bb, MAX_BATCH_BYTES))
+    , snap()
+    , snapshotting(false)
+    , changes()
+    , changes_bytes(0)
+    , overflowed(false)
+    , ended(false)
+    , waiting(false)
+    , nonce(0)
+    , m_ref(0)
+{
+}
+
+hyperdaemon :: watches :: watch_state :: ~watch_state() throw ()
+{
+}
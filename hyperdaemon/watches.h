@@ -0,0 +1,266 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef hyperdaemon_watches_h_
+#define hyperdaemon_watches_h_
+
+// STL
+#include <deque>
+#include <map>
+#include <memory>
+#include <tr1/memory>
+#include <vector>
+
+// po6
+#include <po6/threads/mutex.h>
+#include <po6/threads/thread.h>
+
+// e
+#include <e/buffer.h>
+#include <e/intrusive_ptr.h>
+#include <e/lockfree_hash_map.h>
+#include <e/slice.h>
+#include <e/tuple_compare.h>
+
+// HyperspaceHashing
+#include "hyperspacehashing/hyperspacehashing/search.h"
+
+// HyperDisk
+#include "hyperdisk/hyperdisk/snapshot.h"
+
+// HyperDex
+#include "hyperdex/hyperdex/configuration.h"
+#include "hyperdex/hyperdex/ids.h"
+
+// HyperDaemon
+#include "hyperdaemon/search_table.h"
+
+// Forward Declarations
+namespace hyperdaemon
+{
+class datalayer;
+class logical;
+}
+
+namespace hyperdaemon
+{
+
+// Continuous queries.  A watch lives at the point leader of a region, which
+// sees every change to the region's objects as it commits, and holds the
+// changes to objects matching the watch's search until the client asks for
+// them.  Each request is answered once there is something to send, so changes
+// which commit while the client works on one batch go out in the next.
+// Watches are limited and expire as searches do (see WATCHES_PER_CLIENT).
+class watches
+{
+    public:
+        watches(datalayer* data, logical* comm);
+        ~watches() throw ();
+
+    public:
+        void prepare(const hyperdex::configuration& newconfig, const hyperdex::instance& us);
+        void reconfigure(const hyperdex::configuration& newconfig, const hyperdex::instance& us);
+        void cleanup(const hyperdex::configuration& newconfig, const hyperdex::instance& us);
+
+    public:
+        // Watch the objects matching "wc".  If "initial", the objects which
+        // match when the watch starts are sent first, as puts.  This is also
+        // the first request for changes.  "wc" refers to "msg", which the
+        // watch keeps for as long as it lives.
+        void start(const hyperdex::entityid& us,
+                   const hyperdex::entityid& client,
+                   uint64_t watchid,
+                   uint64_t nonce,
+                   std::auto_ptr<e::buffer> msg,
+                   const hyperspacehashing::search& wc,
+                   bool initial,
+                   uint32_t batch_items,
+                   uint64_t batch_bytes);
+        void next(const hyperdex::entityid& us,
+                  const hyperdex::entityid& client,
+                  uint64_t watchid,
+                  uint64_t nonce);
+        void stop(const hyperdex::entityid& us,
+                  const hyperdex::entityid& client,
+                  uint64_t watchid);
+        // Called by the replication manager, with the key's lock held, when
+        // the change to "key" at "version" commits at the point leader.
+        // "old_value" is the value the change replaced, if there was one.
+        void notify(const hyperdex::regionid& region,
+                    const e::slice& key,
+                    uint64_t version,
+                    bool has_value,
+                    const std::vector<e::slice>& value,
+                    bool has_old_value,
+                    const std::vector<e::slice>& old_value);
+
+    private:
+        class watch_state;
+        class watch_id;
+        class same_region;
+        typedef search_table<watch_id, hyperdex::entityid, e::intrusive_ptr<watch_state> > table_t;
+        static uint64_t regionid_hash(const hyperdex::regionid& r) { return r.hash(); }
+        typedef e::lockfree_hash_map<hyperdex::regionid, uint64_t, regionid_hash>
+                watched_map_t;
+
+    private:
+        bool lookup_watch(const watch_id& id, e::intrusive_ptr<watch_state>* state);
+        void remove_watch(const watch_id& id);
+        // Drop the regions of watches removed from m_watches from the
+        // watched regions.  Must be called with m_watches_lock held.
+        void forget_watches(const std::vector<e::intrusive_ptr<watch_state> >& removed);
+        // Answer the requests waiting on watches which have been removed, and
+        // release what they hold.  Must be called without m_watches_lock.
+        void end_watches(const std::vector<e::intrusive_ptr<watch_state> >& ended);
+        void expire_watches();
+        void periodic();
+        // Answer the request waiting on "state" with what it holds.  Must be
+        // called with state->lock held.
+        void send_batch(e::intrusive_ptr<watch_state> state);
+        // Answer a request with an empty batch which ends the watch.
+        void send_end(const hyperdex::entityid& us,
+                      const hyperdex::entityid& client,
+                      uint64_t nonce,
+                      bool overflowed);
+
+    private:
+        watches(const watches&);
+
+    private:
+        watches& operator = (const watches&);
+
+    private:
+        datalayer* m_data;
+        logical* m_comm;
+        hyperdex::configuration m_config;
+        po6::threads::mutex m_watches_lock;
+        table_t m_watches;
+        // The number of watches on each region, and the regions with any,
+        // which commits check without the lock so that they need not take it
+        // for a region nobody watches.
+        std::map<hyperdex::regionid, size_t> m_region_watches;
+        watched_map_t m_watched;
+        volatile bool m_shutdown;
+        po6::threads::thread m_periodic_thread;
+};
+
+class watches::watch_state
+{
+    public:
+        watch_state(const hyperdex::entityid& us,
+                    const hyperdex::entityid& client,
+                    uint64_t watch_number,
+                    std::auto_ptr<e::buffer> msg,
+                    const hyperspacehashing::search& terms,
+                    uint32_t batch_items,
+                    uint64_t batch_bytes);
+        ~watch_state() throw ();
+
+    public:
+        po6::threads::mutex lock;
+        const hyperdex::entityid us;
+        const hyperdex::entityid client;
+        const uint64_t watch_number;
+        const std::auto_ptr<e::buffer> backing;
+        const hyperspacehashing::search terms;
+        const hyperspacehashing::compiled_search predicate;
+        // Most changes/bytes packed into a single RESP_WATCH_BATCH.  A change
+        // bigger than batch_bytes goes out alone.
+        const uint32_t batch_items;
+        const uint64_t batch_bytes;
+        // The objects which matched when the watch started and are yet to be
+        // sent, or NULL.  They go out before any change.
+        e::intrusive_ptr<hyperdisk::snapshot> snap;
+        // Set while the snapshot is being taken.  Changes are queued, but none
+        // is sent until the snapshot is in place.
+        bool snapshotting;
+        // Changes yet to be sent, each packed as it will be sent.
+        std::deque<std::tr1::shared_ptr<e::buffer> > changes;
+        uint64_t changes_bytes;
+        // Set once "changes" would have exceeded WATCH_QUEUE_BYTES.  The
+        // changes are dropped, and the next request ends the watch.
+        bool overflowed;
+        // Set once the watch is evicted, expired, or ended by a
+        // reconfiguration.  A request which finds it ends the watch.
+        bool ended;
+        // Set while the request with "nonce" waits for a change.
+        bool waiting;
+        uint64_t nonce;
+
+    private:
+        friend class e::intrusive_ptr<watch_state>;
+
+    private:
+        void inc() { __sync_add_and_fetch(&m_ref, 1); }
+        void dec() { if (__sync_sub_and_fetch(&m_ref, 1) == 0) delete this; }
+
+    private:
+        size_t m_ref;
+};
+
+class watches::watch_id
+{
+    public:
+        watch_id(const hyperdex::regionid re,
+                 const hyperdex::entityid cl,
+                 uint64_t wn)
+        : region(re), client(cl), search_number(wn) {}
+        ~watch_id() throw () {}
+
+    public:
+        int compare(const watch_id& other) const
+        { return e::tuple_compare(region, client, search_number,
+                                  other.region, other.client, other.search_number); }
+
+    public:
+        bool operator < (const watch_id& rhs) const { return compare(rhs) < 0; }
+        bool operator == (const watch_id& rhs) const { return compare(rhs) == 0; }
+        bool operator != (const watch_id& rhs) const { return compare(rhs) != 0; }
+
+    public:
+        hyperdex::regionid region;
+        hyperdex::entityid client;
+        // The watch number, under the name search_table expects.
+        uint64_t search_number;
+};
+
+class watches::same_region
+{
+    public:
+        same_region(const hyperdex::regionid& r) : m_region(r) {}
+
+    public:
+        bool operator () (const watch_id& id) const { return id.region == m_region; }
+
+    private:
+        hyperdex::regionid m_region;
+};
+
+} // namespace hyperdaemon
+
+#endif // hyperdaemon_watches_h_
@@ -60,6 +60,15 @@ enum hyperdatatype
     HYPERDATATYPE_GARBAGE   = 9087
 };
 
+/* Aggregate occupies [9088, 9104) */
+enum hyperaggregate
+{
+    HYPERAGGREGATE_COUNT    = 9088,
+    HYPERAGGREGATE_SUM      = 9089,
+    HYPERAGGREGATE_MIN      = 9090,
+    HYPERAGGREGATE_MAX      = 9091
+};
+
 #ifdef __cplusplus
 
 // C++
@@ -98,6 +107,23 @@ operator << (std::ostream& lhs, hyperdatatype rhs)
     return lhs;
 }
 
+inline std::ostream&
+operator << (std::ostream& lhs, hyperaggregate rhs)
+{
+    switch (rhs)
+    {
+        stringify(HYPERAGGREGATE_COUNT);
+        stringify(HYPERAGGREGATE_SUM);
+        stringify(HYPERAGGREGATE_MIN);
+        stringify(HYPERAGGREGATE_MAX);
+        default:
+            lhs << "AGGREGATE UNKNOWN";
+            break;
+    }
+
+    return lhs;
+}
+
 #undef stringify
 #undef xstr
 #undef str
@@ -397,7 +397,7 @@ hyperdex :: configuration :: search_entities(const spaceid& si,
     std::map<entityid, instance>::const_iterator end;
     start = m_entities.lower_bound(hyperdex::entityid(si.space, 0, 0, 0, 0));
     end   = m_entities.upper_bound(hyperdex::entityid(si.space, UINT16_MAX, UINT8_MAX, UINT64_MAX, UINT8_MAX));
-    return _search_entities(start, end, s);
+    return _search_entities(start, end, s, NULL);
 }
 
 std::map<hyperdex::entityid, hyperdex::instance>
@@ -408,7 +408,19 @@ hyperdex :: configuration :: search_entities(const subspaceid& ssi,
     std::map<entityid, instance>::const_iterator end;
     start = m_entities.lower_bound(hyperdex::entityid(ssi.space, ssi.subspace, 0, 0, 0));
     end   = m_entities.upper_bound(hyperdex::entityid(ssi.space, ssi.subspace, UINT8_MAX, UINT64_MAX, UINT8_MAX));
-    return _search_entities(start, end, s);
+    return _search_entities(start, end, s, NULL);
+}
+
+void
+hyperdex :: configuration :: search_fanout(const spaceid& si,
+                                           const hyperspacehashing::search& s,
+                                           size_t* contacted, size_t* regions) const
+{
+    std::map<entityid, instance>::const_iterator start;
+    std::map<entityid, instance>::const_iterator end;
+    start = m_entities.lower_bound(hyperdex::entityid(si.space, 0, 0, 0, 0));
+    end   = m_entities.upper_bound(hyperdex::entityid(si.space, UINT16_MAX, UINT8_MAX, UINT64_MAX, UINT8_MAX));
+    *contacted = _search_entities(start, end, s, regions).size();
 }
 
 hyperdex::instance
@@ -506,10 +518,12 @@ hyperdex :: configuration :: shutdown() const
 std::map<hyperdex::entityid, hyperdex::instance>
 hyperdex :: configuration :: _search_entities(std::map<entityid, instance>::const_iterator iter,
                                               std::map<entityid, instance>::const_iterator end,
-                                              const hyperspacehashing::search& s) const
+                                              const hyperspacehashing::search& s,
+                                              size_t* regions) const
 {
     typedef std::map<uint16_t, std::map<hyperdex::entityid, hyperdex::instance> > candidates_map;
     candidates_map candidates;
+    std::map<uint16_t, size_t> totals;
 
     bool hashed = false;
     uint16_t hashed_subspace = 0;
@@ -529,14 +543,24 @@ hyperdex :: configuration :: _search_entities(std::map<entityid, instance>::cons
             hashed_subspace = iter->first.subspace;
         }
 
-        if (iter->first.get_region() != prevreg && sc.matches(iter->first.coord()))
+        // Every entity in a region's chain has the same coordinate, so only
+        // the first needs to be checked.
+        if (iter->first.get_region() == prevreg)
+        {
+            continue;
+        }
+
+        prevreg = iter->first.get_region();
+        ++totals[iter->first.subspace];
+
+        if (sc.matches(iter->first.coord()))
         {
             candidates[iter->first.subspace].insert(*iter);
-            prevreg = iter->first.get_region();
         }
     }
 
     bool set = false;
+    uint16_t chosen = 0;
     std::map<hyperdex::entityid, hyperdex::instance> ret;
 
     for (candidates_map::iterator c = candidates.begin(); c != candidates.end(); ++c)
@@ -544,10 +568,15 @@ hyperdex :: configuration :: _search_entities(std::map<entityid, instance>::cons
         if (c->second.size() < ret.size() || !set)
         {
             ret.swap(c->second);
+            chosen = c->first;
             set = true;
         }
     }
 
+    if (regions)
+    {
+        *regions = set ? totals[chosen] : 0;
+    }
+
     return ret;
 }
-
@@ -39,6 +39,9 @@ hyperdex :: configuration_parser :: configuration_parser()
     , m_subspaces()
     , m_repl_attrs()
     , m_disk_attrs()
+    , m_prefix_attrs()
+    , m_equality_hashes()
+    , m_distributions()
     , m_regions()
     , m_entities()
     , m_transfers()
@@ -79,13 +82,17 @@ hyperdex :: configuration_parser :: generate()
 
     for (ri = m_repl_attrs.begin(); ri != m_repl_attrs.end(); ++ri)
     {
-        hyperspacehashing::prefix::hasher h(attrs_to_hashfuncs(ri->first, ri->second));
+        std::vector<hyperspacehashing::hash_t> hfuncs(attrs_to_hashfuncs(ri->first, ri->second));
+        hyperspacehashing::prefix::hasher h(hfuncs, hashfuncs_to_distributions(ri->first, hfuncs),
+                                            m_equality_hashes[ri->first]);
         repl_hashers.insert(std::make_pair(ri->first, h));
     }
 
     for (di = m_disk_attrs.begin(); di != m_disk_attrs.end(); ++di)
     {
-        hyperspacehashing::mask::hasher h(attrs_to_hashfuncs(di->first, di->second));
+        std::vector<hyperspacehashing::hash_t> hfuncs(attrs_to_hashfuncs(di->first, di->second));
+        hyperspacehashing::mask::hasher h(hfuncs, hashfuncs_to_distributions(di->first, hfuncs),
+                                          m_equality_hashes[di->first]);
         disk_hashers.insert(std::make_pair(di->first, h));
     }
 
@@ -134,6 +141,10 @@ hyperdex :: configuration_parser :: parse(const std::string& config)
         {
             ABORT_ON_ERROR(parse_subspace(start, eol));
         }
+        else if (strncmp("distribution ", start, 13) == 0)
+        {
+            ABORT_ON_ERROR(parse_distribution(start, eol));
+        }
         else if (strncmp("region ", start, 7) == 0)
         {
             ABORT_ON_ERROR(parse_region(start, eol));
@@ -392,26 +403,44 @@ hyperdex :: configuration_parser :: parse_subspace(char* start,
 
     std::vector<bool> repl_attrs(si->second.size(), false);
     std::vector<bool> disk_attrs(si->second.size(), false);
+    std::vector<bool> prefix_attrs(si->second.size(), false);
 
     for (size_t i = 0; i < si->second.size(); ++i)
     {
         bool repl;
+        bool repl_prefix;
         bool disk;
+        bool disk_prefix;
 
         SKIP_WHITESPACE(start, eol);
         end = start;
         SKIP_TO_WHITESPACE(end, eol);
         *end = '\0';
-        ABORT_ON_ERROR(extract_bool(start, end, &repl));
+        ABORT_ON_ERROR(extract_hashing(start, end, &repl, &repl_prefix));
         start = end + 1;
 
         SKIP_WHITESPACE(start, eol);
         end = start;
         SKIP_TO_WHITESPACE(end, eol);
         *end = '\0';
-        ABORT_ON_ERROR(extract_bool(start, end, &disk));
+        ABORT_ON_ERROR(extract_hashing(start, end, &disk, &disk_prefix));
         start = end + 1;
 
+        // Prefix hashing applies to strings other than the key, and an
+        // attribute is hashed the same way everywhere it is hashed.
+        if (repl_prefix || disk_prefix)
+        {
+            if (i == 0 || si->second[i].type != HYPERDATATYPE_STRING)
+            {
+                return CP_BAD_ATTR_CHOICE;
+            }
+
+            if ((repl && !repl_prefix) || (disk && !disk_prefix))
+            {
+                return CP_BAD_ATTR_CHOICE;
+            }
+        }
+
         if (subspace == 0 && i > 0 && repl)
         {
             return CP_BAD_ATTR_CHOICE;
@@ -453,6 +482,19 @@ hyperdex :: configuration_parser :: parse_subspace(char* start,
 
         repl_attrs[i] = repl;
         disk_attrs[i] = disk;
+        prefix_attrs[i] = repl_prefix || disk_prefix;
+    }
+
+    // The equality hash function optionally follows the attributes.
+    hyperspacehashing::equality_hash_t eq = hyperspacehashing::CITYHASH;
+
+    if (end != eol)
+    {
+        SKIP_WHITESPACE(start, eol);
+        end = start;
+        SKIP_TO_WHITESPACE(end, eol);
+        *end = '\0';
+        ABORT_ON_ERROR(extract_equality_hash(start, end, &eq));
     }
 
     if (end != eol)
@@ -474,6 +516,85 @@ hyperdex :: configuration_parser :: parse_subspace(char* start,
     m_subspaces.insert(subspaceid(space, subspace));
     m_repl_attrs[subspaceid(space, subspace)] = repl_attrs;
     m_disk_attrs[subspaceid(space, subspace)] = disk_attrs;
+    m_prefix_attrs[subspaceid(space, subspace)] = prefix_attrs;
+    m_equality_hashes[subspaceid(space, subspace)] = eq;
+    return CP_SUCCESS;
+}
+
+hyperdex::configuration_parser::error
+hyperdex :: configuration_parser :: parse_distribution(char* start,
+                                                       char* const eol)
+{
+    char* end;
+    uint32_t space;
+    uint16_t attr;
+    std::vector<uint64_t> bounds;
+
+    // Skip "distribution "
+    start += 13;
+
+    // Pull out the space id
+    SKIP_WHITESPACE(start, eol);
+    end = start;
+    SKIP_TO_WHITESPACE(end, eol);
+    *end = '\0';
+    ABORT_ON_ERROR(extract_uint32_t(start, end, &space));
+    start = end + 1;
+
+    // Pull out the attribute number
+    SKIP_WHITESPACE(start, eol);
+    end = start;
+    SKIP_TO_WHITESPACE(end, eol);
+    *end = '\0';
+    ABORT_ON_ERROR(extract_uint16_t(start, end, &attr));
+    start = end + 1;
+
+    while (start < eol)
+    {
+        uint64_t bound;
+        SKIP_WHITESPACE(start, eol);
+        end = start;
+        SKIP_TO_WHITESPACE(end, eol);
+        *end = '\0';
+        ABORT_ON_ERROR(extract_uint64_t(start, end, &bound));
+        start = end + 1;
+        bounds.push_back(bound);
+    }
+
+    if (end != eol)
+    {
+        return CP_EXCESS_DATA;
+    }
+
+    std::map<spaceid, std::vector<attribute> >::const_iterator si;
+
+    if ((si = m_spaces.find(spaceid(space))) == m_spaces.end())
+    {
+        return CP_MISSING_SPACE;
+    }
+
+    if (attr >= si->second.size())
+    {
+        return CP_UNKNOWN_ATTR;
+    }
+
+    // Only int64 attributes other than the key are range hashed, and the
+    // bounds must split the number line into segments.
+    if (attr == 0 || si->second[attr].type != HYPERDATATYPE_INT64 ||
+        bounds.empty() || !hyperspacehashing::quantiles::valid(bounds))
+    {
+        return CP_BAD_ATTR_CHOICE;
+    }
+
+    std::vector<hyperspacehashing::quantiles>& dists(m_distributions[spaceid(space)]);
+    dists.resize(si->second.size());
+
+    if (!dists[attr].identity())
+    {
+        return CP_DUPE_ATTR;
+    }
+
+    dists[attr] = hyperspacehashing::quantiles(bounds);
     return CP_SUCCESS;
 }
 
@@ -770,6 +891,55 @@ hyperdex :: configuration_parser :: extract_bool(char* start,
     }
 }
 
+hyperdex::configuration_parser::error
+hyperdex :: configuration_parser :: extract_hashing(char* start,
+                                                    char* end,
+                                                    bool* hashed,
+                                                    bool* prefix)
+{
+    assert(start <= end);
+    assert(*end == '\0');
+
+    if (strcmp(start, "prefix") == 0)
+    {
+        *hashed = true;
+        *prefix = true;
+        return CP_SUCCESS;
+    }
+
+    *prefix = false;
+    return extract_bool(start, end, hashed);
+}
+
+hyperdex::configuration_parser::error
+hyperdex :: configuration_parser :: extract_equality_hash(char* start,
+                                                          char* end,
+                                                          hyperspacehashing::equality_hash_t* eq)
+{
+    assert(start <= end);
+    assert(*end == '\0');
+
+    if (start == end)
+    {
+        return CP_MISSING;
+    }
+
+    if (strcmp(start, "cityhash") == 0)
+    {
+        *eq = hyperspacehashing::CITYHASH;
+        return CP_SUCCESS;
+    }
+    else if (strcmp(start, "shorthash") == 0)
+    {
+        *eq = hyperspacehashing::SHORTHASH;
+        return CP_SUCCESS;
+    }
+    else
+    {
+        return CP_UNKNOWN_HASH;
+    }
+}
+
 hyperdex::configuration_parser::error
 hyperdex :: configuration_parser :: extract_datatype(char* start,
                                                      char* end,
@@ -968,6 +1138,10 @@ hyperdex :: configuration_parser :: attrs_to_hashfuncs(const subspaceid& ssi,
     si = m_spaces.find(ssi.get_space());
     assert(si != m_spaces.end());
     assert(si->second.size() == attrs.size());
+    std::map<subspaceid, std::vector<bool> >::const_iterator pi;
+    pi = m_prefix_attrs.find(ssi);
+    assert(pi != m_prefix_attrs.end());
+    assert(pi->second.size() == attrs.size());
     std::vector<hyperspacehashing::hash_t> hfuncs;
     hfuncs.reserve(attrs.size());
 
@@ -978,7 +1152,8 @@ hyperdex :: configuration_parser :: attrs_to_hashfuncs(const subspaceid& ssi,
             switch (si->second[i].type)
             {
                 case HYPERDATATYPE_STRING:
-                    hfuncs.push_back(hyperspacehashing::EQUALITY);
+                    hfuncs.push_back(pi->second[i] ? hyperspacehashing::PREFIX
+                                                   : hyperspacehashing::EQUALITY);
                     break;
                 case HYPERDATATYPE_INT64:
                     hfuncs.push_back(hyperspacehashing::RANGE);
@@ -1009,3 +1184,30 @@ hyperdex :: configuration_parser :: attrs_to_hashfuncs(const subspaceid& ssi,
 
     return hfuncs;
 }
+
+std::vector<hyperspacehashing::quantiles>
+hyperdex :: configuration_parser :: hashfuncs_to_distributions(const subspaceid& ssi,
+                                                               const std::vector<hyperspacehashing::hash_t>& hfuncs)
+{
+    std::vector<hyperspacehashing::quantiles> dists(hfuncs.size());
+    std::map<spaceid, std::vector<hyperspacehashing::quantiles> >::const_iterator di;
+    di = m_distributions.find(ssi.get_space());
+
+    if (di == m_distributions.end())
+    {
+        return dists;
+    }
+
+    assert(di->second.size() == hfuncs.size());
+
+    // A transform only applies where the attribute is range hashed.
+    for (size_t i = 0; i < hfuncs.size(); ++i)
+    {
+        if (hfuncs[i] == hyperspacehashing::RANGE)
+        {
+            dists[i] = di->second[i];
+        }
+    }
+
+    return dists;
+}
@@ -127,6 +127,11 @@ class configuration
                                                      const hyperspacehashing::search& s) const;
         std::map<entityid, instance> search_entities(const subspaceid& subspace,
                                                      const hyperspacehashing::search& s) const;
+        // The fan-out of a search:  how many regions search_entities will
+        // contact, out of how many regions the subspace it picks holds.
+        void search_fanout(const spaceid& space,
+                           const hyperspacehashing::search& s,
+                           size_t* contacted, size_t* regions) const;
 
     // State Transfer
     public:
@@ -144,7 +149,8 @@ class configuration
     private:
         std::map<entityid, instance> _search_entities(std::map<entityid, instance>::const_iterator start,
                                                       std::map<entityid, instance>::const_iterator end,
-                                                      const hyperspacehashing::search& s) const;
+                                                      const hyperspacehashing::search& s,
+                                                      size_t* regions) const;
 
     private:
         std::string m_config_text;
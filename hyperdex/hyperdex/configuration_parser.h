@@ -63,6 +63,7 @@ class configuration_parser
             CP_UNKNOWN_CMD,
             CP_UNKNOWN_HOST,
             CP_UNKNOWN_TYPE,
+            CP_UNKNOWN_HASH,
             CP_BAD_BOOL,
             CP_BAD_IP,
             CP_BAD_UINT64,
@@ -91,6 +92,8 @@ class configuration_parser
                           char* const eol);
         error parse_subspace(char* start,
                              char* const eol);
+        error parse_distribution(char* start,
+                                 char* const eol);
         error parse_region(char* start,
                            char* const eol);
         error parse_transfer(char* start,
@@ -102,6 +105,15 @@ class configuration_parser
         error extract_bool(char* start,
                            char* end,
                            bool* t);
+        // Like extract_bool, but also accepts "prefix", which means hashed
+        // by the leading bytes of a string.
+        error extract_hashing(char* start,
+                              char* end,
+                              bool* hashed,
+                              bool* prefix);
+        error extract_equality_hash(char* start,
+                                    char* end,
+                                    hyperspacehashing::equality_hash_t* eq);
         error extract_datatype(char* start,
                                char* end,
                                hyperdatatype* t);
@@ -123,6 +135,9 @@ class configuration_parser
         std::vector<hyperspacehashing::hash_t>
             attrs_to_hashfuncs(const subspaceid& ssi,
                                const std::vector<bool>& attrs);
+        std::vector<hyperspacehashing::quantiles>
+            hashfuncs_to_distributions(const subspaceid& ssi,
+                                       const std::vector<hyperspacehashing::hash_t>& hfuncs);
 
     private:
         std::string m_config_text;
@@ -133,6 +148,9 @@ class configuration_parser
         std::set<subspaceid> m_subspaces;
         std::map<subspaceid, std::vector<bool> > m_repl_attrs;
         std::map<subspaceid, std::vector<bool> > m_disk_attrs;
+        std::map<subspaceid, std::vector<bool> > m_prefix_attrs;
+        std::map<subspaceid, hyperspacehashing::equality_hash_t> m_equality_hashes;
+        std::map<spaceid, std::vector<hyperspacehashing::quantiles> > m_distributions;
         std::set<regionid> m_regions;
         std::map<entityid, instance> m_entities;
         std::map<std::pair<instance, uint16_t>, hyperdex::regionid> m_transfers;
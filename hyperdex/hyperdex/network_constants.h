@@ -45,7 +45,8 @@ enum network_returncode
     NET_CMPFAIL     = 8325,
     NET_BADMICROS   = 8326,
     NET_READONLY    = 8327,
-    NET_OVERFLOW    = 8328
+    NET_OVERFLOW    = 8328,
+    NET_BACKOFF     = 8329
 };
 
 enum network_msgtype
@@ -65,17 +66,45 @@ enum network_msgtype
     REQ_ATOMIC      = 16,
     RESP_ATOMIC     = 17,
 
+    // Answered with a RESP_GET.
+    REQ_GET_AT      = 18,
+    // Answered with a RESP_GET holding only the requested attributes.
+    REQ_GET_PARTIAL = 19,
+
     REQ_SEARCH_START    = 32,
     REQ_SEARCH_NEXT     = 33,
     REQ_SEARCH_STOP     = 34,
     RESP_SEARCH_ITEM    = 35,
     RESP_SEARCH_DONE    = 36,
+    // Continued with REQ_SEARCH_NEXT/REQ_SEARCH_STOP, like a search.
+    REQ_SCAN_START      = 37,
+    // Sent in place of RESP_SEARCH_ITEM when REQ_SEARCH_START carries batch
+    // limits:  a flags byte (1 if the search is finished), a count, and that
+    // many key/value pairs.
+    RESP_SEARCH_BATCH   = 38,
+    // Evaluated over one region's matching objects in a single round trip.
+    REQ_AGGREGATE       = 39,
+    RESP_AGGREGATE      = 40,
+    // Answered with one region's first objects in the requested order.
+    REQ_SORTED_SEARCH   = 41,
+    RESP_SORTED_SEARCH  = 42,
+    // A watch of the changes committed to objects matching a search.  Each
+    // REQ_WATCH_START/REQ_WATCH_NEXT is answered with one RESP_WATCH_BATCH
+    // once there is at least one change to send:  a flags byte (1 if the
+    // watch is over, 2 if it overflowed), a count, and that many changes.
+    REQ_WATCH_START     = 43,
+    REQ_WATCH_NEXT      = 44,
+    REQ_WATCH_STOP      = 45,
+    RESP_WATCH_BATCH    = 46,
 
     CHAIN_PUT       = 64,
     CHAIN_DEL       = 65,
     CHAIN_PENDING   = 66,
     CHAIN_SUBSPACE  = 67,
     CHAIN_ACK       = 68,
+    // Many of the above between the same two entities:  for each, its type
+    // byte and its body as a length-prefixed slice, in the order sent.
+    CHAIN_BATCH     = 69,
 
     XFER_MORE       = 96,
     XFER_DATA       = 97,
@@ -104,16 +133,29 @@ operator << (std::ostream& lhs, const network_msgtype& rhs)
         stringify(RESP_DEL);
         stringify(REQ_ATOMIC);
         stringify(RESP_ATOMIC);
+        stringify(REQ_GET_AT);
+        stringify(REQ_GET_PARTIAL);
         stringify(REQ_SEARCH_START);
         stringify(REQ_SEARCH_NEXT);
         stringify(REQ_SEARCH_STOP);
         stringify(RESP_SEARCH_ITEM);
         stringify(RESP_SEARCH_DONE);
+        stringify(REQ_SCAN_START);
+        stringify(RESP_SEARCH_BATCH);
+        stringify(REQ_AGGREGATE);
+        stringify(RESP_AGGREGATE);
+        stringify(REQ_SORTED_SEARCH);
+        stringify(RESP_SORTED_SEARCH);
+        stringify(REQ_WATCH_START);
+        stringify(REQ_WATCH_NEXT);
+        stringify(REQ_WATCH_STOP);
+        stringify(RESP_WATCH_BATCH);
         stringify(CHAIN_PUT);
         stringify(CHAIN_DEL);
         stringify(CHAIN_PENDING);
         stringify(CHAIN_SUBSPACE);
         stringify(CHAIN_ACK);
+        stringify(CHAIN_BATCH);
         stringify(XFER_MORE);
         stringify(XFER_DATA);
         stringify(XFER_DONE);
@@ -0,0 +1,106 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef hyperdex_ordering_h_
+#define hyperdex_ordering_h_
+
+// C
+#include <cstring>
+#include <stdint.h>
+
+// STL
+#include <algorithm>
+
+// e
+#include <e/endian.h>
+#include <e/slice.h>
+
+// HyperDex
+#include "hyperdex.h"
+
+namespace hyperdex
+{
+
+// An int64 attribute as stored:  eight little-endian bytes, or empty for 0.
+inline int64_t
+int64_value(const e::slice& s)
+{
+    uint8_t buf[sizeof(int64_t)];
+    memset(buf, 0, sizeof(buf));
+    memmove(buf, s.data(), std::min(s.size(), sizeof(buf)));
+    int64_t num;
+    e::unpack64le(buf, &num);
+    return num;
+}
+
+// Order two values of an attribute of the given type:  int64s as signed
+// numbers, and everything else bytewise, with a prefix sorting first.  Returns
+// less than, equal to, or greater than zero as lhs sorts before, with, or after
+// rhs.
+inline int
+compare_for_sort(hyperdatatype type, const e::slice& lhs, const e::slice& rhs)
+{
+    if (type == HYPERDATATYPE_INT64)
+    {
+        int64_t l = int64_value(lhs);
+        int64_t r = int64_value(rhs);
+        return l < r ? -1 : (l > r ? 1 : 0);
+    }
+
+    size_t sz = std::min(lhs.size(), rhs.size());
+    int cmp = sz > 0 ? memcmp(lhs.data(), rhs.data(), sz) : 0;
+
+    if (cmp != 0)
+    {
+        return cmp;
+    }
+
+    return lhs.size() < rhs.size() ? -1 : (lhs.size() > rhs.size() ? 1 : 0);
+}
+
+// Whether one object comes before another when sorting by an attribute of the
+// given type.  Objects which tie are ordered by key, so that every server and
+// client agrees on a single order.
+inline bool
+sorts_before(hyperdatatype type, bool descending,
+             const e::slice& lhs_sort, const e::slice& lhs_key,
+             const e::slice& rhs_sort, const e::slice& rhs_key)
+{
+    int cmp = compare_for_sort(type, lhs_sort, rhs_sort);
+
+    if (cmp == 0)
+    {
+        return compare_for_sort(HYPERDATATYPE_STRING, lhs_key, rhs_key) < 0;
+    }
+
+    return descending ? cmp > 0 : cmp < 0;
+}
+
+} // namespace hyperdex
+
+#endif // hyperdex_ordering_h_
@@ -28,6 +28,9 @@
 #ifndef hyperdex_packing_h_
 #define hyperdex_packing_h_
 
+// STL
+#include <vector>
+
 // e
 #include <e/buffer.h>
 #include <e/slice.h>
@@ -48,6 +51,30 @@ packspace(const std::vector<e::slice>& slices)
     return sum;
 }
 
+// Pick the attributes numbered in "attrs" out of "value", in the order given.
+// Attribute 1 is value[0] (attribute 0 is the key, which is never part of a
+// value).  Returns false if any number is out of range.
+inline bool
+project(const std::vector<e::slice>& value,
+        const std::vector<uint16_t>& attrs,
+        std::vector<e::slice>* projected)
+{
+    projected->clear();
+    projected->reserve(attrs.size());
+
+    for (size_t i = 0; i < attrs.size(); ++i)
+    {
+        if (attrs[i] < 1 || attrs[i] > value.size())
+        {
+            return false;
+        }
+
+        projected->push_back(value[attrs[i] - 1]);
+    }
+
+    return true;
+}
+
 } // namespace hyperdex
 
 #endif // hyperdex_packing_h_
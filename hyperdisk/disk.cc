@@ -29,30 +29,41 @@
 
 // C
 #include <cstdio>
-#include <cmath>
 
 // POSIX
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 // C++
 #include <iomanip>
 #include <sstream>
 #include <fstream>
 
+// STL
+#include <algorithm>
+#include <tr1/functional>
+
+// po6
+#include <po6/threads/thread.h>
+
 // e
 #include <e/guard.h>
+#include <e/timer.h>
 
 // HyperspaceHashing
 #include "hyperspacehashing/hyperspacehashing/mask.h"
 
 // HyperDisk
 #include "hyperdisk/hyperdisk/disk.h"
+#include "hyperdisk/disk_snapshot.h"
 #include "hyperdisk/log_entry.h"
 #include "hyperdisk/offset_update.h"
 #include "hyperdisk/shard.h"
 #include "hyperdisk/shard_snapshot.h"
 #include "hyperdisk/shard_vector.h"
+#include "hyperdisk/sorted_snapshot.h"
+#include "hyperdisk/wal_snapshot.h"
 
 // util
 #include <util/atomicfile.h>
@@ -84,6 +95,80 @@ using hyperspacehashing::mask::coordinate;
 // accesses, but using the WAL to detect them.  PUT/DEL do this by writing to
 // the WAL.  Trickle does this by using locking when exchanging the
 // shard_vectors.
+//
+// do_optimistic_io splits shards without holding m_shard_mutate for the whole
+// split.  It marks the shards in m_splitting under the lock, copies them with
+// the lock released, and takes the lock again to install the new shards.  A
+// marked shard is not mutated in between:  flush stops at the first log entry
+// which touches a marked shard and leaves it (and everything after it) in the
+// WAL, and nothing cleans or splits a marked shard.  Once the split is
+// installed the next flush applies those entries to the new shards.
+
+// SPLIT PLANNING:  do_optimistic_io is called periodically.  Each call samples
+// the fullness of every shard and keeps a moving average of how quickly each is
+// filling.  A shard is split once it is predicted to fill sooner than a few
+// times the (also measured) duration of a split, so that the split finishes
+// before a flush finds the shard full and stalls in do_mandatory_io.
+
+// Shards below this fullness are never split early.
+static const int PLANNER_MIN_USED = 50;
+// Shards at or above this fullness are split even if they are not growing.
+static const int PLANNER_MAX_USED = 90;
+// Split when the time to fill falls below this multiple of the time a split
+// takes, but never with less than PLANNER_MIN_LEAD seconds to spare.
+static const double PLANNER_LEAD_FACTOR = 4.;
+static const double PLANNER_MIN_LEAD = 5.;
+// Weight given to the newest sample in the moving average of the fill rate.
+static const double PLANNER_ALPHA = 0.5;
+// The most shards split at once.
+static const size_t PLANNER_MAX_PARALLEL = 4;
+// The split workers, with the thread which asks for the splits, number at
+// least this many, so that a lone split fills its four shards at once.
+static const size_t SPLIT_THREADS = 4;
+// Room for the hashes of a typical full shard.
+static const size_t SPLIT_HASHES_HINT = 16384;
+
+class hyperdisk::disk::split_job
+{
+    public:
+        split_job(shard* s, const coordinate& c);
+
+    public:
+        shard* s;
+        coordinate c;
+        // In the order they are to be placed in the shard_vector.
+        coordinate new_coords[4];
+        e::intrusive_ptr<hyperdisk::shard> new_shards[4];
+        // The entries of "s" which go to each new shard, and the number of
+        // new shards still being filled (protected by m_split_lock).
+        std::vector<uint32_t> entries[4];
+        size_t fills;
+        returncode status;
+};
+
+hyperdisk :: disk :: split_job :: split_job(shard* _s, const coordinate& _c)
+    : s(_s)
+    , c(_c)
+    , fills(0)
+    , status(SPLITFAILED)
+{
+}
+
+// Work for the split workers:  prepare a whole split, or fill one of its new
+// shards.
+class hyperdisk::disk::split_task
+{
+    public:
+        static const size_t PREPARE = 4;
+
+    public:
+        split_task() : job(NULL), part(PREPARE) {}
+        split_task(split_job* j, size_t p) : job(j), part(p) {}
+
+    public:
+        split_job* job;
+        size_t part;
+};
 
 const int hyperdisk :: disk :: STATE_FILE_VER = 1;
 const char* hyperdisk :: disk :: STATE_FILE_NAME = "disk_state.hd";
@@ -129,6 +214,18 @@ hyperdisk :: disk :: quiesce(const std::string& quiesce_state_id)
             case SEARCHFULL:
                 // Split the shards and try agian.
                 do_mandatory_io();
+                continue;
+            case SPLITTING:
+                // What is left waits for a split to be installed.
+                {
+                    po6::threads::mutex::hold hold(&m_shards_mutate);
+
+                    while (!m_splitting.empty())
+                    {
+                        m_splitting_cond.wait();
+                    }
+                }
+
                 continue;
             case NOTFOUND:
             case WRONGARITY:
@@ -136,6 +233,7 @@ hyperdisk :: disk :: quiesce(const std::string& quiesce_state_id)
             case DROPFAILED:
             case MISSINGDISK:
             case SPLITFAILED:
+            case WALFULL:
             default:
                 return false;
         }
@@ -319,7 +417,7 @@ hyperdisk :: disk :: get(const e::slice& key,
         {
             if (it->is_put)
             {
-                *value = it->value;
+                value->assign(it->value.begin(), it->value.end());
                 *version = it->version;
                 wal_res = SUCCESS;
             }
@@ -341,6 +439,72 @@ hyperdisk :: disk :: get(const e::slice& key,
     return shard_res;
 }
 
+hyperdisk::returncode
+hyperdisk :: disk :: get_at(const e::slice& key,
+                            uint64_t at,
+                            std::vector<e::slice>* value,
+                            uint64_t* version,
+                            reference* backing)
+{
+    coordinate coord = m_hasher.hash(key);
+    e::intrusive_ptr<shard_vector> shards;
+    // Take the iterator first so that nothing flushed after we look at the
+    // shards is missed.
+    e::locking_iterable_fifo<log_entry>::iterator it = m_log.iterate();
+
+    {
+        po6::threads::mutex::hold b(&m_shards_lock);
+        shards = m_shards;
+    }
+
+    // The log is newer than anything in the shards, so an old enough entry
+    // in it is the answer.
+    bool found = false;
+    returncode wal_res = NOTFOUND;
+
+    for (; it.valid(); it.next())
+    {
+        if (it->coord.primary_intersects(coord) && it->key == key &&
+            it->version <= at)
+        {
+            if (it->is_put)
+            {
+                value->assign(it->value.begin(), it->value.end());
+                *version = it->version;
+                wal_res = SUCCESS;
+            }
+            else
+            {
+                wal_res = NOTFOUND;
+            }
+
+            found = true;
+            backing->set(it);
+        }
+    }
+
+    if (found)
+    {
+        return wal_res;
+    }
+
+    for (size_t i = 0; i < shards->size(); ++i)
+    {
+        if (!shards->get_coordinate(i).primary_intersects(coord))
+        {
+            continue;
+        }
+
+        if (shards->get_shard(i)->get_at(coord.primary_hash, key, at, value, version) == SUCCESS)
+        {
+            backing->set(shards->get_shard(i));
+            return SUCCESS;
+        }
+    }
+
+    return NOTFOUND;
+}
+
 hyperdisk::returncode
 hyperdisk :: disk :: put(std::tr1::shared_ptr<e::buffer> backing,
                          const e::slice& key,
@@ -353,16 +517,23 @@ hyperdisk :: disk :: put(std::tr1::shared_ptr<e::buffer> backing,
     }
 
     coordinate coord = m_hasher.hash(key, value);
-    m_log.append(log_entry(coord, backing, key, value, version));
+    log_entry entry(coord, backing, key, value, version);
+    __sync_add_and_fetch(&m_log_bytes, entry.bytes());
+    m_log.append(entry);
+    __sync_add_and_fetch(&m_log_appends, 1);
     return SUCCESS;
 }
 
 hyperdisk::returncode
 hyperdisk :: disk :: del(std::tr1::shared_ptr<e::buffer> backing,
-                         const e::slice& key)
+                         const e::slice& key,
+                         uint64_t version)
 {
     coordinate coord = m_hasher.hash(key);
-    m_log.append(log_entry(coord, backing, key));
+    log_entry entry(coord, backing, key, version);
+    __sync_add_and_fetch(&m_log_bytes, entry.bytes());
+    m_log.append(entry);
+    __sync_add_and_fetch(&m_log_appends, 1);
     return SUCCESS;
 }
 
@@ -370,51 +541,72 @@ e::intrusive_ptr<hyperdisk::snapshot>
 hyperdisk :: disk :: make_snapshot(const hyperspacehashing::search& terms)
 {
     hyperspacehashing::mask::coordinate coord(m_hasher.hash(terms));
-    e::intrusive_ptr<shard_vector> shards;
-    e::locking_iterable_fifo<offset_update>::iterator it = m_offsets.iterate();
+    // Take the log first so that nothing flushed after we look at the shards
+    // is missed.
+    std::tr1::shared_ptr<const wal_overlay> wal(current_wal_overlay());
+    std::vector<hyperdisk::shard_snapshot> snaps;
+    e::intrusive_ptr<shard_vector> shards = snapshot_shards(coord, &snaps);
+    e::intrusive_ptr<hyperdisk::snapshot> snap;
+    snap = new disk_snapshot(coord, shards, &snaps);
+    e::intrusive_ptr<hyperdisk::snapshot> ret;
+    ret = new wal_snapshot(wal, snap, coord, true, false, false);
+    return ret;
+}
 
-    {
-        po6::threads::mutex::hold b(&m_shards_lock);
-        shards = m_shards;
-    }
+e::intrusive_ptr<hyperdisk::snapshot>
+hyperdisk :: disk :: make_ordered_snapshot(const hyperspacehashing::search& terms,
+                                           bool descending)
+{
+    hyperspacehashing::mask::coordinate coord(m_hasher.hash(terms));
+    std::tr1::shared_ptr<const wal_overlay> wal(current_wal_overlay());
+    std::vector<hyperdisk::shard_snapshot> snaps;
+    e::intrusive_ptr<shard_vector> shards = snapshot_shards(coord, &snaps);
+    e::intrusive_ptr<hyperdisk::snapshot> snap;
+    snap = new sorted_snapshot(coord, shards, &snaps, descending);
+    e::intrusive_ptr<hyperdisk::snapshot> ret;
+    ret = new wal_snapshot(wal, snap, coord, true, true, descending);
+    return ret;
+}
 
-    std::vector<uint32_t> offsets(shards->size());
+void
+hyperdisk :: disk :: make_partitioned_snapshot(const hyperspacehashing::search& terms,
+                                               std::vector<e::intrusive_ptr<snapshot> >* parts)
+{
+    hyperspacehashing::mask::coordinate coord(m_hasher.hash(terms));
+    // Every part shares the one copy of the log, so that each skips the same
+    // superseded objects.  The last part returns only the log's objects.
+    std::tr1::shared_ptr<const wal_overlay> wal(current_wal_overlay());
+    std::vector<hyperdisk::shard_snapshot> snaps;
+    e::intrusive_ptr<shard_vector> shards = snapshot_shards(coord, &snaps);
 
-    for (size_t i = 0; i < shards->size(); ++i)
+    for (size_t i = 0; i <= snaps.size(); ++i)
     {
-        offsets[i] = shards->get_offset(i);
-    }
+        std::vector<hyperdisk::shard_snapshot> one;
 
-    for (; it.valid() && it->shard_generation <= shards->generation(); it.next())
-    {
-        if (it->shard_generation == shards->generation())
+        if (i < snaps.size())
         {
-            offsets[it->shard_num] = it->new_offset;
+            one.push_back(snaps[i]);
         }
-    }
-
-    std::vector<hyperdisk::shard_snapshot> snaps;
-    snaps.reserve(shards->size());
 
-    for (size_t i = 0; i < shards->size(); ++i)
-    {
-        if (coord.intersects(shards->get_coordinate(i)))
-        {
-            snaps.push_back(shard_snapshot(offsets[i], shards->get_shard(i)));
-        }
+        e::intrusive_ptr<hyperdisk::snapshot> snap;
+        snap = new disk_snapshot(coord, shards, &one);
+        e::intrusive_ptr<hyperdisk::snapshot> part;
+        part = new wal_snapshot(wal, snap, coord, i == snaps.size(), false, false);
+        parts->push_back(part);
     }
-
-    e::intrusive_ptr<hyperdisk::snapshot> ret;
-    ret = new snapshot(coord, shards, &snaps);
-    return ret;
 }
 
 e::intrusive_ptr<hyperdisk::rolling_snapshot>
 hyperdisk :: disk :: make_rolling_snapshot()
 {
     hyperspacehashing::search terms(m_arity);
+    hyperspacehashing::mask::coordinate coord(m_hasher.hash(terms));
     e::locking_iterable_fifo<log_entry>::iterator iter(m_log.iterate());
-    e::intrusive_ptr<snapshot> snap = make_snapshot(terms);
+    // The log is replayed after the snapshot, so the snapshot must not
+    // include it as make_snapshot() does.
+    std::vector<hyperdisk::shard_snapshot> snaps;
+    e::intrusive_ptr<shard_vector> shards = snapshot_shards(coord, &snaps);
+    e::intrusive_ptr<snapshot> snap = new disk_snapshot(coord, shards, &snaps);
     e::intrusive_ptr<rolling_snapshot> ret = new rolling_snapshot(iter, snap);
     return ret;
 }
@@ -423,6 +615,13 @@ hyperdisk::returncode
 hyperdisk :: disk :: drop()
 {
     po6::threads::mutex::hold a(&m_shards_mutate);
+
+    // A split in progress is still writing its new shards.
+    while (!m_splitting.empty())
+    {
+        m_splitting_cond.wait();
+    }
+
     po6::threads::mutex::hold b(&m_shards_lock);
     po6::threads::mutex::hold c(&m_spare_shards_lock);
     returncode ret = SUCCESS;
@@ -478,9 +677,20 @@ hyperdisk :: disk :: flush(ssize_t num, bool nonblocking)
     e::guard hold = e::makeobjguard(m_shards_mutate, &po6::threads::mutex::unlock);
 
     bool flushed = false;
+    uint64_t flushed_bytes = 0;
+    uint64_t flushed_entries = 0;
     returncode flush_status = SUCCESS;
     hold.use_variable();
     e::locking_iterable_fifo<log_entry>::iterator it = m_log.iterate();
+    // The oldest entry held in the log for a shard being split.  Later
+    // entries are still written to the shards, but stay in the log (marked
+    // "applied") until it is flushed, as the log can only shrink from the
+    // front.
+    bool blocked = false;
+    e::locking_iterable_fifo<log_entry>::iterator first_blocked = it;
+    // Reused across entries so that only the first allocates.
+    std::vector<offset_update> updates;
+    updates.reserve(2);
 
     // num == -1 means flush all
     for (ssize_t nf = 0; (nf < num || num < 0) && it.valid(); ++nf, it.next())
@@ -491,6 +701,27 @@ hyperdisk :: disk :: flush(ssize_t num, bool nonblocking)
         size_t del_num = 0;
         uint32_t del_offset = 0;
 
+        if (it->applied)
+        {
+            flushed_bytes += blocked ? 0 : it->bytes();
+            flushed_entries += blocked ? 0 : 1;
+            continue;
+        }
+
+        // Every entry for a key shares its primary hash, so once one entry
+        // for a key is held back, so are all later ones and the key's
+        // entries still apply in order.
+        if (!m_splitting.empty() && blocked_by_split(coord))
+        {
+            if (!blocked)
+            {
+                blocked = true;
+                first_blocked = it;
+            }
+
+            continue;
+        }
+
         for (size_t i = 0; !del_needed && i < m_shards->size(); ++i)
         {
             if (!m_shards->get_coordinate(i).primary_intersects(coord))
@@ -521,7 +752,7 @@ hyperdisk :: disk :: flush(ssize_t num, bool nonblocking)
 
         if (it->is_put)
         {
-            const std::vector<e::slice>& value = it->value;
+            const log_entry::value_t& value = it->value;
             const uint64_t version = it->version;
 
             // This must start at the last position and work downward so that
@@ -534,7 +765,8 @@ hyperdisk :: disk :: flush(ssize_t num, bool nonblocking)
                 }
 
                 returncode ret;
-                ret = m_shards->get_shard(i)->put(coord, key, value,
+                ret = m_shards->get_shard(i)->put(coord, key,
+                                                  value.begin(), value.size(),
                                                   version, &put_offset);
 
                 if (ret == SUCCESS)
@@ -562,7 +794,7 @@ hyperdisk :: disk :: flush(ssize_t num, bool nonblocking)
 
         if (del_needed && (!put_performed || del_num != put_num))
         {
-            switch (m_shards->get_shard(del_num)->del(coord.primary_hash, key, &del_offset))
+            switch (m_shards->get_shard(del_num)->del(coord.primary_hash, key, it->version, &del_offset))
             {
                 case SUCCESS:
                     break;
@@ -575,6 +807,8 @@ hyperdisk :: disk :: flush(ssize_t num, bool nonblocking)
                 case MISSINGDISK:
                 case SPLITFAILED:
                 case DIDNOTHING:
+                case WALFULL:
+                case SPLITTING:
                 default:
                     abort();
             }
@@ -582,10 +816,20 @@ hyperdisk :: disk :: flush(ssize_t num, bool nonblocking)
 
         flushed = true;
 
+        if (blocked)
+        {
+            it->applied = true;
+        }
+        else
+        {
+            flushed_bytes += it->bytes();
+            ++flushed_entries;
+        }
+
         // Here we prepare two offset_updates that we can push onto the offsets
         // log.  We then make the offset changes to the shard_vector, and then
         // finish by removing the items we put on the log.
-        std::vector<offset_update> updates;
+        updates.clear();
 
         if (del_needed && (!put_performed || del_num != put_num))
         {
@@ -622,13 +866,35 @@ hyperdisk :: disk :: flush(ssize_t num, bool nonblocking)
         }
     }
 
-    m_log.advance_to(it);
+    bool drained = !it.valid();
+
+    {
+        // The cached overlay lets go of the entries flushed, so that it pins
+        // only what m_log_bytes counts.
+        po6::threads::mutex::hold hold_wal(&m_wal_lock);
+        m_log.advance_to(blocked ? first_blocked : it);
+        m_log_head += flushed_entries;
+
+        if (m_wal && flushed_entries > 0)
+        {
+            m_wal.reset(new wal_overlay(*m_wal, m_log_head));
+        }
+    }
+
+    __sync_sub_and_fetch(&m_log_bytes, flushed_bytes);
 
     if (flush_status != SUCCESS)
     {
         return flush_status;
     }
 
+    // Everything left waits for a split.  Flushing again before it is
+    // installed would make no progress.
+    if (blocked && drained)
+    {
+        return SPLITTING;
+    }
+
     if (flushed)
     {
         return SUCCESS;
@@ -649,6 +915,15 @@ hyperdisk :: disk :: do_mandatory_io()
     {
         assert(m_needs_io <= m_shards->size());
         size_t needs_io = m_needs_io;
+
+        // The split in progress will make room; installing it renumbers
+        // m_needs_io.
+        if (std::find(m_splitting.begin(), m_splitting.end(),
+                      m_shards->get_shard(needs_io)) != m_splitting.end())
+        {
+            return SPLITTING;
+        }
+
         m_needs_io = -1;
         return deal_with_full_shard(needs_io);
     }
@@ -666,38 +941,137 @@ hyperdisk :: disk :: do_optimistic_io()
         shards = m_shards;
     }
 
-    size_t most_loaded = 0;
-    int most_loaded_amt = 0;
-    uint64_t used = 0;
-    uint64_t capacity = 0;
+    uint64_t now = e::time();
+    // Pairs of (seconds until full, shard index).
+    std::vector<std::pair<double, size_t> > candidates;
 
-    for (size_t i = 0; i < shards->size(); ++i)
     {
-        int loaded = shards->get_shard(i)->used_space();
+        po6::threads::mutex::hold hold(&m_planner_lock);
+        double lead = std::max(PLANNER_MIN_LEAD,
+                               PLANNER_LEAD_FACTOR * m_split_nanos / 1000000000.);
+        std::map<const shard*, fill_estimate> fill;
 
-        if (loaded > most_loaded_amt)
+        for (size_t i = 0; i < shards->size(); ++i)
         {
-            most_loaded = i;
-            most_loaded_amt = loaded;
+            const shard* s = shards->get_shard(i);
+            fill_estimate& est(fill[s]);
+            est.coord = shards->get_coordinate(i);
+            est.when = now;
+            est.used = s->used_space();
+            std::map<const shard*, fill_estimate>::iterator prev = m_fill.find(s);
+
+            // A shard which shrank, or whose address has been reused by another
+            // shard, starts over.
+            if (prev != m_fill.end() && prev->second.coord == est.coord &&
+                prev->second.used <= est.used && prev->second.when < now)
+            {
+                double secs = (now - prev->second.when) / 1000000000.;
+                double rate = (est.used - prev->second.used) / secs;
+                est.rate = PLANNER_ALPHA * rate + (1 - PLANNER_ALPHA) * prev->second.rate;
+            }
+
+            if (est.used < PLANNER_MIN_USED ||
+                est.coord.primary_mask == UINT64_MAX ||
+                est.coord.secondary_lower_mask == UINT64_MAX ||
+                est.coord.secondary_upper_mask == UINT64_MAX)
+            {
+                continue;
+            }
+
+            if (est.used >= PLANNER_MAX_USED)
+            {
+                candidates.push_back(std::make_pair(0., i));
+            }
+            else if (est.rate > 0 && (100 - est.used) / est.rate <= lead)
+            {
+                candidates.push_back(std::make_pair((100 - est.used) / est.rate, i));
+            }
         }
 
-        used += loaded;
-        capacity += 100;
+        m_fill.swap(fill);
+    }
+
+    if (candidates.empty())
+    {
+        return DIDNOTHING;
     }
 
-    if (capacity)
+    std::sort(candidates.begin(), candidates.end());
+    returncode ret = SUCCESS;
+    std::vector<split_job> jobs;
+
     {
-        double flip = static_cast<double>(rand_r(&m_seed)) / static_cast<double>(RAND_MAX);
-        double thresh = 1 / pow(1.01, 100 - used);
         po6::threads::mutex::hold holdm(&m_shards_mutate);
 
-        if (shards == m_shards && flip < thresh && most_loaded_amt >= 75)
+        // The shards changed since we sampled them.  The next call will see the
+        // new shards.
+        if (shards != m_shards)
+        {
+            return DIDNOTHING;
+        }
+
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        size_t parallel = std::min(PLANNER_MAX_PARALLEL, static_cast<size_t>(cpus > 0 ? cpus : 1));
+        std::vector<shard*> to_clean;
+
+        for (size_t i = 0; i < candidates.size() &&
+                           to_clean.size() + jobs.size() < parallel; ++i)
+        {
+            shard* s = shards->get_shard(candidates[i].second);
+
+            // Another call is already splitting it.
+            if (std::find(m_splitting.begin(), m_splitting.end(), s) != m_splitting.end())
+            {
+                continue;
+            }
+
+            if (s->stale_space() >= 30)
+            {
+                to_clean.push_back(s);
+            }
+            else
+            {
+                jobs.push_back(split_job(s, shards->get_coordinate(candidates[i].second)));
+            }
+        }
+
+        if (to_clean.empty() && jobs.empty())
+        {
+            return DIDNOTHING;
+        }
+
+        // Cleaning replaces a shard in place, so the indices of the others hold.
+        for (size_t i = 0; ret == SUCCESS && i < to_clean.size(); ++i)
+        {
+            for (size_t j = 0; j < shards->size(); ++j)
+            {
+                if (shards->get_shard(j) == to_clean[i])
+                {
+                    ret = clean_shard(j);
+                    break;
+                }
+            }
+        }
+
+        if (ret != SUCCESS || jobs.empty())
+        {
+            return ret;
+        }
+
+        for (size_t i = 0; i < jobs.size(); ++i)
         {
-            return deal_with_full_shard(most_loaded);
+            m_splitting.push_back(jobs[i].s);
         }
     }
 
-    return DIDNOTHING;
+    uint64_t start = e::time();
+    ret = split_shards(&jobs);
+    uint64_t elapsed = e::time() - start;
+
+    po6::threads::mutex::hold hold(&m_planner_lock);
+    m_split_nanos = m_split_nanos == 0 ? elapsed
+                  : PLANNER_ALPHA * elapsed + (1 - PLANNER_ALPHA) * m_split_nanos;
+    return ret;
 }
 
 hyperdisk::returncode
@@ -825,18 +1199,36 @@ hyperdisk :: disk :: sync()
     return ret;
 }
 
+uint64_t
+hyperdisk :: disk :: wal_bytes()
+{
+    return m_log_bytes;
+}
+
+void
+hyperdisk :: disk :: retain_history(uint64_t versions)
+{
+    m_history = versions;
+}
+
 hyperdisk :: disk :: disk(const po6::pathname& directory,
                           const hyperspacehashing::mask::hasher& hasher,
                           const uint16_t arity,
                           bool load_quiesced_state,
                           const std::string& quiesce_state_id)
-    : m_ref(0)
+    : engine()
     , m_arity(arity)
     , m_hasher(hasher)
     , m_shards_mutate()
     , m_shards_lock()
     , m_shards()
     , m_log()
+    , m_log_bytes(0)
+    , m_log_appends(0)
+    , m_wal_lock()
+    , m_wal()
+    , m_wal_appends(0)
+    , m_log_head(0)
     , m_offsets()
     , m_base()
     , m_base_filename(directory)
@@ -844,7 +1236,18 @@ hyperdisk :: disk :: disk(const po6::pathname& directory,
     , m_spare_shards()
     , m_spare_shard_counter(0)
     , m_needs_io(-1)
-    , m_seed(0)
+    , m_splitting()
+    , m_splitting_cond(&m_shards_mutate)
+    , m_split_lock()
+    , m_split_cond(&m_split_lock)
+    , m_split_queue()
+    , m_split_unfinished(0)
+    , m_split_shutdown(false)
+    , m_split_threads()
+    , m_planner_lock()
+    , m_fill()
+    , m_split_nanos(0)
+    , m_history(0)
 {
     if (mkdir(directory.get(), S_IRWXU) < 0 && errno != EEXIST)
     {
@@ -878,6 +1281,16 @@ hyperdisk :: disk :: disk(const po6::pathname& directory,
 
 hyperdisk :: disk :: ~disk() throw ()
 {
+    {
+        po6::threads::mutex::hold hold(&m_split_lock);
+        m_split_shutdown = true;
+        m_split_cond.broadcast();
+    }
+
+    for (size_t i = 0; i < m_split_threads.size(); ++i)
+    {
+        m_split_threads[i]->join();
+    }
 }
 
 po6::pathname
@@ -1042,7 +1455,7 @@ hyperdisk :: disk :: clean_shard(size_t shard_num)
     shard* s = m_shards->get_shard(shard_num);
     e::intrusive_ptr<hyperdisk::shard> newshard = create_tmp_shard(c);
     e::guard disk_guard = e::makeobjguard(*this, &hyperdisk::disk::drop_tmp_shard, c);
-    s->copy_to(c, newshard);
+    s->copy_to(c, newshard, m_history);
     e::intrusive_ptr<shard_vector> newshard_vector;
     newshard_vector = m_shards->replace(shard_num, newshard);
 
@@ -1085,9 +1498,72 @@ which_to_split(uint64_t mask, const int* zeros, const int* ones)
 hyperdisk::returncode
 hyperdisk :: disk :: split_shard(size_t shard_num)
 {
-    coordinate c = m_shards->get_coordinate(shard_num);
-    shard* s = m_shards->get_shard(shard_num);
-    hyperdisk::shard_snapshot snap = s->make_snapshot();
+    split_job job(m_shards->get_shard(shard_num), m_shards->get_coordinate(shard_num));
+    prepare_split(&job);
+    return install_split(&job);
+}
+
+hyperdisk::returncode
+hyperdisk :: disk :: split_shards(std::vector<split_job>* jobs)
+{
+    assert(!jobs->empty());
+
+    {
+        po6::threads::mutex::hold hold(&m_split_lock);
+
+        // The first split runs on this thread.
+        while (m_split_threads.size() + 1 < std::max(jobs->size(), SPLIT_THREADS))
+        {
+            std::tr1::shared_ptr<po6::threads::thread>
+                t(new po6::threads::thread(std::tr1::bind(&disk::split_worker, this)));
+            t->start();
+            m_split_threads.push_back(t);
+        }
+
+        for (size_t i = 1; i < jobs->size(); ++i)
+        {
+            m_split_queue.push(split_task(&(*jobs)[i], split_task::PREPARE));
+        }
+
+        m_split_unfinished += jobs->size() - 1;
+        m_split_cond.broadcast();
+    }
+
+    prepare_split(&(*jobs)[0]);
+    wait_for_splits(&m_split_unfinished);
+
+    po6::threads::mutex::hold holdm(&m_shards_mutate);
+    returncode ret = SUCCESS;
+
+    for (size_t i = 0; i < jobs->size(); ++i)
+    {
+        returncode r = install_split(&(*jobs)[i]);
+
+        if (ret == SUCCESS)
+        {
+            ret = r;
+        }
+    }
+
+    return ret;
+}
+
+void
+hyperdisk :: disk :: prepare_split(split_job* job)
+{
+    const coordinate& c(job->c);
+    shard* s = job->s;
+
+    // Take the hashes of every object in one pass over the shard.  Choosing
+    // the split bits needs two passes over them, which are then cheap.
+    std::vector<std::pair<uint64_t, uint64_t> > hashes;
+    hashes.reserve(SPLIT_HASHES_HINT);
+
+    for (hyperdisk::shard_snapshot snap = s->make_snapshot(); snap.valid(); snap.next())
+    {
+        hashes.push_back(std::make_pair(snap.coordinate().primary_hash,
+                                        snap.coordinate().secondary_lower_hash));
+    }
 
     // Find which bit of the secondary hash is the best to split over.
     int zeros[64];
@@ -1095,7 +1571,7 @@ hyperdisk :: disk :: split_shard(size_t shard_num)
     memset(zeros, 0, sizeof(zeros));
     memset(ones, 0, sizeof(ones));
 
-    for (; snap.valid(); snap.next())
+    for (size_t i = 0; i < hashes.size(); ++i)
     {
         for (int j = 0; j < 64; ++j)
         {
@@ -1106,7 +1582,7 @@ hyperdisk :: disk :: split_shard(size_t shard_num)
                 continue;
             }
 
-            if (snap.coordinate().secondary_lower_hash & bit)
+            if (hashes[i].second & bit)
             {
                 ++ones[j];
             }
@@ -1119,7 +1595,6 @@ hyperdisk :: disk :: split_shard(size_t shard_num)
 
     int secondary_split = which_to_split(c.secondary_lower_mask, zeros, ones);
     uint64_t secondary_bit = 1ULL << secondary_split;
-    snap = s->make_snapshot();
 
     // Determine the splits for the two shards resulting from the split above.
     int zeros_lower[64];
@@ -1131,7 +1606,7 @@ hyperdisk :: disk :: split_shard(size_t shard_num)
     memset(ones_lower, 0, sizeof(ones_lower));
     memset(ones_upper, 0, sizeof(ones_upper));
 
-    for (; snap.valid(); snap.next())
+    for (size_t i = 0; i < hashes.size(); ++i)
     {
         for (int j = 0; j < 64; ++j)
         {
@@ -1142,9 +1617,9 @@ hyperdisk :: disk :: split_shard(size_t shard_num)
                 continue;
             }
 
-            if (snap.coordinate().secondary_lower_hash & secondary_bit)
+            if (hashes[i].second & secondary_bit)
             {
-                if (snap.coordinate().primary_hash & bit)
+                if (hashes[i].first & bit)
                 {
                     ++ones_upper[j];
                 }
@@ -1155,7 +1630,7 @@ hyperdisk :: disk :: split_shard(size_t shard_num)
             }
             else
             {
-                if (snap.coordinate().primary_hash & bit)
+                if (hashes[i].first & bit)
                 {
                     ++ones_lower[j];
                 }
@@ -1172,61 +1647,290 @@ hyperdisk :: disk :: split_shard(size_t shard_num)
     int primary_upper_split = which_to_split(c.primary_mask, zeros_upper, ones_upper);
     uint64_t primary_upper_bit = 1ULL << primary_upper_split;
 
-    // Create four new shards, and scatter the data between them.
-    coordinate zero_zero_coord(c.primary_mask | primary_lower_bit, c.primary_hash,
-                               c.secondary_lower_mask | secondary_bit, c.secondary_lower_hash,
-                               c.secondary_upper_mask, c.secondary_upper_hash);
-    coordinate zero_one_coord(c.primary_mask | primary_upper_bit, c.primary_hash,
-                              c.secondary_lower_mask | secondary_bit, c.secondary_lower_hash | secondary_bit,
-                              c.secondary_upper_mask, c.secondary_upper_hash);
-    coordinate one_zero_coord(c.primary_mask | primary_lower_bit, c.primary_hash | primary_lower_bit,
-                              c.secondary_lower_mask | secondary_bit, c.secondary_lower_hash,
-                              c.secondary_upper_mask, c.secondary_upper_hash);
-    coordinate one_one_coord(c.primary_mask | primary_upper_bit, c.primary_hash | primary_upper_bit,
-                             c.secondary_lower_mask | secondary_bit, c.secondary_lower_hash | secondary_bit,
-                             c.secondary_upper_mask, c.secondary_upper_hash);
+    // Create four new shards.  Those with a zero bit for the secondary hash
+    // must come last, so that they will be picked up first.  This is necessary
+    // to make objects with no searchable attribute work properly.
+    job->new_coords[0] = coordinate(c.primary_mask | primary_upper_bit, c.primary_hash,
+                                    c.secondary_lower_mask | secondary_bit, c.secondary_lower_hash | secondary_bit,
+                                    c.secondary_upper_mask, c.secondary_upper_hash);
+    job->new_coords[1] = coordinate(c.primary_mask | primary_upper_bit, c.primary_hash | primary_upper_bit,
+                                    c.secondary_lower_mask | secondary_bit, c.secondary_lower_hash | secondary_bit,
+                                    c.secondary_upper_mask, c.secondary_upper_hash);
+    job->new_coords[2] = coordinate(c.primary_mask | primary_lower_bit, c.primary_hash,
+                                    c.secondary_lower_mask | secondary_bit, c.secondary_lower_hash,
+                                    c.secondary_upper_mask, c.secondary_upper_hash);
+    job->new_coords[3] = coordinate(c.primary_mask | primary_lower_bit, c.primary_hash | primary_lower_bit,
+                                    c.secondary_lower_mask | secondary_bit, c.secondary_lower_hash,
+                                    c.secondary_upper_mask, c.secondary_upper_hash);
+    size_t created = 0;
 
     try
     {
-        e::intrusive_ptr<hyperdisk::shard> zero_zero = create_shard(zero_zero_coord);
-        e::guard zzg = e::makeobjguard(*this, &hyperdisk::disk::drop_shard, zero_zero_coord);
-        s->copy_to(zero_zero_coord, zero_zero);
+        for (; created < 4; ++created)
+        {
+            job->new_shards[created] = create_shard(job->new_coords[created]);
+        }
 
-        e::intrusive_ptr<hyperdisk::shard> zero_one = create_shard(zero_one_coord);
-        e::guard zog = e::makeobjguard(*this, &hyperdisk::disk::drop_shard, zero_one_coord);
-        s->copy_to(zero_one_coord, zero_one);
+        // Scatter the data between them in one scan of the old shard, and
+        // fill three of them on the split workers.
+        s->partition(job->new_coords, 4, m_history, job->entries);
 
-        e::intrusive_ptr<hyperdisk::shard> one_zero = create_shard(one_zero_coord);
-        e::guard ozg = e::makeobjguard(*this, &hyperdisk::disk::drop_shard, one_zero_coord);
-        s->copy_to(one_zero_coord, one_zero);
+        {
+            po6::threads::mutex::hold hold(&m_split_lock);
 
-        e::intrusive_ptr<hyperdisk::shard> one_one = create_shard(one_one_coord);
-        e::guard oog = e::makeobjguard(*this, &hyperdisk::disk::drop_shard, one_one_coord);
-        s->copy_to(one_one_coord, one_one);
+            for (size_t i = 1; i < 4; ++i)
+            {
+                m_split_queue.push(split_task(job, i));
+            }
 
-        e::intrusive_ptr<shard_vector> newshard_vector;
-        // Those with a zero bit for the secondary hash must come last, so that
-        // they will be picked up first.  This is necessary to make objects with
-        // no searchable attribute work properly.
-        newshard_vector = m_shards->replace(shard_num,
-                                            zero_one_coord, zero_one,
-                                            one_one_coord, one_one,
-                                            zero_zero_coord, zero_zero,
-                                            one_zero_coord, one_zero);
+            job->fills += 3;
+            m_split_cond.broadcast();
+        }
 
+        s->copy_entries_to(&job->entries[0], job->new_shards[0].get());
+        wait_for_splits(&job->fills);
+        job->status = SUCCESS;
+    }
+    catch (std::exception& e)
+    {
+        for (size_t i = 0; i < created; ++i)
         {
-            po6::threads::mutex::hold hold(&m_shards_lock);
-            m_shards = newshard_vector;
+            drop_shard(job->new_coords[i]);
+            job->new_shards[i] = e::intrusive_ptr<hyperdisk::shard>();
         }
 
-        zzg.dismiss();
-        zog.dismiss();
-        ozg.dismiss();
-        oog.dismiss();
-        return drop_shard(c);
+        job->status = SPLITFAILED;
     }
-    catch (std::exception& e)
+}
+
+hyperdisk::returncode
+hyperdisk :: disk :: install_split(split_job* job)
+{
+    std::vector<shard*>::iterator splitting;
+    splitting = std::find(m_splitting.begin(), m_splitting.end(), job->s);
+
+    if (splitting != m_splitting.end())
+    {
+        m_splitting.erase(splitting);
+        m_splitting_cond.broadcast();
+    }
+
+    if (job->status != SUCCESS)
+    {
+        return job->status;
+    }
+
+    size_t shard_num = 0;
+
+    while (shard_num < m_shards->size() && m_shards->get_shard(shard_num) != job->s)
+    {
+        ++shard_num;
+    }
+
+    if (shard_num == m_shards->size())
     {
+        for (size_t i = 0; i < 4; ++i)
+        {
+            drop_shard(job->new_coords[i]);
+        }
+
         return SPLITFAILED;
     }
+
+    e::intrusive_ptr<shard_vector> newshard_vector;
+    newshard_vector = m_shards->replace(shard_num,
+                                        job->new_coords[0], job->new_shards[0],
+                                        job->new_coords[1], job->new_shards[1],
+                                        job->new_coords[2], job->new_shards[2],
+                                        job->new_coords[3], job->new_shards[3]);
+
+    // Pending mandatory I/O names its shard by index, which the split may have
+    // moved.  The shard which was split no longer needs it.
+    shard* needs_io = NULL;
+
+    if (m_needs_io != static_cast<size_t>(-1) && m_needs_io != shard_num)
+    {
+        needs_io = m_shards->get_shard(m_needs_io);
+    }
+
+    m_needs_io = -1;
+
+    for (size_t i = 0; needs_io && i < newshard_vector->size(); ++i)
+    {
+        if (newshard_vector->get_shard(i) == needs_io)
+        {
+            m_needs_io = i;
+        }
+    }
+
+    {
+        po6::threads::mutex::hold hold(&m_shards_lock);
+        m_shards = newshard_vector;
+    }
+
+    return drop_shard(job->c);
+}
+
+std::tr1::shared_ptr<const hyperdisk::wal_overlay>
+hyperdisk :: disk :: current_wal_overlay()
+{
+    // An entry is in the log before it is counted, so an overlay built after
+    // reading the count holds every entry counted.  The cached overlay is
+    // extended with the entries appended since it was built, which are those
+    // past its end.  Entries it holds which are flushed before the shards are
+    // snapshotted are also in the shards, where it supersedes them with the
+    // same data.
+    uint64_t appends = __sync_add_and_fetch(&m_log_appends, 0);
+    po6::threads::mutex::hold hold(&m_wal_lock);
+
+    if (m_wal && m_wal_appends == appends)
+    {
+        return m_wal;
+    }
+
+    e::locking_iterable_fifo<log_entry>::iterator iter(m_log.iterate());
+    uint64_t first = m_log_head;
+
+    while (m_wal && first < m_wal->end() && iter.valid())
+    {
+        iter.next();
+        ++first;
+    }
+
+    m_wal.reset(new wal_overlay(m_wal.get(), m_log_head, iter, first));
+    m_wal_appends = appends;
+    return m_wal;
+}
+
+bool
+hyperdisk :: disk :: blocked_by_split(const coordinate& coord)
+{
+    for (size_t i = 0; i < m_shards->size(); ++i)
+    {
+        if ((m_shards->get_coordinate(i).primary_intersects(coord) ||
+             m_shards->get_coordinate(i).intersects(coord)) &&
+            std::find(m_splitting.begin(), m_splitting.end(),
+                      m_shards->get_shard(i)) != m_splitting.end())
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void
+hyperdisk :: disk :: split_worker()
+{
+    while (true)
+    {
+        split_task task;
+
+        {
+            po6::threads::mutex::hold hold(&m_split_lock);
+
+            while (!m_split_shutdown && m_split_queue.empty())
+            {
+                m_split_cond.wait();
+            }
+
+            if (m_split_queue.empty())
+            {
+                return;
+            }
+
+            task = m_split_queue.front();
+            m_split_queue.pop();
+        }
+
+        run_split_task(task);
+    }
+}
+
+void
+hyperdisk :: disk :: run_split_task(const split_task& task)
+{
+    if (task.part == split_task::PREPARE)
+    {
+        prepare_split(task.job);
+        po6::threads::mutex::hold hold(&m_split_lock);
+        --m_split_unfinished;
+        m_split_cond.broadcast();
+    }
+    else
+    {
+        split_job* job = task.job;
+        job->s->copy_entries_to(&job->entries[task.part], job->new_shards[task.part].get());
+        po6::threads::mutex::hold hold(&m_split_lock);
+        --job->fills;
+        m_split_cond.broadcast();
+    }
+}
+
+void
+hyperdisk :: disk :: wait_for_splits(const size_t* unfinished)
+{
+    while (true)
+    {
+        split_task task;
+
+        {
+            po6::threads::mutex::hold hold(&m_split_lock);
+
+            while (*unfinished > 0 && m_split_queue.empty())
+            {
+                m_split_cond.wait();
+            }
+
+            if (*unfinished == 0)
+            {
+                return;
+            }
+
+            task = m_split_queue.front();
+            m_split_queue.pop();
+        }
+
+        run_split_task(task);
+    }
+}
+
+e::intrusive_ptr<hyperdisk::shard_vector>
+hyperdisk :: disk :: snapshot_shards(const coordinate& coord,
+                                     std::vector<shard_snapshot>* snaps)
+{
+    e::intrusive_ptr<shard_vector> shards;
+    e::locking_iterable_fifo<offset_update>::iterator it = m_offsets.iterate();
+
+    {
+        po6::threads::mutex::hold b(&m_shards_lock);
+        shards = m_shards;
+    }
+
+    std::vector<uint32_t> offsets(shards->size());
+
+    for (size_t i = 0; i < shards->size(); ++i)
+    {
+        offsets[i] = shards->get_offset(i);
+    }
+
+    for (; it.valid() && it->shard_generation <= shards->generation(); it.next())
+    {
+        if (it->shard_generation == shards->generation())
+        {
+            offsets[it->shard_num] = it->new_offset;
+        }
+    }
+
+    snaps->reserve(shards->size());
+
+    for (size_t i = 0; i < shards->size(); ++i)
+    {
+        if (coord.intersects(shards->get_coordinate(i)))
+        {
+            snaps->push_back(shard_snapshot(offsets[i], shards->get_shard(i)));
+        }
+    }
+
+    return shards;
 }
@@ -0,0 +1,103 @@
+// Copyright (c) 2011, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#define __STDC_LIMIT_MACROS
+
+// HyperDisk
+#include "hyperdisk/disk_snapshot.h"
+#include "hyperdisk/shard_snapshot.h"
+#include "hyperdisk/shard_vector.h"
+
+hyperdisk :: disk_snapshot :: disk_snapshot(const hyperspacehashing::mask::coordinate& coord,
+                                            e::intrusive_ptr<shard_vector> shards,
+                                            std::vector<hyperdisk::shard_snapshot>* ss)
+    : snapshot()
+    , m_coord(coord)
+    , m_shards(shards)
+    , m_snaps()
+{
+    m_snaps.swap(*ss);
+}
+
+hyperdisk :: disk_snapshot :: ~disk_snapshot() throw ()
+{
+}
+
+bool
+hyperdisk :: disk_snapshot :: valid()
+{
+    while (!m_snaps.empty())
+    {
+        if (m_snaps.back().valid(m_coord))
+        {
+            return true;
+        }
+        else
+        {
+            m_snaps.pop_back();
+        }
+    }
+
+    return false;
+}
+
+void
+hyperdisk :: disk_snapshot :: next()
+{
+    if (!m_snaps.empty())
+    {
+        m_snaps.back().next();
+    }
+}
+
+hyperspacehashing::mask::coordinate
+hyperdisk :: disk_snapshot :: coordinate()
+{
+    assert(!m_snaps.empty());
+    return m_snaps.back().coordinate();
+}
+
+uint64_t
+hyperdisk :: disk_snapshot :: version()
+{
+    assert(!m_snaps.empty());
+    return m_snaps.back().version();
+}
+
+const e::slice&
+hyperdisk :: disk_snapshot :: key()
+{
+    assert(!m_snaps.empty());
+    return m_snaps.back().key();
+}
+
+const std::vector<e::slice>&
+hyperdisk :: disk_snapshot :: value()
+{
+    assert (!m_snaps.empty());
+    return m_snaps.back().value();
+}
@@ -0,0 +1,85 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef hyperdisk_disk_snapshot_h_
+#define hyperdisk_disk_snapshot_h_
+
+// STL
+#include <vector>
+
+// e
+#include <e/intrusive_ptr.h>
+
+// HyperDisk
+#include "hyperdisk/hyperdisk/snapshot.h"
+#include "hyperdisk/shard_snapshot.h"
+
+// Forward Declarations
+namespace hyperdisk
+{
+class shard_vector;
+}
+
+namespace hyperdisk
+{
+
+// The snapshot implementation for ``disk``.  It iterates the shard_snapshots of
+// every shard which intersects the search coordinate.
+class disk_snapshot : public snapshot
+{
+    public:
+        disk_snapshot(const hyperspacehashing::mask::coordinate& coord,
+                      e::intrusive_ptr<shard_vector> shards,
+                      std::vector<hyperdisk::shard_snapshot>* snaps);
+        ~disk_snapshot() throw ();
+
+    public:
+        virtual bool valid();
+        virtual void next();
+
+    public:
+        virtual hyperspacehashing::mask::coordinate coordinate();
+        virtual uint64_t version();
+        virtual const e::slice& key();
+        virtual const std::vector<e::slice>& value();
+
+    private:
+        disk_snapshot(const disk_snapshot&);
+
+    private:
+        disk_snapshot& operator = (const disk_snapshot&);
+
+    private:
+        hyperspacehashing::mask::coordinate m_coord;
+        e::intrusive_ptr<shard_vector> m_shards;
+        std::vector<hyperdisk::shard_snapshot> m_snaps;
+};
+
+} // namespace hyperdisk
+
+#endif // hyperdisk_disk_snapshot_h_
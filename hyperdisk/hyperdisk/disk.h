@@ -29,6 +29,7 @@
 #define hyperdisk_disk_h_
 
 // STL
+#include <map>
 #include <queue>
 #include <string>
 #include <tr1/memory>
@@ -36,7 +37,9 @@
 
 // po6
 #include <po6/pathname.h>
+#include <po6/threads/cond.h>
 #include <po6/threads/mutex.h>
+#include <po6/threads/thread.h>
 
 // e
 #include <e/intrusive_ptr.h>
@@ -47,6 +50,7 @@
 #include <hyperspacehashing/mask.h>
 
 // HyperDisk
+#include <hyperdisk/engine.h>
 #include <hyperdisk/reference.h>
 #include <hyperdisk/returncode.h>
 #include <hyperdisk/snapshot.h>
@@ -57,7 +61,9 @@ namespace hyperdisk
 class log_entry;
 class offset_update;
 class shard;
+class shard_snapshot;
 class shard_vector;
+class wal_overlay;
 }
 
 namespace hyperdisk
@@ -69,7 +75,7 @@ namespace hyperdisk
 // All public methods are thread-safe, and synchronization is handled
 // internally.
 
-class disk
+class disk : public engine
 {
     public:
         // Create a new blank disk.
@@ -84,24 +90,42 @@ class disk
 
     public:
         // May return SUCCESS or NOTFOUND.
-        returncode get(const e::slice& key, std::vector<e::slice>* value,
-                       uint64_t* version, reference* backing);
+        virtual returncode get(const e::slice& key, std::vector<e::slice>* value,
+                               uint64_t* version, reference* backing);
+        // May return SUCCESS or NOTFOUND.  Superseded versions are served from
+        // the write-ahead log, and from stale records in the shards until
+        // cleaning or splitting drops them.
+        virtual returncode get_at(const e::slice& key, uint64_t at,
+                                  std::vector<e::slice>* value,
+                                  uint64_t* version, reference* backing);
         // May return SUCCESS or WRONGARITY.
-        returncode put(std::tr1::shared_ptr<e::buffer> backing, const e::slice& key,
-                       const std::vector<e::slice>& value, uint64_t version);
+        virtual returncode put(std::tr1::shared_ptr<e::buffer> backing, const e::slice& key,
+                               const std::vector<e::slice>& value, uint64_t version);
         // May return SUCCESS.
-        returncode del(std::tr1::shared_ptr<e::buffer> backing, const e::slice& key);
+        virtual returncode del(std::tr1::shared_ptr<e::buffer> backing, const e::slice& key,
+                               uint64_t version);
         // Create a snapshot of the disk.  The snapshot will contain the result
         // after applying a prefix of the execution history of the disk.
-        e::intrusive_ptr<snapshot> make_snapshot(const hyperspacehashing::search& terms);
+        // Entries in the write-ahead log are merged into the snapshot, so
+        // there is no need to flush before taking it.
+        virtual e::intrusive_ptr<snapshot> make_snapshot(const hyperspacehashing::search& terms);
+        // Create a snapshot of the disk which returns objects in key order.
+        // Each shard's objects are sorted separately, and the sorted runs are
+        // merged as the snapshot is iterated.
+        virtual e::intrusive_ptr<snapshot> make_ordered_snapshot(const hyperspacehashing::search& terms,
+                                                                 bool descending);
+        // Create one snapshot for each shard which intersects the search, and
+        // one more for the objects in the write-ahead log.
+        virtual void make_partitioned_snapshot(const hyperspacehashing::search& terms,
+                                               std::vector<e::intrusive_ptr<snapshot> >* parts);
         // Create a snapshot of the disk.  This will return every result that
         // will be returned by make_snapshot(), but will then continue to return
         // any execution history past the point at which the snapshot was taken.
-        e::intrusive_ptr<rolling_snapshot> make_rolling_snapshot();
+        virtual e::intrusive_ptr<rolling_snapshot> make_rolling_snapshot();
         // Drop the disk.  This removes it from the filesystem.  All existing
         // snapshots will continue to exist, but no calls should be made to the
         // disk (except the destructor).
-        returncode drop();
+        virtual returncode drop();
 
     public:
         // Move data from in-memory data structures to the shards.  This
@@ -113,27 +137,36 @@ class disk
         // shards which need to be split to make more space.  If this returns 
         // a *FULL error, then you must call either 'do_mandatory_io' or 
         // 'do_optimistic_io'. 
-        returncode flush(ssize_t num, bool nonblocking);
+        virtual returncode flush(ssize_t num, bool nonblocking);
         // Do only the amount of shard-splitting necessary to split shards which
         // are 100% used.
-        returncode do_mandatory_io();
-        // Possibly split one shard if our disk is getting full.
-        returncode do_optimistic_io();
+        virtual returncode do_mandatory_io();
+        // Sample how quickly each shard is filling, and split those predicted
+        // to fill before a split could complete.  Several shards may be split
+        // at once, each on its own thread.
+        virtual returncode do_optimistic_io();
         // Preallocate shards to ease the hit we would take from the large
         // amount of disk I/O at once.
-        returncode preallocate();
+        virtual returncode preallocate();
         // Move data either synchronously or asynchronously from operating
         // system buffers to the underlying FS.  May return SUCCESS or
         // SYNCFAILED.  errno will be set to the reason the sync failed.
-        returncode async();
-        returncode sync();
+        virtual returncode async();
+        virtual returncode sync();
+        // The number of bytes pinned by entries in the write-ahead log.
+        virtual uint64_t wal_bytes();
+        // Stale records within "versions" of their object's current version
+        // survive cleaning and splitting, space permitting.
+        virtual void retain_history(uint64_t versions);
 
     public:
         // Quiesce.
-        bool quiesce(const std::string& quiesce_state_id);
+        virtual bool quiesce(const std::string& quiesce_state_id);
 
     private:
         friend class e::intrusive_ptr<disk>;
+        class split_job;
+        class split_task;
         class stored;
         static uint64_t hash(const std::string& s);
         typedef e::lockfree_hash_map<std::string, e::intrusive_ptr<stored>, hash>
@@ -149,9 +182,6 @@ class disk
         ~disk() throw ();
 
     private:
-        // Reference counting for disks.
-        void inc() { __sync_add_and_fetch(&m_ref, 1); }
-        void dec() { if (__sync_sub_and_fetch(&m_ref, 1) == 0) delete this; }
         // The pathname (relative to m_base) of a (tmp) shard at coordinate.
         po6::pathname shard_filename(const hyperspacehashing::mask::coordinate& c);
         po6::pathname shard_tmp_filename(const hyperspacehashing::mask::coordinate& c);
@@ -168,9 +198,53 @@ class disk
         returncode deal_with_full_shard(size_t shard_num);
         returncode clean_shard(size_t shard_num);
         returncode split_shard(size_t shard_num);
+        // Split shards in parallel.  The jobs' shards must be in m_splitting.
+        // This must be called WITHOUT m_shards_mutate held; it takes it only to
+        // install the splits.
+        returncode split_shards(std::vector<split_job>* jobs);
+        // Choose the new coordinates for a split and copy the data into the
+        // four new shards.  This touches neither m_shards nor the disk's other
+        // state, so several may run at once.
+        void prepare_split(split_job* job);
+        // Swap a prepared split into m_shards and take its shard out of
+        // m_splitting.  The m_shard_mutate lock must be held.
+        returncode install_split(split_job* job);
+        // True if a log entry at "coord" would touch a shard in m_splitting.
+        // The m_shard_mutate lock must be held.
+        bool blocked_by_split(const hyperspacehashing::mask::coordinate& coord);
+        // Body of the split workers, which prepare the splits of split_shards
+        // and fill the new shards of every split.
+        void split_worker();
+        void run_split_task(const split_task& task);
+        // Wait until "*unfinished" (protected by m_split_lock) is 0, doing
+        // queued split work meanwhile so that a split which waits on its
+        // fills never starves the workers.
+        void wait_for_splits(const size_t* unfinished);
+        // The overlay of the log as it is now, shared with every other search
+        // which starts before the log is next appended to.  Call this before
+        // taking the shard snapshots.
+        std::tr1::shared_ptr<const wal_overlay> current_wal_overlay();
+        // Take a shard_snapshot of every shard which intersects "coord",
+        // returning the shards they belong to.
+        e::intrusive_ptr<shard_vector> snapshot_shards(const hyperspacehashing::mask::coordinate& coord,
+                                                       std::vector<shard_snapshot>* snaps);
+
+    private:
+        // The split planner's view of how quickly one shard is filling.
+        class fill_estimate
+        {
+            public:
+                fill_estimate() : coord(), when(0), used(0), rate(0) {}
+
+            public:
+                hyperspacehashing::mask::coordinate coord;
+                uint64_t when;
+                int used;
+                // Percent of the shard per second.
+                double rate;
+        };
 
     private:
-        size_t m_ref;
         size_t m_arity;
         hyperspacehashing::mask::hasher m_hasher;
         // Read about locking in the source.
@@ -178,6 +252,17 @@ class disk
         po6::threads::mutex m_shards_lock;
         e::intrusive_ptr<shard_vector> m_shards;
         e::locking_iterable_fifo<log_entry> m_log;
+        uint64_t m_log_bytes;
+        // Counts appends to m_log.  Bumped after the entry is in the log.
+        uint64_t m_log_appends;
+        // The most recent overlay of m_log, and m_log_appends when it was
+        // built.  m_log_head counts the entries flushed from m_log, and so
+        // numbers its oldest entry.  The log only shrinks with m_wal_lock
+        // held, so that m_log_head and the log agree for those who hold it.
+        po6::threads::mutex m_wal_lock;
+        std::tr1::shared_ptr<const wal_overlay> m_wal;
+        uint64_t m_wal_appends;
+        uint64_t m_log_head;
         e::locking_iterable_fifo<offset_update> m_offsets;
         po6::io::fd m_base;
         po6::pathname m_base_filename;
@@ -185,7 +270,23 @@ class disk
         std::queue<std::pair<po6::pathname, e::intrusive_ptr<shard> > > m_spare_shards;
         size_t m_spare_shard_counter;
         size_t m_needs_io;
-        unsigned int m_seed;
+        // Shards being split by do_optimistic_io while m_shards_mutate is not
+        // held.  Flushes leave entries for these shards in the log until the
+        // split is installed.  Protected by m_shards_mutate.
+        std::vector<shard*> m_splitting;
+        po6::threads::cond m_splitting_cond;
+        // Work queue for the split threads, which start on first use and run
+        // until the disk is destroyed.
+        po6::threads::mutex m_split_lock;
+        po6::threads::cond m_split_cond;
+        std::queue<split_task> m_split_queue;
+        size_t m_split_unfinished;
+        bool m_split_shutdown;
+        std::vector<std::tr1::shared_ptr<po6::threads::thread> > m_split_threads;
+        po6::threads::mutex m_planner_lock;
+        std::map<const shard*, fill_estimate> m_fill;
+        uint64_t m_split_nanos;
+        uint64_t m_history;
 
     private:
         // State dump and load.
@@ -0,0 +1,153 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef hyperdisk_engine_h_
+#define hyperdisk_engine_h_
+
+// POSIX
+#include <sys/types.h>
+
+// STL
+#include <string>
+#include <tr1/memory>
+#include <vector>
+
+// e
+#include <e/buffer.h>
+#include <e/intrusive_ptr.h>
+#include <e/slice.h>
+
+// HyperspaceHashing
+#include <hyperspacehashing/search.h>
+
+// HyperDisk
+#include <hyperdisk/reference.h>
+#include <hyperdisk/returncode.h>
+#include <hyperdisk/snapshot.h>
+
+namespace hyperdisk
+{
+
+// A storage engine holds the objects for a single region.  The daemon only
+// ever talks to its data through this interface, so any engine may be swapped
+// in behind it.  ``disk`` is the default (and durable) engine, while
+// ``memory`` is a trivial reference engine which keeps everything in RAM.
+//
+// All public methods must be thread-safe.  Engines which have no use for the
+// background I/O calls (flush, do_*_io, preallocate, async, sync) should
+// return DIDNOTHING or SUCCESS as appropriate.
+
+class engine
+{
+    public:
+        // May return SUCCESS or NOTFOUND.
+        virtual returncode get(const e::slice& key, std::vector<e::slice>* value,
+                               uint64_t* version, reference* backing) = 0;
+        // Get the object as it was at version "at":  the newest version of it
+        // which is no greater than "at", unless it was deleted or overwritten
+        // by a version no greater than "at".  Engines need only answer for
+        // versions within the history they retain (see retain_history).  May
+        // return SUCCESS or NOTFOUND.
+        virtual returncode get_at(const e::slice& key, uint64_t at,
+                                  std::vector<e::slice>* value,
+                                  uint64_t* version, reference* backing) = 0;
+        // May return SUCCESS or WRONGARITY.
+        virtual returncode put(std::tr1::shared_ptr<e::buffer> backing, const e::slice& key,
+                               const std::vector<e::slice>& value, uint64_t version) = 0;
+        // May return SUCCESS.
+        virtual returncode del(std::tr1::shared_ptr<e::buffer> backing, const e::slice& key,
+                               uint64_t version) = 0;
+        // Create a snapshot of the engine.  The snapshot will contain the
+        // result after applying a prefix of the execution history.
+        virtual e::intrusive_ptr<snapshot> make_snapshot(const hyperspacehashing::search& terms) = 0;
+        // As make_snapshot, except that objects are returned in key order (or
+        // reverse key order).  Keys compare as little-endian integers, which
+        // is the order in which RANGE hashing places them, with ties broken
+        // bytewise.
+        virtual e::intrusive_ptr<snapshot> make_ordered_snapshot(const hyperspacehashing::search& terms,
+                                                                 bool descending) = 0;
+        // As make_snapshot, except that the objects are split among several
+        // snapshots (appended to "parts") which may be iterated in parallel.
+        // Together they return the same objects as one snapshot would.
+        virtual void make_partitioned_snapshot(const hyperspacehashing::search& terms,
+                                               std::vector<e::intrusive_ptr<snapshot> >* parts) = 0;
+        // Create a snapshot which will return every result that will be
+        // returned by make_snapshot(), and then continue to return any
+        // execution history past the point at which the snapshot was taken.
+        virtual e::intrusive_ptr<rolling_snapshot> make_rolling_snapshot() = 0;
+        // Drop the engine, removing any persistent state.  Existing snapshots
+        // remain valid.
+        virtual returncode drop() = 0;
+
+    public:
+        // Background maintenance.  See ``disk`` for the semantics of each.
+        virtual returncode flush(ssize_t num, bool nonblocking) = 0;
+        virtual returncode do_mandatory_io() = 0;
+        virtual returncode do_optimistic_io() = 0;
+        virtual returncode preallocate() = 0;
+        virtual returncode async() = 0;
+        virtual returncode sync() = 0;
+
+    public:
+        // The number of bytes of memory pinned by writes which have not yet
+        // been flushed out of the engine's write-ahead log.
+        virtual uint64_t wal_bytes() = 0;
+        // Keep superseded versions of an object readable by get_at while they
+        // are within "versions" versions of the object's current version.
+        // This is best-effort; engines may drop history to reclaim space.
+        virtual void retain_history(uint64_t versions) = 0;
+
+    public:
+        // Persist state so that it may be re-opened with the same
+        // quiesce_state_id.  Returns false if the engine cannot do so.
+        virtual bool quiesce(const std::string& quiesce_state_id) = 0;
+
+    protected:
+        friend class e::intrusive_ptr<engine>;
+
+    protected:
+        engine();
+        virtual ~engine() throw ();
+
+    protected:
+        void inc() { __sync_add_and_fetch(&m_ref, 1); }
+        void dec() { if (__sync_sub_and_fetch(&m_ref, 1) == 0) delete this; }
+
+    private:
+        engine(const engine&);
+
+    private:
+        engine& operator = (const engine&);
+
+    private:
+        size_t m_ref;
+};
+
+} // namespace hyperdisk
+
+#endif // hyperdisk_engine_h_
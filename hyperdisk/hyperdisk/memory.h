@@ -0,0 +1,135 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef hyperdisk_memory_h_
+#define hyperdisk_memory_h_
+
+// STL
+#include <map>
+#include <string>
+#include <tr1/memory>
+#include <vector>
+
+// po6
+#include <po6/threads/mutex.h>
+
+// e
+#include <e/intrusive_ptr.h>
+#include <e/locking_iterable_fifo.h>
+
+// HyperspaceHashing
+#include <hyperspacehashing/mask.h>
+
+// HyperDisk
+#include <hyperdisk/engine.h>
+
+// Forward Declarations
+namespace hyperdisk
+{
+class log_entry;
+}
+
+namespace hyperdisk
+{
+
+// A reference engine which keeps every object in an in-memory map.  It is
+// neither durable nor particularly fast, but it is simple enough to be
+// obviously correct, which makes it a useful baseline against which to compare
+// other engines.
+
+class memory : public engine
+{
+    public:
+        static e::intrusive_ptr<memory> create(const hyperspacehashing::mask::hasher& hasher,
+                                               uint16_t arity);
+
+    public:
+        virtual returncode get(const e::slice& key, std::vector<e::slice>* value,
+                               uint64_t* version, reference* backing);
+        // Only history which has not yet been trimmed from the log is kept.
+        virtual returncode get_at(const e::slice& key, uint64_t at,
+                                  std::vector<e::slice>* value,
+                                  uint64_t* version, reference* backing);
+        virtual returncode put(std::tr1::shared_ptr<e::buffer> backing, const e::slice& key,
+                               const std::vector<e::slice>& value, uint64_t version);
+        virtual returncode del(std::tr1::shared_ptr<e::buffer> backing, const e::slice& key,
+                               uint64_t version);
+        virtual e::intrusive_ptr<snapshot> make_snapshot(const hyperspacehashing::search& terms);
+        virtual e::intrusive_ptr<snapshot> make_ordered_snapshot(const hyperspacehashing::search& terms,
+                                                                 bool descending);
+        virtual void make_partitioned_snapshot(const hyperspacehashing::search& terms,
+                                               std::vector<e::intrusive_ptr<snapshot> >* parts);
+        virtual e::intrusive_ptr<rolling_snapshot> make_rolling_snapshot();
+        virtual returncode drop();
+
+    public:
+        // Trims the log kept for rolling snapshots.  Everything else is a
+        // no-op.
+        virtual returncode flush(ssize_t num, bool nonblocking);
+        virtual returncode do_mandatory_io();
+        virtual returncode do_optimistic_io();
+        virtual returncode preallocate();
+        virtual returncode async();
+        virtual returncode sync();
+        virtual uint64_t wal_bytes();
+        virtual void retain_history(uint64_t versions);
+
+    public:
+        // Always fails; there is nothing to persist the state to.
+        virtual bool quiesce(const std::string& quiesce_state_id);
+
+    private:
+        friend class e::intrusive_ptr<memory>;
+        typedef std::map<std::string, std::tr1::shared_ptr<log_entry> > table_t;
+
+    private:
+        memory(const hyperspacehashing::mask::hasher& hasher, uint16_t arity);
+        memory(const memory&);
+        ~memory() throw ();
+
+    private:
+        // Drop up to "num" entries (all of them if "num" is -1) from the front
+        // of the log.  Returns false if there were none.  Must be called with
+        // m_lock held.
+        bool trim_log(ssize_t num);
+
+    private:
+        memory& operator = (const memory&);
+
+    private:
+        size_t m_arity;
+        hyperspacehashing::mask::hasher m_hasher;
+        po6::threads::mutex m_lock;
+        table_t m_table;
+        e::locking_iterable_fifo<log_entry> m_log;
+        uint64_t m_log_bytes;
+};
+
+} // namespace hyperdisk
+
+#endif // hyperdisk_memory_h_
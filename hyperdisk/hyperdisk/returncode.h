@@ -46,7 +46,9 @@ enum returncode
     DROPFAILED  = 8198,
     MISSINGDISK = 8199,
     SPLITFAILED = 8200,
-    DIDNOTHING  = 8201
+    DIDNOTHING  = 8201,
+    WALFULL     = 8202,
+    SPLITTING   = 8203
 };
 
 #define str(x) #x
@@ -68,6 +70,8 @@ operator << (std::ostream& lhs, const returncode& rhs)
         stringify(MISSINGDISK);
         stringify(SPLITFAILED);
         stringify(DIDNOTHING);
+        stringify(WALFULL);
+        stringify(SPLITTING);
         default:
             lhs << "unknown returncode";
             break;
@@ -30,6 +30,7 @@
 
 // STL
 #include <memory>
+#include <vector>
 
 // e
 #include <e/intrusive_ptr.h>
@@ -43,37 +44,35 @@
 namespace hyperdisk
 {
 class log_entry;
-class shard_snapshot;
-class shard_vector;
 }
 
 namespace hyperdisk
 {
 
-// A snapshot will iterate all shards in a disk, frozen at a particular point in
-// time.  That is, it will be linearizable with all updates to the disk.
+// A snapshot will iterate all objects in an engine, frozen at a particular
+// point in time.  That is, it will be linearizable with all updates to the
+// engine.  Each engine provides its own implementation.
 class snapshot
 {
     public:
-        bool valid();
-        void next();
+        virtual bool valid() = 0;
+        virtual void next() = 0;
 
     public:
-        hyperspacehashing::mask::coordinate coordinate();
-        uint64_t version();
-        const e::slice& key();
-        const std::vector<e::slice>& value();
+        virtual hyperspacehashing::mask::coordinate coordinate() = 0;
+        virtual uint64_t version() = 0;
+        virtual const e::slice& key() = 0;
+        virtual const std::vector<e::slice>& value() = 0;
+
+    protected:
+        snapshot();
+        virtual ~snapshot() throw ();
 
     private:
         friend class e::intrusive_ptr<snapshot>;
-        friend class disk;
 
     private:
-        snapshot(const hyperspacehashing::mask::coordinate& coord,
-                 e::intrusive_ptr<shard_vector> shards,
-                 std::vector<hyperdisk::shard_snapshot>* snaps);
         snapshot(const snapshot&);
-        ~snapshot() throw ();
 
     private:
         void inc() { __sync_add_and_fetch(&m_ref, 1); }
@@ -84,12 +83,9 @@ class snapshot
 
     private:
         size_t m_ref;
-        hyperspacehashing::mask::coordinate m_coord;
-        e::intrusive_ptr<shard_vector> m_shards;
-        std::vector<hyperdisk::shard_snapshot> m_snaps;
 };
 
-// A rolling snapshot will replay the disks' log after iterating all shards.
+// A rolling snapshot will replay an engine's log after iterating a snapshot.
 class rolling_snapshot
 {
     public:
@@ -105,6 +101,7 @@ class rolling_snapshot
     private:
         friend class e::intrusive_ptr<rolling_snapshot>;
         friend class disk;
+        friend class memory;
 
     private:
         void inc() { __sync_add_and_fetch(&m_ref, 1); }
@@ -123,6 +120,7 @@ class rolling_snapshot
         size_t m_ref;
         e::locking_iterable_fifo<log_entry>::iterator m_iter;
         e::intrusive_ptr<snapshot> m_snap;
+        std::vector<e::slice> m_value;
 };
 
 } // namespace hyperdisk
@@ -0,0 +1,85 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef hyperdisk_key_order_h_
+#define hyperdisk_key_order_h_
+
+// C
+#include <stdint.h>
+#include <string.h>
+
+// STL
+#include <algorithm>
+
+// e
+#include <e/slice.h>
+
+// HyperspaceHashing
+#include "hyperspacehashing/hashes_internal.h"
+
+namespace hyperdisk
+{
+
+// The order of keys in an ordered snapshot.  Keys are compared as the
+// unsigned little-endian integers which RANGE hashing places by, so negative
+// int64 keys sort after every non-negative one.  Ties (keys which
+// share their first eight bytes) are broken bytewise.  The prefix is passed in
+// precomputed as "order" so that it is computed once per key when sorting.
+inline int
+key_compare(uint64_t lhs_order, const e::slice& lhs,
+            uint64_t rhs_order, const e::slice& rhs)
+{
+    if (lhs_order != rhs_order)
+    {
+        return lhs_order < rhs_order ? -1 : 1;
+    }
+
+    int cmp = memcmp(lhs.data(), rhs.data(), std::min(lhs.size(), rhs.size()));
+
+    if (cmp != 0)
+    {
+        return cmp;
+    }
+
+    if (lhs.size() != rhs.size())
+    {
+        return lhs.size() < rhs.size() ? -1 : 1;
+    }
+
+    return 0;
+}
+
+inline uint64_t
+key_order(const e::slice& key)
+{
+    return hyperspacehashing::lendian(key);
+}
+
+} // namespace hyperdisk
+
+#endif // hyperdisk_key_order_h_
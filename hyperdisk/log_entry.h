@@ -38,6 +38,9 @@
 // HyperspaceHashing
 #include "hyperspacehashing/hyperspacehashing/mask.h"
 
+// HyperDisk
+#include "hyperdisk/small_vector.h"
+
 namespace hyperdisk
 {
 
@@ -47,9 +50,19 @@ namespace hyperdisk
 // coordinate(UINT64_MAX, X, UINT64_MAX, Y) is a PUT while
 // coordinate(UINT64_MAX, X, 0, 0) is a DEL.  coordinate(0, 0, 0, 0) indicates a
 // dummy log entry.
+//
+// Values with up to LOG_ENTRY_INLINE_VALUES attributes are stored within the
+// entry itself, so that appending an entry to the write-ahead log costs only
+// the allocation of the log's node.  Nodes are not pooled: each is freed on
+// its own once the log is trimmed past it.
+
+#define LOG_ENTRY_INLINE_VALUES 4
 
 class log_entry
 {
+    public:
+        typedef small_vector<e::slice, LOG_ENTRY_INLINE_VALUES> value_t;
+
     public:
         log_entry();
         log_entry(const hyperspacehashing::mask::coordinate& coord,
@@ -59,15 +72,26 @@ class log_entry
                   uint64_t version);
         log_entry(const hyperspacehashing::mask::coordinate& coord,
                   std::tr1::shared_ptr<e::buffer> backing,
-                  const e::slice& key);
+                  const e::slice& key,
+                  uint64_t version);
+
+    public:
+        // The number of bytes of memory this entry keeps alive.  Only the
+        // entry's own key and value are charged, as entries unpacked from one
+        // message share its backing buffer.
+        size_t bytes() const;
 
     public:
         hyperspacehashing::mask::coordinate coord;
         bool is_put;
         std::tr1::shared_ptr<e::buffer> backing;
         e::slice key;
-        std::vector<e::slice> value;
+        value_t value;
         uint64_t version;
+        // Set by a flush which wrote the entry to the shards while an older
+        // entry for a shard being split held it in the log.  Only touched
+        // with the disk's mutate lock held.
+        bool applied;
 };
 
 inline
@@ -78,6 +102,7 @@ log_entry :: log_entry()
     , key()
     , value()
     , version()
+    , applied(false)
 {
 }
 
@@ -93,22 +118,40 @@ log_entry :: log_entry(const hyperspacehashing::mask::coordinate& c,
     , key(k)
     , value(va)
     , version(ve)
+    , applied(false)
 {
 }
 
 inline
 log_entry :: log_entry(const hyperspacehashing::mask::coordinate& c,
                        std::tr1::shared_ptr<e::buffer> b,
-                       const e::slice& k)
+                       const e::slice& k,
+                       uint64_t ve)
     : coord(c)
     , is_put(false)
     , backing(b)
     , key(k)
     , value()
-    , version()
+    , version(ve)
+    , applied(false)
 {
 }
 
+inline size_t
+log_entry :: bytes() const
+{
+    size_t sz = sizeof(log_entry)
+              + value.heap_capacity() * sizeof(e::slice)
+              + key.size();
+
+    for (size_t i = 0; i < value.size(); ++i)
+    {
+        sz += value[i].size();
+    }
+
+    return sz;
+}
+
 } // namespace hyperdisk
 
 #endif // hyperdisk_log_entry_h_
@@ -0,0 +1,475 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#define __STDC_LIMIT_MACROS
+
+// C
+#include <cassert>
+
+// STL
+#include <algorithm>
+
+// e
+#include <e/guard.h>
+
+// HyperspaceHashing
+#include "hyperspacehashing/hyperspacehashing/mask.h"
+
+// HyperDisk
+#include "hyperdisk/hyperdisk/memory.h"
+#include "hyperdisk/key_order.h"
+#include "hyperdisk/log_entry.h"
+
+using hyperspacehashing::mask::coordinate;
+
+namespace hyperdisk
+{
+
+// Iterates a copy of the table taken while holding the engine's lock.  The
+// entries are shared with the table, so taking the copy does not copy any
+// keys or values.
+class memory_snapshot : public snapshot
+{
+    public:
+        memory_snapshot(const hyperspacehashing::mask::coordinate& coord,
+                        std::vector<std::tr1::shared_ptr<log_entry> >* entries);
+        ~memory_snapshot() throw ();
+
+    public:
+        virtual bool valid();
+        virtual void next();
+
+    public:
+        virtual hyperspacehashing::mask::coordinate coordinate();
+        virtual uint64_t version();
+        virtual const e::slice& key();
+        virtual const std::vector<e::slice>& value();
+
+    private:
+        memory_snapshot(const memory_snapshot&);
+
+    private:
+        memory_snapshot& operator = (const memory_snapshot&);
+
+    private:
+        hyperspacehashing::mask::coordinate m_coord;
+        std::vector<std::tr1::shared_ptr<log_entry> > m_entries;
+        size_t m_idx;
+        std::vector<e::slice> m_value;
+};
+
+} // namespace hyperdisk
+
+static std::string
+slice_to_string(const e::slice& s)
+{
+    return std::string(reinterpret_cast<const char*>(s.data()), s.size());
+}
+
+static bool
+compare_entries(const std::tr1::shared_ptr<hyperdisk::log_entry>& lhs,
+                const std::tr1::shared_ptr<hyperdisk::log_entry>& rhs)
+{
+    return hyperdisk::key_compare(hyperdisk::key_order(lhs->key), lhs->key,
+                                  hyperdisk::key_order(rhs->key), rhs->key) < 0;
+}
+
+hyperdisk :: memory_snapshot :: memory_snapshot(const hyperspacehashing::mask::coordinate& coord,
+                                                std::vector<std::tr1::shared_ptr<log_entry> >* entries)
+    : snapshot()
+    , m_coord(coord)
+    , m_entries()
+    , m_idx(0)
+    , m_value()
+{
+    m_entries.swap(*entries);
+}
+
+hyperdisk :: memory_snapshot :: ~memory_snapshot() throw ()
+{
+}
+
+bool
+hyperdisk :: memory_snapshot :: valid()
+{
+    while (m_idx < m_entries.size())
+    {
+        if (m_coord.intersects(m_entries[m_idx]->coord))
+        {
+            return true;
+        }
+
+        ++m_idx;
+    }
+
+    return false;
+}
+
+void
+hyperdisk :: memory_snapshot :: next()
+{
+    if (m_idx < m_entries.size())
+    {
+        ++m_idx;
+    }
+}
+
+hyperspacehashing::mask::coordinate
+hyperdisk :: memory_snapshot :: coordinate()
+{
+    assert(m_idx < m_entries.size());
+    return m_entries[m_idx]->coord;
+}
+
+uint64_t
+hyperdisk :: memory_snapshot :: version()
+{
+    assert(m_idx < m_entries.size());
+    return m_entries[m_idx]->version;
+}
+
+const e::slice&
+hyperdisk :: memory_snapshot :: key()
+{
+    assert(m_idx < m_entries.size());
+    return m_entries[m_idx]->key;
+}
+
+const std::vector<e::slice>&
+hyperdisk :: memory_snapshot :: value()
+{
+    assert(m_idx < m_entries.size());
+    m_value.assign(m_entries[m_idx]->value.begin(), m_entries[m_idx]->value.end());
+    return m_value;
+}
+
+e::intrusive_ptr<hyperdisk::memory>
+hyperdisk :: memory :: create(const hyperspacehashing::mask::hasher& hasher,
+                              uint16_t arity)
+{
+    return new memory(hasher, arity);
+}
+
+hyperdisk::returncode
+hyperdisk :: memory :: get(const e::slice& key,
+                           std::vector<e::slice>* value,
+                           uint64_t* version,
+                           reference* backing)
+{
+    po6::threads::mutex::hold hold(&m_lock);
+    table_t::iterator it = m_table.find(slice_to_string(key));
+
+    if (it == m_table.end())
+    {
+        return NOTFOUND;
+    }
+
+    value->assign(it->second->value.begin(), it->second->value.end());
+    *version = it->second->version;
+    backing->set(it->second->backing);
+    return SUCCESS;
+}
+
+hyperdisk::returncode
+hyperdisk :: memory :: get_at(const e::slice& key,
+                              uint64_t at,
+                              std::vector<e::slice>* value,
+                              uint64_t* version,
+                              reference* backing)
+{
+    po6::threads::mutex::hold hold(&m_lock);
+    e::locking_iterable_fifo<log_entry>::iterator it = m_log.iterate();
+    bool found = false;
+    returncode res = NOTFOUND;
+
+    for (; it.valid(); it.next())
+    {
+        if (it->key == key && it->version <= at)
+        {
+            if (it->is_put)
+            {
+                value->assign(it->value.begin(), it->value.end());
+                *version = it->version;
+                res = SUCCESS;
+            }
+            else
+            {
+                res = NOTFOUND;
+            }
+
+            found = true;
+            backing->set(it);
+        }
+    }
+
+    if (found)
+    {
+        return res;
+    }
+
+    // Nothing in the log is old enough, so the version we want predates the
+    // log.  Only the table entry can still answer that.
+    table_t::iterator t = m_table.find(slice_to_string(key));
+
+    if (t == m_table.end() || t->second->version > at)
+    {
+        return NOTFOUND;
+    }
+
+    value->assign(t->second->value.begin(), t->second->value.end());
+    *version = t->second->version;
+    backing->set(t->second->backing);
+    return SUCCESS;
+}
+
+hyperdisk::returncode
+hyperdisk :: memory :: put(std::tr1::shared_ptr<e::buffer> backing,
+                           const e::slice& key,
+                           const std::vector<e::slice>& value,
+                           uint64_t version)
+{
+    if (value.size() + 1 != m_arity)
+    {
+        return WRONGARITY;
+    }
+
+    coordinate coord = m_hasher.hash(key, value);
+    std::tr1::shared_ptr<log_entry> entry(new log_entry(coord, backing, key, value, version));
+    po6::threads::mutex::hold hold(&m_lock);
+    m_table[slice_to_string(key)] = entry;
+    __sync_add_and_fetch(&m_log_bytes, entry->bytes());
+    m_log.append(*entry);
+    return SUCCESS;
+}
+
+hyperdisk::returncode
+hyperdisk :: memory :: del(std::tr1::shared_ptr<e::buffer> backing,
+                           const e::slice& key,
+                           uint64_t version)
+{
+    coordinate coord = m_hasher.hash(key);
+    log_entry entry(coord, backing, key, version);
+    po6::threads::mutex::hold hold(&m_lock);
+    m_table.erase(slice_to_string(key));
+    __sync_add_and_fetch(&m_log_bytes, entry.bytes());
+    m_log.append(entry);
+    return SUCCESS;
+}
+
+e::intrusive_ptr<hyperdisk::snapshot>
+hyperdisk :: memory :: make_snapshot(const hyperspacehashing::search& terms)
+{
+    coordinate coord(m_hasher.hash(terms));
+    std::vector<std::tr1::shared_ptr<log_entry> > entries;
+
+    {
+        po6::threads::mutex::hold hold(&m_lock);
+        entries.reserve(m_table.size());
+
+        for (table_t::iterator it = m_table.begin(); it != m_table.end(); ++it)
+        {
+            entries.push_back(it->second);
+        }
+    }
+
+    e::intrusive_ptr<snapshot> ret = new memory_snapshot(coord, &entries);
+    return ret;
+}
+
+e::intrusive_ptr<hyperdisk::snapshot>
+hyperdisk :: memory :: make_ordered_snapshot(const hyperspacehashing::search& terms,
+                                             bool descending)
+{
+    coordinate coord(m_hasher.hash(terms));
+    std::vector<std::tr1::shared_ptr<log_entry> > entries;
+
+    {
+        po6::threads::mutex::hold hold(&m_lock);
+        entries.reserve(m_table.size());
+
+        for (table_t::iterator it = m_table.begin(); it != m_table.end(); ++it)
+        {
+            if (coord.intersects(it->second->coord))
+            {
+                entries.push_back(it->second);
+            }
+        }
+    }
+
+    // The table is in bytewise order, which is not key order.
+    std::sort(entries.begin(), entries.end(), compare_entries);
+
+    if (descending)
+    {
+        std::reverse(entries.begin(), entries.end());
+    }
+
+    e::intrusive_ptr<snapshot> ret = new memory_snapshot(coord, &entries);
+    return ret;
+}
+
+void
+hyperdisk :: memory :: make_partitioned_snapshot(const hyperspacehashing::search& terms,
+                                                 std::vector<e::intrusive_ptr<snapshot> >* parts)
+{
+    // Everything is already in RAM, so there is nothing to gain by splitting.
+    parts->push_back(make_snapshot(terms));
+}
+
+e::intrusive_ptr<hyperdisk::rolling_snapshot>
+hyperdisk :: memory :: make_rolling_snapshot()
+{
+    // Hold the lock so that the log iterator starts exactly where the snapshot
+    // leaves off.  Anything already in the log is also in the table, and
+    // replaying it is harmless.
+    hyperspacehashing::search terms(m_arity);
+    po6::threads::mutex::hold hold(&m_lock);
+    e::locking_iterable_fifo<log_entry>::iterator iter(m_log.iterate());
+    std::vector<std::tr1::shared_ptr<log_entry> > entries;
+    entries.reserve(m_table.size());
+
+    for (table_t::iterator it = m_table.begin(); it != m_table.end(); ++it)
+    {
+        entries.push_back(it->second);
+    }
+
+    e::intrusive_ptr<snapshot> snap = new memory_snapshot(m_hasher.hash(terms), &entries);
+    e::intrusive_ptr<rolling_snapshot> ret = new rolling_snapshot(iter, snap);
+    return ret;
+}
+
+hyperdisk::returncode
+hyperdisk :: memory :: drop()
+{
+    po6::threads::mutex::hold hold(&m_lock);
+    m_table.clear();
+    trim_log(-1);
+    return SUCCESS;
+}
+
+hyperdisk::returncode
+hyperdisk :: memory :: flush(ssize_t num, bool nonblocking)
+{
+    if (nonblocking)
+    {
+        if (!m_lock.trylock())
+        {
+            return SUCCESS;
+        }
+    }
+    else
+    {
+        m_lock.lock();
+    }
+
+    e::guard hold = e::makeobjguard(m_lock, &po6::threads::mutex::unlock);
+    hold.use_variable();
+    return trim_log(num) ? SUCCESS : DIDNOTHING;
+}
+
+bool
+hyperdisk :: memory :: trim_log(ssize_t num)
+{
+    e::locking_iterable_fifo<log_entry>::iterator it = m_log.iterate();
+    bool trimmed = false;
+    uint64_t trimmed_bytes = 0;
+
+    // num == -1 means trim all
+    for (ssize_t nt = 0; (nt < num || num < 0) && it.valid(); ++nt, it.next())
+    {
+        trimmed = true;
+        trimmed_bytes += it->bytes();
+    }
+
+    m_log.advance_to(it);
+    __sync_sub_and_fetch(&m_log_bytes, trimmed_bytes);
+    return trimmed;
+}
+
+hyperdisk::returncode
+hyperdisk :: memory :: do_mandatory_io()
+{
+    return DIDNOTHING;
+}
+
+hyperdisk::returncode
+hyperdisk :: memory :: do_optimistic_io()
+{
+    return DIDNOTHING;
+}
+
+hyperdisk::returncode
+hyperdisk :: memory :: preallocate()
+{
+    return DIDNOTHING;
+}
+
+hyperdisk::returncode
+hyperdisk :: memory :: async()
+{
+    return SUCCESS;
+}
+
+hyperdisk::returncode
+hyperdisk :: memory :: sync()
+{
+    return SUCCESS;
+}
+
+uint64_t
+hyperdisk :: memory :: wal_bytes()
+{
+    return m_log_bytes;
+}
+
+void
+hyperdisk :: memory :: retain_history(uint64_t)
+{
+}
+
+bool
+hyperdisk :: memory :: quiesce(const std::string&)
+{
+    return false;
+}
+
+hyperdisk :: memory :: memory(const hyperspacehashing::mask::hasher& hasher,
+                              uint16_t arity)
+    : engine()
+    , m_arity(arity)
+    , m_hasher(hasher)
+    , m_lock()
+    , m_table()
+    , m_log()
+    , m_log_bytes(0)
+{
+}
+
+hyperdisk :: memory :: ~memory() throw ()
+{
+}
@@ -33,12 +33,14 @@
 hyperdisk :: reference :: reference()
     : m_it()
     , m_shard()
+    , m_buf()
 {
 }
 
 hyperdisk :: reference :: reference(const reference& other)
     : m_it()
     , m_shard(other.m_shard)
+    , m_buf(other.m_buf)
 {
     if (other.m_it.get())
     {
@@ -62,6 +64,12 @@ hyperdisk :: reference :: set(const e::intrusive_ptr<shard>& shard)
     m_shard = shard;
 }
 
+void
+hyperdisk :: reference :: set(const std::tr1::shared_ptr<e::buffer>& buf)
+{
+    m_buf = buf;
+}
+
 hyperdisk::reference&
 hyperdisk :: reference :: operator = (const reference& rhs)
 {
@@ -80,5 +88,6 @@ hyperdisk :: reference :: operator = (const reference& rhs)
     }
 
     m_shard = rhs.m_shard;
+    m_buf = rhs.m_buf;
     return *this;
 }
@@ -56,6 +56,16 @@
 
 using hyperspacehashing::mask::coordinate;
 
+// Marks stale entries which partition decided to keep.  Search log indices
+// never reach this bit.
+#define ENTRY_RETAINED (1U << 31)
+
+static bool
+compare_entries(uint32_t lhs, uint32_t rhs)
+{
+    return (lhs & ~ENTRY_RETAINED) < (rhs & ~ENTRY_RETAINED);
+}
+
 e::intrusive_ptr<hyperdisk::shard>
 hyperdisk :: shard :: create(const po6::io::fd& base,
                              const po6::pathname& filename)
@@ -180,6 +190,53 @@ hyperdisk :: shard :: get(uint32_t primary_hash,
     return SUCCESS;
 }
 
+hyperdisk::returncode
+hyperdisk :: shard :: get_at(uint32_t primary_hash,
+                             const e::slice& key,
+                             uint64_t at,
+                             std::vector<e::slice>* value,
+                             uint64_t* version)
+{
+    for (size_t ent = 0; ent < m_search_offset; ++ent)
+    {
+        if (static_cast<uint32_t>(m_search_log[ent].primary) != primary_hash)
+        {
+            continue;
+        }
+
+        uint32_t offset = m_search_log[ent].offset;
+
+        if (data_key_size(offset) != key.size() ||
+            memcmp(m_data + data_key_offset(offset), key.data(), key.size()) != 0)
+        {
+            continue;
+        }
+
+        uint64_t this_version = data_version(offset);
+
+        if (this_version > at)
+        {
+            continue;
+        }
+
+        if (m_search_log[ent].invalid != 0)
+        {
+            uint64_t superseded = superseded_at(ent);
+
+            if (superseded == 0 || superseded <= at)
+            {
+                continue;
+            }
+        }
+
+        *version = this_version;
+        data_value(offset, key.size(), value);
+        return SUCCESS;
+    }
+
+    return NOTFOUND;
+}
+
 hyperdisk::returncode
 hyperdisk :: shard :: put(const hyperspacehashing::mask::coordinate& coord,
                           const e::slice& key,
@@ -187,7 +244,18 @@ hyperdisk :: shard :: put(const hyperspacehashing::mask::coordinate& coord,
                           uint64_t version,
                           uint32_t* cached)
 {
-    if (data_size(key, value) + m_data_offset > FILE_SIZE)
+    return put(coord, key, value.empty() ? NULL : &value.front(), value.size(),
+               version, cached);
+}
+
+hyperdisk::returncode
+hyperdisk :: shard :: put(const hyperspacehashing::mask::coordinate& coord,
+                          const e::slice& key,
+                          const e::slice* value, size_t value_sz,
+                          uint64_t version,
+                          uint32_t* cached)
+{
+    if (data_size(key, value, value_sz) + m_data_offset > FILE_SIZE)
     {
         return DATAFULL;
     }
@@ -205,7 +273,7 @@ hyperdisk :: shard :: put(const hyperspacehashing::mask::coordinate& coord,
 
     // Values to pack.
     uint32_t key_size = key.size();
-    uint16_t value_arity = value.size();
+    uint16_t value_arity = value_sz;
 
     // Pack the values on disk.
     uint32_t curr_offset = m_data_offset;
@@ -218,7 +286,7 @@ hyperdisk :: shard :: put(const hyperspacehashing::mask::coordinate& coord,
     memmove(m_data + curr_offset, &value_arity, sizeof(value_arity));
     curr_offset += sizeof(value_arity);
 
-    for (size_t i = 0; i < value.size(); ++i)
+    for (size_t i = 0; i < value_sz; ++i)
     {
         uint32_t size = value[i].size();
         memmove(m_data + curr_offset, &size, sizeof(size));
@@ -267,6 +335,15 @@ hyperdisk::returncode
 hyperdisk :: shard :: del(uint32_t primary_hash,
                           const e::slice& key,
                           uint32_t* cached)
+{
+    return del(primary_hash, key, 0, cached);
+}
+
+hyperdisk::returncode
+hyperdisk :: shard :: del(uint32_t primary_hash,
+                          const e::slice& key,
+                          uint64_t version,
+                          uint32_t* cached)
 {
     size_t table_entry;
     uint64_t table_value;
@@ -279,6 +356,14 @@ hyperdisk :: shard :: del(uint32_t primary_hash,
     }
 
     invalidate_search_log(table_offset, m_data_offset);
+
+    // The invalidated entry points here, so record the version which deleted
+    // it, just as a PUT leaves its version at the start of its record.
+    if (m_data_offset + sizeof(uint64_t) <= FILE_SIZE)
+    {
+        memmove(m_data + m_data_offset, &version, sizeof(version));
+    }
+
     m_data_offset += sizeof(uint64_t);
     m_hash_table[table_entry] = (static_cast<uint64_t>(table_offset) << 32)
                               | (static_cast<uint64_t>(HASH_OFFSET_INVALID) << 32)
@@ -367,68 +452,25 @@ hyperdisk :: shard :: sync()
 }
 
 void
-hyperdisk :: shard :: copy_to(const coordinate& c, e::intrusive_ptr<shard> s)
+hyperdisk :: shard :: copy_to(const coordinate& c, e::intrusive_ptr<shard> s,
+                              uint64_t history)
 {
-    assert(m_data != s->m_data); // LCOV_EXCL_LINE
-    memset(s->m_hash_table, 0, HASH_TABLE_SIZE);
-    memset(s->m_search_log, 0, SEARCH_INDEX_SIZE);
-    s->m_data_offset = INDEX_SEGMENT_SIZE;
-    s->m_search_offset = 0;
-
-    for (size_t ent = 0; ent < SEARCH_INDEX_ENTRIES; ++ent)
-    {
-        // Skip stale entries.
-        if (m_search_log[ent].invalid != 0)
-        {
-            continue;
-        }
-
-        if (!c.intersects(coordinate(UINT64_MAX, m_search_log[ent].primary,
-                                     UINT64_MAX, m_search_log[ent].lower,
-                                     UINT64_MAX, m_search_log[ent].upper)))
-        {
-            continue;
-        }
-
-        // Figure out how big the entry is.
-        uint32_t entry_start = m_search_log[ent].offset;
-
-        if (entry_start == 0)
-        {
-            break;
-        }
-
-        uint32_t entry_end = 0;
-
-        if (ent < SEARCH_INDEX_ENTRIES - 1 && m_search_log[ent + 1].offset)
-        {
-            entry_end = m_search_log[ent + 1].offset;
-        }
-        else
-        {
-            entry_end = std::min(m_data_offset, static_cast<uint32_t>(FILE_SIZE));
-        }
+    std::vector<uint32_t> entries;
+    partition(&c, 1, history, &entries);
+    copy_entries_to(&entries, s.get());
+}
 
-        assert(entry_start <= entry_end); // LCOV_EXCL_LINE
-        assert(entry_end <= FILE_SIZE); // LCOV_EXCL_LINE
-        assert(s->m_data_offset + (entry_end - entry_start) <= FILE_SIZE); // LCOV_EXCL_LINE
+void
+hyperdisk :: shard :: split_to(const coordinate* cs,
+                               const e::intrusive_ptr<shard>* ss,
+                               size_t n, uint64_t history)
+{
+    std::vector<std::vector<uint32_t> > entries(n);
+    partition(cs, n, history, &entries.front());
 
-        // Copy the entry's data
-        memmove(s->m_data + s->m_data_offset, m_data + entry_start, (entry_end - entry_start));
-        // Insert into the search log.
-        s->m_search_log[s->m_search_offset].offset = s->m_data_offset;
-        s->m_search_log[s->m_search_offset].invalid = 0;
-        s->m_search_log[s->m_search_offset].primary = m_search_log[ent].primary;
-        s->m_search_log[s->m_search_offset].lower = m_search_log[ent].lower;
-        s->m_search_log[s->m_search_offset].upper = m_search_log[ent].upper;
-        // Insert into the hash table.
-        size_t bucket;
-        s->hash_lookup(static_cast<uint32_t>(m_search_log[ent].primary), &bucket);
-        s->m_hash_table[bucket] = (static_cast<uint64_t>(s->m_data_offset) << 32)
-                                | (static_cast<uint64_t>(m_search_log[ent].primary) & 0xffffffffULL);
-        // Update the position trackers.
-        ++s->m_search_offset;
-        s->m_data_offset = (s->m_data_offset + (entry_end - entry_start) + 7) & ~7; // Keep everything 8-byte aligned.
+    for (size_t i = 0; i < n; ++i)
+    {
+        copy_entries_to(&entries[i], ss[i].get());
     }
 }
 
@@ -489,7 +531,9 @@ hyperdisk :: shard :: fsck(std::ostream& err)
 
             if (table_hash == static_cast<uint32_t>(m_search_log[ent].primary))
             {
-                if (table_offset < HASH_OFFSET_INVALID && m_search_log[ent].offset != table_offset)
+                // Stale entries may share a key with the live one.
+                if (table_offset < HASH_OFFSET_INVALID && m_search_log[ent].offset != table_offset &&
+                    m_search_log[ent].invalid == 0)
                 {
                     err << "entry " << ent << " in log and entry " << table_entry
                         << " in hash table do not match.\n"
@@ -584,12 +628,19 @@ hyperdisk :: shard :: ~shard()
 size_t
 hyperdisk :: shard :: data_size(const e::slice& key,
                                 const std::vector<e::slice>& value) const
+{
+    return data_size(key, value.empty() ? NULL : &value.front(), value.size());
+}
+
+size_t
+hyperdisk :: shard :: data_size(const e::slice& key,
+                                const e::slice* value, size_t value_sz) const
 {
     size_t hypothetical_size = sizeof(uint64_t) + sizeof(uint32_t)
                              + sizeof(uint16_t) + key.size()
-                             + sizeof(uint32_t) * value.size();
+                             + sizeof(uint32_t) * value_sz;
 
-    for (size_t i = 0; i < value.size(); ++i)
+    for (size_t i = 0; i < value_sz; ++i)
     {
         hypothetical_size += value[i].size();
     }
@@ -728,3 +779,200 @@ hyperdisk :: shard :: invalidate_search_log(uint32_t to_invalidate, uint32_t inv
         }
     }
 }
+
+void
+hyperdisk :: shard :: partition(const coordinate* cs, size_t n, uint64_t history,
+                                std::vector<uint32_t>* entries)
+{
+    std::vector<size_t> bytes(n, 0);
+    std::vector<std::vector<uint32_t> > stale(n);
+
+    for (size_t ent = 0; ent < SEARCH_INDEX_ENTRIES; ++ent)
+    {
+        if (m_search_log[ent].offset == 0)
+        {
+            break;
+        }
+
+        coordinate entc(UINT64_MAX, m_search_log[ent].primary,
+                        UINT64_MAX, m_search_log[ent].lower,
+                        UINT64_MAX, m_search_log[ent].upper);
+        size_t i = 0;
+
+        while (i < n && !cs[i].intersects(entc))
+        {
+            ++i;
+        }
+
+        if (i == n)
+        {
+            continue;
+        }
+
+        if (m_search_log[ent].invalid == 0)
+        {
+            entries[i].push_back(ent);
+            bytes[i] += entry_size(ent);
+        }
+        else if (history > 0)
+        {
+            stale[i].push_back(ent);
+        }
+    }
+
+    if (history == 0)
+    {
+        return;
+    }
+
+    // Keep the newest history first.  Retained history is stale space, so
+    // keep it well under the point at which the disk cleans a shard (30%),
+    // and keep the target under half full so that it has room to grow.
+    for (size_t i = 0; i < n; ++i)
+    {
+        size_t kept = 0;
+        size_t kept_bytes = 0;
+
+        for (ssize_t j = stale[i].size() - 1; j >= 0; --j)
+        {
+            uint32_t ent = stale[i][j];
+            uint32_t offset = m_search_log[ent].offset;
+            uint64_t superseded = superseded_at(ent);
+            size_t need = entry_size(ent) + 2 * sizeof(uint64_t);
+
+            if (superseded == 0 ||
+                kept_bytes + need > DATA_SEGMENT_SIZE / 5 ||
+                kept >= SEARCH_INDEX_ENTRIES / 5 ||
+                bytes[i] + need > DATA_SEGMENT_SIZE / 2 ||
+                entries[i].size() >= SEARCH_INDEX_ENTRIES / 2)
+            {
+                continue;
+            }
+
+            // Compare against the object's current version in this shard.
+            // History of objects deleted from or moved out of this shard is
+            // not kept.
+            size_t key_size = data_key_size(offset);
+            e::slice key;
+            data_key(offset, key_size, &key);
+            size_t table_entry;
+            uint64_t table_value;
+            hash_lookup(static_cast<uint32_t>(m_search_log[ent].primary), key,
+                        &table_entry, &table_value);
+            uint32_t table_offset = static_cast<uint32_t>(table_value >> 32);
+
+            if (table_offset == 0 || table_offset >= HASH_OFFSET_INVALID ||
+                superseded + history <= data_version(table_offset))
+            {
+                continue;
+            }
+
+            entries[i].push_back(ent | ENTRY_RETAINED);
+            bytes[i] += need;
+            kept_bytes += need;
+            ++kept;
+        }
+
+        std::sort(entries[i].begin(), entries[i].end(), compare_entries);
+    }
+}
+
+uint32_t
+hyperdisk :: shard :: entry_size(size_t ent) const
+{
+    uint32_t entry_start = m_search_log[ent].offset;
+    uint32_t entry_end = 0;
+
+    if (ent < SEARCH_INDEX_ENTRIES - 1 && m_search_log[ent + 1].offset)
+    {
+        entry_end = m_search_log[ent + 1].offset;
+    }
+    else
+    {
+        entry_end = std::min(m_data_offset, static_cast<uint32_t>(FILE_SIZE));
+    }
+
+    assert(entry_start <= entry_end); // LCOV_EXCL_LINE
+    return entry_end - entry_start;
+}
+
+uint64_t
+hyperdisk :: shard :: superseded_at(size_t ent) const
+{
+    uint32_t invalid = m_search_log[ent].invalid;
+
+    if (invalid == 0 || invalid + sizeof(uint64_t) > FILE_SIZE)
+    {
+        return 0;
+    }
+
+    return data_version(invalid);
+}
+
+void
+hyperdisk :: shard :: copy_entries_to(const std::vector<uint32_t>* entries, shard* s) const
+{
+    assert(m_data != s->m_data); // LCOV_EXCL_LINE
+    memset(s->m_hash_table, 0, HASH_TABLE_SIZE);
+    memset(s->m_search_log, 0, SEARCH_INDEX_SIZE);
+    s->m_data_offset = INDEX_SEGMENT_SIZE;
+    s->m_search_offset = 0;
+
+    for (size_t i = 0; i < entries->size(); ++i)
+    {
+        bool retained = (*entries)[i] & ENTRY_RETAINED;
+        size_t ent = (*entries)[i] & ~ENTRY_RETAINED;
+
+        // Figure out how big the entry is.
+        uint32_t entry_start = m_search_log[ent].offset;
+        uint32_t entry_end = entry_start + entry_size(ent);
+
+        assert(entry_end <= FILE_SIZE); // LCOV_EXCL_LINE
+        assert(s->m_data_offset + (entry_end - entry_start) <= FILE_SIZE); // LCOV_EXCL_LINE
+
+        // Copy the entry's data
+        memmove(s->m_data + s->m_data_offset, m_data + entry_start, (entry_end - entry_start));
+        uint32_t invalid = 0;
+
+        // A retained stale entry must still point at the version which
+        // superseded it.  Either that version was copied along with the entry,
+        // or it is appended after it.
+        if (retained)
+        {
+            uint32_t old_invalid = m_search_log[ent].invalid;
+
+            if (old_invalid >= entry_start && old_invalid + sizeof(uint64_t) <= entry_end)
+            {
+                invalid = s->m_data_offset + (old_invalid - entry_start);
+            }
+            else
+            {
+                uint64_t superseded = superseded_at(ent);
+                invalid = (s->m_data_offset + (entry_end - entry_start) + 7) & ~7;
+                assert(invalid + sizeof(uint64_t) <= FILE_SIZE); // LCOV_EXCL_LINE
+                memmove(s->m_data + invalid, &superseded, sizeof(superseded));
+                entry_end = entry_start + (invalid + sizeof(uint64_t) - s->m_data_offset);
+            }
+        }
+
+        // Insert into the search log.
+        s->m_search_log[s->m_search_offset].offset = s->m_data_offset;
+        s->m_search_log[s->m_search_offset].invalid = invalid;
+        s->m_search_log[s->m_search_offset].primary = m_search_log[ent].primary;
+        s->m_search_log[s->m_search_offset].lower = m_search_log[ent].lower;
+        s->m_search_log[s->m_search_offset].upper = m_search_log[ent].upper;
+
+        // Insert into the hash table.  Only the current version is indexed.
+        if (!retained)
+        {
+            size_t bucket;
+            s->hash_lookup(static_cast<uint32_t>(m_search_log[ent].primary), &bucket);
+            s->m_hash_table[bucket] = (static_cast<uint64_t>(s->m_data_offset) << 32)
+                                    | (static_cast<uint64_t>(m_search_log[ent].primary) & 0xffffffffULL);
+        }
+
+        // Update the position trackers.
+        ++s->m_search_offset;
+        s->m_data_offset = (s->m_data_offset + (entry_end - entry_start) + 7) & ~7; // Keep everything 8-byte aligned.
+    }
+}
@@ -28,6 +28,9 @@
 #ifndef hyperdisk_shard_h_
 #define hyperdisk_shard_h_
 
+// STL
+#include <vector>
+
 // po6
 #include <po6/pathname.h>
 
@@ -104,15 +107,31 @@ class shard
         returncode get(uint32_t primary_hash, const e::slice& key,
                        std::vector<e::slice>* value, uint64_t* version);
         returncode get(uint32_t primary_hash, const e::slice& key);
+        // Find the version of the object that was current at version "at".
+        // This is the newest record with a version no greater than "at" which
+        // had not yet been superseded as of "at".  Superseded records are
+        // only found until the shard is cleaned or split (subject to the
+        // history passed to copy_to/split_to).  This scans the search log.
+        // May return SUCCESS or NOTFOUND.
+        returncode get_at(uint32_t primary_hash, const e::slice& key, uint64_t at,
+                          std::vector<e::slice>* value, uint64_t* version);
         // May return SUCCESS, DATAFULL, HASHFULL, or SEARCHFULL.
         returncode put(const hyperspacehashing::mask::coordinate& coord,
                        const e::slice& key,
                        const std::vector<e::slice>& value,
                        uint64_t version, uint32_t* cached = NULL);
+        returncode put(const hyperspacehashing::mask::coordinate& coord,
+                       const e::slice& key,
+                       const e::slice* value, size_t value_sz,
+                       uint64_t version, uint32_t* cached = NULL);
         // May return SUCCESS or NOTFOUND.  This used to return DATAFULL, but we
         // allow the data offset to extend beyond the end of the shard for
         // deletion entries.
         returncode del(uint32_t primary_hash, const e::slice& key, uint32_t* cached = NULL);
+        // As above, but also record the version of the deletion so that
+        // get_at knows until when the deleted record was current.
+        returncode del(uint32_t primary_hash, const e::slice& key,
+                       uint64_t version, uint32_t* cached);
         // The space calc functions are only accurate when mutually exclusive
         // with GET operations.
         // How much stale space (as a percentage) may be reclaimed from this log
@@ -129,8 +148,30 @@ class shard
         returncode sync();
         // Copy all non-stale data from this shard to the other shard,
         // completely erasing all the data in the other shard.  Only
-        // entries which match the coordinate will be kept.
-        void copy_to(const hyperspacehashing::mask::coordinate& c, e::intrusive_ptr<shard> s);
+        // entries which match the coordinate will be kept.  Stale records
+        // superseded fewer than "history" versions before their object's
+        // current version are kept too (as stale records), within a budget
+        // that keeps the other shard from looking like it needs cleaning.
+        void copy_to(const hyperspacehashing::mask::coordinate& c, e::intrusive_ptr<shard> s,
+                     uint64_t history = 0);
+        // Copy all non-stale data from this shard into the "n" shards "ss",
+        // completely erasing all the data in them.  Each entry goes to the
+        // first of the coordinates "cs" which it matches, or nowhere if it
+        // matches none.  This shard is scanned once, after which the targets
+        // are filled one after another.  Stale records are kept as for
+        // copy_to.
+        void split_to(const hyperspacehashing::mask::coordinate* cs,
+                      const e::intrusive_ptr<shard>* ss,
+                      size_t n, uint64_t history = 0);
+        // The two steps of split_to, for callers which fill the targets in
+        // parallel.  Sort the indices of the live entries in the search log
+        // by the first of the "n" coordinates "cs" they match.  Stale entries
+        // kept because of "history" are flagged with ENTRY_RETAINED.
+        void partition(const hyperspacehashing::mask::coordinate* cs, size_t n,
+                       uint64_t history, std::vector<uint32_t>* entries);
+        // Copy the search log entries listed in "entries" to "s", erasing any
+        // data "s" held.  Copies to distinct shards may run at once.
+        void copy_entries_to(const std::vector<uint32_t>* entries, shard* s) const;
         // Perform a logical integrity check of the shard.
         bool fsck();
         bool fsck(std::ostream& err);
@@ -160,6 +201,7 @@ class shard
 
     private:
         size_t data_size(const e::slice& key, const std::vector<e::slice>& value) const;
+        size_t data_size(const e::slice& key, const e::slice* value, size_t value_sz) const;
         uint64_t data_version(uint32_t offset) const;
         size_t data_key_size(uint32_t offset) const;
         size_t data_key_offset(uint32_t offset) const
@@ -184,6 +226,11 @@ class shard
         // This will invalidate any entry in the search log which references
         // the specified offset.
         void invalidate_search_log(uint32_t to_invalidate, uint32_t invalidate_with);
+        // The size of the data for the search log entry "ent".
+        uint32_t entry_size(size_t ent) const;
+        // The version which superseded the stale search log entry "ent", or 0
+        // if it is not known.
+        uint64_t superseded_at(size_t ent) const;
 
     private:
         shard& operator = (const shard&);
@@ -123,6 +123,16 @@ hyperdisk :: shard_snapshot :: next()
     m_parsed = false;
 }
 
+void
+hyperdisk :: shard_snapshot :: seek(uint32_t position)
+{
+    m_entry = position;
+    m_valid = true;
+    m_parsed = false;
+    bool visible = valid();
+    assert(visible);
+}
+
 uint64_t
 hyperdisk :: shard_snapshot :: version()
 {
@@ -56,6 +56,10 @@ class shard_snapshot
         bool valid();
         bool valid(const hyperspacehashing::mask::coordinate& coord);
         void next();
+        // The position of the current entry, and a way to return to it.  Only
+        // positions previously returned by "position" may be passed to "seek".
+        uint32_t position() const { return m_entry; }
+        void seek(uint32_t position);
 
     public:
         hyperspacehashing::mask::coordinate coordinate() { return m_coord; }
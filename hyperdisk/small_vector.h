@@ -0,0 +1,162 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef hyperdisk_small_vector_h_
+#define hyperdisk_small_vector_h_
+
+// C
+#include <stddef.h>
+
+// STL
+#include <algorithm>
+#include <vector>
+
+namespace hyperdisk
+{
+
+// A read-mostly vector which keeps up to N elements inside the object itself,
+// and only goes to the heap for more.  It exists so that a log_entry can carry
+// the value of a typical object without a separate allocation, and be copied
+// into the write-ahead log without another.  T must be cheap to copy and
+// default-construct.
+
+template <typename T, size_t N>
+class small_vector
+{
+    public:
+        small_vector();
+        explicit small_vector(const std::vector<T>& v);
+        small_vector(const small_vector& other);
+        ~small_vector() throw ();
+
+    public:
+        size_t size() const { return m_size; }
+        bool empty() const { return m_size == 0; }
+        // Elements stored on the heap; 0 if they fit inline.
+        size_t heap_capacity() const { return m_data == m_inline ? 0 : m_capacity; }
+        const T* begin() const { return m_data; }
+        const T* end() const { return m_data + m_size; }
+        const T& operator [] (size_t i) const { return m_data[i]; }
+
+    public:
+        void assign(const T* first, const T* last);
+        small_vector& operator = (const small_vector& rhs);
+
+    private:
+        void release();
+
+    private:
+        size_t m_size;
+        size_t m_capacity;
+        T* m_data;
+        T m_inline[N];
+};
+
+template <typename T, size_t N>
+small_vector<T, N> :: small_vector()
+    : m_size(0)
+    , m_capacity(N)
+    , m_data(m_inline)
+    , m_inline()
+{
+}
+
+template <typename T, size_t N>
+small_vector<T, N> :: small_vector(const std::vector<T>& v)
+    : m_size(0)
+    , m_capacity(N)
+    , m_data(m_inline)
+    , m_inline()
+{
+    if (!v.empty())
+    {
+        assign(&v.front(), &v.front() + v.size());
+    }
+}
+
+template <typename T, size_t N>
+small_vector<T, N> :: small_vector(const small_vector& other)
+    : m_size(0)
+    , m_capacity(N)
+    , m_data(m_inline)
+    , m_inline()
+{
+    assign(other.begin(), other.end());
+}
+
+template <typename T, size_t N>
+small_vector<T, N> :: ~small_vector() throw ()
+{
+    release();
+}
+
+template <typename T, size_t N>
+void
+small_vector<T, N> :: assign(const T* first, const T* last)
+{
+    size_t sz = last - first;
+
+    if (sz > m_capacity)
+    {
+        T* data = new T[sz];
+        release();
+        m_data = data;
+        m_capacity = sz;
+    }
+
+    std::copy(first, last, m_data);
+    m_size = sz;
+}
+
+template <typename T, size_t N>
+small_vector<T, N>&
+small_vector<T, N> :: operator = (const small_vector& rhs)
+{
+    if (this != &rhs)
+    {
+        assign(rhs.begin(), rhs.end());
+    }
+
+    return *this;
+}
+
+template <typename T, size_t N>
+void
+small_vector<T, N> :: release()
+{
+    if (m_data != m_inline)
+    {
+        delete[] m_data;
+        m_data = m_inline;
+        m_capacity = N;
+    }
+}
+
+} // namespace hyperdisk
+
+#endif // hyperdisk_small_vector_h_
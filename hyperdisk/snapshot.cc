@@ -30,84 +30,22 @@
 // HyperDisk
 #include "hyperdisk/hyperdisk/snapshot.h"
 #include "hyperdisk/log_entry.h"
-#include "hyperdisk/shard_snapshot.h"
-#include "hyperdisk/shard_vector.h"
 
-hyperdisk :: snapshot :: snapshot(const hyperspacehashing::mask::coordinate& coord,
-                                  e::intrusive_ptr<shard_vector> shards,
-                                  std::vector<hyperdisk::shard_snapshot>* ss)
+hyperdisk :: snapshot :: snapshot()
     : m_ref(0)
-    , m_coord(coord)
-    , m_shards(shards)
-    , m_snaps()
 {
-    m_snaps.swap(*ss);
 }
 
 hyperdisk :: snapshot :: ~snapshot() throw ()
 {
 }
 
-bool
-hyperdisk :: snapshot :: valid()
-{
-    while (!m_snaps.empty())
-    {
-        if (m_snaps.back().valid(m_coord))
-        {
-            return true;
-        }
-        else
-        {
-            m_snaps.pop_back();
-        }
-    }
-
-    return false;
-}
-
-void
-hyperdisk :: snapshot :: next()
-{
-    if (!m_snaps.empty())
-    {
-        m_snaps.back().next();
-    }
-}
-
-hyperspacehashing::mask::coordinate
-hyperdisk :: snapshot :: coordinate()
-{
-    assert(!m_snaps.empty());
-    return m_snaps.back().coordinate();
-}
-
-uint64_t
-hyperdisk :: snapshot :: version()
-{
-    assert(!m_snaps.empty());
-    return m_snaps.back().version();
-}
-
-const e::slice&
-hyperdisk :: snapshot :: key()
-{
-    assert(!m_snaps.empty());
-    return m_snaps.back().key();
-}
-
-const std::vector<e::slice>&
-hyperdisk :: snapshot :: value()
-{
-    assert (!m_snaps.empty());
-    return m_snaps.back().value();
-}
-
 hyperdisk :: rolling_snapshot :: rolling_snapshot(const e::locking_iterable_fifo<log_entry>::iterator& iter,
                                                   const e::intrusive_ptr<snapshot>& snap)
     : m_ref(0)
     , m_iter(iter)
     , m_snap(snap)
+    , m_value()
 {
     valid();
 }
@@ -195,7 +133,8 @@ hyperdisk :: rolling_snapshot :: value()
     }
     else if (m_iter.valid())
     {
-        return m_iter->value;
+        m_value.assign(m_iter->value.begin(), m_iter->value.end());
+        return m_value;
     }
     else
     {
@@ -0,0 +1,206 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#define __STDC_LIMIT_MACROS
+
+// STL
+#include <algorithm>
+
+// HyperspaceHashing
+#include "hyperspacehashing/hyperspacehashing/mask.h"
+
+// HyperDisk
+#include "hyperdisk/key_order.h"
+#include "hyperdisk/shard_snapshot.h"
+#include "hyperdisk/shard_vector.h"
+#include "hyperdisk/sorted_snapshot.h"
+
+class hyperdisk::sorted_snapshot::run_entry
+{
+    public:
+        run_entry() : order(0), key(), position(0) {}
+        run_entry(uint64_t o, const e::slice& k, uint32_t p)
+            : order(o), key(k), position(p) {}
+
+    public:
+        uint64_t order;
+        e::slice key;
+        uint32_t position;
+};
+
+// Orders the entries within a run.
+class hyperdisk::sorted_snapshot::run_compare
+{
+    public:
+        run_compare(bool descending) : m_descending(descending) {}
+
+    public:
+        bool operator () (const run_entry& lhs, const run_entry& rhs) const
+        {
+            int cmp = key_compare(lhs.order, lhs.key, rhs.order, rhs.key);
+            return m_descending ? cmp > 0 : cmp < 0;
+        }
+
+    private:
+        bool m_descending;
+};
+
+// Orders the runs by their heads.  The std heap functions put the greatest
+// element first, so this is the reverse of run_compare.
+class hyperdisk::sorted_snapshot::head_compare
+{
+    public:
+        head_compare(const sorted_snapshot* ss) : m_ss(ss) {}
+
+    public:
+        bool operator () (size_t lhs, size_t rhs) const
+        {
+            const run_entry& l(m_ss->m_runs[lhs][m_ss->m_heads[lhs]]);
+            const run_entry& r(m_ss->m_runs[rhs][m_ss->m_heads[rhs]]);
+            return run_compare(m_ss->m_descending)(r, l);
+        }
+
+    private:
+        const sorted_snapshot* m_ss;
+};
+
+hyperdisk :: sorted_snapshot :: sorted_snapshot(const hyperspacehashing::mask::coordinate& coord,
+                                                e::intrusive_ptr<shard_vector> shards,
+                                                std::vector<hyperdisk::shard_snapshot>* ss,
+                                                bool descending)
+    : snapshot()
+    , m_coord(coord)
+    , m_shards(shards)
+    , m_snaps()
+    , m_runs()
+    , m_heads()
+    , m_heap()
+    , m_descending(descending)
+{
+    m_snaps.swap(*ss);
+    m_runs.resize(m_snaps.size());
+    m_heads.resize(m_snaps.size(), 0);
+    m_heap.reserve(m_snaps.size());
+
+    for (size_t i = 0; i < m_snaps.size(); ++i)
+    {
+        // Each shard is sorted on its own, as each is its own run.  The keys
+        // point into the shard, which m_shards keeps mapped.
+        for (; m_snaps[i].valid(m_coord); m_snaps[i].next())
+        {
+            const e::slice& k(m_snaps[i].key());
+            m_runs[i].push_back(run_entry(key_order(k), k, m_snaps[i].position()));
+        }
+
+        std::sort(m_runs[i].begin(), m_runs[i].end(), run_compare(m_descending));
+
+        if (!m_runs[i].empty())
+        {
+            m_heap.push_back(i);
+        }
+    }
+
+    std::make_heap(m_heap.begin(), m_heap.end(), head_compare(this));
+
+    if (!m_heap.empty())
+    {
+        seek_head(m_heap.front());
+    }
+}
+
+hyperdisk :: sorted_snapshot :: ~sorted_snapshot() throw ()
+{
+}
+
+bool
+hyperdisk :: sorted_snapshot :: valid()
+{
+    return !m_heap.empty();
+}
+
+void
+hyperdisk :: sorted_snapshot :: next()
+{
+    if (m_heap.empty())
+    {
+        return;
+    }
+
+    std::pop_heap(m_heap.begin(), m_heap.end(), head_compare(this));
+    size_t run = m_heap.back();
+    ++m_heads[run];
+
+    if (m_heads[run] < m_runs[run].size())
+    {
+        std::push_heap(m_heap.begin(), m_heap.end(), head_compare(this));
+    }
+    else
+    {
+        m_heap.pop_back();
+        std::vector<run_entry>().swap(m_runs[run]);
+    }
+
+    if (!m_heap.empty())
+    {
+        seek_head(m_heap.front());
+    }
+}
+
+hyperspacehashing::mask::coordinate
+hyperdisk :: sorted_snapshot :: coordinate()
+{
+    assert(!m_heap.empty());
+    return m_snaps[m_heap.front()].coordinate();
+}
+
+uint64_t
+hyperdisk :: sorted_snapshot :: version()
+{
+    assert(!m_heap.empty());
+    return m_snaps[m_heap.front()].version();
+}
+
+const e::slice&
+hyperdisk :: sorted_snapshot :: key()
+{
+    assert(!m_heap.empty());
+    return m_snaps[m_heap.front()].key();
+}
+
+const std::vector<e::slice>&
+hyperdisk :: sorted_snapshot :: value()
+{
+    assert(!m_heap.empty());
+    return m_snaps[m_heap.front()].value();
+}
+
+void
+hyperdisk :: sorted_snapshot :: seek_head(size_t run)
+{
+    m_snaps[run].seek(m_runs[run][m_heads[run]].position);
+}
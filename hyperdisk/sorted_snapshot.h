@@ -0,0 +1,107 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef hyperdisk_sorted_snapshot_h_
+#define hyperdisk_sorted_snapshot_h_
+
+// STL
+#include <vector>
+
+// e
+#include <e/intrusive_ptr.h>
+
+// HyperDisk
+#include "hyperdisk/hyperdisk/snapshot.h"
+#include "hyperdisk/shard_snapshot.h"
+
+// Forward Declarations
+namespace hyperdisk
+{
+class shard_vector;
+}
+
+namespace hyperdisk
+{
+
+// An ordered snapshot for ``disk``.  The objects of each shard which intersects
+// the search coordinate are sorted into a run (see key_order.h), and the runs
+// are merged, so that objects are returned in key order (or in reverse key
+// order if "descending").  Keys compare as unsigned integers, so negative
+// int64 keys come after the non-negative ones.  Only keys and positions are
+// held while merging; values are parsed as each object is returned.  The sort
+// is paid once per scan; a scan paged by its limit keeps its snapshot between
+// pages (see hyperdaemon/searches.h).
+class sorted_snapshot : public snapshot
+{
+    public:
+        sorted_snapshot(const hyperspacehashing::mask::coordinate& coord,
+                        e::intrusive_ptr<shard_vector> shards,
+                        std::vector<hyperdisk::shard_snapshot>* snaps,
+                        bool descending);
+        ~sorted_snapshot() throw ();
+
+    public:
+        virtual bool valid();
+        virtual void next();
+
+    public:
+        virtual hyperspacehashing::mask::coordinate coordinate();
+        virtual uint64_t version();
+        virtual const e::slice& key();
+        virtual const std::vector<e::slice>& value();
+
+    private:
+        class run_entry;
+        class run_compare;
+        class head_compare;
+
+    private:
+        sorted_snapshot(const sorted_snapshot&);
+
+    private:
+        // Position m_snaps[run] at the head of the run.
+        void seek_head(size_t run);
+
+    private:
+        sorted_snapshot& operator = (const sorted_snapshot&);
+
+    private:
+        hyperspacehashing::mask::coordinate m_coord;
+        e::intrusive_ptr<shard_vector> m_shards;
+        std::vector<hyperdisk::shard_snapshot> m_snaps;
+        std::vector<std::vector<run_entry> > m_runs;
+        std::vector<size_t> m_heads;
+        // Runs which are not yet exhausted, kept as a heap with the run whose
+        // head comes next at the front.
+        std::vector<size_t> m_heap;
+        bool m_descending;
+};
+
+} // namespace hyperdisk
+
+#endif // hyperdisk_sorted_snapshot_h_
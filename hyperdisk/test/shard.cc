@@ -177,6 +177,66 @@ TEST(ShardTest, DelPutDelPut)
     ASSERT_TRUE(d->fsck());
 }
 
+TEST(ShardTest, GetAtVersion)
+{
+    po6::io::fd cwd(AT_FDCWD);
+    e::intrusive_ptr<hyperdisk::shard> d = hyperdisk::shard::create(cwd, "tmp-disk");
+    e::guard g = e::makeguard(::unlink, "tmp-disk");
+    e::slice key("key", 3);
+    uint32_t primary_hash = 0x6e9accf9UL;
+    std::vector<e::slice> value;
+    uint64_t version;
+
+    // Put, overwrite, delete and put again.
+    value.push_back(e::slice("one", 3));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(primary_hash, 0x2462bca6UL), key, value, 1));
+    value[0] = e::slice("two", 3);
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(primary_hash, 0x2462bca6UL), key, value, 2));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->del(primary_hash, key, 3, NULL));
+    value[0] = e::slice("four", 4);
+    ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(primary_hash, 0x2462bca6UL), key, value, 4));
+
+    // Every version is still in the shard.
+    ASSERT_EQ(hyperdisk::NOTFOUND, d->get_at(primary_hash, key, 0, &value, &version));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->get_at(primary_hash, key, 1, &value, &version));
+    ASSERT_EQ(1, version);
+    ASSERT_TRUE(e::slice("one", 3) == value[0]);
+    ASSERT_EQ(hyperdisk::SUCCESS, d->get_at(primary_hash, key, 2, &value, &version));
+    ASSERT_EQ(2, version);
+    ASSERT_TRUE(e::slice("two", 3) == value[0]);
+    ASSERT_EQ(hyperdisk::NOTFOUND, d->get_at(primary_hash, key, 3, &value, &version));
+    ASSERT_EQ(hyperdisk::SUCCESS, d->get_at(primary_hash, key, UINT64_MAX, &value, &version));
+    ASSERT_EQ(4, version);
+    ASSERT_TRUE(e::slice("four", 4) == value[0]);
+    ASSERT_TRUE(d->fsck());
+
+    // Without history, copying keeps only the current version.
+    e::intrusive_ptr<hyperdisk::shard> newd1 = hyperdisk::shard::create(cwd, "tmp-disk2");
+    e::guard g1 = e::makeguard(::unlink, "tmp-disk2");
+    d->copy_to(hyperspacehashing::mask::coordinate(0, 0, 0, 0, 0, 0), newd1);
+    ASSERT_EQ(hyperdisk::NOTFOUND, newd1->get_at(primary_hash, key, 2, &value, &version));
+    ASSERT_EQ(hyperdisk::SUCCESS, newd1->get_at(primary_hash, key, 4, &value, &version));
+    ASSERT_EQ(4, version);
+    ASSERT_TRUE(newd1->fsck());
+
+    // With history, versions superseded recently enough are kept.
+    e::intrusive_ptr<hyperdisk::shard> newd2 = hyperdisk::shard::create(cwd, "tmp-disk3");
+    e::guard g2 = e::makeguard(::unlink, "tmp-disk3");
+    d->copy_to(hyperspacehashing::mask::coordinate(0, 0, 0, 0, 0, 0), newd2, 2);
+    ASSERT_EQ(hyperdisk::SUCCESS, newd2->get_at(primary_hash, key, 1, &value, &version));
+    ASSERT_EQ(1, version);
+    ASSERT_TRUE(e::slice("one", 3) == value[0]);
+    ASSERT_EQ(hyperdisk::SUCCESS, newd2->get_at(primary_hash, key, 2, &value, &version));
+    ASSERT_EQ(2, version);
+    ASSERT_TRUE(e::slice("two", 3) == value[0]);
+    ASSERT_EQ(hyperdisk::NOTFOUND, newd2->get_at(primary_hash, key, 3, &value, &version));
+    ASSERT_EQ(hyperdisk::SUCCESS, newd2->get(primary_hash, key, &value, &version));
+    ASSERT_EQ(4, version);
+    ASSERT_TRUE(e::slice("four", 4) == value[0]);
+    ASSERT_EQ(hyperdisk::SUCCESS, newd2->get_at(primary_hash, key, 4, &value, &version));
+    ASSERT_TRUE(newd2->fsck());
+}
+
 TEST(ShardTest, SearchFull)
 {
     po6::io::fd cwd(AT_FDCWD);
@@ -341,6 +401,64 @@ TEST(ShardTest, CopyFromFull)
     ASSERT_TRUE(newd2->fsck());
 }
 
+TEST(ShardTest, SplitFromFull)
+{
+    po6::io::fd cwd(AT_FDCWD);
+    e::intrusive_ptr<hyperdisk::shard> d = hyperdisk::shard::create(cwd, "tmp-disk");
+    e::guard g = e::makeguard(::unlink, "tmp-disk");
+    hyperspacehashing::mask::hasher h(std::vector<hyperspacehashing::hash_t>(2, hyperspacehashing::EQUALITY));
+    std::auto_ptr<e::buffer> value_backing(e::buffer::create(998));
+    std::vector<e::slice> value(1);
+    value_backing->pack() << e::buffer::padding(998);
+    value[0] = value_backing->as_slice();
+
+    for (uint64_t i = 0; i < 32768; ++i)
+    {
+        std::auto_ptr<e::buffer> key(e::buffer::create(sizeof(i)));
+        key->pack() << i;
+        hyperspacehashing::mask::coordinate c = h.hash(key->as_slice(), value);
+        ASSERT_EQ(hyperdisk::SUCCESS, d->put(coord(c.primary_hash, c.secondary_lower_hash), key->as_slice(), value, 1));
+    }
+
+    hyperspacehashing::mask::coordinate cs[4];
+    e::intrusive_ptr<hyperdisk::shard> ss[4];
+    e::guard g0 = e::makeguard(::unlink, "tmp-disk-0");
+    e::guard g1 = e::makeguard(::unlink, "tmp-disk-1");
+    e::guard g2 = e::makeguard(::unlink, "tmp-disk-2");
+    e::guard g3 = e::makeguard(::unlink, "tmp-disk-3");
+    const char* names[4] = {"tmp-disk-0", "tmp-disk-1", "tmp-disk-2", "tmp-disk-3"};
+
+    for (size_t i = 0; i < 4; ++i)
+    {
+        cs[i] = hyperspacehashing::mask::coordinate(1, i & 1, 1, (i >> 1) & 1, 0, 0);
+        ss[i] = hyperdisk::shard::create(cwd, names[i]);
+    }
+
+    d->split_to(cs, ss, 4);
+    hyperdisk::shard_snapshot snaps[4] = {ss[0]->make_snapshot(),
+                                          ss[1]->make_snapshot(),
+                                          ss[2]->make_snapshot(),
+                                          ss[3]->make_snapshot()};
+
+    // Every object lands in exactly one target, in its original order.
+    for (hyperdisk::shard_snapshot dsnap = d->make_snapshot(); dsnap.valid(); dsnap.next())
+    {
+        size_t i = (dsnap.coordinate().primary_hash & 1) | ((dsnap.coordinate().secondary_lower_hash & 1) << 1);
+        ASSERT_TRUE(snaps[i].valid());
+        ASSERT_TRUE(dsnap.coordinate() == snaps[i].coordinate());
+        ASSERT_EQ(dsnap.version(), snaps[i].version());
+        ASSERT_TRUE(dsnap.key() == snaps[i].key());
+        ASSERT_TRUE(dsnap.value() == snaps[i].value());
+        snaps[i].next();
+    }
+
+    for (size_t i = 0; i < 4; ++i)
+    {
+        ASSERT_FALSE(snaps[i].valid());
+        ASSERT_TRUE(ss[i]->fsck());
+    }
+}
+
 TEST(ShardTest, SameHashDifferentKey)
 {
     po6::io::fd cwd(AT_FDCWD);
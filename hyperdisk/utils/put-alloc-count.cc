@@ -0,0 +1,185 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#define __STDC_LIMIT_MACROS
+
+// C
+#include <cstdlib>
+
+// POSIX
+#include <unistd.h>
+
+// C++
+#include <iomanip>
+#include <iostream>
+#include <new>
+
+// STL
+#include <string>
+#include <tr1/memory>
+#include <vector>
+
+// po6
+#include <po6/error.h>
+#include <po6/pathname.h>
+
+// e
+#include <e/buffer.h>
+#include <e/timer.h>
+
+// HyperspaceHashing
+#include "hyperspacehashing/hyperspacehashing/mask.h"
+
+// HyperDisk
+#include "hyperdisk/hyperdisk/disk.h"
+
+// Count the heap allocations made by each PUT to a disk, both while the entry
+// is appended to the write-ahead log and while it is flushed to the shards.
+// The caller's backing buffers are allocated before counting starts.  This
+// counts calls to the ordinary allocator; the write-ahead log has no allocator
+// of its own, and each of its nodes is allocated and freed separately.
+//
+// Usage:  put-alloc-count [arity [puts]]
+
+static uint64_t allocations = 0;
+
+void*
+operator new (size_t sz) throw (std::bad_alloc)
+{
+    __sync_add_and_fetch(&allocations, 1);
+    void* ptr = malloc(sz ? sz : 1);
+
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+
+    return ptr;
+}
+
+void*
+operator new[] (size_t sz) throw (std::bad_alloc)
+{
+    return operator new (sz);
+}
+
+void
+operator delete (void* ptr) throw ()
+{
+    free(ptr);
+}
+
+void
+operator delete[] (void* ptr) throw ()
+{
+    free(ptr);
+}
+
+static void
+report(const char* what, uint64_t allocs, uint64_t nanos, size_t n)
+{
+    std::cout << std::setw(8) << what << ":  "
+              << std::fixed << std::setprecision(2)
+              << static_cast<double>(allocs) / n << " allocations/PUT, "
+              << static_cast<double>(nanos) / n << " ns/PUT" << std::endl;
+}
+
+int
+main(int argc, char* argv[])
+{
+    uint16_t arity = argc > 1 ? strtoul(argv[1], NULL, 0) : 4;
+    size_t puts = argc > 2 ? strtoul(argv[2], NULL, 0) : 100000;
+
+    if (arity < 1)
+    {
+        std::cerr << "arity must be at least 1" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        std::vector<hyperspacehashing::hash_t> hashes(arity, hyperspacehashing::EQUALITY);
+        hyperspacehashing::mask::hasher hasher(hashes);
+        e::intrusive_ptr<hyperdisk::disk> d;
+        d = hyperdisk::disk::create(po6::pathname("wal-alloc-bench"), hasher, arity);
+
+        std::vector<uint64_t> keys(puts);
+        std::vector<std::tr1::shared_ptr<e::buffer> > backings(puts);
+        std::string attr(32, 'v');
+        std::vector<e::slice> value(arity - 1, e::slice(attr.data(), attr.size()));
+
+        for (size_t i = 0; i < puts; ++i)
+        {
+            keys[i] = i;
+            backings[i].reset(e::buffer::create(sizeof(uint64_t)));
+        }
+
+        uint64_t allocs = allocations;
+        uint64_t start = e::time();
+
+        for (size_t i = 0; i < puts; ++i)
+        {
+            e::slice key(reinterpret_cast<const char*>(&keys[i]), sizeof(uint64_t));
+
+            if (d->put(backings[i], key, value, i) != hyperdisk::SUCCESS)
+            {
+                std::cerr << "put failed" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
+        report("append", allocations - allocs, e::time() - start, puts);
+        backings.clear();
+        allocs = allocations;
+        start = e::time();
+
+        while (true)
+        {
+            hyperdisk::returncode ret = d->flush(-1, false);
+
+            if (ret == hyperdisk::DATAFULL || ret == hyperdisk::SEARCHFULL)
+            {
+                d->do_mandatory_io();
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        report("flush", allocations - allocs, e::time() - start, puts);
+        d->drop();
+    }
+    catch (po6::error& e)
+    {
+        std::cerr << "error:  [" << e << "] " << e.what();
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,169 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#define __STDC_LIMIT_MACROS
+
+// C
+#include <cstdlib>
+
+// POSIX
+#include <fcntl.h>
+#include <unistd.h>
+
+// C++
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// po6
+#include <po6/error.h>
+#include <po6/io/fd.h>
+
+// e
+#include <e/intrusive_ptr.h>
+#include <e/timer.h>
+
+// HyperspaceHashing
+#include "hyperspacehashing/hyperspacehashing/mask.h"
+
+// HyperDisk
+#include "hyperdisk/shard.h"
+
+// Measure the latency of splitting a full shard four ways, comparing one
+// copy_to per target (each a scan of the source) against split_to with a
+// varying number of threads.
+//
+// Usage:  split-bench [value-size [iterations]]
+
+using hyperspacehashing::mask::coordinate;
+
+static uint64_t
+mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static size_t
+fill(e::intrusive_ptr<hyperdisk::shard> s, size_t value_size)
+{
+    std::string v(value_size, 'v');
+    std::vector<e::slice> value(1, e::slice(v.data(), v.size()));
+    size_t n = 0;
+
+    while (true)
+    {
+        uint64_t k = mix(n);
+        coordinate c(UINT64_MAX, mix(k) & 0xffffffffULL,
+                     UINT64_MAX, mix(k + 1),
+                     UINT64_MAX, mix(k + 2));
+
+        if (s->put(c, e::slice(reinterpret_cast<const char*>(&k), sizeof(k)),
+                   value, n) != hyperdisk::SUCCESS)
+        {
+            return n;
+        }
+
+        ++n;
+    }
+}
+
+static double
+millis(uint64_t start)
+{
+    return (e::time() - start) / 1000000.;
+}
+
+int
+main(int argc, char* argv[])
+{
+    size_t value_size = argc > 1 ? strtoul(argv[1], NULL, 0) : 128;
+    size_t iterations = argc > 2 ? strtoul(argv[2], NULL, 0) : 5;
+
+    try
+    {
+        po6::io::fd cwd(AT_FDCWD);
+        e::intrusive_ptr<hyperdisk::shard> source;
+        source = hyperdisk::shard::create(cwd, "split-bench-source");
+        e::intrusive_ptr<hyperdisk::shard> targets[4];
+        coordinate coords[4];
+
+        for (size_t i = 0; i < 4; ++i)
+        {
+            std::ostringstream ostr;
+            ostr << "split-bench-target-" << i;
+            targets[i] = hyperdisk::shard::create(cwd, po6::pathname(ostr.str()));
+            coords[i] = coordinate(1, i & 1, 1, (i >> 1) & 1, 0, 0);
+        }
+
+        size_t objects = fill(source, value_size);
+        std::cout << "filled shard with " << objects << " objects of "
+                  << value_size << " bytes" << std::endl;
+        std::cout << std::fixed << std::setprecision(3);
+
+        for (size_t it = 0; it < iterations; ++it)
+        {
+            uint64_t start = e::time();
+
+            for (size_t i = 0; i < 4; ++i)
+            {
+                source->copy_to(coords[i], targets[i]);
+            }
+
+            std::cout << "copy_to x4:             " << millis(start) << " ms" << std::endl;
+
+            for (size_t threads = 1; threads <= 4; threads *= 2)
+            {
+                start = e::time();
+                source->split_to(coords, targets, 4, threads);
+                std::cout << "split_to, " << threads << " thread(s):  "
+                          << millis(start) << " ms" << std::endl;
+            }
+        }
+
+        unlink("split-bench-source");
+
+        for (size_t i = 0; i < 4; ++i)
+        {
+            std::ostringstream ostr;
+            ostr << "split-bench-target-" << i;
+            unlink(ostr.str().c_str());
+        }
+    }
+    catch (po6::error& e)
+    {
+        std::cerr << "error:  [" << e << "] " << e.what();
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
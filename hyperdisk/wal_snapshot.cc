@@ -0,0 +1,309 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#define __STDC_LIMIT_MACROS
+
+// C
+#include <cassert>
+#include <cstring>
+
+// STL
+#include <algorithm>
+
+// HyperDisk
+#include "hyperdisk/key_order.h"
+#include "hyperdisk/wal_snapshot.h"
+
+class hyperdisk::wal_overlay::bytewise_less
+{
+    public:
+        bytewise_less(const std::vector<log_entry>* entries) : m_entries(entries) {}
+
+    public:
+        bool operator () (size_t lhs, size_t rhs) const
+        { return less((*m_entries)[lhs].key, (*m_entries)[rhs].key); }
+        bool operator () (const log_entry& lhs, const e::slice& rhs) const
+        { return less(lhs.key, rhs); }
+
+    public:
+        static bool less(const e::slice& lhs, const e::slice& rhs)
+        {
+            int cmp = memcmp(lhs.data(), rhs.data(), std::min(lhs.size(), rhs.size()));
+            return cmp < 0 || (cmp == 0 && lhs.size() < rhs.size());
+        }
+
+    private:
+        const std::vector<log_entry>* m_entries;
+};
+
+class hyperdisk::wal_snapshot::put_order
+{
+    public:
+        put_order(const wal_overlay* wal, bool descending)
+            : m_wal(wal), m_descending(descending) {}
+
+    public:
+        bool operator () (size_t lhs, size_t rhs) const
+        {
+            const e::slice& l(m_wal->latest(lhs).key);
+            const e::slice& r(m_wal->latest(rhs).key);
+            int cmp = key_compare(key_order(l), l, key_order(r), r);
+            return m_descending ? cmp > 0 : cmp < 0;
+        }
+
+    private:
+        const wal_overlay* m_wal;
+        bool m_descending;
+};
+
+hyperdisk :: wal_overlay :: wal_overlay(const wal_overlay* prev, uint64_t head,
+                                        e::locking_iterable_fifo<log_entry>::iterator iter,
+                                        uint64_t first)
+    : m_latest()
+    , m_numbers()
+    , m_end(first)
+{
+    std::vector<log_entry> fresh;
+
+    for (; iter.valid(); iter.next())
+    {
+        fresh.push_back(*iter);
+    }
+
+    m_end = first + fresh.size();
+    // After a stable sort, the last index in each run of equal keys is the
+    // newest entry for that key.
+    std::vector<size_t> order(fresh.size());
+
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+
+    std::stable_sort(order.begin(), order.end(), bytewise_less(&fresh));
+    std::vector<size_t> newest;
+
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        if (i + 1 < order.size() &&
+            fresh[order[i]].key == fresh[order[i + 1]].key)
+        {
+            continue;
+        }
+
+        newest.push_back(order[i]);
+    }
+
+    // Merge the new entries into those of "prev", which they replace.
+    size_t psz = prev ? prev->m_latest.size() : 0;
+    size_t p = 0;
+    size_t n = 0;
+    m_latest.reserve(psz + newest.size());
+    m_numbers.reserve(psz + newest.size());
+
+    while (p < psz || n < newest.size())
+    {
+        if (p < psz && prev->m_numbers[p] < head)
+        {
+            ++p;
+        }
+        else if (n < newest.size() &&
+                 (p == psz || !bytewise_less::less(prev->m_latest[p].key, fresh[newest[n]].key)))
+        {
+            if (p < psz && prev->m_latest[p].key == fresh[newest[n]].key)
+            {
+                ++p;
+            }
+
+            m_latest.push_back(fresh[newest[n]]);
+            m_numbers.push_back(first + newest[n]);
+            ++n;
+        }
+        else
+        {
+            m_latest.push_back(prev->m_latest[p]);
+            m_numbers.push_back(prev->m_numbers[p]);
+            ++p;
+        }
+    }
+}
+
+hyperdisk :: wal_overlay :: wal_overlay(const wal_overlay& prev, uint64_t head)
+    : m_latest()
+    , m_numbers()
+    , m_end(std::max(prev.m_end, head))
+{
+    for (size_t i = 0; i < prev.m_latest.size(); ++i)
+    {
+        if (prev.m_numbers[i] >= head)
+        {
+            m_latest.push_back(prev.m_latest[i]);
+            m_numbers.push_back(prev.m_numbers[i]);
+        }
+    }
+}
+
+hyperdisk :: wal_overlay :: ~wal_overlay() throw ()
+{
+}
+
+bool
+hyperdisk :: wal_overlay :: superseded(const e::slice& key) const
+{
+    std::vector<log_entry>::const_iterator it;
+    it = std::lower_bound(m_latest.begin(), m_latest.end(), key, bytewise_less(NULL));
+    return it != m_latest.end() && it->key == key;
+}
+
+hyperdisk :: wal_snapshot :: wal_snapshot(std::tr1::shared_ptr<const wal_overlay> wal,
+                                          const e::intrusive_ptr<snapshot>& snap,
+                                          const hyperspacehashing::mask::coordinate& coord,
+                                          bool with_puts, bool ordered, bool descending)
+    : snapshot()
+    , m_wal(wal)
+    , m_snap(snap)
+    , m_ordered(ordered)
+    , m_descending(descending)
+    , m_puts()
+    , m_next(0)
+    , m_from_snap(false)
+    , m_value()
+{
+    for (size_t i = 0; with_puts && i < m_wal->latest(); ++i)
+    {
+        const log_entry& ent(m_wal->latest(i));
+
+        if (ent.is_put && coord.intersects(ent.coord))
+        {
+            m_puts.push_back(i);
+        }
+    }
+
+    if (ordered)
+    {
+        std::sort(m_puts.begin(), m_puts.end(), put_order(m_wal.get(), descending));
+    }
+}
+
+hyperdisk :: wal_snapshot :: ~wal_snapshot() throw ()
+{
+}
+
+bool
+hyperdisk :: wal_snapshot :: valid()
+{
+    while (m_snap->valid() && m_wal->superseded(m_snap->key()))
+    {
+        m_snap->next();
+    }
+
+    bool snap_valid = m_snap->valid();
+    bool log_valid = m_next < m_puts.size();
+
+    if (snap_valid && log_valid && m_ordered)
+    {
+        const e::slice& s(m_snap->key());
+        const e::slice& l(put(m_next).key);
+        int cmp = key_compare(key_order(s), s, key_order(l), l);
+        m_from_snap = m_descending ? cmp > 0 : cmp < 0;
+    }
+    else
+    {
+        m_from_snap = snap_valid;
+    }
+
+    return snap_valid || log_valid;
+}
+
+void
+hyperdisk :: wal_snapshot :: next()
+{
+    if (!valid())
+    {
+        return;
+    }
+
+    if (m_from_snap)
+    {
+        m_snap->next();
+    }
+    else
+    {
+        ++m_next;
+    }
+}
+
+hyperspacehashing::mask::coordinate
+hyperdisk :: wal_snapshot :: coordinate()
+{
+    if (m_from_snap)
+    {
+        return m_snap->coordinate();
+    }
+
+    assert(m_next < m_puts.size());
+    return put(m_next).coord;
+}
+
+uint64_t
+hyperdisk :: wal_snapshot :: version()
+{
+    if (m_from_snap)
+    {
+        return m_snap->version();
+    }
+
+    assert(m_next < m_puts.size());
+    return put(m_next).version;
+}
+
+const e::slice&
+hyperdisk :: wal_snapshot :: key()
+{
+    if (m_from_snap)
+    {
+        return m_snap->key();
+    }
+
+    assert(m_next < m_puts.size());
+    return put(m_next).key;
+}
+
+const std::vector<e::slice>&
+hyperdisk :: wal_snapshot :: value()
+{
+    if (m_from_snap)
+    {
+        return m_snap->value();
+    }
+
+    assert(m_next < m_puts.size());
+    const log_entry::value_t& value(put(m_next).value);
+    m_value.assign(value.begin(), value.end());
+    return m_value;
+}
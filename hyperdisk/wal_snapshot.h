@@ -0,0 +1,144 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef hyperdisk_wal_snapshot_h_
+#define hyperdisk_wal_snapshot_h_
+
+// STL
+#include <tr1/memory>
+#include <vector>
+
+// e
+#include <e/intrusive_ptr.h>
+#include <e/locking_iterable_fifo.h>
+
+// HyperDisk
+#include "hyperdisk/hyperdisk/snapshot.h"
+#include "hyperdisk/log_entry.h"
+
+namespace hyperdisk
+{
+
+// The un-flushed entries of the write-ahead log, as seen by searches.  The
+// overlay must be taken before the shard snapshot.  It holds the newest entry
+// for each key among the log's entries, which are numbered in the order they
+// were appended.  An object in the shards which has a newer PUT or DEL in the
+// overlay is "superseded".  It is immutable once built, so every search which
+// starts while the log is unchanged may share it, and a later overlay is built
+// from it rather than from the whole log.
+class wal_overlay
+{
+    public:
+        // The newest entries of "prev" (if not NULL) numbered "head" or
+        // higher, updated with the entries from "iter" to the end of the log.
+        // The first entry from "iter" is numbered "first".
+        wal_overlay(const wal_overlay* prev, uint64_t head,
+                    e::locking_iterable_fifo<log_entry>::iterator iter,
+                    uint64_t first);
+        // The newest entries of "prev" numbered "head" or higher, so that the
+        // entries flushed before "head" are released.
+        wal_overlay(const wal_overlay& prev, uint64_t head);
+        ~wal_overlay() throw ();
+
+    public:
+        bool superseded(const e::slice& key) const;
+        // The newest entry for each key, in bytewise key order.
+        size_t latest() const { return m_latest.size(); }
+        const log_entry& latest(size_t i) const { return m_latest[i]; }
+        // One past the number of the last entry the overlay has seen.
+        uint64_t end() const { return m_end; }
+
+    private:
+        class bytewise_less;
+
+    private:
+        wal_overlay(const wal_overlay&);
+
+    private:
+        wal_overlay& operator = (const wal_overlay&);
+
+    private:
+        // The newest entry for each key, in bytewise key order, and the number
+        // of each.
+        std::vector<log_entry> m_latest;
+        std::vector<uint64_t> m_numbers;
+        uint64_t m_end;
+};
+
+// A snapshot which overlays a wal_overlay on a snapshot of the shards, so that
+// a search need not wait for the log to be flushed.  Superseded objects in
+// "snap" are skipped.  If "with_puts", the overlay's newest PUTs which
+// intersect "coord" are returned after "snap" (or merged into it in key order
+// if "ordered").  Callers must check valid() before using the accessors.
+class wal_snapshot : public snapshot
+{
+    public:
+        wal_snapshot(std::tr1::shared_ptr<const wal_overlay> wal,
+                     const e::intrusive_ptr<snapshot>& snap,
+                     const hyperspacehashing::mask::coordinate& coord,
+                     bool with_puts, bool ordered, bool descending);
+        ~wal_snapshot() throw ();
+
+    public:
+        virtual bool valid();
+        virtual void next();
+
+    public:
+        virtual hyperspacehashing::mask::coordinate coordinate();
+        virtual uint64_t version();
+        virtual const e::slice& key();
+        virtual const std::vector<e::slice>& value();
+
+    private:
+        class put_order;
+
+    private:
+        const log_entry& put(size_t i) const { return m_wal->latest(m_puts[i]); }
+
+    private:
+        wal_snapshot(const wal_snapshot&);
+
+    private:
+        wal_snapshot& operator = (const wal_snapshot&);
+
+    private:
+        std::tr1::shared_ptr<const wal_overlay> m_wal;
+        e::intrusive_ptr<snapshot> m_snap;
+        bool m_ordered;
+        bool m_descending;
+        // Indices into m_wal's latest entries of the PUTs to return, and the
+        // next of them to return.
+        std::vector<size_t> m_puts;
+        size_t m_next;
+        bool m_from_snap;
+        std::vector<e::slice> m_value;
+};
+
+} // namespace hyperdisk
+
+#endif // hyperdisk_wal_snapshot_h_
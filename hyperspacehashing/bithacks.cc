@@ -0,0 +1,259 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#define __STDC_LIMIT_MACROS
+
+// C
+#include <stdint.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HYPERSPACEHASHING_X86_64
+#include <cpuid.h>
+#endif
+
+// HyperspaceHashing
+#include "hyperspacehashing/bithacks.h"
+
+// Every kernel is built from a single primitive:  spread(src, sz, shift)
+// places bit q of src at bit shift + q * sz, dropping whatever falls off the
+// end of the word.  Interlacing is then one spread per dimension.
+
+namespace
+{
+
+uint64_t spread_tables[3][256];
+uint64_t stride_masks[65];
+
+uint64_t
+spread_loop(uint64_t src, size_t sz, size_t shift)
+{
+    uint64_t ret = 0;
+
+    for (size_t pos = shift; src && pos < 64; pos += sz, src >>= 1)
+    {
+        ret |= (src & 1) << pos;
+    }
+
+    return ret;
+}
+
+uint64_t
+spread_table(uint64_t src, size_t sz, size_t shift)
+{
+    if (sz == 1)
+    {
+        return src << shift;
+    }
+
+    if (sz > 4)
+    {
+        return spread_loop(src, sz, shift);
+    }
+
+    const uint64_t* table = spread_tables[sz - 2];
+    uint64_t ret = 0;
+
+    for (size_t pos = shift; src && pos < 64; pos += 8 * sz, src >>= 8)
+    {
+        ret |= table[src & 0xff] << pos;
+    }
+
+    return ret;
+}
+
+#ifdef HYPERSPACEHASHING_X86_64
+// Written with asm so that the rest of the library need not be compiled for
+// BMI2.  It is only ever executed after interlace_bmi2_supported says so.
+uint64_t
+spread_bmi2(uint64_t src, size_t sz, size_t shift)
+{
+    uint64_t mask = stride_masks[sz < 64 ? sz : 64] << shift;
+    uint64_t ret;
+    __asm__ ("pdepq %2, %1, %0" : "=r" (ret) : "r" (src), "rm" (mask));
+    return ret;
+}
+#else
+uint64_t
+spread_bmi2(uint64_t src, size_t sz, size_t shift)
+{
+    return spread_table(src, sz, shift);
+}
+#endif
+
+template <uint64_t (*spread)(uint64_t, size_t, size_t)>
+uint64_t
+lower(const uint64_t* nums, size_t sz)
+{
+    uint64_t ret = 0;
+    size_t dims = sz < 64 ? sz : 64;
+
+    for (size_t d = 0; d < dims; ++d)
+    {
+        ret |= spread(nums[d], sz, d);
+    }
+
+    return ret;
+}
+
+template <uint64_t (*spread)(uint64_t, size_t, size_t)>
+uint64_t
+upper(const uint64_t* nums, size_t sz)
+{
+    uint64_t ret = 0;
+    size_t dims = sz < 64 ? sz : 64;
+
+    for (size_t d = 0; d < dims; ++d)
+    {
+        // Dimension d fills bits 63 - d, 63 - d - sz, ... from its most
+        // significant bits down, so the lowest of those bits takes bit
+        // 64 - count.
+        size_t count = (63 - d) / sz + 1;
+        ret |= spread(nums[d] >> (64 - count), sz, (63 - d) % sz);
+    }
+
+    return ret;
+}
+
+template <uint64_t (*spread)(uint64_t, size_t, size_t)>
+void
+double_lower(const uint64_t* nums, size_t sz, uint64_t* lower, uint64_t* upper)
+{
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+    size_t dims = sz < 128 ? sz : 128;
+
+    for (size_t d = 0; d < dims; ++d)
+    {
+        if (d >= 64)
+        {
+            hi |= spread(nums[d], sz, d - 64);
+            continue;
+        }
+
+        // The first count bits of dimension d land in the lower word, and the
+        // rest continue in the upper word.
+        size_t count = (63 - d) / sz + 1;
+        size_t next = d + count * sz;
+        lo |= spread(nums[d], sz, d);
+
+        if (count < 64 && next < 128)
+        {
+            hi |= spread(nums[d] >> count, sz, next - 64);
+        }
+    }
+
+    *lower = lo;
+    *upper = hi;
+}
+
+#ifdef HYPERSPACEHASHING_X86_64
+// AMD implemented PDEP in microcode before Zen 3 (family 19h), where it takes
+// hundreds of cycles and loses to the lookup tables.
+bool
+pdep_is_slow()
+{
+    unsigned int eax, ebx, ecx, edx;
+    __cpuid(0, eax, ebx, ecx, edx);
+    bool amd = ebx == 0x68747541 && edx == 0x69746e65 && ecx == 0x444d4163;
+    __cpuid(1, eax, ebx, ecx, edx);
+    unsigned int family = (eax >> 8) & 0xf;
+
+    if (family == 0xf)
+    {
+        family += (eax >> 20) & 0xff;
+    }
+
+    return amd && family < 0x19;
+}
+#endif
+
+bool
+select_interlace_kernel()
+{
+    for (size_t sz = 2; sz <= 4; ++sz)
+    {
+        for (uint64_t b = 0; b < 256; ++b)
+        {
+            spread_tables[sz - 2][b] = spread_loop(b, sz, 0);
+        }
+    }
+
+    for (size_t sz = 1; sz <= 64; ++sz)
+    {
+        stride_masks[sz] = spread_loop(UINT64_MAX, sz, 0);
+    }
+
+#ifdef HYPERSPACEHASHING_X86_64
+    if (interlace_bmi2_supported() && !pdep_is_slow())
+    {
+        interlace_selected = &interlace_bmi2;
+        return true;
+    }
+#endif
+
+    interlace_selected = &interlace_table;
+    return true;
+}
+
+} // namespace
+
+const interlace_kernel interlace_reference = {"reference",
+                                              reference_lower_interlace,
+                                              reference_upper_interlace,
+                                              reference_double_lower_interlace};
+const interlace_kernel interlace_table = {"table",
+                                          lower<spread_table>,
+                                          upper<spread_table>,
+                                          double_lower<spread_table>};
+const interlace_kernel interlace_bmi2 = {"bmi2",
+                                         lower<spread_bmi2>,
+                                         upper<spread_bmi2>,
+                                         double_lower<spread_bmi2>};
+const interlace_kernel* interlace_selected = &interlace_reference;
+
+bool
+interlace_bmi2_supported()
+{
+#ifdef HYPERSPACEHASHING_X86_64
+    unsigned int eax, ebx, ecx, edx;
+
+    if (__get_cpuid_max(0, 0) < 7)
+    {
+        return false;
+    }
+
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return ebx & (1U << 8);
+#else
+    return false;
+#endif
+}
+
+// Runs with the library's static initializers.  Callers that get in earlier
+// see interlace_reference, which gives the same answers.
+static bool interlace_kernel_selected = select_interlace_kernel();
@@ -56,8 +56,17 @@ lookup_msb_mask[] = {0ULL, 9223372036854775808ULL, 13835058055282163712ULL,
     18446744073709551600ULL, 18446744073709551608ULL, 18446744073709551612ULL,
     18446744073709551614ULL, 18446744073709551615ULL};
 
+// lower_interlace places bit q of nums[d] at bit d + q * sz of the result.
+// upper_interlace is its mirror image:  bit 63 - q of nums[d] goes to bit
+// 63 - (d + q * sz).  double_lower_interlace is lower_interlace with a 128-bit
+// result split across two words.
+//
+// The reference_* versions are the straightforward bit-at-a-time
+// implementations.  The unprefixed versions dispatch to the fastest kernel
+// the CPU supports, which is picked once when the library is loaded.
+
 inline uint64_t
-lower_interlace(uint64_t* nums, size_t sz)
+reference_lower_interlace(const uint64_t* nums, size_t sz)
 {
     uint64_t ret = 0;
 
@@ -80,7 +89,7 @@ lower_interlace(uint64_t* nums, size_t sz)
 }
 
 inline uint64_t
-upper_interlace(uint64_t* nums, size_t sz)
+reference_upper_interlace(const uint64_t* nums, size_t sz)
 {
     uint64_t ret = 0;
 
@@ -103,7 +112,8 @@ upper_interlace(uint64_t* nums, size_t sz)
 }
 
 inline void
-double_lower_interlace(uint64_t* nums, size_t sz, uint64_t* lower, uint64_t* upper)
+reference_double_lower_interlace(const uint64_t* nums, size_t sz,
+                                 uint64_t* lower, uint64_t* upper)
 {
     *lower = 0;
     *upper = 0;
@@ -150,4 +160,45 @@ double_lower_interlace(uint64_t* nums, size_t sz, uint64_t* lower, uint64_t* upp
     *upper = result[1];
 }
 
+struct interlace_kernel
+{
+    const char* name;
+    uint64_t (*lower)(const uint64_t* nums, size_t sz);
+    uint64_t (*upper)(const uint64_t* nums, size_t sz);
+    void (*double_lower)(const uint64_t* nums, size_t sz,
+                         uint64_t* lower, uint64_t* upper);
+};
+
+// The bit-at-a-time loops above.
+extern const interlace_kernel interlace_reference;
+// Byte lookup tables for two, three and four dimensions, and a loop over
+// just the bits that are used otherwise.
+extern const interlace_kernel interlace_table;
+// PDEP from x86 BMI2.  Only usable if interlace_bmi2_supported().
+extern const interlace_kernel interlace_bmi2;
+bool
+interlace_bmi2_supported();
+
+// The kernel used by the functions below.  This is interlace_reference until
+// the library's static initializers have run.
+extern const interlace_kernel* interlace_selected;
+
+inline uint64_t
+lower_interlace(const uint64_t* nums, size_t sz)
+{
+    return interlace_selected->lower(nums, sz);
+}
+
+inline uint64_t
+upper_interlace(const uint64_t* nums, size_t sz)
+{
+    return interlace_selected->upper(nums, sz);
+}
+
+inline void
+double_lower_interlace(const uint64_t* nums, size_t sz, uint64_t* lower, uint64_t* upper)
+{
+    interlace_selected->double_lower(nums, sz, lower, upper);
+}
+
 #endif // bithacks_h_
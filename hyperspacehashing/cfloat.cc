@@ -76,31 +76,21 @@ hyperspacehashing :: cfloat_range(uint64_t clower,
                                   uint64_t* mask,
                                   uint64_t* range)
 {
-    uint64_t m = UINT64_MAX;
-    m >>= (64 - space);
-    m = (~(clower ^ cupper)) & m;
-    bool seen_one = false;
-    bool seen_zero = false;
+    // Keep the leading bits (within the low "space" bits) on which clower and
+    // cupper agree; every value between them shares those bits.
+    uint64_t m = 0;
 
-    for (ssize_t b = 63; b >= 0; --b)
+    for (ssize_t b = static_cast<ssize_t>(space) - 1; b >= 0; --b)
     {
         uint64_t bit = 1;
         bit <<= b;
 
-        if ((m & bit))
+        if (((clower ^ cupper) & bit))
         {
-            seen_one = true;
+            break;
         }
 
-        if (seen_one && !(m & bit))
-        {
-            seen_zero = true;
-        }
-
-        if (seen_zero)
-        {
-            m &= ~bit;
-        }
+        m |= bit;
     }
 
     *mask = m;
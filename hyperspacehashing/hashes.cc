@@ -25,8 +25,11 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#define __STDC_LIMIT_MACROS
+
 // C
-#include <cstring>
+#include <cassert>
+#include <cstdlib>
 
 // STL
 #include <algorithm>
@@ -38,6 +41,7 @@
 #include <e/endian.h>
 
 // HyperspaceHashing
+#include "cfloat.h"
 #include "hashes_internal.h"
 #include "hyperspacehashing/hashes.h"
 
@@ -48,13 +52,157 @@ hyperspacehashing :: cityhash(const e::slice& buf)
     return CityHash64(reinterpret_cast<const char*>(buf.data()), buf.size());
 }
 
+uint64_t
+hyperspacehashing :: shorthash(const e::slice& buf)
+{
+    static const uint64_t k0 = 0x9ae16a3b2f90404fULL;
+    static const uint64_t k1 = 0xc3a5c85c97cb3127ULL;
+    const uint8_t* p = buf.data();
+    size_t n = buf.size();
+
+    if (n > 16)
+    {
+        return cityhash(buf);
+    }
+
+    // Read the value as two words.  Between them they cover every byte, and
+    // values of 4 bytes or more are read with (possibly overlapping) whole
+    // loads rather than byte by byte.
+    uint64_t a = 0;
+    uint64_t b = 0;
+
+    if (n >= 8)
+    {
+        e::unpack64le(p, &a);
+        e::unpack64le(p + n - 8, &b);
+    }
+    else if (n >= 4)
+    {
+        uint32_t lo;
+        uint32_t hi;
+        e::unpack32le(p, &lo);
+        e::unpack32le(p + n - 4, &hi);
+        a = (static_cast<uint64_t>(hi) << 32) | lo;
+    }
+    else if (n > 0)
+    {
+        a = (static_cast<uint64_t>(p[0]) << 16)
+          | (static_cast<uint64_t>(p[n >> 1]) << 8)
+          | p[n - 1];
+    }
+
+    // The length goes in too, so values that differ only in trailing zero
+    // bytes do not collide.
+    b ^= k0 + n;
+    uint64_t h = (a * k1) ^ ((b << 32) | (b >> 32));
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+hyperspacehashing::hash_func
+hyperspacehashing :: equality_hash(equality_hash_t eq)
+{
+    switch (eq)
+    {
+        case CITYHASH:
+            return cityhash;
+        case SHORTHASH:
+            return shorthash;
+        default:
+            abort();
+    }
+}
+
 uint64_t
 hyperspacehashing :: lendian(const e::slice& buf)
 {
-    uint8_t tmp[sizeof(int64_t)];
-    memset(tmp, 0, sizeof(int64_t));
-    memmove(tmp, buf.data(), std::min(buf.size(), sizeof(int64_t)));
-    uint64_t ret;
-    e::unpack64le(tmp, &ret);
+    uint64_t ret = 0;
+
+    if (buf.size() >= sizeof(uint64_t))
+    {
+        e::unpack64le(buf.data(), &ret);
+        return ret;
+    }
+
+    // Shorter values are zero-extended.
+    for (size_t i = buf.size(); i > 0; --i)
+    {
+        ret = (ret << 8) | buf.data()[i - 1];
+    }
+
+    return ret;
+}
+
+uint64_t
+hyperspacehashing :: bendian(const e::slice& buf)
+{
+    uint64_t ret = 0;
+
+    if (buf.size() >= sizeof(uint64_t))
+    {
+        e::unpack64be(buf.data(), &ret);
+        return ret;
+    }
+
+    for (size_t i = 0; i < buf.size(); ++i)
+    {
+        ret |= static_cast<uint64_t>(buf.data()[i]) << (56 - 8 * i);
+    }
+
     return ret;
 }
+
+void
+hyperspacehashing :: prefix_range(const e::slice& prefix, bool exact, unsigned int space,
+                                  uint64_t* mask, uint64_t* hash)
+{
+    assert(space > 0 && space <= 64);
+    // Values beginning with the prefix share its first 8 * size bits.  An
+    // exact value pins down the zero padding as well.
+    size_t fixed = exact ? 64 : std::min(prefix.size() * 8, size_t(64));
+    uint64_t m = fixed == 0 ? 0 : UINT64_MAX << (64 - fixed);
+    *mask = m >> (64 - space);
+    *hash = (bendian(prefix) & m) >> (64 - space);
+}
+
+uint64_t
+hyperspacehashing :: column_cityhash(const e::slice& buf, unsigned int)
+{
+    return cityhash(buf);
+}
+
+uint64_t
+hyperspacehashing :: column_shorthash(const e::slice& buf, unsigned int)
+{
+    return shorthash(buf);
+}
+
+hyperspacehashing::column_func
+hyperspacehashing :: column_equality(equality_hash_t eq)
+{
+    switch (eq)
+    {
+        case CITYHASH:
+            return column_cityhash;
+        case SHORTHASH:
+            return column_shorthash;
+        default:
+            abort();
+    }
+}
+
+uint64_t
+hyperspacehashing :: column_cfloat(const e::slice& buf, unsigned int space)
+{
+    return cfloat(lendian(buf), space);
+}
+
+uint64_t
+hyperspacehashing :: column_prefix(const e::slice& buf, unsigned int space)
+{
+    return cfloat(bendian(buf), space);
+}
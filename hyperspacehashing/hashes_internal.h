@@ -47,8 +47,39 @@ typedef uint64_t (*hash_func)(const e::slice& buf);
 uint64_t
 cityhash(const e::slice& buf);
 uint64_t
+shorthash(const e::slice& buf);
+// The function behind an equality_hash_t.
+hash_func
+equality_hash(equality_hash_t eq);
+uint64_t
 lendian(const e::slice& buf);
 
+// The per-attribute hash functions, in the form the hashers dispatch through.
+// space is the number of bits the attribute gets in the coordinate.
+uint64_t
+column_cityhash(const e::slice& buf, unsigned int space);
+uint64_t
+column_shorthash(const e::slice& buf, unsigned int space);
+uint64_t
+column_cfloat(const e::slice& buf, unsigned int space);
+uint64_t
+column_prefix(const e::slice& buf, unsigned int space);
+typedef uint64_t (*column_func)(const e::slice& buf, unsigned int space);
+// The column function behind an equality_hash_t.
+column_func
+column_equality(equality_hash_t eq);
+
+// The first eight bytes of buf as a big-endian integer, zero-padded.
+uint64_t
+bendian(const e::slice& buf);
+
+// The mask and hash (both in the low "space" bits) covering every value of a
+// PREFIX attribute that begins with "prefix".  If "exact", only values equal
+// to "prefix" are covered.
+void
+prefix_range(const e::slice& prefix, bool exact, unsigned int space,
+             uint64_t* mask, uint64_t* hash);
+
 
 } // namespace hyperspacehashing
 
@@ -32,11 +32,29 @@ namespace hyperspacehashing
 {
 
 // 0 is reserved for internal use.
+//
+// PREFIX places strings by their leading bytes, read as a big-endian
+// integer, so that every string with a given prefix falls in one contiguous
+// block of the attribute's bits.  It may not be used for the key.
 enum hash_t
 {
     EQUALITY = 1,
     RANGE    = 2,
-    NONE     = 3
+    NONE     = 3,
+    PREFIX   = 4
+};
+
+// The function EQUALITY attributes (and an EQUALITY key) are hashed with.
+// Every node must agree on it, so it is chosen per subspace in the
+// configuration.
+//
+// SHORTHASH is a multiply-and-mix hash for values of up to 16 bytes, which is
+// cheaper than CityHash on the short keys most spaces use.  Longer values
+// fall back to CityHash.
+enum equality_hash_t
+{
+    CITYHASH  = 1,
+    SHORTHASH = 2
 };
 
 } // namespace hyperspacehashing
@@ -33,6 +33,7 @@
 
 // HyperspaceHashing
 #include <hyperspacehashing/hashes.h>
+#include <hyperspacehashing/quantiles.h>
 #include <hyperspacehashing/search.h>
 
 namespace hyperspacehashing
@@ -70,7 +71,12 @@ class coordinate
 class hasher
 {
     public:
-        hasher(const std::vector<hash_t>& funcs);
+        // dists, if not empty, holds a transform for each attribute, which
+        // must be the identity for all but non-key RANGE attributes.  eq
+        // picks the function EQUALITY attributes are hashed with.
+        hasher(const std::vector<hash_t>& funcs,
+               const std::vector<quantiles>& dists = std::vector<quantiles>(),
+               equality_hash_t eq = CITYHASH);
         hasher(const hasher& other);
         ~hasher() throw ();
 
@@ -79,15 +85,51 @@ class hasher
         coordinate hash(const e::slice& key, const std::vector<e::slice>& value) const;
         coordinate hash(const std::vector<e::slice>& value) const;
         coordinate hash(const search& s) const;
+        // Hash the n objects (keys[i], values[i]) into coords[i].  This
+        // gives the same coordinates as calling hash(key, value) on each,
+        // but works an attribute at a time across the whole batch.
+        void hash(const e::slice* keys,
+                  const std::vector<e::slice>* values,
+                  size_t n, coordinate* coords) const;
 
     public:
         hasher& operator = (const hasher& rhs);
 
+    private:
+        typedef uint64_t (*equality_func)(const e::slice& buf);
+        typedef uint64_t (*column_func)(const e::slice& buf, unsigned int space);
+        // A hashed attribute, with its hash function resolved up front.
+        class column
+        {
+            public:
+                column(size_t attr, unsigned int num,
+                       unsigned int space, column_func func,
+                       const quantiles& dist);
+
+            public:
+                size_t attr;
+                unsigned int num;
+                unsigned int space;
+                column_func func;
+                // Applied in place of func when not the identity.
+                quantiles dist;
+        };
+
+    private:
+        void hash_secondary(const std::vector<e::slice>* values,
+                            size_t n, coordinate* coords) const;
+
     private:
         std::vector<hash_t> m_funcs;
+        std::vector<quantiles> m_dists;
+        equality_func m_equality;
         unsigned int m_num;
         std::vector<unsigned int> m_nums;
         std::vector<unsigned int> m_space;
+        column_func m_key_func;
+        std::vector<column> m_columns;
+        uint64_t m_lower_mask;
+        uint64_t m_upper_mask;
 };
 
 } // namespace mask
@@ -36,6 +36,7 @@
 
 // HyperspaceHashing
 #include <hyperspacehashing/hashes.h>
+#include <hyperspacehashing/quantiles.h>
 #include <hyperspacehashing/search.h>
 
 // Forward Declarations
@@ -95,7 +96,12 @@ class search_coordinate
 class hasher
 {
     public:
-        hasher(const std::vector<hash_t>& funcs);
+        // dists, if not empty, holds a transform for each attribute, which
+        // must be the identity for all but non-key RANGE attributes.  eq
+        // picks the function EQUALITY attributes are hashed with.
+        hasher(const std::vector<hash_t>& funcs,
+               const std::vector<quantiles>& dists = std::vector<quantiles>(),
+               equality_hash_t eq = CITYHASH);
         hasher(const hasher& other);
         ~hasher() throw ();
 
@@ -104,12 +110,42 @@ class hasher
         coordinate hash(const std::vector<e::slice>& value) const;
         coordinate hash(const e::slice& key, const std::vector<e::slice>& value) const;
         search_coordinate hash(const search& s) const;
+        // Hash the n objects (keys[i], values[i]) into coords[i].  This
+        // gives the same coordinates as calling hash(key, value) on each,
+        // but works an attribute at a time across the whole batch.
+        void hash(const e::slice* keys,
+                  const std::vector<e::slice>* values,
+                  size_t n, coordinate* coords) const;
 
     public:
         hasher& operator = (const hasher& rhs);
 
+    private:
+        typedef uint64_t (*equality_func)(const e::slice& buf);
+        typedef uint64_t (*column_func)(const e::slice& buf, unsigned int space);
+        // A hashed attribute (attr 0 is the key) with its hash function and
+        // its share of the 64 bits resolved up front.
+        class column
+        {
+            public:
+                column(size_t attr, unsigned int num,
+                       unsigned int space, column_func func,
+                       const quantiles& dist);
+
+            public:
+                size_t attr;
+                unsigned int num;
+                unsigned int space;
+                column_func func;
+                // Applied in place of func when not the identity.
+                quantiles dist;
+        };
+
     private:
         std::vector<hash_t> m_funcs;
+        std::vector<quantiles> m_dists;
+        equality_func m_equality;
+        std::vector<column> m_columns;
 };
 
 } // namespace prefix
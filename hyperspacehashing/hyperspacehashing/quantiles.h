@@ -0,0 +1,80 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef hyperspacehashing_quantiles_h_
+#define hyperspacehashing_quantiles_h_
+
+// C
+#include <stdint.h>
+
+// STL
+#include <vector>
+
+namespace hyperspacehashing
+{
+
+// A monotone, piecewise-linear transform applied to RANGE attributes before
+// they are hashed.  The bounds split the 64-bit number line into
+// bounds.size() + 1 segments, and each segment is stretched or squeezed onto
+// an equal share of the output.  When the bounds are quantiles of the
+// attribute's values, skewed values come out spread evenly across the bits
+// that place them, and so across regions.
+//
+// The transform preserves order, so a range [lower, upper) of values maps
+// onto the range [map(lower), map(upper)] of transformed values.  A
+// default-constructed transform is the identity.
+class quantiles
+{
+    public:
+        quantiles();
+        // The bounds must be strictly increasing.
+        quantiles(const std::vector<uint64_t>& bounds);
+        quantiles(const quantiles& other);
+        ~quantiles() throw ();
+
+    public:
+        static bool valid(const std::vector<uint64_t>& bounds);
+
+    public:
+        bool identity() const { return m_bounds.empty(); }
+        const std::vector<uint64_t>& bounds() const { return m_bounds; }
+        uint64_t map(uint64_t value) const;
+
+    public:
+        quantiles& operator = (const quantiles& rhs);
+        bool operator == (const quantiles& rhs) const;
+
+    private:
+        std::vector<uint64_t> m_bounds;
+        // The width of each segment's share of the output.
+        uint64_t m_share;
+};
+
+} // namespace hyperspacehashing
+
+#endif // hyperspacehashing_quantiles_h_
@@ -52,16 +52,20 @@ class search
         const e::slice& equality_value(size_t idx) const;
         bool is_range(size_t idx) const;
         void range_value(size_t idx, uint64_t* lower, uint64_t* upper) const;
+        bool is_prefix(size_t idx) const;
+        const e::slice& prefix_value(size_t idx) const;
         bool matches(const e::slice& key, const std::vector<e::slice>& value) const;
         size_t packed_size() const;
 
-    // It is an error to call equality_set or range_set on an index which has
-    // already been provided as an index to equality_set or range_set.  It will
-    // fail an assertion.  This is to prevent misconceptions about the way in
-    // which these two interact.
+    // It is an error to call equality_set, range_set or prefix_set on an
+    // index which has already been provided as an index to any of them.  It
+    // will fail an assertion.  This is to prevent misconceptions about the way
+    // in which these interact.
     public:
         void equality_set(size_t idx, const e::slice& val);
         void range_set(size_t idx, uint64_t start, uint64_t end);
+        // Match values which begin with val.
+        void prefix_set(size_t idx, const e::slice& val);
 
     private:
         friend e::buffer::packer operator << (e::buffer::packer lhs, const search& rhs);
@@ -73,6 +77,70 @@ class search
         e::bitfield m_range_bits;
         std::vector<uint64_t> m_range_lower;
         std::vector<uint64_t> m_range_upper;
+        // Prefix terms keep their value in m_equality.
+        e::bitfield m_prefix_bits;
+};
+
+// A search prepared for testing many objects.  It gives the same answers as
+// search::matches, but decides up front which attributes to test and in what
+// order:  equality tests come first, as they reject the most objects, then
+// prefix tests from longest to shortest, and range tests follow from narrowest
+// to widest.  It refers to the equality
+// values of the search it was built from, so whatever backs those slices must
+// outlive it.
+class compiled_search
+{
+    public:
+        compiled_search(const search& s);
+        compiled_search(const compiled_search& other);
+        ~compiled_search() throw ();
+
+    public:
+        bool matches(const e::slice& key, const std::vector<e::slice>& value) const;
+
+    public:
+        compiled_search& operator = (const compiled_search& rhs);
+
+    private:
+        class equality_test
+        {
+            public:
+                equality_test(size_t attr, const e::slice& val);
+
+            public:
+                size_t attr;
+                const uint8_t* data;
+                size_t size;
+        };
+        class prefix_test : public equality_test
+        {
+            public:
+                prefix_test(size_t attr, const e::slice& val);
+
+            public:
+                bool operator < (const prefix_test& rhs) const;
+        };
+        class range_test
+        {
+            public:
+                range_test(size_t attr, uint64_t lower, uint64_t upper);
+
+            public:
+                bool operator < (const range_test& rhs) const;
+
+            public:
+                size_t attr;
+                uint64_t lower;
+                // upper - lower; a value v matches when v - lower < width.
+                uint64_t width;
+        };
+
+    private:
+        size_t m_arity;
+        bool m_never;
+        std::vector<equality_test> m_equality;
+        std::vector<prefix_test> m_prefix;
+        std::vector<range_test> m_range;
 };
 
 e::buffer::packer
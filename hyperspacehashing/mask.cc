@@ -33,6 +33,10 @@
 #include "hyperspacehashing/cfloat.h"
 #include "hyperspacehashing/hashes_internal.h"
 
+// Objects are hashed BATCH at a time so that the scratch space stays small
+// and on the stack.
+static const size_t BATCH = 16;
+
 hyperspacehashing :: mask :: coordinate :: coordinate()
     : primary_mask()
     , primary_hash()
@@ -102,13 +106,49 @@ hyperspacehashing :: mask :: coordinate :: operator == (const coordinate& rhs) c
            secondary_upper_hash == rhs.secondary_upper_hash;
 }
 
-hyperspacehashing :: mask :: hasher :: hasher(const std::vector<hash_t>& funcs)
+hyperspacehashing :: mask :: hasher :: column :: column(size_t _attr, unsigned int _num,
+                                                  unsigned int _space, column_func _func,
+                                                  const quantiles& _dist)
+    : attr(_attr)
+    , num(_num)
+    , space(_space)
+    , func(_func)
+    , dist(_dist)
+{
+}
+
+hyperspacehashing :: mask :: hasher :: hasher(const std::vector<hash_t>& funcs,
+                                              const std::vector<quantiles>& dists,
+                                              equality_hash_t eq)
     : m_funcs(funcs)
+    , m_dists(dists)
+    , m_equality(equality_hash(eq))
     , m_num()
     , m_nums(funcs.size(), -1)
     , m_space(funcs.size(), 64)
+    , m_key_func()
+    , m_columns()
+    , m_lower_mask()
+    , m_upper_mask()
 {
     assert(m_funcs.size() >= 1);
+    assert(m_dists.empty() || m_dists.size() == m_funcs.size());
+    m_dists.resize(m_funcs.size());
+    assert(m_dists[0].identity());
+
+    switch (m_funcs[0])
+    {
+        case EQUALITY:
+            m_key_func = column_equality(eq);
+            break;
+        case RANGE:
+            m_key_func = column_cfloat;
+            break;
+        case NONE:
+            break;
+        default:
+            abort();
+    }
 
     for (size_t i = 1; m_num < 128 && i < m_funcs.size(); ++i)
     {
@@ -122,6 +162,10 @@ hyperspacehashing :: mask :: hasher :: hasher(const std::vector<hash_t>& funcs)
                 m_nums[i] = m_num;
                 ++m_num;
                 break;
+            case PREFIX:
+                m_nums[i] = m_num;
+                ++m_num;
+                break;
             case NONE:
                 break;
             default:
@@ -139,13 +183,50 @@ hyperspacehashing :: mask :: hasher :: hasher(const std::vector<hash_t>& funcs)
             m_space[i] = std::min(64U, numbits + (m_nums[i] < plusones ? 1 : 0));
         }
     }
+
+    for (size_t i = 1; i < m_funcs.size(); ++i)
+    {
+        if (m_nums[i] != static_cast<unsigned int>(-1))
+        {
+            column_func func = column_cfloat;
+
+            if (m_funcs[i] == EQUALITY)
+            {
+                func = column_equality(eq);
+            }
+            else if (m_funcs[i] == PREFIX)
+            {
+                func = column_prefix;
+            }
+
+            assert(m_funcs[i] == RANGE || m_dists[i].identity());
+            m_columns.push_back(column(i, m_nums[i], m_space[i], func, m_dists[i]));
+        }
+    }
+
+    // Every hashed attribute is fully specified by an object, so its
+    // secondary masks never change.
+    uint64_t masks[128];
+
+    for (size_t i = 0; i < 128; ++i)
+    {
+        masks[i] = UINT64_MAX;
+    }
+
+    double_lower_interlace(masks, m_num, &m_lower_mask, &m_upper_mask);
 }
 
 hyperspacehashing :: mask :: hasher :: hasher(const hasher& other)
     : m_funcs(other.m_funcs)
+    , m_dists(other.m_dists)
+    , m_equality(other.m_equality)
     , m_num(other.m_num)
     , m_nums(other.m_nums)
     , m_space(other.m_space)
+    , m_key_func(other.m_key_func)
+    , m_columns(other.m_columns)
+    , m_lower_mask(other.m_lower_mask)
+    , m_upper_mask(other.m_upper_mask)
 {
     assert(m_funcs.size() >= 1);
     assert(m_funcs.size() == m_nums.size());
@@ -159,85 +240,42 @@ hyperspacehashing :: mask :: hasher :: ~hasher() throw ()
 hyperspacehashing::mask::coordinate
 hyperspacehashing :: mask :: hasher :: hash(const e::slice& key) const
 {
-    uint64_t key_mask = 0;
-    uint64_t key_hash = 0;
-
-    switch (m_funcs[0])
+    if (!m_key_func)
     {
-        case EQUALITY:
-            key_mask = UINT64_MAX;
-            key_hash = cityhash(key);
-            break;
-        case RANGE:
-            key_mask = UINT64_MAX;
-            key_hash = cfloat(lendian(key), 64);
-            break;
-        case NONE:
-            key_mask = 0;
-            key_hash = 0;
-            break;
-        default:
-            abort();
+        return coordinate();
     }
 
-    return coordinate(key_mask, key_hash, 0, 0, 0, 0);
+    return coordinate(UINT64_MAX, m_key_func(key, 64), 0, 0, 0, 0);
 }
 
 hyperspacehashing::mask::coordinate
 hyperspacehashing :: mask :: hasher :: hash(const e::slice& key,
                                             const std::vector<e::slice>& value) const
 {
-    coordinate primary = hash(key);
-    coordinate secondary = hash(value);
-    return coordinate(primary.primary_mask, primary.primary_hash,
-                      secondary.secondary_lower_mask, secondary.secondary_lower_hash,
-                      secondary.secondary_upper_mask, secondary.secondary_upper_hash);
+    coordinate ret = hash(key);
+    hash_secondary(&value, 1, &ret);
+    return ret;
 }
 
 hyperspacehashing::mask::coordinate
 hyperspacehashing :: mask :: hasher :: hash(const std::vector<e::slice>& value) const
 {
-    assert(value.size() + 1 == m_funcs.size());
-    assert(m_nums.size() == m_funcs.size());
-    assert(m_nums.size() == m_space.size());
-    uint64_t masks[128];
-    uint64_t hashes[128];
-    memset(masks, 0, sizeof(masks));
-    memset(hashes, 0, sizeof(hashes));
+    coordinate ret;
+    hash_secondary(&value, 1, &ret);
+    return ret;
+}
 
-    for (size_t i = 1; i < m_funcs.size(); ++i)
+void
+hyperspacehashing :: mask :: hasher :: hash(const e::slice* keys,
+                                            const std::vector<e::slice>* values,
+                                            size_t n, coordinate* coords) const
+{
+    for (size_t i = 0; i < n; ++i)
     {
-        if (m_nums[i] != static_cast<unsigned int>(-1))
-        {
-            uint64_t cfl;
-
-            switch (m_funcs[i])
-            {
-                case EQUALITY:
-                    masks[m_nums[i]] = UINT64_MAX;
-                    hashes[m_nums[i]] = cityhash(value[i - 1]);
-                    break;
-                case RANGE:
-                    assert(m_space[i] <= 64);
-                    cfl = cfloat(lendian(value[i - 1]), m_space[i]);
-                    masks[m_nums[i]] = UINT64_MAX;
-                    hashes[m_nums[i]] = cfl;
-                    break;
-                case NONE:
-                    abort();
-                default:
-                    abort();
-            }
-        }
+        coords[i] = hash(keys[i]);
     }
 
-    uint64_t lower_mask = 0;
-    uint64_t upper_mask = 0;
-    double_lower_interlace(masks, m_num, &lower_mask, &upper_mask);
-    uint64_t lower_hash = 0;
-    uint64_t upper_hash = 0;
-    double_lower_interlace(hashes, m_num, &lower_hash, &upper_hash);
-    return coordinate(0, 0, lower_mask, lower_hash, upper_mask, upper_hash);
+    hash_secondary(values, n, coords);
 }
 
 hyperspacehashing::mask::coordinate
@@ -266,7 +304,7 @@ hyperspacehashing :: mask :: hasher :: hash(const search& s) const
                 if (s.is_equality(0))
                 {
                     primary_mask = UINT64_MAX;
-                    primary_hash = cityhash(s.equality_value(0));
+                    primary_hash = m_equality(s.equality_value(0));
                 }
 
                 break;
@@ -310,7 +348,7 @@ hyperspacehashing :: mask :: hasher :: hash(const search& s) const
                     if (s.is_equality(i))
                     {
                         masks[m_nums[i]] = UINT64_MAX;
-                        hashes[m_nums[i]] = cityhash(s.equality_value(i));
+                        hashes[m_nums[i]] = m_equality(s.equality_value(i));
                     }
 
                     break;
@@ -319,11 +357,25 @@ hyperspacehashing :: mask :: hasher :: hash(const search& s) const
                     if (s.is_range(i))
                     {
                         s.range_value(i, &lower, &upper);
-                        clower = cfloat(lower, m_space[i]);
-                        cupper = cfloat(upper, m_space[i]);
+                        // upper is excluded from the range.
+                        upper = lower < upper ? upper - 1 : upper;
+                        clower = cfloat(m_dists[i].map(lower), m_space[i]);
+                        cupper = cfloat(m_dists[i].map(upper), m_space[i]);
                         cfloat_range(clower, cupper, m_space[i], &masks[m_nums[i]], &hashes[m_nums[i]]);
                     }
 
+                    break;
+                case PREFIX:
+
+                    if (s.is_equality(i))
+                    {
+                        prefix_range(s.equality_value(i), true, m_space[i], &masks[m_nums[i]], &hashes[m_nums[i]]);
+                    }
+                    else if (s.is_prefix(i))
+                    {
+                        prefix_range(s.prefix_value(i), false, m_space[i], &masks[m_nums[i]], &hashes[m_nums[i]]);
+                    }
+
                     break;
                 case NONE:
                     abort();
@@ -341,3 +393,54 @@ hyperspacehashing :: mask :: hasher :: hash(const search& s) const
     double_lower_interlace(hashes, m_num, &lower_hash, &upper_hash);
     return coordinate(0, 0, lower_mask, lower_hash, upper_mask, upper_hash);
 }
+
+void
+hyperspacehashing :: mask :: hasher :: hash_secondary(const std::vector<e::slice>* values,
+                                                      size_t n, coordinate* coords) const
+{
+    uint64_t hashes[BATCH * 128];
+
+    for (size_t base = 0; base < n; base += BATCH)
+    {
+        size_t count = std::min(n - base, BATCH);
+
+        // Run one attribute's hash function over the whole batch before
+        // moving on to the next.  The calls are independent of one another,
+        // so the CPU overlaps consecutive hashes instead of waiting on each.
+        for (size_t c = 0; c < m_columns.size(); ++c)
+        {
+            const column& col(m_columns[c]);
+
+            if (col.dist.identity())
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const std::vector<e::slice>& value(values[base + i]);
+                    assert(value.size() + 1 == m_funcs.size());
+                    hashes[i * m_num + col.num] = col.func(value[col.attr - 1], col.space);
+                }
+            }
+            else
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const std::vector<e::slice>& value(values[base + i]);
+                    assert(value.size() + 1 == m_funcs.size());
+                    uint64_t num = col.dist.map(lendian(value[col.attr - 1]));
+                    hashes[i * m_num + col.num] = cfloat(num, col.space);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            coordinate* c = coords + base + i;
+            uint64_t lower_hash = 0;
+            uint64_t upper_hash = 0;
+            double_lower_interlace(hashes + i * m_num, m_num, &lower_hash, &upper_hash);
+            *c = coordinate(c->primary_mask, c->primary_hash,
+                            m_lower_mask, lower_hash,
+                            m_upper_mask, upper_hash);
+        }
+    }
+}
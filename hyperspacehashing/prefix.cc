@@ -34,6 +34,10 @@
 #include "hyperspacehashing/prefix.h"
 #include "range_match.h"
 
+// Objects are hashed BATCH at a time so that the scratch space stays small
+// and on the stack.
+static const size_t BATCH = 16;
+
 hyperspacehashing :: prefix :: coordinate :: coordinate()
     : prefix(0)
     , point(0)
@@ -129,13 +133,83 @@ hyperspacehashing :: prefix :: search_coordinate :: search_coordinate(uint64_t m
 {
 }
 
-hyperspacehashing :: prefix :: hasher :: hasher(const std::vector<hash_t>& funcs)
+hyperspacehashing :: prefix :: hasher :: column :: column(size_t _attr, unsigned int _num,
+                                                    unsigned int _space, column_func _func,
+                                                    const quantiles& _dist)
+    : attr(_attr)
+    , num(_num)
+    , space(_space)
+    , func(_func)
+    , dist(_dist)
+{
+}
+
+hyperspacehashing :: prefix :: hasher :: hasher(const std::vector<hash_t>& funcs,
+                                                const std::vector<quantiles>& dists,
+                                                equality_hash_t eq)
     : m_funcs(funcs)
+    , m_dists(dists)
+    , m_equality(equality_hash(eq))
+    , m_columns()
 {
+    assert(m_dists.empty() || m_dists.size() == m_funcs.size());
+    m_dists.resize(m_funcs.size());
+    assert(m_dists.empty() || m_dists[0].identity());
+    std::vector<size_t> attrs;
+
+    for (size_t i = 0; attrs.size() < 64 && i < m_funcs.size(); ++i)
+    {
+        switch (m_funcs[i])
+        {
+            case EQUALITY:
+            case RANGE:
+            case PREFIX:
+                attrs.push_back(i);
+                break;
+            case NONE:
+                break;
+            default:
+                abort();
+        }
+    }
+
+    if (attrs.empty())
+    {
+        return;
+    }
+
+    unsigned int numbits = 64 / attrs.size();
+    unsigned int plusones = 64 % attrs.size();
+
+    for (size_t idx = 0; idx < attrs.size(); ++idx)
+    {
+        // Equality hashes use all 64 bits and let upper_interlace take the
+        // ones it needs; range and prefix hashes are sized to their share of
+        // the bits.
+        unsigned int space = numbits + (idx < plusones ? 1 : 0);
+        const quantiles& dist(m_dists[attrs[idx]]);
+        assert(m_funcs[attrs[idx]] == RANGE || dist.identity());
+
+        if (m_funcs[attrs[idx]] == EQUALITY)
+        {
+            m_columns.push_back(column(attrs[idx], idx, 64, column_equality(eq), dist));
+        }
+        else if (m_funcs[attrs[idx]] == PREFIX)
+        {
+            m_columns.push_back(column(attrs[idx], idx, space, column_prefix, dist));
+        }
+        else
+        {
+            m_columns.push_back(column(attrs[idx], idx, space, column_cfloat, dist));
+        }
+    }
 }
 
 hyperspacehashing :: prefix :: hasher :: hasher(const hasher& other)
     : m_funcs(other.m_funcs)
+    , m_dists(other.m_dists)
+    , m_equality(other.m_equality)
+    , m_columns(other.m_columns)
 {
 }
 
@@ -163,7 +237,7 @@ hyperspacehashing :: prefix :: hasher :: hash(const e::slice& key) const
     switch (m_funcs[0])
     {
         case EQUALITY:
-            return coordinate(64, cityhash(key));
+            return coordinate(64, m_equality(key));
         case RANGE:
             return coordinate(64, cfloat(lendian(key), 64));
         case NONE:
@@ -176,93 +250,70 @@ hyperspacehashing :: prefix :: hasher :: hash(const e::slice& key) const
 hyperspacehashing::prefix::coordinate
 hyperspacehashing :: prefix :: hasher :: hash(const e::slice& key, const std::vector<e::slice>& value) const
 {
-    assert(value.size() + 1 == m_funcs.size());
-    size_t num = 0;
-    uint64_t hashes[64];
+    coordinate ret;
+    hash(&key, &value, 1, &ret);
+    return ret;
+}
 
-    switch (m_funcs[0])
-    {
-        case EQUALITY:
-            hashes[num] = cityhash(key);
-            ++num;
-            break;
-        case RANGE:
-            hashes[num] = 0;
-            ++num;
-            break;
-        case NONE:
-            break;
-        default:
-            abort();
-    }
+void
+hyperspacehashing :: prefix :: hasher :: hash(const e::slice* keys,
+                                              const std::vector<e::slice>* values,
+                                              size_t n, coordinate* coords) const
+{
+    size_t num = m_columns.size();
 
-    for (size_t i = 1; num < 64 && i < m_funcs.size(); ++i)
+    if (num == 0)
     {
-        switch (m_funcs[i])
+        for (size_t i = 0; i < n; ++i)
         {
-            case EQUALITY:
-                hashes[num] = cityhash(value[i - 1]);
-                ++num;
-                break;
-            case RANGE:
-                hashes[num] = 0;
-                ++num;
-                break;
-            case NONE:
-                break;
-            default:
-                abort();
+            assert(values[i].size() + 1 == m_funcs.size());
+            coords[i] = coordinate(0, 0);
         }
-    }
 
-    if (num == 0)
-    {
-        return coordinate(0, 0);
+        return;
     }
 
-    unsigned int numbits = 64 / num;
-    unsigned int plusones = 64 % num;
-    unsigned int space;
-    size_t idx = 0;
+    uint64_t hashes[BATCH * 64];
 
-    switch (m_funcs[0])
+    for (size_t base = 0; base < n; base += BATCH)
     {
-        case EQUALITY:
-            ++idx;
-            break;
-        case RANGE:
-            space = numbits + (idx < plusones ? 1 : 0);
-            hashes[idx] = cfloat(lendian(key), space);
-            hashes[idx] <<= 64 - space;
-            ++idx;
-            break;
-        case NONE:
-            break;
-        default:
-            abort();
-    }
+        size_t count = std::min(n - base, BATCH);
 
-    for (size_t i = 1; idx < num && i < m_funcs.size(); ++i)
-    {
-        switch (m_funcs[i])
+        // Run one attribute's hash function over the whole batch before
+        // moving on to the next.  The calls are independent of one another,
+        // so the CPU overlaps consecutive hashes instead of waiting on each.
+        for (size_t c = 0; c < num; ++c)
         {
-            case EQUALITY:
-                ++idx;
-                break;
-            case RANGE:
-                space = numbits + (idx < plusones ? 1 : 0);
-                hashes[idx] = cfloat(lendian(value[i - 1]), space);
-                hashes[idx] <<= 64 - space;
-                ++idx;
-                break;
-            case NONE:
-                break;
-            default:
-                abort();
+            const column& col(m_columns[c]);
+
+            if (col.dist.identity())
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const std::vector<e::slice>& value(values[base + i]);
+                    assert(value.size() + 1 == m_funcs.size());
+                    const e::slice& attr(col.attr == 0 ? keys[base + i] : value[col.attr - 1]);
+                    hashes[i * num + col.num] = col.func(attr, col.space) << (64 - col.space);
+                }
+            }
+            else
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const std::vector<e::slice>& value(values[base + i]);
+                    assert(value.size() + 1 == m_funcs.size());
+                    const e::slice& attr(col.attr == 0 ? keys[base + i] : value[col.attr - 1]);
+                    uint64_t n = col.dist.map(lendian(attr));
+                    hashes[i * num + col.num] = cfloat(n, col.space) << (64 - col.space);
+                }
+            }
         }
-    }
 
-    return coordinate(64, upper_interlace(hashes, num));
+        for (size_t i = 0; i < count; ++i)
+        {
+            coords[base + i] = coordinate(64, upper_interlace(hashes + i * num, num));
+        }
+    }
 }
 
 hyperspacehashing::prefix::search_coordinate
@@ -282,7 +333,7 @@ hyperspacehashing :: prefix :: hasher :: hash(const search& s) const
                 if (s.is_equality(i))
                 {
                     masks[num] = UINT64_MAX;
-                    hashes[num] = cityhash(s.equality_value(i));
+                    hashes[num] = m_equality(s.equality_value(i));
                 }
                 else
                 {
@@ -293,6 +344,7 @@ hyperspacehashing :: prefix :: hasher :: hash(const search& s) const
                 ++num;
                 break;
             case RANGE:
+            case PREFIX:
                 masks[num] = 0;
                 hashes[num] = 0;
                 ++num;
@@ -323,8 +375,12 @@ hyperspacehashing :: prefix :: hasher :: hash(const search& s) const
                 uint64_t upper;
                 s.range_value(i, &lower, &upper);
                 space = numbits + (idx < plusones ? 1 : 0);
-                uint64_t clower = cfloat(lower, space);
-                uint64_t cupper = cfloat(upper, space);
+                // The range excludes upper, so bound it by the last value
+                // it includes; otherwise a range ending on a region
+                // boundary would reach into the region that follows.
+                uint64_t last = lower < upper ? upper - 1 : upper;
+                uint64_t clower = cfloat(m_dists[i].map(lower), space);
+                uint64_t cupper = cfloat(m_dists[i].map(last), space);
                 cfloat_range(clower, cupper, space, &masks[idx], &hashes[idx]);
                 // Create the partial matching which is folded into
                 // equality coordinate.
@@ -349,6 +405,25 @@ hyperspacehashing :: prefix :: hasher :: hash(const search& s) const
                 s.range_value(i, &lower, &upper);
                 range.push_back(range_match(i, lower, upper, 0, 0, 0));
             }
+            else if (m_funcs[i] == PREFIX && (s.is_prefix(i) || s.is_equality(i)))
+            {
+                // Every value with the prefix lies in one aligned block of
+                // this attribute's bits, so the search fixes the block's
+                // leading bits and leaves the rest free.
+                space = numbits + (idx < plusones ? 1 : 0);
+
+                if (s.is_prefix(i))
+                {
+                    prefix_range(s.prefix_value(i), false, space, &masks[idx], &hashes[idx]);
+                }
+                else
+                {
+                    prefix_range(s.equality_value(i), true, space, &masks[idx], &hashes[idx]);
+                }
+
+                masks[idx] <<= (64 - space);
+                hashes[idx] <<= (64 - space);
+            }
 
             switch (m_funcs[i])
             {
@@ -358,6 +433,9 @@ hyperspacehashing :: prefix :: hasher :: hash(const search& s) const
                 case RANGE:
                     ++idx;
                     break;
+                case PREFIX:
+                    ++idx;
+                    break;
                 case NONE:
                     break;
                 default:
@@ -386,6 +464,9 @@ hyperspacehashing :: prefix :: hasher :: hash(const search& s) const
             case RANGE:
                 ++idx;
                 break;
+            case PREFIX:
+                ++idx;
+                break;
             case NONE:
                 break;
             default:
@@ -400,5 +481,8 @@ hyperspacehashing::prefix::hasher&
 hyperspacehashing :: prefix :: hasher :: operator = (const hasher& rhs)
 {
     m_funcs = rhs.m_funcs;
+    m_dists = rhs.m_dists;
+    m_equality = rhs.m_equality;
+    m_columns = rhs.m_columns;
     return *this;
 }
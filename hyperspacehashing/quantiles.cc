@@ -0,0 +1,111 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#define __STDC_LIMIT_MACROS
+
+// C
+#include <cassert>
+
+// STL
+#include <algorithm>
+
+// HyperspaceHashing
+#include "hyperspacehashing/quantiles.h"
+
+hyperspacehashing :: quantiles :: quantiles()
+    : m_bounds()
+    , m_share(UINT64_MAX)
+{
+}
+
+hyperspacehashing :: quantiles :: quantiles(const std::vector<uint64_t>& bounds)
+    : m_bounds(bounds)
+    , m_share(UINT64_MAX / (bounds.size() + 1))
+{
+    assert(valid(m_bounds));
+}
+
+hyperspacehashing :: quantiles :: quantiles(const quantiles& other)
+    : m_bounds(other.m_bounds)
+    , m_share(other.m_share)
+{
+}
+
+hyperspacehashing :: quantiles :: ~quantiles() throw ()
+{
+}
+
+bool
+hyperspacehashing :: quantiles :: valid(const std::vector<uint64_t>& bounds)
+{
+    for (size_t i = 1; i < bounds.size(); ++i)
+    {
+        if (bounds[i - 1] >= bounds[i])
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+uint64_t
+hyperspacehashing :: quantiles :: map(uint64_t value) const
+{
+    if (m_bounds.empty())
+    {
+        return value;
+    }
+
+    size_t seg = std::upper_bound(m_bounds.begin(), m_bounds.end(), value) - m_bounds.begin();
+    uint64_t lower = seg == 0 ? 0 : m_bounds[seg - 1];
+    uint64_t upper = seg == m_bounds.size() ? UINT64_MAX : m_bounds[seg] - 1;
+    // The segment holds [lower, upper], so it is never empty.
+    double width = static_cast<double>(upper - lower) + 1.0;
+    // Rounding is monotone, so the scaled offset never decreases as value
+    // grows.  Clamp it so that it stays within the segment's share.
+    double scaled = static_cast<double>(value - lower) / width * static_cast<double>(m_share);
+    uint64_t offset = scaled >= static_cast<double>(m_share) ? m_share - 1
+                                                              : static_cast<uint64_t>(scaled);
+    return seg * m_share + offset;
+}
+
+hyperspacehashing::quantiles&
+hyperspacehashing :: quantiles :: operator = (const quantiles& rhs)
+{
+    // We rely upon others catching self-assignment.
+    m_bounds = rhs.m_bounds;
+    m_share = rhs.m_share;
+    return *this;
+}
+
+bool
+hyperspacehashing :: quantiles :: operator == (const quantiles& rhs) const
+{
+    return m_bounds == rhs.m_bounds;
+}
@@ -49,11 +49,14 @@
 //      m_cupper.
 //
 // Partial-tolerant comparison:
-//      If the mask does not specify a full coordinate, ordering-based
-//      comparisons do not work.  In this case, the best we can do is
-//      compare bits that are the same in the cloat-mapped lower and
-//      upper ranges to the hash.  This case is folded into the equality
-//      comparison and thus is not handled by range_match.
+//      If the mask does not specify a full coordinate, the coordinate (a
+//      region) fixes the leading bits of the cfloat-mapped number and
+//      leaves the rest free.  upper_interlace places an attribute's bits in
+//      order from the top, so the region holds an interval of the number:
+//      from its fixed bits followed by zeros to its fixed bits followed by
+//      ones.  The region matches when that interval meets [m_clower,
+//      m_cupper].  Comparing only the bits under m_cmask preserves order,
+//      so none of this needs the bits pulled out of the interlacing.
 
 hyperspacehashing :: range_match :: range_match(unsigned int idx,
                                                 uint64_t lower, uint64_t upper,
@@ -72,18 +75,11 @@ bool
 hyperspacehashing :: range_match :: matches(const prefix::coordinate& coord) const
 {
     uint64_t prefix = lookup_msb_mask[coord.prefix];
-
-    // Interlace-tolerant comparison
-    if ((prefix & m_cmask) == m_cmask)
-    {
-        uint64_t hash = coord.point & m_cmask;
-        return (m_clower <= hash) && (hash <= m_cupper);
-    }
-    // Partial-tolerant comparison handled in equality check.
-    else
-    {
-        return true;
-    }
+    uint64_t fixed = coord.point & m_cmask & prefix;
+    uint64_t free = m_cmask & ~prefix;
+    // When the coordinate fixes every bit, this is the interlace-tolerant
+    // comparison; otherwise it is the partial-tolerant one.
+    return fixed <= m_cupper && m_clower <= (fixed | free);
 }
 
 bool
@@ -25,6 +25,12 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+// C
+#include <cstring>
+
+// STL
+#include <algorithm>
+
 // HyperspaceHashing
 #include "hashes_internal.h"
 #include <hyperspacehashing/search.h>
@@ -37,6 +43,7 @@ hyperspacehashing :: search :: search(size_t n)
     , m_range_bits(n)
     , m_range_lower(n)
     , m_range_upper(n)
+    , m_prefix_bits(n)
 {
 }
 
@@ -50,7 +57,8 @@ hyperspacehashing :: search :: sanity_check() const
     return m_equality_bits.bits() == m_equality.size() &&
            m_equality.size() == m_range_bits.bits() &&
            m_range_bits.bits() == m_range_lower.size() &&
-           m_range_lower.size() == m_range_upper.size();
+           m_range_lower.size() == m_range_upper.size() &&
+           m_range_upper.size() == m_prefix_bits.bits();
 }
 
 size_t
@@ -95,6 +103,23 @@ hyperspacehashing :: search :: range_value(size_t idx, uint64_t* lower, uint64_t
     *upper = m_range_upper[idx];
 }
 
+bool
+hyperspacehashing :: search :: is_prefix(size_t idx) const
+{
+    assert(sanity_check());
+    assert(idx < m_prefix_bits.bits());
+    return m_prefix_bits.get(idx);
+}
+
+const e::slice&
+hyperspacehashing :: search :: prefix_value(size_t idx) const
+{
+    assert(sanity_check());
+    assert(idx < m_prefix_bits.bits());
+    assert(m_prefix_bits.get(idx));
+    return m_equality[idx];
+}
+
 bool
 hyperspacehashing :: search :: matches(const e::slice& key, const std::vector<e::slice>& value) const
 {
@@ -116,6 +141,16 @@ hyperspacehashing :: search :: matches(const e::slice& key, const std::vector<e:
             return false;
         }
     }
+    else if (m_prefix_bits.get(0))
+    {
+        const e::slice& p(m_equality[0]);
+
+        if (key.size() < p.size() ||
+            (p.size() > 0 && memcmp(key.data(), p.data(), p.size()) != 0))
+        {
+            return false;
+        }
+    }
 
     for (size_t i = 1; i < m_equality.size(); ++i)
     {
@@ -135,6 +170,17 @@ hyperspacehashing :: search :: matches(const e::slice& key, const std::vector<e:
                 return false;
             }
         }
+        else if (m_prefix_bits.get(i))
+        {
+            const e::slice& v(value[i - 1]);
+            const e::slice& p(m_equality[i]);
+
+            if (v.size() < p.size() ||
+                (p.size() > 0 && memcmp(v.data(), p.data(), p.size()) != 0))
+            {
+                return false;
+            }
+        }
     }
 
     return true;
@@ -143,7 +189,7 @@ hyperspacehashing :: search :: matches(const e::slice& key, const std::vector<e:
 size_t
 hyperspacehashing :: search :: packed_size() const
 {
-    size_t sz = size() * (sizeof(uint8_t) * 2 + sizeof(uint64_t) * 4 + sizeof(uint32_t));
+    size_t sz = size() * (sizeof(uint8_t) * 3 + sizeof(uint64_t) * 4 + sizeof(uint32_t));
 
     for (size_t i = 0; i < size(); ++i)
     {
@@ -160,6 +206,7 @@ hyperspacehashing :: search :: equality_set(size_t idx, const e::slice& val)
     assert(idx < m_equality_bits.bits());
     assert(!m_equality_bits.get(idx));
     assert(!m_range_bits.get(idx));
+    assert(!m_prefix_bits.get(idx));
     m_equality_bits.set(idx);
     m_equality[idx] = val;
 }
@@ -171,21 +218,182 @@ hyperspacehashing :: search :: range_set(size_t idx, uint64_t start, uint64_t en
     assert(idx < m_equality_bits.bits());
     assert(!m_equality_bits.get(idx));
     assert(!m_range_bits.get(idx));
+    assert(!m_prefix_bits.get(idx));
     m_range_bits.set(idx);
     m_range_lower[idx] = start;
     m_range_upper[idx] = end;
 }
 
+void
+hyperspacehashing :: search :: prefix_set(size_t idx, const e::slice& val)
+{
+    assert(sanity_check());
+    assert(idx < m_equality_bits.bits());
+    assert(!m_equality_bits.get(idx));
+    assert(!m_range_bits.get(idx));
+    assert(!m_prefix_bits.get(idx));
+    m_prefix_bits.set(idx);
+    m_equality[idx] = val;
+}
+
 e::buffer::packer
 hyperspacehashing :: operator << (e::buffer::packer lhs, const search& rhs)
 {
     return lhs << rhs.m_equality_bits << rhs.m_equality
-               << rhs.m_range_bits << rhs.m_range_lower << rhs.m_range_upper;
+               << rhs.m_range_bits << rhs.m_range_lower << rhs.m_range_upper
+               << rhs.m_prefix_bits;
 }
 
 e::buffer::unpacker
 hyperspacehashing :: operator >> (e::buffer::unpacker lhs, search& rhs)
 {
     return lhs >> rhs.m_equality_bits >> rhs.m_equality
-               >> rhs.m_range_bits >> rhs.m_range_lower >> rhs.m_range_upper;
+               >> rhs.m_range_bits >> rhs.m_range_lower >> rhs.m_range_upper
+               >> rhs.m_prefix_bits;
+}
+
+hyperspacehashing :: compiled_search :: compiled_search(const search& s)
+    : m_arity(s.size())
+    , m_never(false)
+    , m_equality()
+    , m_prefix()
+    , m_range()
+{
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        if (s.is_equality(i))
+        {
+            m_equality.push_back(equality_test(i, s.equality_value(i)));
+        }
+        else if (s.is_range(i))
+        {
+            uint64_t lower;
+            uint64_t upper;
+            s.range_value(i, &lower, &upper);
+
+            if (lower >= upper)
+            {
+                m_never = true;
+            }
+            else
+            {
+                m_range.push_back(range_test(i, lower, upper));
+            }
+        }
+        else if (s.is_prefix(i))
+        {
+            m_prefix.push_back(prefix_test(i, s.prefix_value(i)));
+        }
+    }
+
+    std::stable_sort(m_prefix.begin(), m_prefix.end());
+    std::stable_sort(m_range.begin(), m_range.end());
+}
+
+hyperspacehashing :: compiled_search :: compiled_search(const compiled_search& other)
+    : m_arity(other.m_arity)
+    , m_never(other.m_never)
+    , m_equality(other.m_equality)
+    , m_prefix(other.m_prefix)
+    , m_range(other.m_range)
+{
+}
+
+hyperspacehashing :: compiled_search :: ~compiled_search() throw ()
+{
+}
+
+bool
+hyperspacehashing :: compiled_search :: matches(const e::slice& key,
+                                                const std::vector<e::slice>& value) const
+{
+    assert(value.size() + 1 == m_arity);
+
+    if (m_never)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < m_equality.size(); ++i)
+    {
+        const equality_test& t(m_equality[i]);
+        const e::slice& attr(t.attr == 0 ? key : value[t.attr - 1]);
+
+        // Sizes differ for most non-matching values, so check them before
+        // looking at the bytes.
+        if (attr.size() != t.size ||
+            (t.size > 0 && memcmp(attr.data(), t.data, t.size) != 0))
+        {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < m_prefix.size(); ++i)
+    {
+        const prefix_test& t(m_prefix[i]);
+        const e::slice& attr(t.attr == 0 ? key : value[t.attr - 1]);
+
+        if (attr.size() < t.size ||
+            (t.size > 0 && memcmp(attr.data(), t.data, t.size) != 0))
+        {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < m_range.size(); ++i)
+    {
+        const range_test& t(m_range[i]);
+        uint64_t num = lendian(t.attr == 0 ? key : value[t.attr - 1]);
+
+        if (num - t.lower >= t.width)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+hyperspacehashing::compiled_search&
+hyperspacehashing :: compiled_search :: operator = (const compiled_search& rhs)
+{
+    // We rely upon others catching self-assignment.
+    m_arity = rhs.m_arity;
+    m_never = rhs.m_never;
+    m_equality = rhs.m_equality;
+    m_prefix = rhs.m_prefix;
+    m_range = rhs.m_range;
+    return *this;
+}
+
+hyperspacehashing :: compiled_search :: equality_test :: equality_test(size_t a, const e::slice& val)
+    : attr(a)
+    , data(val.data())
+    , size(val.size())
+{
+}
+
+hyperspacehashing :: compiled_search :: prefix_test :: prefix_test(size_t a, const e::slice& val)
+    : equality_test(a, val)
+{
+}
+
+bool
+hyperspacehashing :: compiled_search :: prefix_test :: operator < (const prefix_test& rhs) const
+{
+    // Longer prefixes are more selective.
+    return size > rhs.size;
+}
+
+hyperspacehashing :: compiled_search :: range_test :: range_test(size_t a, uint64_t l, uint64_t u)
+    : attr(a)
+    , lower(l)
+    , width(u - l)
+{
+}
+
+bool
+hyperspacehashing :: compiled_search :: range_test :: operator < (const range_test& rhs) const
+{
+    return width < rhs.width;
 }
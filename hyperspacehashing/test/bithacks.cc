@@ -27,9 +27,15 @@
 
 #define __STDC_LIMIT_MACROS
 
+// C
+#include <cstdio>
+
 // Google Test
 #include <gtest/gtest.h>
 
+// e
+#include <e/timer.h>
+
 // HyperspaceHashing
 #include "hyperspacehashing/bithacks.h"
 
@@ -103,4 +109,133 @@ TEST(BithacksTest, DoubleLowerInterlace)
     ASSERT_EQ(0x482486cb6c26986dULL, upper);
 }
 
+// Deterministic xorshift so failures reproduce.
+uint64_t
+next_random(uint64_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+void
+check_kernel(const interlace_kernel* k)
+{
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+    uint64_t nums[130];
+
+    for (size_t sz = 0; sz <= 130; ++sz)
+    {
+        for (int trial = 0; trial < 64; ++trial)
+        {
+            for (size_t i = 0; i < 130; ++i)
+            {
+                nums[i] = next_random(&state);
+            }
+
+            if (trial == 0)
+            {
+                for (size_t i = 0; i < 130; ++i)
+                {
+                    nums[i] = UINT64_MAX;
+                }
+            }
+
+            ASSERT_EQ(reference_lower_interlace(nums, sz), k->lower(nums, sz))
+                << k->name << " lower sz=" << sz;
+            ASSERT_EQ(reference_upper_interlace(nums, sz), k->upper(nums, sz))
+                << k->name << " upper sz=" << sz;
+            uint64_t exp_lower;
+            uint64_t exp_upper;
+            uint64_t lower;
+            uint64_t upper;
+            reference_double_lower_interlace(nums, sz, &exp_lower, &exp_upper);
+            k->double_lower(nums, sz, &lower, &upper);
+            ASSERT_EQ(exp_lower, lower) << k->name << " double_lower sz=" << sz;
+            ASSERT_EQ(exp_upper, upper) << k->name << " double_lower sz=" << sz;
+        }
+    }
+}
+
+TEST(BithacksTest, TableKernelMatchesReference)
+{
+    check_kernel(&interlace_table);
+}
+
+TEST(BithacksTest, Bmi2KernelMatchesReference)
+{
+    if (!interlace_bmi2_supported())
+    {
+        return;
+    }
+
+    check_kernel(&interlace_bmi2);
+}
+
+TEST(BithacksTest, SelectedKernelMatchesReference)
+{
+    check_kernel(interlace_selected);
+}
+
+TEST(BithacksTest, InterlaceThroughput)
+{
+    const interlace_kernel* kernels[] = {&interlace_reference, &interlace_table, &interlace_bmi2};
+    const size_t dims[] = {1, 2, 3, 4, 6, 8};
+    const size_t iterations = 1 << 18;
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    uint64_t nums[8];
+
+    for (size_t i = 0; i < 8; ++i)
+    {
+        nums[i] = next_random(&state);
+    }
+
+    printf("kernel     dims  upper ns  double_lower ns\n");
+
+    for (size_t d = 0; d < sizeof(dims) / sizeof(size_t); ++d)
+    {
+        uint64_t expected = 0;
+
+        for (size_t k = 0; k < sizeof(kernels) / sizeof(const interlace_kernel*); ++k)
+        {
+            const interlace_kernel* kern = kernels[k];
+
+            if (kern == &interlace_bmi2 && !interlace_bmi2_supported())
+            {
+                continue;
+            }
+
+            uint64_t sum = 0;
+            uint64_t start = e::time();
+
+            for (size_t i = 0; i < iterations; ++i)
+            {
+                nums[i & 7] += i;
+                sum += kern->upper(nums, dims[d]);
+            }
+
+            uint64_t middle = e::time();
+
+            for (size_t i = 0; i < iterations; ++i)
+            {
+                uint64_t lower;
+                uint64_t upper;
+                nums[i & 7] -= i;
+                kern->double_lower(nums, dims[d], &lower, &upper);
+                sum += lower ^ upper;
+            }
+
+            uint64_t end = e::time();
+            // Each kernel sees the same inputs, so the sums double as a check.
+            expected = k == 0 ? sum : expected;
+            ASSERT_EQ(expected, sum) << kern->name << " dims=" << dims[d];
+            printf("%-10s %4lu  %8.2f  %15.2f\n", kern->name,
+                   static_cast<unsigned long>(dims[d]),
+                   static_cast<double>(middle - start) / iterations,
+                   static_cast<double>(end - middle) / iterations);
+        }
+    }
+}
+
 } // namespace
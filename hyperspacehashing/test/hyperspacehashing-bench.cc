@@ -0,0 +1,808 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#define __STDC_LIMIT_MACROS
+
+// C
+#include <cstdlib>
+#include <cstring>
+
+// Popt
+#include <popt.h>
+
+// C++
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// STL
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+// e
+#include <e/guard.h>
+#include <e/timer.h>
+
+// HyperspaceHashing
+#include "hyperspacehashing/cfloat.h"
+#include "hyperspacehashing/hyperspacehashing/hashes.h"
+#include "hyperspacehashing/hyperspacehashing/mask.h"
+#include "hyperspacehashing/hyperspacehashing/prefix.h"
+#include "hyperspacehashing/hyperspacehashing/search.h"
+
+// Time the operations on the PUT and search paths:  hashing objects and
+// searches with both hashers, intersecting and matching the resulting
+// coordinates, cfloat, matching objects against a search, and hashing keys
+// with each equality hash function.
+//
+// Before timing anything, batch hashing is checked against hashing one object
+// at a time, and compiled searches against search::matches.  Afterwards the
+// objects are placed in 2^region-bits equal regions of the prefix space, and
+// the number of regions each search contacts is reported against the number
+// holding a match; a region holding a match which is not contacted fails the
+// run.
+//
+// Objects have a key and "dimensions" attributes which alternate between
+// EQUALITY strings of value-size bytes and RANGE little-endian int64s.  The
+// searches range over range-width percent of every RANGE attribute's domain.
+// All data derives from the seed, so equal parameters give equal work.
+//
+// Each benchmark is timed "repetitions" times and the fastest run reported.
+// Results may be saved to a file, and compared against one saved earlier;
+// a benchmark more than "tolerance" percent slower than its baseline is a
+// regression and fails the run.
+
+static long dimensions = 8;
+static long key_size = 16;
+static long value_size = 16;
+static double range_width = 1;
+static long operations = 1000000;
+static long repetitions = 5;
+static long seed = 0;
+static const char* only = NULL;
+static const char* baseline = NULL;
+static const char* save = NULL;
+static double tolerance = 10;
+static long region_bits = 8;
+
+extern "C"
+{
+
+static struct poptOption popts[] = {
+    POPT_AUTOHELP
+    {"dimensions", 'd', POPT_ARG_LONG, &dimensions, 'd',
+        "the number of attributes besides the key (1-63)",
+        "number"},
+    {"key-size", 'k', POPT_ARG_LONG, &key_size, 'k',
+        "the size of each key",
+        "bytes"},
+    {"value-size", 'v', POPT_ARG_LONG, &value_size, 'v',
+        "the size of each EQUALITY attribute",
+        "bytes"},
+    {"range-width", 'w', POPT_ARG_DOUBLE, &range_width, 'w',
+        "the share of each RANGE attribute's domain a search covers",
+        "percent"},
+    {"operations", 'n', POPT_ARG_LONG, &operations, 'n',
+        "the number of operations in each timed run",
+        "number"},
+    {"repetitions", 'r', POPT_ARG_LONG, &repetitions, 'r',
+        "the number of timed runs of each benchmark",
+        "number"},
+    {"seed", 's', POPT_ARG_LONG, &seed, 's',
+        "the seed all data is derived from",
+        "number"},
+    {"only", 'o', POPT_ARG_STRING, &only, 'o',
+        "run only the benchmarks whose names contain this",
+        "name"},
+    {"baseline", 'b', POPT_ARG_STRING, &baseline, 'b',
+        "compare against results saved in this file",
+        "file"},
+    {"save", 'S', POPT_ARG_STRING, &save, 'S',
+        "save the results to this file",
+        "file"},
+    {"tolerance", 't', POPT_ARG_DOUBLE, &tolerance, 't',
+        "how much slower than the baseline counts as a regression",
+        "percent"},
+    {"region-bits", 'B', POPT_ARG_LONG, &region_bits, 'B',
+        "split the prefix space into 2^bits regions when measuring fanout (1-20)",
+        "number"},
+    POPT_TABLEEND
+};
+
+} // extern "C"
+
+static uint64_t
+mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Everything the benchmarks work on, generated up front so that the timings
+// only cover the operations themselves.  Benchmarks cycle through the
+// objects, so there are fewer objects than operations.
+class workload
+{
+    public:
+        workload();
+
+    public:
+        std::vector<hyperspacehashing::hash_t> funcs;
+        std::vector<uint8_t> data;
+        std::vector<e::slice> keys;
+        std::vector<std::vector<e::slice> > values;
+        std::vector<uint64_t> numbers;
+        std::vector<hyperspacehashing::search> searches;
+        std::vector<hyperspacehashing::compiled_search> compiled;
+        hyperspacehashing::mask::hasher mh;
+        hyperspacehashing::prefix::hasher ph;
+        // Key-only subspaces, as a point lookup hashes through.
+        hyperspacehashing::prefix::hasher city;
+        hyperspacehashing::prefix::hasher shorthash;
+        std::vector<hyperspacehashing::mask::coordinate> mcoords;
+        std::vector<hyperspacehashing::mask::coordinate> msearches;
+        std::vector<hyperspacehashing::prefix::coordinate> pcoords;
+        std::vector<hyperspacehashing::prefix::search_coordinate> psearches;
+
+    private:
+        workload(const workload&);
+        workload& operator = (const workload&);
+};
+
+static const size_t OBJECTS = 1 << 14;
+static const size_t SEARCHES = 1 << 6;
+
+static std::vector<hyperspacehashing::hash_t>
+make_funcs()
+{
+    std::vector<hyperspacehashing::hash_t> funcs(dimensions + 1);
+
+    for (size_t i = 0; i < funcs.size(); ++i)
+    {
+        funcs[i] = i % 2 == 0 ? hyperspacehashing::EQUALITY : hyperspacehashing::RANGE;
+    }
+
+    return funcs;
+}
+
+static const std::vector<hyperspacehashing::hash_t> KEY_FUNCS(1, hyperspacehashing::EQUALITY);
+
+workload :: workload()
+    : funcs(make_funcs())
+    , data()
+    , keys()
+    , values()
+    , numbers()
+    , searches()
+    , compiled()
+    , mh(funcs)
+    , ph(funcs)
+    , city(KEY_FUNCS, std::vector<hyperspacehashing::quantiles>(), hyperspacehashing::CITYHASH)
+    , shorthash(KEY_FUNCS, std::vector<hyperspacehashing::quantiles>(), hyperspacehashing::SHORTHASH)
+    , mcoords()
+    , msearches()
+    , pcoords()
+    , psearches()
+{
+    size_t object_size = key_size;
+
+    for (size_t a = 1; a < funcs.size(); ++a)
+    {
+        object_size += funcs[a] == hyperspacehashing::RANGE ? sizeof(uint64_t) : value_size;
+    }
+
+    uint64_t salt = mix(seed + 1);
+    data.resize(OBJECTS * object_size);
+
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = mix(salt + i);
+    }
+
+    for (size_t i = 0; i < OBJECTS; ++i)
+    {
+        const uint8_t* ptr = &data[0] + i * object_size;
+        keys.push_back(e::slice(ptr, key_size));
+        ptr += key_size;
+        values.push_back(std::vector<e::slice>());
+
+        for (size_t a = 1; a < funcs.size(); ++a)
+        {
+            size_t sz = funcs[a] == hyperspacehashing::RANGE ? sizeof(uint64_t) : value_size;
+            values.back().push_back(e::slice(ptr, sz));
+            ptr += sz;
+        }
+
+        numbers.push_back(mix(salt ^ i));
+        mcoords.push_back(mh.hash(keys.back(), values.back()));
+        pcoords.push_back(ph.hash(keys.back(), values.back()));
+    }
+
+    uint64_t width = static_cast<uint64_t>(UINT64_MAX * (range_width / 100.));
+
+    for (size_t i = 0; i < SEARCHES; ++i)
+    {
+        hyperspacehashing::search s(funcs.size());
+
+        for (size_t a = 1; a < funcs.size(); ++a)
+        {
+            if (funcs[a] == hyperspacehashing::RANGE)
+            {
+                uint64_t lower = mix(salt + OBJECTS + i * funcs.size() + a);
+                lower = lower > UINT64_MAX - width ? UINT64_MAX - width : lower;
+                s.range_set(a, lower, lower + width);
+            }
+        }
+
+        searches.push_back(s);
+        compiled.push_back(hyperspacehashing::compiled_search(s));
+        msearches.push_back(mh.hash(s));
+        psearches.push_back(ph.hash(s));
+    }
+}
+
+typedef uint64_t (*benchmark_func)(const workload& w, size_t ops);
+
+static uint64_t
+bench_cfloat(const workload& w, size_t ops)
+{
+    unsigned int space = 64 / dimensions;
+    uint64_t sink = 0;
+
+    for (size_t i = 0; i < ops; ++i)
+    {
+        sink += hyperspacehashing::cfloat(w.numbers[i % OBJECTS], space);
+    }
+
+    return sink;
+}
+
+static uint64_t
+bench_mask_hash(const workload& w, size_t ops)
+{
+    uint64_t sink = 0;
+
+    for (size_t i = 0; i < ops; ++i)
+    {
+        size_t o = i % OBJECTS;
+        hyperspacehashing::mask::coordinate c = w.mh.hash(w.keys[o], w.values[o]);
+        sink += c.primary_hash ^ c.secondary_lower_hash ^ c.secondary_upper_hash;
+    }
+
+    return sink;
+}
+
+static uint64_t
+bench_mask_hash_batch(const workload& w, size_t ops)
+{
+    static const size_t batch = 64;
+    hyperspacehashing::mask::coordinate coords[batch];
+    uint64_t sink = 0;
+
+    for (size_t i = 0; i < ops; i += batch)
+    {
+        size_t o = i % OBJECTS;
+        size_t n = std::min(batch, std::min(ops - i, OBJECTS - o));
+        w.mh.hash(&w.keys[o], &w.values[o], n, coords);
+        sink += coords[0].secondary_lower_hash;
+    }
+
+    return sink;
+}
+
+static uint64_t
+bench_mask_hash_search(const workload& w, size_t ops)
+{
+    uint64_t sink = 0;
+
+    for (size_t i = 0; i < ops; ++i)
+    {
+        sink += w.mh.hash(w.searches[i % SEARCHES]).secondary_lower_mask;
+    }
+
+    return sink;
+}
+
+static uint64_t
+bench_mask_intersects(const workload& w, size_t ops)
+{
+    uint64_t sink = 0;
+
+    for (size_t i = 0; i < ops; ++i)
+    {
+        const hyperspacehashing::mask::coordinate& s(w.msearches[(i / OBJECTS) % SEARCHES]);
+        sink += s.intersects(w.mcoords[i % OBJECTS]) ? 1 : 0;
+    }
+
+    return sink;
+}
+
+static uint64_t
+bench_prefix_hash(const workload& w, size_t ops)
+{
+    uint64_t sink = 0;
+
+    for (size_t i = 0; i < ops; ++i)
+    {
+        size_t o = i % OBJECTS;
+        sink += w.ph.hash(w.keys[o], w.values[o]).point;
+    }
+
+    return sink;
+}
+
+// The coordinate is checked against one object only so that it is used.
+static uint64_t
+bench_prefix_hash_batch(const workload& w, size_t ops)
+{
+    static const size_t batch = 64;
+    hyperspacehashing::prefix::coordinate coords[batch];
+    uint64_t sink = 0;
+
+    for (size_t i = 0; i < ops; i += batch)
+    {
+        size_t o = i % OBJECTS;
+        size_t n = std::min(batch, std::min(ops - i, OBJECTS - o));
+        w.ph.hash(&w.keys[o], &w.values[o], n, coords);
+        sink += coords[0].point;
+    }
+
+    return sink;
+}
+
+static uint64_t
+bench_prefix_hash_search(const workload& w, size_t ops)
+{
+    uint64_t sink = 0;
+
+    for (size_t i = 0; i < ops; ++i)
+    {
+        hyperspacehashing::prefix::search_coordinate sc = w.ph.hash(w.searches[i % SEARCHES]);
+        sink += sc.matches(w.pcoords[i % OBJECTS]) ? 1 : 0;
+    }
+
+    return sink;
+}
+
+static uint64_t
+bench_prefix_matches(const workload& w, size_t ops)
+{
+    uint64_t sink = 0;
+
+    for (size_t i = 0; i < ops; ++i)
+    {
+        const hyperspacehashing::prefix::search_coordinate& s(w.psearches[(i / OBJECTS) % SEARCHES]);
+        sink += s.matches(w.pcoords[i % OBJECTS]) ? 1 : 0;
+    }
+
+    return sink;
+}
+
+static uint64_t
+bench_search_matches(const workload& w, size_t ops)
+{
+    uint64_t sink = 0;
+
+    for (size_t i = 0; i < ops; ++i)
+    {
+        const hyperspacehashing::search& s(w.searches[(i / OBJECTS) % SEARCHES]);
+        size_t o = i % OBJECTS;
+        sink += s.matches(w.keys[o], w.values[o]) ? 1 : 0;
+    }
+
+    return sink;
+}
+
+static uint64_t
+bench_compiled_matches(const workload& w, size_t ops)
+{
+    uint64_t sink = 0;
+
+    for (size_t i = 0; i < ops; ++i)
+    {
+        const hyperspacehashing::compiled_search& s(w.compiled[(i / OBJECTS) % SEARCHES]);
+        size_t o = i % OBJECTS;
+        sink += s.matches(w.keys[o], w.values[o]) ? 1 : 0;
+    }
+
+    return sink;
+}
+
+static uint64_t
+bench_key_cityhash(const workload& w, size_t ops)
+{
+    uint64_t sink = 0;
+
+    for (size_t i = 0; i < ops; ++i)
+    {
+        sink += w.city.hash(w.keys[i % OBJECTS]).point;
+    }
+
+    return sink;
+}
+
+static uint64_t
+bench_key_shorthash(const workload& w, size_t ops)
+{
+    uint64_t sink = 0;
+
+    for (size_t i = 0; i < ops; ++i)
+    {
+        sink += w.shorthash.hash(w.keys[i % OBJECTS]).point;
+    }
+
+    return sink;
+}
+
+static const struct
+{
+    const char* name;
+    benchmark_func func;
+} benchmarks[] = {
+    {"cfloat", bench_cfloat},
+    {"mask-hash", bench_mask_hash},
+    {"mask-hash-batch", bench_mask_hash_batch},
+    {"mask-hash-search", bench_mask_hash_search},
+    {"mask-intersects", bench_mask_intersects},
+    {"prefix-hash", bench_prefix_hash},
+    {"prefix-hash-batch", bench_prefix_hash_batch},
+    {"prefix-hash-search", bench_prefix_hash_search},
+    {"prefix-matches", bench_prefix_matches},
+    {"search-matches", bench_search_matches},
+    {"compiled-matches", bench_compiled_matches},
+    {"key-cityhash", bench_key_cityhash},
+    {"key-shorthash", bench_key_shorthash},
+};
+
+// Check that the faster paths agree with the ones they replace, so that a
+// benchmark never times a wrong answer.
+static bool
+check(const workload& w)
+{
+    std::vector<hyperspacehashing::mask::coordinate> mcoords(OBJECTS);
+    std::vector<hyperspacehashing::prefix::coordinate> pcoords(OBJECTS);
+    w.mh.hash(&w.keys[0], &w.values[0], OBJECTS, &mcoords[0]);
+    w.ph.hash(&w.keys[0], &w.values[0], OBJECTS, &pcoords[0]);
+    bool ok = true;
+
+    for (size_t o = 0; o < OBJECTS; ++o)
+    {
+        if (!(mcoords[o] == w.mcoords[o]))
+        {
+            std::cerr << "mask batch hashing disagrees with single hashing" << std::endl;
+            ok = false;
+            break;
+        }
+    }
+
+    for (size_t o = 0; o < OBJECTS; ++o)
+    {
+        if (pcoords[o].prefix != w.pcoords[o].prefix ||
+            pcoords[o].point != w.pcoords[o].point)
+        {
+            std::cerr << "prefix batch hashing disagrees with single hashing" << std::endl;
+            ok = false;
+            break;
+        }
+    }
+
+    for (size_t s = 0; s < SEARCHES; ++s)
+    {
+        for (size_t o = 0; o < OBJECTS; ++o)
+        {
+            if (w.searches[s].matches(w.keys[o], w.values[o]) !=
+                w.compiled[s].matches(w.keys[o], w.values[o]))
+            {
+                std::cerr << "compiled search disagrees with search::matches" << std::endl;
+                return false;
+            }
+        }
+    }
+
+    return ok;
+}
+
+// Report how many regions each search contacts against how many hold an
+// object it matches.  Returns false if a region holding a match is missed.
+static bool
+fanout(const workload& w)
+{
+    size_t nregions = 1ULL << region_bits;
+    std::vector<std::vector<size_t> > regions(nregions);
+    size_t contacted = 0;
+    size_t ideal = 0;
+    size_t missed = 0;
+
+    for (size_t o = 0; o < OBJECTS; ++o)
+    {
+        regions[w.pcoords[o].point >> (64 - region_bits)].push_back(o);
+    }
+
+    for (size_t s = 0; s < SEARCHES; ++s)
+    {
+        for (size_t r = 0; r < nregions; ++r)
+        {
+            hyperspacehashing::prefix::coordinate c(region_bits, r << (64 - region_bits));
+            bool contact = w.psearches[s].matches(c);
+            bool holds = false;
+
+            for (size_t i = 0; !holds && i < regions[r].size(); ++i)
+            {
+                holds = w.searches[s].matches(w.keys[regions[r][i]], w.values[regions[r][i]]);
+            }
+
+            contacted += contact ? 1 : 0;
+            ideal += holds ? 1 : 0;
+            missed += holds && !contact ? 1 : 0;
+        }
+    }
+
+    std::cout << "fanout over " << nregions << " regions:  contacted "
+              << static_cast<double>(contacted) / SEARCHES
+              << " regions/search, ideal " << static_cast<double>(ideal) / SEARCHES
+              << " regions/search, "
+              << (ideal ? static_cast<double>(contacted) / ideal : 0.)
+              << "x the ideal" << std::endl;
+
+    if (missed)
+    {
+        std::cerr << missed << " regions holding results were not contacted" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// The parameters a set of results was produced with.  Results are only
+// comparable if these match.
+static std::string
+parameters()
+{
+    std::ostringstream ostr;
+    ostr << "dimensions=" << dimensions
+         << " key-size=" << key_size
+         << " value-size=" << value_size
+         << " range-width=" << range_width
+         << " operations=" << operations
+         << " seed=" << seed;
+    return ostr.str();
+}
+
+// Saved results are a line of parameters followed by "name ns/op" lines.
+static bool
+load(const char* path, std::string* params, std::map<std::string, double>* results)
+{
+    std::ifstream fin(path);
+
+    if (!fin || !std::getline(fin, *params))
+    {
+        return false;
+    }
+
+    std::string name;
+    double ns;
+
+    while (fin >> name >> ns)
+    {
+        (*results)[name] = ns;
+    }
+
+    return fin.eof();
+}
+
+static bool
+store(const char* path, const std::map<std::string, double>& results)
+{
+    std::ofstream fout(path);
+    fout << parameters() << std::endl;
+    fout << std::setprecision(6);
+
+    for (std::map<std::string, double>::const_iterator r = results.begin();
+            r != results.end(); ++r)
+    {
+        fout << r->first << " " << r->second << std::endl;
+    }
+
+    return fout.good();
+}
+
+int
+main(int argc, const char* argv[])
+{
+    poptContext poptcon;
+    poptcon = poptGetContext(NULL, argc, argv, popts, POPT_CONTEXT_POSIXMEHARDER);
+    e::guard g = e::makeguard(poptFreeContext, poptcon);
+    g.use_variable();
+    int rc;
+
+    while ((rc = poptGetNextOpt(poptcon)) != -1)
+    {
+        switch (rc)
+        {
+            case 'd':
+                if (dimensions < 1 || dimensions > 63)
+                {
+                    std::cerr << "dimensions must be between 1 and 63" << std::endl;
+                    return EXIT_FAILURE;
+                }
+
+                break;
+            case 'k':
+            case 'v':
+                if (key_size < 0 || value_size < 0)
+                {
+                    std::cerr << "sizes must be >= 0" << std::endl;
+                    return EXIT_FAILURE;
+                }
+
+                break;
+            case 'w':
+                if (range_width <= 0 || range_width > 100)
+                {
+                    std::cerr << "range-width must be in (0, 100]" << std::endl;
+                    return EXIT_FAILURE;
+                }
+
+                break;
+            case 'n':
+            case 'r':
+                if (operations < 1 || repetitions < 1)
+                {
+                    std::cerr << "operations and repetitions must be >= 1" << std::endl;
+                    return EXIT_FAILURE;
+                }
+
+                break;
+            case 't':
+                if (tolerance < 0)
+                {
+                    std::cerr << "tolerance must be >= 0" << std::endl;
+                    return EXIT_FAILURE;
+                }
+
+                break;
+            case 'B':
+                if (region_bits < 1 || region_bits > 20)
+                {
+                    std::cerr << "region-bits must be between 1 and 20" << std::endl;
+                    return EXIT_FAILURE;
+                }
+
+                break;
+            case 's':
+            case 'o':
+            case 'b':
+            case 'S':
+                break;
+            case POPT_ERROR_NOARG:
+            case POPT_ERROR_BADOPT:
+            case POPT_ERROR_BADNUMBER:
+            case POPT_ERROR_OVERFLOW:
+                std::cerr << poptStrerror(rc) << " " << poptBadOption(poptcon, 0) << std::endl;
+                return EXIT_FAILURE;
+            case POPT_ERROR_OPTSTOODEEP:
+            case POPT_ERROR_BADQUOTE:
+            case POPT_ERROR_ERRNO:
+            default:
+                std::cerr << "logic error in argument parsing" << std::endl;
+                return EXIT_FAILURE;
+        }
+    }
+
+    std::string base_params;
+    std::map<std::string, double> base;
+
+    if (baseline && !load(baseline, &base_params, &base))
+    {
+        std::cerr << "cannot read baseline " << baseline << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (baseline && base_params != parameters())
+    {
+        std::cerr << "warning:  baseline was run with " << base_params << std::endl;
+    }
+
+    workload w;
+
+    if (!check(w))
+    {
+        return EXIT_FAILURE;
+    }
+
+    std::map<std::string, double> results;
+    size_t regressions = 0;
+    uint64_t sink = 0;
+    std::cout << parameters() << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+
+    for (size_t b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); ++b)
+    {
+        if (only && !strstr(benchmarks[b].name, only))
+        {
+            continue;
+        }
+
+        double best = 0;
+
+        for (long r = 0; r < repetitions; ++r)
+        {
+            uint64_t start = e::time();
+            sink += benchmarks[b].func(w, operations);
+            double ns = static_cast<double>(e::time() - start) / operations;
+            best = r == 0 || ns < best ? ns : best;
+        }
+
+        results[benchmarks[b].name] = best;
+        std::cout << std::setw(20) << std::left << benchmarks[b].name
+                  << std::setw(10) << std::right << best << " ns/op "
+                  << std::setw(14) << std::right << 1e9 / best << " ops/s";
+        std::map<std::string, double>::const_iterator bl = base.find(benchmarks[b].name);
+
+        if (bl != base.end())
+        {
+            double change = 100. * (best - bl->second) / bl->second;
+            std::cout << "  " << std::setw(8) << std::right << bl->second << " baseline "
+                      << std::showpos << std::setw(7) << change << "%" << std::noshowpos;
+
+            if (change > tolerance)
+            {
+                std::cout << "  REGRESSION";
+                ++regressions;
+            }
+        }
+
+        std::cout << std::endl;
+    }
+
+    // Print the sink so that no benchmark's work can be optimized away.
+    std::cout << "checksum " << sink << std::endl;
+    bool fanout_ok = fanout(w);
+
+    if (save && !store(save, results))
+    {
+        std::cerr << "cannot save results to " << save << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (regressions)
+    {
+        std::cerr << regressions << " benchmarks regressed by more than "
+                  << tolerance << "%" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return fanout_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
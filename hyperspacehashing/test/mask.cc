@@ -30,9 +30,13 @@
 // Google Test
 #include <gtest/gtest.h>
 
+// C
+#include <cstring>
+
 // HyperspaceHashing
 #include "hyperspacehashing/hyperspacehashing/hashes.h"
 #include "hyperspacehashing/hyperspacehashing/mask.h"
+#include "hyperspacehashing/hyperspacehashing/search.h"
 
 #pragma GCC diagnostic ignored "-Wswitch-default"
 
@@ -42,7 +46,8 @@ using namespace hyperspacehashing::mask;
 // Mask-based hashing treats the key and the value separately.  This
 // checks that hash(key) does not affect the secondary hash, and
 // hash(value) does not affect the primary hash.  It then checks that
-// hash(key, value) is the combination of the two simpler hashes.
+// hash(key, value) is the combination of the two simpler hashes, and that
+// batch hashing gives the same result.
 static void
 all_permutations(const std::vector<hash_t>& hf,
                  uint64_t pmask, uint64_t phash, const e::slice& key,
@@ -73,6 +78,14 @@ all_permutations(const std::vector<hash_t>& hf,
     ASSERT_EQ(slhash, c.secondary_lower_hash);
     ASSERT_EQ(sumask, c.secondary_upper_mask);
     ASSERT_EQ(suhash, c.secondary_upper_hash);
+    // A batch must agree with hashing each object on its own.
+    e::slice keys[3] = {key, e::slice("other", 5), key};
+    std::vector<e::slice> values[3] = {value, value, value};
+    coordinate coords[3];
+    h.hash(keys, values, 3, coords);
+    ASSERT_TRUE(coords[0] == c);
+    ASSERT_TRUE(coords[1] == h.hash(keys[1], values[1]));
+    ASSERT_TRUE(coords[2] == c);
 }
 
 namespace
@@ -201,4 +214,59 @@ TEST(MaskTest, KeyValueRange)
                      UINT64_MAX, 0xf0ccfffccfcccffcULL, UINT64_MAX, 0xf3fcccf3cffcfcffULL, value);
 }
 
+TEST(MaskTest, PrefixSearch)
+{
+    std::vector<hash_t> hf(3);
+    hf[0] = EQUALITY;
+    hf[1] = PREFIX;
+    hf[2] = EQUALITY;
+    hasher h(hf);
+    const char* words[] = {"ap", "apple", "apricot", "a", "b", "banana", "bp", "zap"};
+    search pre(3);
+    pre.prefix_set(1, e::slice("ap", 2));
+    coordinate psc = h.hash(pre);
+    search eq(3);
+    eq.equality_set(1, e::slice("apple", 5));
+    coordinate esc = h.hash(eq);
+
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); ++i)
+    {
+        std::vector<e::slice> value;
+        value.push_back(e::slice(words[i], strlen(words[i])));
+        value.push_back(e::slice("value2", 6));
+        coordinate c = h.hash(e::slice("key", 3), value);
+        ASSERT_EQ(strncmp(words[i], "ap", 2) == 0, psc.intersects(c));
+        ASSERT_EQ(strcmp(words[i], "apple") == 0, esc.intersects(c));
+    }
+}
+
+TEST(MaskTest, ShortHashSearch)
+{
+    std::vector<hash_t> hf(3);
+    hf[0] = EQUALITY;
+    hf[1] = EQUALITY;
+    hf[2] = RANGE;
+    hasher h(hf, std::vector<quantiles>(), SHORTHASH);
+    hasher city(hf);
+    coordinate kc = h.hash(e::slice("key", 3));
+    search eq(3);
+    eq.equality_set(1, e::slice("value", 5));
+    coordinate esc = h.hash(eq);
+    const char* keys[] = {"key", "kez", "key\0"};
+    const char* words[] = {"value", "valuf", "value\0"};
+
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i)
+    {
+        uint64_t num = 42;
+        std::vector<e::slice> value;
+        value.push_back(e::slice(words[i], strlen(words[i]) + (i == 2 ? 1 : 0)));
+        value.push_back(e::slice(&num, sizeof(num)));
+        e::slice k(keys[i], strlen(keys[i]) + (i == 2 ? 1 : 0));
+        coordinate c = h.hash(k, value);
+        ASSERT_EQ(i == 0, kc.primary_intersects(c));
+        ASSERT_EQ(i == 0, esc.intersects(c));
+        ASSERT_NE(city.hash(k).primary_hash, c.primary_hash);
+    }
+}
+
 } // namespace
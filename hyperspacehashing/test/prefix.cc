@@ -27,12 +27,19 @@
 
 #define __STDC_LIMIT_MACROS
 
+// C
+#include <cstring>
+
+// STL
+#include <algorithm>
+
 // Google Test
 #include <gtest/gtest.h>
 
 // HyperspaceHashing
 #include "hyperspacehashing/hyperspacehashing/hashes.h"
 #include "hyperspacehashing/hyperspacehashing/prefix.h"
+#include "hyperspacehashing/hyperspacehashing/search.h"
 
 #pragma GCC diagnostic ignored "-Wswitch-default"
 
@@ -216,4 +223,174 @@ TEST(PrefixTest, KeyValueRange)
     ASSERT_EQ(17581152392886156543ULL, c.point);
 }
 
+TEST(PrefixTest, Batch)
+{
+    std::vector<hash_t> hf(4);
+    hf[0] = EQUALITY;
+    hf[1] = RANGE;
+    hf[2] = NONE;
+    hf[3] = EQUALITY;
+    hasher h(hf);
+    const char* words[] = {"key", "value1", "value2", "\xbe\xba\xfe\xca\xef\xbe\xad\xde"};
+    e::slice keys[20];
+    std::vector<e::slice> values[20];
+
+    for (size_t i = 0; i < 20; ++i)
+    {
+        keys[i] = e::slice(words[i % 4], strlen(words[i % 4]));
+
+        for (size_t j = 1; j < hf.size(); ++j)
+        {
+            const char* w = words[(i + j) % 4];
+            values[i].push_back(e::slice(w, strlen(w)));
+        }
+    }
+
+    // 20 objects spans more than one internal batch.
+    coordinate coords[20];
+    h.hash(keys, values, 20, coords);
+
+    for (size_t i = 0; i < 20; ++i)
+    {
+        coordinate c = h.hash(keys[i], values[i]);
+        ASSERT_EQ(c.prefix, coords[i].prefix);
+        ASSERT_EQ(c.point, coords[i].point);
+    }
+}
+
+TEST(PrefixTest, PrefixOrder)
+{
+    std::vector<hash_t> hf(2);
+    hf[0] = NONE;
+    hf[1] = PREFIX;
+    hasher h(hf);
+    // Sorted, so their points must not decrease.
+    const char* words[] = {"", "a", "ap", "apple", "apple pie", "apricot", "b", "banana"};
+    uint64_t last = 0;
+
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); ++i)
+    {
+        coordinate c = h.hash(e::slice("key", 3),
+                              std::vector<e::slice>(1, e::slice(words[i], strlen(words[i]))));
+        ASSERT_EQ(64, c.prefix);
+        ASSERT_LE(last, c.point);
+        last = c.point;
+    }
+}
+
+TEST(PrefixTest, PrefixSearch)
+{
+    std::vector<hash_t> hf(3);
+    hf[0] = NONE;
+    hf[1] = PREFIX;
+    hf[2] = EQUALITY;
+    hasher h(hf);
+    const char* words[] = {"ap", "apple", "apricot", "a", "b", "banana", "bp", "zap"};
+    search s(3);
+    s.prefix_set(1, e::slice("ap", 2));
+    search_coordinate sc = h.hash(s);
+
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); ++i)
+    {
+        std::vector<e::slice> value;
+        value.push_back(e::slice(words[i], strlen(words[i])));
+        value.push_back(e::slice("value2", 6));
+        coordinate c = h.hash(e::slice("key", 3), value);
+        // Each attribute has 32 bits, enough to separate two byte prefixes.
+        ASSERT_EQ(strncmp(words[i], "ap", 2) == 0, sc.matches(c));
+    }
+}
+
+TEST(PrefixTest, RangeFanOut)
+{
+    std::vector<hash_t> hf(3);
+    hf[0] = NONE;
+    hf[1] = RANGE;
+    hf[2] = EQUALITY;
+    hasher h(hf);
+    // The range straddles the top bit, so its bounds share no leading bits,
+    // yet only the regions whose leading four bits of value1 are 0x7 or 0x8
+    // can hold a match.
+    search s(3);
+    s.range_set(1, 0x7800000000000000ULL, 0x8400000000000000ULL);
+    search_coordinate sc = h.hash(s);
+    size_t matched = 0;
+
+    for (uint64_t r = 0; r < 256; ++r)
+    {
+        if (sc.matches(coordinate(8, r << 56)))
+        {
+            ++matched;
+        }
+    }
+
+    // 2 of 16 possibilities for value1's bits times 16 for value2's.
+    ASSERT_EQ(32U, matched);
+    uint64_t values[] = {0x0000000000000000ULL, 0x77ffffffffffffffULL,
+                         0x7800000000000000ULL, 0x7fffffffffffffffULL,
+                         0x8000000000000000ULL, 0x83ffffffffffffffULL,
+                         0x8400000000000000ULL, 0xffffffffffffffffULL};
+
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i)
+    {
+        std::vector<e::slice> value;
+        value.push_back(e::slice(&values[i], sizeof(uint64_t)));
+        value.push_back(e::slice("value2", 6));
+        coordinate c = h.hash(e::slice("key", 3), value);
+        // The region holding a value must be contacted whenever the value
+        // is in range, and the regions at either end never are.
+        bool inrange = i >= 2 && i < 6;
+        bool outside = i == 0 || i == 7;
+        ASSERT_EQ(inrange, sc.matches(c));
+        ASSERT_EQ(!outside, sc.matches(coordinate(8, c.point)));
+    }
+}
+
+TEST(PrefixTest, ShortHash)
+{
+    std::vector<hash_t> hf(1, EQUALITY);
+    hasher city(hf);
+    hasher h(hf, std::vector<quantiles>(), SHORTHASH);
+    // Every length up to and past 16 bytes, including values that differ
+    // only in trailing zero bytes, must hash apart.
+    const char buf[] = "0123456789abcdef\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0";
+    std::vector<uint64_t> points;
+
+    for (size_t n = 0; n <= 32; ++n)
+    {
+        coordinate c = h.hash(e::slice(buf, n));
+        ASSERT_EQ(64, c.prefix);
+        ASSERT_EQ(c.point, h.hash(e::slice(buf, n)).point);
+        points.push_back(c.point);
+    }
+
+    std::sort(points.begin(), points.end());
+    ASSERT_TRUE(std::unique(points.begin(), points.end()) == points.end());
+    // Past 16 bytes it is CityHash.
+    ASSERT_EQ(city.hash(e::slice(buf, 17)).point, h.hash(e::slice(buf, 17)).point);
+    ASSERT_NE(city.hash(e::slice(buf, 8)).point, h.hash(e::slice(buf, 8)).point);
+}
+
+TEST(PrefixTest, ShortHashSearch)
+{
+    std::vector<hash_t> hf(3);
+    hf[0] = NONE;
+    hf[1] = EQUALITY;
+    hf[2] = EQUALITY;
+    hasher h(hf, std::vector<quantiles>(), SHORTHASH);
+    const char* words[] = {"a", "ab", "abcd", "abcdefgh", "abcdefghijklmnop", "abcdefghijklmnopq"};
+    search s(3);
+    s.equality_set(1, e::slice("abcd", 4));
+    search_coordinate sc = h.hash(s);
+
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); ++i)
+    {
+        std::vector<e::slice> value;
+        value.push_back(e::slice(words[i], strlen(words[i])));
+        value.push_back(e::slice("value2", 6));
+        coordinate c = h.hash(e::slice("key", 3), value);
+        ASSERT_EQ(strcmp(words[i], "abcd") == 0, sc.matches(c));
+    }
+}
+
 } // namespace
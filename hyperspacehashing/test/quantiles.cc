@@ -0,0 +1,175 @@
+// Copyright (c) 2012, Cornell University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of HyperDex nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#define __STDC_LIMIT_MACROS
+
+// Google Test
+#include <gtest/gtest.h>
+
+// e
+#include <e/endian.h>
+
+// HyperspaceHashing
+#include "hyperspacehashing/hyperspacehashing/mask.h"
+#include "hyperspacehashing/hyperspacehashing/prefix.h"
+#include "hyperspacehashing/hyperspacehashing/quantiles.h"
+
+#pragma GCC diagnostic ignored "-Wswitch-default"
+
+using namespace hyperspacehashing;
+
+namespace
+{
+
+TEST(QuantilesTest, Identity)
+{
+    quantiles q;
+    ASSERT_TRUE(q.identity());
+    ASSERT_EQ(0ULL, q.map(0));
+    ASSERT_EQ(12345ULL, q.map(12345));
+    ASSERT_EQ(UINT64_MAX, q.map(UINT64_MAX));
+}
+
+TEST(QuantilesTest, Valid)
+{
+    std::vector<uint64_t> b;
+    ASSERT_TRUE(quantiles::valid(b));
+    b.push_back(5);
+    b.push_back(10);
+    ASSERT_TRUE(quantiles::valid(b));
+    b.push_back(10);
+    ASSERT_FALSE(quantiles::valid(b));
+}
+
+TEST(QuantilesTest, Monotone)
+{
+    std::vector<uint64_t> b;
+    b.push_back(1000);
+    b.push_back(1001);
+    b.push_back(1010);
+    b.push_back(UINT64_MAX - 1);
+    quantiles q(b);
+    uint64_t probes[] = {0, 1, 999, 1000, 1001, 1005, 1009, 1010, 1011,
+                         1ULL << 32, 1ULL << 63, UINT64_MAX - 2,
+                         UINT64_MAX - 1, UINT64_MAX};
+    uint64_t last = 0;
+
+    for (size_t i = 0; i < sizeof(probes) / sizeof(probes[0]); ++i)
+    {
+        uint64_t m = q.map(probes[i]);
+        ASSERT_LE(last, m);
+        last = m;
+    }
+
+    // Each bound starts an equal share of the output.
+    uint64_t share = UINT64_MAX / 5;
+    ASSERT_EQ(0ULL, q.map(0));
+    ASSERT_EQ(share, q.map(1000));
+    ASSERT_EQ(2 * share, q.map(1001));
+    ASSERT_EQ(3 * share, q.map(1010));
+    ASSERT_EQ(4 * share, q.map(UINT64_MAX - 1));
+}
+
+// Values packed into a narrow band land in one region without a transform,
+// and in every region with one built from their quantiles.
+TEST(QuantilesTest, SpreadsSkewedValues)
+{
+    std::vector<hash_t> hf(2);
+    hf[0] = NONE;
+    hf[1] = RANGE;
+    std::vector<uint64_t> b;
+
+    for (uint64_t i = 1; i < 8; ++i)
+    {
+        b.push_back(1000000 + i * 125);
+    }
+
+    std::vector<quantiles> dists(2);
+    dists[1] = quantiles(b);
+    prefix::hasher plain(hf);
+    prefix::hasher spread(hf, dists);
+    bool plain_regions[8] = {false};
+    bool spread_regions[8] = {false};
+
+    for (uint64_t v = 1000000; v < 1001000; ++v)
+    {
+        uint8_t buf[sizeof(uint64_t)];
+        e::pack64le(v, buf);
+        std::vector<e::slice> value(1, e::slice(buf, sizeof(buf)));
+        plain_regions[plain.hash(e::slice("k", 1), value).point >> 61] = true;
+        spread_regions[spread.hash(e::slice("k", 1), value).point >> 61] = true;
+    }
+
+    size_t plain_count = 0;
+    size_t spread_count = 0;
+
+    for (size_t i = 0; i < 8; ++i)
+    {
+        plain_count += plain_regions[i] ? 1 : 0;
+        spread_count += spread_regions[i] ? 1 : 0;
+    }
+
+    ASSERT_EQ(1U, plain_count);
+    ASSERT_EQ(8U, spread_count);
+}
+
+// Range searches over transformed attributes must still find every object in
+// the range.
+TEST(QuantilesTest, RangeSearch)
+{
+    std::vector<hash_t> hf(3);
+    hf[0] = EQUALITY;
+    hf[1] = RANGE;
+    hf[2] = RANGE;
+    std::vector<uint64_t> b;
+
+    for (uint64_t i = 1; i < 16; ++i)
+    {
+        b.push_back(5000 + i * 7);
+    }
+
+    std::vector<quantiles> dists(3);
+    dists[1] = quantiles(b);
+    prefix::hasher ph(hf, dists);
+    mask::hasher mh(hf, dists);
+    search s(3);
+    s.range_set(1, 5020, 5060);
+    prefix::search_coordinate psc = ph.hash(s);
+    mask::coordinate msc = mh.hash(s);
+
+    for (uint64_t v = 5020; v < 5060; ++v)
+    {
+        uint8_t buf[sizeof(uint64_t)];
+        e::pack64le(v, buf);
+        std::vector<e::slice> value(2, e::slice(buf, sizeof(buf)));
+        ASSERT_TRUE(psc.matches(ph.hash(e::slice("k", 1), value)));
+        ASSERT_TRUE(msc.intersects(mh.hash(e::slice("k", 1), value)));
+    }
+}
+
+} // namespace
@@ -42,17 +42,21 @@
 using hyperspacehashing::hash_t;
 using hyperspacehashing::EQUALITY;
 using hyperspacehashing::NONE;
+using hyperspacehashing::PREFIX;
 using namespace hyperspacehashing;
 
 void
 validate(const std::vector<hash_t> hf, const e::slice& key, const std::vector<e::slice>& value);
+void
+validate_compiled(const e::slice& key, const std::vector<e::slice>& value);
 
 #define TESTPOS(X) \
     assert(hf.size() == ((X) + 1)); \
     assert(value.size() == (X)); \
     hf[(X)] = static_cast<hash_t>(v##X); \
     value[(X) - 1] = e::slice(&nums[(X)], sizeof(nums[(X)])); \
-    validate(hf, key, value)
+    validate(hf, key, value); \
+    validate_compiled(key, value)
 
 #define EXPAND \
     hf.push_back(NONE); \
@@ -84,24 +88,25 @@ main(int, char* [])
             std::vector<e::slice> value;
             e::slice key(&nums[0], sizeof(nums[0]));
             validate(hf, key, value);
+            validate_compiled(key, value);
             EXPAND;
 
-            for (size_t v1 = EQUALITY; v1 <= NONE; ++v1)
+            for (size_t v1 = EQUALITY; v1 <= PREFIX; ++v1)
             {
                 TESTPOS(1);
                 EXPAND;
 
-                for (size_t v2 = EQUALITY; v2 <= NONE; ++v2)
+                for (size_t v2 = EQUALITY; v2 <= PREFIX; ++v2)
                 {
                     TESTPOS(2);
                     EXPAND;
 
-                    for (size_t v3 = EQUALITY; v3 <= NONE; ++v3)
+                    for (size_t v3 = EQUALITY; v3 <= PREFIX; ++v3)
                     {
                         TESTPOS(3);
                         EXPAND;
 
-                        for (size_t v4 = EQUALITY; v4 <= NONE; ++v4)
+                        for (size_t v4 = EQUALITY; v4 <= PREFIX; ++v4)
                         {
                             TESTPOS(4);
                         }
@@ -171,6 +176,17 @@ validate(const std::vector<hash_t> hf, const e::slice& key, const std::vector<e:
         assert(msc.intersects(mc));
     }
 
+    // Do a prefix search for each attribute other than the key
+    for (size_t i = 1; i < value.size() + 1; ++i)
+    {
+        search s(value.size() + 1);
+        s.prefix_set(i, e::slice(value[i - 1].data(), value[i - 1].size() / 2));
+        prefix::search_coordinate psc = ph.hash(s);
+        mask::coordinate msc = mh.hash(s);
+        assert(psc.matches(pc));
+        assert(msc.intersects(mc));
+    }
+
     // Do an equality/range search for two attributes
     for (size_t i = 0; i < value.size() + 1; ++i)
     {
@@ -210,3 +226,90 @@ validate(const std::vector<hash_t> hf, const e::slice& key, const std::vector<e:
         }
     }
 }
+
+// A compiled search must agree with search::matches, whether or not the
+// object matches.
+static void
+check_compiled(const search& s, const e::slice& key, const std::vector<e::slice>& value)
+{
+    assert(compiled_search(s).matches(key, value) == s.matches(key, value));
+}
+
+void
+validate_compiled(const e::slice& key, const std::vector<e::slice>& value)
+{
+    uint8_t other[sizeof(uint32_t)] = {0xde, 0xad, 0xbe, 0xef};
+    e::slice wrong(other, sizeof(other));
+    e::slice shorter(other, 2);
+
+    for (size_t i = 0; i < value.size() + 1; ++i)
+    {
+        const e::slice& attr(i == 0 ? key : value[i - 1]);
+        uint64_t num = lendian(attr);
+
+        search eq(value.size() + 1);
+        eq.equality_set(i, attr);
+        assert(compiled_search(eq).matches(key, value));
+        search ne(value.size() + 1);
+        ne.equality_set(i, wrong);
+        check_compiled(ne, key, value);
+        search sz(value.size() + 1);
+        sz.equality_set(i, shorter);
+        check_compiled(sz, key, value);
+
+        search below(value.size() + 1);
+        below.range_set(i, 0, num);
+        check_compiled(below, key, value);
+        search above(value.size() + 1);
+        above.range_set(i, num + 1, UINT64_MAX);
+        check_compiled(above, key, value);
+        search empty(value.size() + 1);
+        empty.range_set(i, num, num);
+        check_compiled(empty, key, value);
+
+        search pre(value.size() + 1);
+        pre.prefix_set(i, e::slice(attr.data(), attr.size() / 2));
+        assert(compiled_search(pre).matches(key, value));
+        search whole(value.size() + 1);
+        whole.prefix_set(i, attr);
+        assert(compiled_search(whole).matches(key, value));
+        search nothing(value.size() + 1);
+        nothing.prefix_set(i, e::slice());
+        assert(compiled_search(nothing).matches(key, value));
+        search wrongpre(value.size() + 1);
+        wrongpre.prefix_set(i, shorter);
+        check_compiled(wrongpre, key, value);
+        // A prefix longer than the value never matches.
+        std::vector<uint8_t> longer(attr.data(), attr.data() + attr.size());
+        longer.push_back(0);
+        search toolong(value.size() + 1);
+        toolong.prefix_set(i, e::slice(&longer.front(), longer.size()));
+        assert(!compiled_search(toolong).matches(key, value));
+        check_compiled(toolong, key, value);
+
+        // Combine with a test on every other attribute, so that the order
+        // in which the tests run varies.
+        for (size_t j = 0; j < value.size() + 1; ++j)
+        {
+            if (i == j)
+            {
+                continue;
+            }
+
+            const e::slice& other_attr(j == 0 ? key : value[j - 1]);
+            uint64_t other_num = lendian(other_attr);
+            search both(value.size() + 1);
+            both.range_set(i, num, num + 1);
+            both.range_set(j, 0, other_num);
+            check_compiled(both, key, value);
+            search mixed(value.size() + 1);
+            mixed.range_set(i, num, num + 1);
+            mixed.equality_set(j, other_attr);
+            assert(compiled_search(mixed).matches(key, value));
+            search prefixed(value.size() + 1);
+            prefixed.prefix_set(i, e::slice(attr.data(), attr.size() / 2));
+            prefixed.equality_set(j, wrong);
+            check_compiled(prefixed, key, value);
+        }
+    }
+}